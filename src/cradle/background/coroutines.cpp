@@ -0,0 +1,300 @@
+#include <cradle/background/coroutines.h>
+
+#ifdef CRADLE_ENABLE_COROUTINES
+
+#include <mutex>
+
+#include <cradle/caching/immutable/internals.h>
+#include <cradle/io/http_executor.h>
+
+namespace cradle {
+
+namespace detail {
+
+namespace {
+
+// This job simply resumes a coroutine.
+struct coroutine_resumption_job : background_job_interface
+{
+    coroutine_resumption_job(
+        std::coroutine_handle<> coroutine, std::exception_ptr& error)
+        : coroutine(coroutine), error(&error)
+    {
+    }
+
+    // If the job is discarded without running, nothing else will ever
+    // resume the coroutine, so it's resumed here (with an error).
+    ~coroutine_resumption_job()
+    {
+        if (!resumed)
+        {
+            *error = std::make_exception_ptr(background_job_canceled());
+            coroutine.resume();
+        }
+    }
+
+    void
+    execute(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter) override
+    {
+        // The coroutine runs until it next suspends (or finishes), after
+        // which it may already be running on another thread, so it can't be
+        // touched once this returns.
+        resumed = true;
+        coroutine.resume();
+    }
+
+    std::coroutine_handle<> coroutine;
+    // where to report that the job was discarded
+    std::exception_ptr* error;
+    bool resumed = false;
+};
+
+} // namespace
+
+void
+resume_coroutine(
+    cradle::background_execution_system& system,
+    std::coroutine_handle<> coroutine,
+    std::exception_ptr& error)
+{
+    add_calculation_job(
+        system,
+        std::make_unique<coroutine_resumption_job>(coroutine, error),
+        BACKGROUND_JOB_HIDDEN);
+}
+
+// the result of an awaited HTTP request - This is written by the request job
+// before the coroutine is resumed, so it needs no synchronization of its own.
+struct coroutine_http_request_state
+{
+    optional<http_response> response;
+    std::exception_ptr error;
+};
+
+namespace {
+
+struct coroutine_http_request_job : http_request_job
+{
+    coroutine_http_request_job(
+        cradle::background_execution_system& system,
+        http_request request,
+        std::shared_ptr<coroutine_http_request_state> state,
+        std::coroutine_handle<> coroutine)
+        : system(&system),
+          request(std::move(request)),
+          state(std::move(state)),
+          coroutine(coroutine)
+    {
+    }
+
+    // If the job is discarded without running, the coroutine still has to
+    // be resumed (with an error).
+    ~coroutine_http_request_job()
+    {
+        if (!started)
+        {
+            try
+            {
+                state->error
+                    = std::make_exception_ptr(background_job_canceled());
+                resume_coroutine(*system, coroutine, state->error);
+            }
+            catch (...)
+            {
+            }
+        }
+    }
+
+    void
+    execute(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter) override
+    {
+        started = true;
+        try
+        {
+            state->response
+                = connection->perform_request(check_in, reporter, request);
+        }
+        catch (...)
+        {
+            // Pass the error along to the coroutine, but also let the pool
+            // see it so that it's reported like any other failure.
+            state->error = std::current_exception();
+            resume_coroutine(*system, coroutine, state->error);
+            throw;
+        }
+        resume_coroutine(*system, coroutine, state->error);
+    }
+
+    cradle::background_execution_system* system;
+    http_request request;
+    std::shared_ptr<coroutine_http_request_state> state;
+    std::coroutine_handle<> coroutine;
+    bool started = false;
+};
+
+} // namespace
+
+// This watches an immutable cache entry on behalf of a coroutine. The entry
+// may become ready before the coroutine actually suspends, so whichever of
+// the two happens second is responsible for continuing the coroutine.
+struct coroutine_cache_entry_watcher : immutable_cache_entry_watcher
+{
+    coroutine_cache_entry_watcher(cradle::background_execution_system& system)
+        : system(&system)
+    {
+    }
+
+    void
+    on_ready(untyped_immutable value) override
+    {
+        finish(std::move(value), false);
+    }
+
+    void
+    on_failure() override
+    {
+        finish(untyped_immutable(), true);
+    }
+
+    void
+    finish(untyped_immutable value, bool failed)
+    {
+        std::coroutine_handle<> suspended;
+        {
+            std::scoped_lock<std::mutex> lock(mutex);
+            if (done)
+                return;
+            done = true;
+            this->value = std::move(value);
+            this->failed = failed;
+            suspended = coroutine;
+        }
+        if (suspended)
+            resume_coroutine(*system, suspended, error);
+    }
+
+    bool
+    is_done()
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        return done;
+    }
+
+    // Record that :coroutine is waiting for the result.
+    // The return value is false if the result is already available (in
+    // which case the coroutine shouldn't suspend).
+    bool
+    suspend(std::coroutine_handle<> coroutine)
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        if (done)
+            return false;
+        this->coroutine = coroutine;
+        return true;
+    }
+
+    cradle::background_execution_system* system;
+
+    std::mutex mutex;
+    bool done = false;
+    untyped_immutable value;
+    bool failed = false;
+    // set if the coroutine's resumption was canceled
+    std::exception_ptr error;
+    std::coroutine_handle<> coroutine;
+};
+
+untyped_immutable_cache_entry_awaitable::
+    untyped_immutable_cache_entry_awaitable(
+        cradle::background_execution_system& system,
+        cradle::immutable_cache& cache,
+        id_interface const& key,
+        function_view<background_job_controller()> const& create_job)
+    : watcher_(std::make_shared<coroutine_cache_entry_watcher>(system)),
+      handle_(cache, key, create_job, watcher_)
+{
+    // The watcher only hears about changes to the entry, so if it's already
+    // in a final state, deliver that directly.
+    auto* record = handle_.record();
+    std::unique_lock<std::mutex> lock(record->stripe->mutex);
+    switch (record->state.load(std::memory_order_relaxed))
+    {
+        case immutable_cache_entry_state::READY: {
+            auto data = record->data;
+            lock.unlock();
+            watcher_->on_ready(std::move(data));
+            break;
+        }
+        case immutable_cache_entry_state::FAILED:
+            lock.unlock();
+            watcher_->on_failure();
+            break;
+        case immutable_cache_entry_state::LOADING:
+            break;
+    }
+}
+
+bool
+untyped_immutable_cache_entry_awaitable::await_ready() const
+{
+    return watcher_->is_done();
+}
+
+bool
+untyped_immutable_cache_entry_awaitable::await_suspend(
+    std::coroutine_handle<> coroutine)
+{
+    return watcher_->suspend(coroutine);
+}
+
+untyped_immutable
+untyped_immutable_cache_entry_awaitable::await_resume()
+{
+    std::scoped_lock<std::mutex> lock(watcher_->mutex);
+    if (watcher_->error)
+        std::rethrow_exception(watcher_->error);
+    if (watcher_->failed)
+        CRADLE_THROW(immutable_cache_entry_failure());
+    return watcher_->value;
+}
+
+} // namespace detail
+
+http_request_awaitable::http_request_awaitable(
+    background_execution_system& system,
+    http_request request,
+    background_job_flag_set flags,
+    int priority)
+    : system_(&system),
+      request_(std::move(request)),
+      flags_(flags),
+      priority_(priority),
+      state_(std::make_shared<detail::coroutine_http_request_state>())
+{
+}
+
+void
+http_request_awaitable::await_suspend(std::coroutine_handle<> coroutine)
+{
+    // Once the job is added, the coroutine may be resumed (and this
+    // destroyed) at any time, so nothing can be touched after that.
+    auto job = std::make_unique<detail::coroutine_http_request_job>(
+        *system_, std::move(request_), state_, coroutine);
+    add_http_job(*system_, std::move(job), flags_, priority_);
+}
+
+http_response
+http_request_awaitable::await_resume()
+{
+    if (state_->error)
+        std::rethrow_exception(state_->error);
+    return std::move(*state_->response);
+}
+
+} // namespace cradle
+
+#endif
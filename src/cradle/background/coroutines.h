@@ -0,0 +1,522 @@
+#ifndef CRADLE_BACKGROUND_COROUTINES_H
+#define CRADLE_BACKGROUND_COROUTINES_H
+
+// This file provides a C++20 coroutine interface to the background execution
+// system.
+//
+// A coroutine that's waiting on an HTTP request or an immutable cache entry
+// doesn't occupy a thread. It's suspended until the result is available and
+// then resumed by a job on the calculation pool, so any number of concurrent
+// waits can be serviced by the pools' existing threads.
+//
+// Coroutines are resumed by jobs. If the system's jobs are cleared (or the
+// system is shut down) while a coroutine is waiting on one, the coroutine is
+// resumed directly (on whichever thread discarded the job), and the
+// operation that it was awaiting throws background_job_canceled.
+//
+// This is only available when CRADLE_ENABLE_COROUTINES is defined (which
+// requires building as C++20).
+
+#ifdef CRADLE_ENABLE_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <memory>
+#include <utility>
+
+#include <cradle/background/system.h>
+#include <cradle/caching/immutable/consumption.h>
+#include <cradle/io/http_requests.hpp>
+#include <cradle/utilities/errors.h>
+
+namespace cradle {
+
+template<class T>
+struct task;
+
+namespace detail {
+
+struct task_promise_base
+{
+    // the coroutine that's awaiting this one (if any)
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    // Tasks are lazy: they don't start until they're awaited.
+    std::suspend_always
+    initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    // When a task finishes, control transfers directly to whoever awaited
+    // it (without growing the stack).
+    struct final_awaiter
+    {
+        bool
+        await_ready() noexcept
+        {
+            return false;
+        }
+
+        template<class Promise>
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<Promise> coroutine) noexcept
+        {
+            auto continuation = coroutine.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void
+        await_resume() noexcept
+        {
+        }
+    };
+
+    final_awaiter
+    final_suspend() noexcept
+    {
+        return {};
+    }
+
+    void
+    unhandled_exception() noexcept
+    {
+        error = std::current_exception();
+    }
+};
+
+template<class T>
+struct task_promise : task_promise_base
+{
+    optional<T> value;
+
+    task<T>
+    get_return_object() noexcept;
+
+    template<class Value>
+    void
+    return_value(Value&& v)
+    {
+        value.emplace(std::forward<Value>(v));
+    }
+
+    T
+    result()
+    {
+        if (error)
+            std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template<>
+struct task_promise<void> : task_promise_base
+{
+    task<void>
+    get_return_object() noexcept;
+
+    void
+    return_void()
+    {
+    }
+
+    void
+    result()
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+};
+
+} // namespace detail
+
+// task<T> is a coroutine that eventually produces a T (or throws).
+//
+// Tasks are lazy. A task doesn't start executing until it's awaited (by
+// another task) or passed to start_task(). It then runs on whatever thread
+// awaited/started it until it suspends (e.g., to wait for an HTTP request),
+// after which it continues on the background threads.
+//
+template<class T = void>
+struct task
+{
+    typedef detail::task_promise<T> promise_type;
+
+    task() noexcept
+    {
+    }
+
+    explicit task(std::coroutine_handle<promise_type> coroutine) noexcept
+        : coroutine_(coroutine)
+    {
+    }
+
+    task(task&& other) noexcept
+        : coroutine_(std::exchange(other.coroutine_, nullptr))
+    {
+    }
+
+    task&
+    operator=(task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            coroutine_ = std::exchange(other.coroutine_, nullptr);
+        }
+        return *this;
+    }
+
+    task(task const&) = delete;
+    task&
+    operator=(task const&)
+        = delete;
+
+    ~task()
+    {
+        reset();
+    }
+
+    bool
+    is_valid() const noexcept
+    {
+        return bool(coroutine_);
+    }
+
+    auto operator co_await() && noexcept
+    {
+        struct awaiter
+        {
+            std::coroutine_handle<promise_type> coroutine;
+
+            bool
+            await_ready() noexcept
+            {
+                return false;
+            }
+
+            std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                coroutine.promise().continuation = awaiting;
+                return coroutine;
+            }
+
+            T
+            await_resume()
+            {
+                return coroutine.promise().result();
+            }
+        };
+        return awaiter{coroutine_};
+    }
+
+ private:
+    void
+    reset() noexcept
+    {
+        if (coroutine_)
+        {
+            coroutine_.destroy();
+            coroutine_ = nullptr;
+        }
+    }
+
+    std::coroutine_handle<promise_type> coroutine_;
+};
+
+namespace detail {
+
+template<class T>
+task<T>
+task_promise<T>::get_return_object() noexcept
+{
+    return task<T>(
+        std::coroutine_handle<task_promise<T>>::from_promise(*this));
+}
+
+inline task<void>
+task_promise<void>::get_return_object() noexcept
+{
+    return task<void>(
+        std::coroutine_handle<task_promise<void>>::from_promise(*this));
+}
+
+// Resume :coroutine from a job on the system's calculation pool.
+// If that job is discarded without running, :error is set to
+// background_job_canceled and the coroutine is resumed directly instead, so
+// :error must be checked when the coroutine resumes.
+void
+resume_coroutine(
+    cradle::background_execution_system& system,
+    std::coroutine_handle<> coroutine,
+    std::exception_ptr& error);
+
+} // namespace detail
+
+// Awaiting resume_in_background(system) moves the awaiting coroutine onto
+// the system's calculation pool.
+// (If the system's jobs are cleared first, this throws
+// background_job_canceled.)
+struct background_resumption
+{
+    background_execution_system* system;
+    std::exception_ptr error;
+
+    bool
+    await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void
+    await_suspend(std::coroutine_handle<> coroutine)
+    {
+        detail::resume_coroutine(*system, coroutine, error);
+    }
+
+    void
+    await_resume() const
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+};
+
+inline background_resumption
+resume_in_background(background_execution_system& system)
+{
+    return background_resumption{&system};
+}
+
+namespace detail {
+
+// This is a coroutine that starts immediately and destroys itself when it's
+// done. It's used to drive tasks that nobody else is awaiting.
+struct detached_coroutine
+{
+    struct promise_type
+    {
+        detached_coroutine
+        get_return_object() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never
+        initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never
+        final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void
+        return_void() noexcept
+        {
+        }
+
+        // Everything that's run as a detached coroutine catches its own
+        // exceptions.
+        void
+        unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+template<class T>
+detached_coroutine
+run_task(
+    cradle::background_execution_system& system,
+    task<T> work,
+    std::promise<T> promise)
+{
+    try
+    {
+        co_await resume_in_background(system);
+        if constexpr (std::is_void_v<T>)
+        {
+            co_await std::move(work);
+            promise.set_value();
+        }
+        else
+        {
+            promise.set_value(co_await std::move(work));
+        }
+    }
+    catch (...)
+    {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+} // namespace detail
+
+// Start executing :work on the system's calculation pool.
+// The returned future receives the task's result (or exception).
+template<class T>
+std::future<T>
+start_task(background_execution_system& system, task<T> work)
+{
+    std::promise<T> promise;
+    auto future = promise.get_future();
+    detail::run_task(system, std::move(work), std::move(promise));
+    return future;
+}
+
+// AWAITABLE HTTP REQUESTS
+
+namespace detail {
+
+struct coroutine_http_request_state;
+
+} // namespace detail
+
+// http_request_awaitable performs an HTTP request on the system's HTTP pool.
+// The awaiting coroutine is suspended while the request is in flight and
+// then resumed on the calculation pool with the response.
+//
+// If the request fails, awaiting it throws the original error.
+//
+struct http_request_awaitable
+{
+    http_request_awaitable(
+        background_execution_system& system,
+        http_request request,
+        background_job_flag_set flags,
+        int priority);
+
+    bool
+    await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void
+    await_suspend(std::coroutine_handle<> coroutine);
+
+    http_response
+    await_resume();
+
+ private:
+    background_execution_system* system_;
+    http_request request_;
+    background_job_flag_set flags_;
+    int priority_;
+    std::shared_ptr<detail::coroutine_http_request_state> state_;
+};
+
+inline http_request_awaitable
+async_http_request(
+    background_execution_system& system,
+    http_request request,
+    background_job_flag_set flags = NO_FLAGS,
+    int priority = 0)
+{
+    return http_request_awaitable(
+        system, std::move(request), flags, priority);
+}
+
+// AWAITABLE IMMUTABLE CACHE ENTRIES
+
+// This is the error that's thrown when awaiting an immutable cache entry
+// whose producer failed.
+CRADLE_DEFINE_EXCEPTION(immutable_cache_entry_failure)
+
+namespace detail {
+
+struct coroutine_cache_entry_watcher;
+
+// This implements the type-independent part of
+// immutable_cache_entry_awaitable.
+struct untyped_immutable_cache_entry_awaitable
+{
+    untyped_immutable_cache_entry_awaitable(
+        cradle::background_execution_system& system,
+        cradle::immutable_cache& cache,
+        id_interface const& key,
+        function_view<background_job_controller()> const& create_job);
+
+    bool
+    await_ready() const;
+
+    bool
+    await_suspend(std::coroutine_handle<> coroutine);
+
+    untyped_immutable
+    await_resume();
+
+ private:
+    std::shared_ptr<coroutine_cache_entry_watcher> watcher_;
+    immutable_cache_entry_handle handle_;
+};
+
+} // namespace detail
+
+// immutable_cache_entry_awaitable waits for an entry in an immutable cache.
+// The entry is acquired as soon as the awaitable is constructed, so (as with
+// immutable_cache_ptr) :create_job is invoked then if nobody else has already
+// started producing it. The awaiting coroutine is only suspended if the
+// entry isn't ready yet, and it's resumed on the calculation pool.
+//
+// If the entry fails to load, awaiting it throws
+// immutable_cache_entry_failure.
+//
+template<class T>
+struct immutable_cache_entry_awaitable
+{
+    immutable_cache_entry_awaitable(
+        background_execution_system& system,
+        immutable_cache& cache,
+        id_interface const& key,
+        function_view<background_job_controller()> const& create_job)
+        : untyped_(system, cache, key, create_job)
+    {
+    }
+
+    bool
+    await_ready() const
+    {
+        return untyped_.await_ready();
+    }
+
+    bool
+    await_suspend(std::coroutine_handle<> coroutine)
+    {
+        return untyped_.await_suspend(coroutine);
+    }
+
+    immutable<T>
+    await_resume()
+    {
+        return cast_immutable<T>(untyped_.await_resume());
+    }
+
+ private:
+    detail::untyped_immutable_cache_entry_awaitable untyped_;
+};
+
+template<class T>
+immutable_cache_entry_awaitable<T>
+await_immutable_cache_entry(
+    background_execution_system& system,
+    immutable_cache& cache,
+    id_interface const& key,
+    function_view<background_job_controller()> const& create_job)
+{
+    return immutable_cache_entry_awaitable<T>(system, cache, key, create_job);
+}
+
+} // namespace cradle
+
+#endif
+
+#endif
@@ -1,26 +1,12 @@
 #include <cradle/background/execution_pool.h>
 
+#include <algorithm>
+#include <iterator>
+
 #include <boost/algorithm/string.hpp>
 
 namespace cradle {
 
-// void
-// record_failure(
-//     background_job_queue& queue,
-//     background_job_ptr& job,
-//     string msg,
-//     bool is_transient)
-// {
-//     // job->state = background_job_state::FAILED;
-//     // boost::lock_guard<boost::mutex> lock(queue.mutex);
-//     // inc_version(queue.version);
-//     // background_job_failure failure;
-//     // failure.is_transient = is_transient;
-//     // failure.message = msg; // != '\0' ? msg : "unknown error";
-//     // failure.job = job;
-//     // queue.failed_jobs.push_back(failure);
-// }
-
 namespace detail {
 
 // void web_request_processing_loop::operator()()
@@ -160,167 +146,722 @@ namespace detail {
 //     }
 // }
 
-// void
-// update_status(keyed_data<background_execution_pool_status>& status,
-//     background_execution_pool& pool)
-// {
-//     background_job_queue& queue = *pool.queue;
-//     boost::mutex::scoped_lock lock(queue.mutex);
-//     auto thread_count = pool.threads.size();
-//     refresh_keyed_data(status,
-//         combine_ids(get_id(queue.version), make_id(thread_count)));
-//     if (!is_valid(status))
-//     {
-//         background_execution_pool_status new_status;
-//         new_status.thread_count = thread_count;
-//         for (auto const& f : queue.failed_jobs)
-//         {
-//             background_job_failure_report report;
-//             report.job = f.job.get();
-//             report.message = f.message;
-//             new_status.transient_failures.push_back(report);
-//         }
-//         new_status.queued_job_count = queue.reported_size;
-//         new_status.idle_thread_count = queue.n_idle_threads;
-//         new_status.job_info = queue.job_info;
-//         set(status, new_status);
-//     }
-// }
+void
+background_job_heap::push(background_job_ptr job)
+{
+    jobs.emplace_back();
+    this->place(jobs.size() - 1, std::move(job));
+    this->sift_up(jobs.size() - 1);
+}
 
-// void update_status(background_execution_system_status& status,
-//     background_execution_system& system)
-// {
-//     for (unsigned i = 0; i != unsigned(background_job_queue_type::COUNT);
-//     ++i)
-//         update_status(status.pools[i], system.impl_->pools[i]);
-// }
+background_job_ptr
+background_job_heap::pop()
+{
+    auto job = jobs.front();
+    this->remove(*job);
+    return job;
+}
 
-// void static
-// get_permanent_failures(std::list<background_job_failure_report>& failures,
-//     background_execution_pool& pool)
-// {
-//     background_job_queue& queue = *pool.queue;
-//     boost::mutex::scoped_lock lock(queue.mutex);
-//     for (auto i = queue.failed_jobs.begin(); i != queue.failed_jobs.end(); )
-//     {
-//         if (!i->is_transient)
-//         {
-//             // Record it.
-//             background_job_failure_report report;
-//             report.job = i->job.get();
-//             report.message = i->message;
-//             failures.push_back(report);
-//             // Erase it.
-//             i = queue.failed_jobs.erase(i);
-//         }
-//         else
-//             ++i;
-//     }
-// }
+void
+background_job_heap::remove(background_job_execution_data& job)
+{
+    size_t index = job.heap_index;
+    assert(index < jobs.size() && jobs[index].get() == &job);
+    auto last = std::move(jobs.back());
+    jobs.pop_back();
+    if (index != jobs.size())
+    {
+        this->place(index, std::move(last));
+        this->update(*jobs[index]);
+    }
+}
 
-// std::list<background_job_failure_report>
-// get_permanent_failures(background_execution_system& system)
-// {
-//     std::list<background_job_failure_report> failures;
-//     for (unsigned i = 0; i != unsigned(background_job_queue_type::COUNT);
-//     ++i)
-//         get_permanent_failures(failures, system.impl_->pools[i]);
-//     return failures;
-// }
+void
+background_job_heap::update(background_job_execution_data& job)
+{
+    size_t index = job.heap_index;
+    if (index != 0 && background_job_precedes(job, *jobs[(index - 1) / 2]))
+        this->sift_up(index);
+    else
+        this->sift_down(index);
+}
 
-size_t
-canceled_job_count(background_job_queue& queue)
+void
+background_job_heap::place(size_t index, background_job_ptr job)
 {
-    std::scoped_lock<std::mutex> lock(queue.mutex);
-    job_priority_queue copy = queue.jobs;
-    size_t count = 0;
-    while (!copy.empty())
+    job->heap_index = index;
+    jobs[index] = std::move(job);
+}
+
+void
+background_job_heap::sift_up(size_t index)
+{
+    auto job = std::move(jobs[index]);
+    while (index != 0)
     {
-        auto top = copy.top();
-        if (top->cancel)
-            ++count;
-        copy.pop();
+        size_t parent = (index - 1) / 2;
+        if (!background_job_precedes(*job, *jobs[parent]))
+            break;
+        this->place(index, std::move(jobs[parent]));
+        index = parent;
     }
-    return count;
+    this->place(index, std::move(job));
 }
 
 void
-clear_pending_jobs(background_execution_pool& pool)
+background_job_heap::sift_down(size_t index)
 {
-    auto& queue = *pool.queue;
-    std::scoped_lock<std::mutex> lock(queue.mutex);
-    ++queue.version;
-    queue.jobs = job_priority_queue();
+    auto job = std::move(jobs[index]);
+    size_t const size = jobs.size();
+    while (1)
+    {
+        size_t child = index * 2 + 1;
+        if (child >= size)
+            break;
+        if (child + 1 < size
+            && background_job_precedes(*jobs[child + 1], *jobs[child]))
+        {
+            ++child;
+        }
+        if (!background_job_precedes(*jobs[child], *job))
+            break;
+        this->place(index, std::move(jobs[child]));
+        index = child;
+    }
+    this->place(index, std::move(job));
 }
 
 void
-clear_all_jobs(background_execution_pool& pool)
+background_job_heap::rebuild()
 {
-    clear_pending_jobs(pool);
+    for (size_t i = 0; i != jobs.size(); ++i)
+        jobs[i]->heap_index = i;
+    for (size_t i = jobs.size() / 2; i-- != 0;)
+        this->sift_down(i);
+}
 
-    for (auto& i : pool.threads)
+namespace {
+
+// the queue that the current thread is servicing (if any) and its own queue
+thread_local background_job_queue* current_queue = nullptr;
+thread_local background_worker_queue* current_worker = nullptr;
+
+std::shared_ptr<background_worker_queue_list const>
+get_workers(background_job_queue& queue)
+{
+    return std::atomic_load(&queue.workers);
+}
+
+// Add :job to :worker's heap.
+// This must be called with the worker's mutex held.
+void
+push_queued_job(background_worker_queue& worker, background_job_ptr job)
+{
+    // :queued_in is set before the priority is read. set_priority() does the
+    // opposite, so either it sees the job in the heap or we see its new
+    // priority.
+    job->queued_in = &worker;
+    job->queued_priority = job->priority;
+    worker.jobs.push(std::move(job));
+    worker.size = worker.jobs.size();
+}
+
+// Take the top job from :worker's heap.
+// This must be called with the worker's mutex held.
+background_job_ptr
+pop_queued_job(background_worker_queue& worker)
+{
+    auto job = worker.jobs.pop();
+    job->queued_in = nullptr;
+    worker.size = worker.jobs.size();
+    return job;
+}
+
+// Find the worker queue that's holding :job and invoke :f on it (with its
+// mutex held). If the job isn't queued, this does nothing.
+template<class Function>
+void
+with_queued_job(
+    background_job_queue& queue,
+    background_job_execution_data& job,
+    Function&& f)
+{
+    while (1)
     {
-        auto& active_job = i->data_proxy->active_job;
-        if (active_job)
-            active_job->cancel = true;
+        auto* worker = job.queued_in.load();
+        if (!worker)
+            return;
+        // Other than the shared and express queues, worker queues go away
+        // when their threads exit, so the worker has to be in the current
+        // list before it's safe to touch. If it's not, it's in the process of
+        // being unregistered, and the job is about to move to the shared
+        // queue.
+        std::shared_ptr<background_worker_queue_list const> workers;
+        if (worker != &queue.shared && worker != &queue.express)
+        {
+            workers = get_workers(queue);
+            if (std::none_of(
+                    workers->begin(),
+                    workers->end(),
+                    [&](std::shared_ptr<background_worker_queue> const& w) {
+                        return w.get() == worker;
+                    }))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+        }
+        std::scoped_lock<std::mutex> lock(worker->mutex);
+        if (job.queued_in == worker)
+        {
+            f(*worker);
+            return;
+        }
     }
+}
 
+// Wake up a sleeping worker (if there are any).
+void
+wake_idle_thread(background_job_queue& queue)
+{
+    // This pairs with the fence in wait_for_background_job() to ensure that
+    // either the sleeping thread sees the new job or we see the thread.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (queue.n_sleeping_threads.load(std::memory_order_relaxed) != 0)
     {
-        auto& queue = *pool.queue;
-        std::scoped_lock<std::mutex> lock(queue.mutex);
+        // Acquiring the mutex ensures that the thread is actually waiting on
+        // the CV (rather than about to wait).
+        {
+            std::scoped_lock<std::mutex> lock(queue.mutex);
+        }
+        queue.cv.notify_one();
+    }
+}
+
+// Cancel a job that was never queued (because it was held back until its
+// inputs completed).
+void
+discard_held_job(background_job_queue& queue, background_job_ptr const& job)
+{
+    job->finish_time = std::chrono::steady_clock::now();
+    ++queue.counters.canceled_count;
+    job->state = background_job_state::CANCELED;
+    finish_job_dependencies(job);
+}
+
+// Cancel a job that has left the queue without being executed.
+void
+discard_queued_job(background_job_queue& queue, background_job_ptr const& job)
+{
+    if (!(job->flags & BACKGROUND_JOB_HIDDEN))
+    {
+        --queue.reported_size;
+        std::scoped_lock<std::mutex> lock(queue.info_mutex);
+        queue.job_info.erase(&*job);
+    }
+    discard_held_job(queue, job);
+}
+
+// Release a job that was held back until its inputs completed into its pool.
+// If the pool is shutting down, the job is canceled instead.
+void
+release_held_job(background_job_ptr const& job, background_job_flag_set flags)
+{
+    auto queue = job->queue.lock();
+    if (!queue)
+        return;
+    background_execution_pool* pool;
+    {
+        std::scoped_lock<std::mutex> lock(queue->mutex);
+        queue->held_jobs.erase(job);
+        pool = queue->terminating ? nullptr : queue->pool;
+        if (pool)
+            ++queue->releasing_count;
+    }
+    if (!pool)
+    {
+        discard_held_job(*queue, job);
+        return;
+    }
+    queue_background_job(*pool, job, flags);
+    {
+        std::scoped_lock<std::mutex> lock(queue->mutex);
+        --queue->releasing_count;
+    }
+    queue->releases_finished.notify_all();
+}
+
+// Try to find a job for the worker that owns :own, without blocking.
+//
+// Each queue's size is checked before its mutex is acquired, so in the
+// common case (where the express and shared queues are empty), a worker only
+// locks its own queue.
+background_job_ptr
+take_background_job(background_job_queue& queue, background_worker_queue& own)
+{
+    // Jobs that skip the queue come first.
+    auto& express = queue.express;
+    if (express.size != 0)
+    {
+        std::scoped_lock<std::mutex> lock(express.mutex);
+        if (!express.jobs.empty())
+            return pop_queued_job(express);
+    }
+
+    // Otherwise, take the better of the jobs at the top of our own queue and
+    // the shared one.
+    {
+        std::scoped_lock<std::mutex> lock(own.mutex);
+        auto& shared = queue.shared;
+        if (shared.size != 0)
+        {
+            std::scoped_lock<std::mutex> shared_lock(shared.mutex);
+            if (!shared.jobs.empty()
+                && (own.jobs.empty()
+                    || background_job_precedes(
+                        *shared.jobs.top(), *own.jobs.top())))
+            {
+                return pop_queued_job(shared);
+            }
+        }
+        if (!own.jobs.empty())
+            return pop_queued_job(own);
+    }
+
+    // Otherwise, steal the best job that another thread has queued.
+    auto workers = get_workers(queue);
+    while (1)
+    {
+        background_worker_queue* victim = nullptr;
+        int best_priority = 0;
+        uint64_t best_sequence = 0;
+        for (auto const& other : *workers)
+        {
+            if (other.get() == &own || other->size == 0)
+                continue;
+            std::scoped_lock<std::mutex> lock(other->mutex);
+            if (other->jobs.empty())
+                continue;
+            // (This is the same ordering as background_job_precedes(), but
+            // the best job so far can't be inspected without its lock.)
+            auto const& top = *other->jobs.top();
+            if (!victim || top.queued_priority > best_priority
+                || (top.queued_priority == best_priority
+                    && top.sequence < best_sequence))
+            {
+                victim = other.get();
+                best_priority = top.queued_priority;
+                best_sequence = top.sequence;
+            }
+        }
+        if (!victim)
+            return background_job_ptr();
+        std::scoped_lock<std::mutex> lock(victim->mutex);
+        if (!victim->jobs.empty())
+            return pop_queued_job(*victim);
+    }
+}
+
+// Remove all jobs from :queue that match :predicate and pass them to
+// :discard.
+template<class Predicate, class Discard>
+void
+remove_queued_jobs(
+    background_job_queue& queue, Predicate&& predicate, Discard&& discard)
+{
+    std::vector<background_job_ptr> removed;
+    auto remove_from = [&](background_worker_queue& worker) {
+        std::scoped_lock<std::mutex> lock(worker.mutex);
+        for (auto& job : worker.jobs.remove_if(predicate))
+        {
+            job->queued_in = nullptr;
+            removed.push_back(std::move(job));
+        }
+        worker.size = worker.jobs.size();
+    };
+    remove_from(queue.express);
+    remove_from(queue.shared);
+    for (auto const& worker : *get_workers(queue))
+        remove_from(*worker);
+
+    if (!removed.empty())
+    {
+        queue.queued_count -= removed.size();
         ++queue.version;
-        queue.failed_jobs.clear();
+        for (auto const& job : removed)
+            discard(job);
     }
 }
 
+// Remove :own from the list of worker queues that are servicing :queue.
+// Any jobs that are left in it are moved to the shared queue.
+// This must be called with the queue's mutex held.
 void
-clear_canceled_jobs(background_job_queue& queue, job_priority_queue& pqueue)
+unregister_background_worker(
+    background_job_queue& queue, background_worker_queue& own)
+{
+    auto workers = std::make_shared<background_worker_queue_list>(
+        *get_workers(queue));
+    workers->erase(std::remove_if(
+        workers->begin(),
+        workers->end(),
+        [&](std::shared_ptr<background_worker_queue> const& w) {
+            return w.get() == &own;
+        }));
+    std::atomic_store(
+        &queue.workers,
+        std::shared_ptr<background_worker_queue_list const>(
+            std::move(workers)));
+
+    {
+        std::scoped_lock<std::mutex, std::mutex> lock(
+            own.mutex, queue.shared.mutex);
+        while (!own.jobs.empty())
+            push_queued_job(queue.shared, pop_queued_job(own));
+    }
+
+    current_queue = nullptr;
+    current_worker = nullptr;
+}
+
+// Wait for a sleeping worker to be woken up.
+// The return value is true iff the worker should exit because it has been
+// idle for too long (in which case it's already been removed from the
+// queue's accounting).
+bool
+wait_for_wakeup(
+    background_job_queue& queue,
+    background_worker_queue& own,
+    std::unique_lock<std::mutex>& lock,
+    background_job_ptr& job)
 {
-    job_priority_queue filtered;
-    while (!pqueue.empty())
+    if (queue.idle_timeout.count() == 0)
     {
-        auto job = pqueue.top();
+        queue.cv.wait(lock);
+        return false;
+    }
+
+    if (queue.cv.wait_for(lock, queue.idle_timeout) != std::cv_status::timeout
+        || queue.thread_count <= queue.min_thread_count)
+    {
+        return false;
+    }
+
+    // We've been idle for too long, so we're going to exit. Submitters check
+    // the idle thread count to decide if they need to add threads, so once
+    // we stop counting ourselves as idle, we have to check for work one last
+    // time. (This pairs with the fence in queue_background_job().)
+    --queue.n_idle_threads;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    job = take_background_job(queue, own);
+    if (job)
+    {
+        ++queue.n_idle_threads;
+        return false;
+    }
+    --queue.thread_count;
+    unregister_background_worker(queue, own);
+    return true;
+}
+
+// Join and remove any threads in :pool that have exited.
+// This must be called with the queue's mutex held, and not once the pool is
+// terminating (since shut_down_pool() joins the threads itself).
+void
+reap_exited_threads(background_execution_pool& pool)
+{
+    auto exited = std::stable_partition(
+        pool.threads.begin(),
+        pool.threads.end(),
+        [](std::shared_ptr<background_execution_thread> const& thread) {
+            return !thread->data_proxy->exited;
+        });
+    for (auto i = exited; i != pool.threads.end(); ++i)
+        (*i)->thread.join();
+    pool.threads.erase(exited, pool.threads.end());
+}
+
+} // namespace
+
+std::shared_ptr<background_worker_queue>
+register_background_worker(background_job_queue& queue)
+{
+    auto own = std::make_shared<background_worker_queue>();
+    {
+        std::scoped_lock<std::mutex> lock(queue.mutex);
+        auto workers = std::make_shared<background_worker_queue_list>(
+            *get_workers(queue));
+        workers->push_back(own);
+        std::atomic_store(
+            &queue.workers,
+            std::shared_ptr<background_worker_queue_list const>(
+                std::move(workers)));
+    }
+    current_queue = &queue;
+    current_worker = own.get();
+    return own;
+}
+
+background_job_ptr
+wait_for_background_job(
+    background_job_queue& queue, background_worker_queue& own)
+{
+    ++queue.version;
+    ++queue.n_idle_threads;
+    while (1)
+    {
+        auto job = take_background_job(queue, own);
+        if (!job)
+        {
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            ++queue.n_sleeping_threads;
+            // (See wake_idle_thread().)
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (!queue.terminating
+                   && !(job = take_background_job(queue, own)))
+            {
+                if (wait_for_wakeup(queue, own, lock, job))
+                {
+                    --queue.n_sleeping_threads;
+                    return job;
+                }
+                if (job)
+                    break;
+            }
+            --queue.n_sleeping_threads;
+            if (!job)
+                return job;
+        }
+
+        --queue.queued_count;
+        ++queue.version;
+
+        // If it's already been instructed to cancel, cancel it.
         if (job->cancel)
         {
-            if (!(job->flags & BACKGROUND_JOB_HIDDEN))
-                --queue.reported_size;
-            queue.job_info.erase(&*job);
+            discard_queued_job(queue, job);
+            continue;
         }
-        else
-            filtered.push(job);
-        pqueue.pop();
+
+        if (!(job->flags & BACKGROUND_JOB_HIDDEN))
+            --queue.reported_size;
+        --queue.n_idle_threads;
+        job->start_time = std::chrono::steady_clock::now();
+        record_latency(
+            queue.counters.queue_wait,
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                job->start_time - job->enqueue_time));
+        return job;
     }
-    pqueue = filtered;
 }
 
 void
-clear_canceled_jobs(background_execution_pool& pool)
+finish_background_job(
+    background_job_queue& queue,
+    background_job_ptr const& job,
+    background_job_state state)
+{
+    job->finish_time = std::chrono::steady_clock::now();
+    auto& counters = queue.counters;
+    record_latency(
+        counters.run_time,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            job->finish_time - job->start_time));
+    switch (state)
+    {
+        case background_job_state::COMPLETED:
+            ++counters.completed_count;
+            break;
+        case background_job_state::FAILED:
+            ++counters.failed_count;
+            break;
+        default:
+            ++counters.canceled_count;
+            break;
+    }
+
+    if (!(job->flags & BACKGROUND_JOB_HIDDEN))
+    {
+        std::scoped_lock<std::mutex> lock(queue.info_mutex);
+        queue.job_info.erase(&*job);
+    }
+    ++queue.version;
+    job->state = state;
+    finish_job_dependencies(job);
+}
+
+void
+record_failure(
+    background_job_queue& queue,
+    background_job_ptr const& job,
+    string message,
+    bool is_transient)
+{
+    if (is_transient)
+        ++queue.counters.transient_failure_count;
+    std::scoped_lock<std::mutex> lock(queue.mutex);
+    ++queue.version;
+    queue.failed_jobs.push_back(
+        background_job_failure{job, is_transient, std::move(message)});
+    if (queue.failed_jobs.size() > max_recorded_job_failures)
+        queue.failed_jobs.pop_front();
+}
+
+void
+remove_canceled_job(background_job_ptr const& job)
+{
+    auto queue = job->queue.lock();
+    if (!queue)
+        return;
+    bool removed = false;
+    with_queued_job(*queue, *job, [&](background_worker_queue& worker) {
+        worker.jobs.remove(*job);
+        worker.size = worker.jobs.size();
+        job->queued_in = nullptr;
+        removed = true;
+    });
+    if (removed)
+    {
+        --queue->queued_count;
+        ++queue->version;
+        discard_queued_job(*queue, job);
+    }
+}
+
+void
+reprioritize_job(background_job_ptr const& job)
+{
+    auto queue = job->queue.lock();
+    if (!queue)
+        return;
+    with_queued_job(*queue, *job, [&](background_worker_queue& worker) {
+        job->queued_priority = job->priority;
+        worker.jobs.update(*job);
+        ++queue->version;
+    });
+}
+
+size_t
+canceled_job_count(background_job_queue& queue)
+{
+    size_t count = 0;
+    auto count_in = [&](background_worker_queue& worker) {
+        std::scoped_lock<std::mutex> lock(worker.mutex);
+        auto const& jobs = worker.jobs.jobs;
+        count += std::count_if(
+            jobs.begin(), jobs.end(), [](background_job_ptr const& job) {
+                return job->cancel.load();
+            });
+    };
+    count_in(queue.express);
+    count_in(queue.shared);
+    for (auto const& worker : *get_workers(queue))
+        count_in(*worker);
+    return count;
+}
+
+void
+clear_pending_jobs(background_execution_pool& pool)
 {
     auto& queue = *pool.queue;
+    remove_queued_jobs(
+        queue,
+        [](background_job_ptr const&) { return true; },
+        [&](background_job_ptr const& job) {
+            discard_queued_job(queue, job);
+        });
+}
+
+void
+clear_all_jobs(background_execution_pool& pool)
+{
+    clear_pending_jobs(pool);
+
+    auto& queue = *pool.queue;
+
+    // Cancel the jobs that are waiting on their inputs. (Releasing them
+    // cancels them, just as background_job_controller::cancel() does.)
+    std::set<background_job_ptr> held_jobs;
+    {
+        std::scoped_lock<std::mutex> lock(queue.mutex);
+        held_jobs = queue.held_jobs;
+    }
+    for (auto const& job : held_jobs)
+    {
+        job->cancel = true;
+        if (!job->released.exchange(true))
+            job->release(job);
+    }
+
     std::scoped_lock<std::mutex> lock(queue.mutex);
-    clear_canceled_jobs(queue, queue.jobs);
+    for (auto& i : pool.threads)
+    {
+        std::scoped_lock<std::mutex> lock(i->data_proxy->mutex);
+        auto& active_job = i->data_proxy->active_job;
+        if (active_job)
+            active_job->cancel = true;
+    }
+    ++queue.version;
+    queue.failed_jobs.clear();
+}
+
+void
+clear_canceled_jobs(background_execution_pool& pool)
+{
+    auto& queue = *pool.queue;
+    remove_queued_jobs(
+        queue,
+        [](background_job_ptr const& job) { return job->cancel.load(); },
+        [&](background_job_ptr const& job) {
+            discard_queued_job(queue, job);
+        });
 }
 
 void
 shut_down_pool(background_execution_pool& pool)
 {
-    clear_all_jobs(pool);
     auto& queue = *pool.queue;
+    // The pool is marked as terminating before it's cleared. Anyone who
+    // queues a job after this point sees the flag and discards the job
+    // themselves (see queue_background_job()), so the clearing can't miss
+    // anything.
     {
-        std::scoped_lock<std::mutex> lock(queue.mutex);
+        std::unique_lock<std::mutex> lock(queue.mutex);
         queue.terminating = true;
+        // Releases that are already underway still use the pool, so wait
+        // for them. (Any later ones see that the queue is terminating.)
+        queue.releases_finished.wait(
+            lock, [&] { return queue.releasing_count == 0; });
+        queue.pool = nullptr;
+    }
+    clear_all_jobs(pool);
+    std::vector<std::shared_ptr<background_execution_thread>> threads;
+    {
+        std::scoped_lock<std::mutex> lock(queue.mutex);
+        // The threads are moved out of the pool so that nothing else can
+        // join them once the lock is released. (Submitters don't reap
+        // threads once the pool is terminating.)
+        threads = std::move(pool.threads);
+        pool.threads.clear();
     }
     queue.cv.notify_all();
-    for (auto& thread : pool.threads)
+    for (auto& thread : threads)
         thread->thread.join();
 }
 
+background_pool_telemetry
+get_pool_telemetry(background_execution_pool& pool)
+{
+    return read_pool_counters(pool.queue->counters);
+}
+
 bool
 is_pool_idle(background_execution_pool& pool)
 {
     background_job_queue& queue = *pool.queue;
     std::scoped_lock<std::mutex> lock(queue.mutex);
-    return queue.n_idle_threads == pool.threads.size() && queue.jobs.empty();
+    return queue.n_idle_threads == queue.thread_count
+           && queue.queued_count == 0;
 }
 
 void
@@ -329,7 +870,32 @@ add_background_thread(background_execution_pool& pool)
     auto data_proxy = std::make_shared<background_thread_data_proxy>();
     auto thread = std::make_shared<background_execution_thread>(
         pool.create_thread(pool.queue, data_proxy), data_proxy);
+    // Take the lowest placement slot that isn't held by another of the
+    // pool's threads. (Threads release their slots when they're reaped, so
+    // as an elastic pool shrinks and regrows, its threads stay spread
+    // across the machine rather than piling up on the same CPUs.)
+    while (std::any_of(
+        pool.threads.begin(),
+        pool.threads.end(),
+        [&](std::shared_ptr<background_execution_thread> const& other) {
+            return other->placement == thread->placement;
+        }))
+    {
+        ++thread->placement;
+    }
+    if (pool.affinity != thread_affinity_policy::UNPINNED)
+    {
+        auto const& topology = get_cpu_topology();
+        if (topology)
+        {
+            set_thread_affinity(
+                thread->thread,
+                get_thread_cpu_set(
+                    *topology, pool.affinity, thread->placement));
+        }
+    }
     pool.threads.push_back(thread);
+    ++pool.queue->thread_count;
     // lower_thread_priority(thread->thread);
 }
 
@@ -340,25 +906,77 @@ queue_background_job(
     background_job_flag_set flags)
 {
     background_job_queue& queue = *pool.queue;
+    ++queue.version;
+    if (!(flags & BACKGROUND_JOB_HIDDEN))
     {
-        std::scoped_lock<std::mutex> lock(queue.mutex);
-        ++queue.version;
-        if (!(flags & BACKGROUND_JOB_HIDDEN))
         {
+            std::scoped_lock<std::mutex> lock(queue.info_mutex);
             queue.job_info[&*job_ptr]
                 = background_job_info(); // TODO: job_ptr->job->get_info();
-            ++queue.reported_size;
         }
-        queue.jobs.push(job_ptr);
-        // If requested, ensure that there will be an idle thread to pick
-        // up the new job.
-        if ((flags & BACKGROUND_JOB_SKIP_QUEUE)
-            && queue.n_idle_threads < queue.jobs.size())
+        ++queue.reported_size;
+    }
+    ++queue.queued_count;
+
+    // Jobs that skip the queue go to the express queue. Otherwise, jobs
+    // submitted from within the pool go to the submitting thread's own
+    // queue.
+    bool skip_queue = (flags & BACKGROUND_JOB_SKIP_QUEUE) ? true : false;
+    job_ptr->enqueue_time = std::chrono::steady_clock::now();
+    job_ptr->sequence = queue.next_sequence++;
+    auto* worker = &queue.shared;
+    if (skip_queue)
+        worker = &queue.express;
+    else if (current_queue == &queue)
+        worker = current_worker;
+    {
+        std::scoped_lock<std::mutex> lock(worker->mutex);
+        push_queued_job(*worker, job_ptr);
+    }
+    // If the job was canceled (or the pool started shutting down) while it
+    // was being queued, cancel() (or shut_down_pool()) might not have seen it
+    // in the queue, so it's removed here instead.
+    if (queue.terminating)
+        job_ptr->cancel = true;
+    if (job_ptr->cancel)
+        remove_canceled_job(job_ptr);
+
+    // If the job skips the queue (or if the pool is elastic), ensure that
+    // there will be an idle thread to pick up the new job. Since jobs that
+    // skip the queue are taken first, it's enough for those to have as many
+    // idle threads as there are jobs in the express queue. Otherwise, we
+    // need as many idle threads as queued jobs. The fence pairs with the one
+    // in wait_for_wakeup() so that a thread that's exiting either sees the
+    // new job or is excluded from the idle count here.
+    if (skip_queue || pool.max_thread_count != 0)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto needs_thread = [&] {
+            if (skip_queue && queue.n_idle_threads < queue.express.size)
+            {
+                size_t normal_size = pool.max_thread_count != 0
+                                         ? pool.max_thread_count
+                                         : queue.min_thread_count;
+                return queue.thread_count
+                       < normal_size + pool.max_express_thread_count;
+            }
+            return pool.max_thread_count != 0
+                   && queue.n_idle_threads < queue.queued_count
+                   && queue.thread_count < pool.max_thread_count;
+        };
+        if (needs_thread())
         {
-            add_background_thread(pool);
+            std::scoped_lock<std::mutex> lock(queue.mutex);
+            if (!queue.terminating)
+            {
+                reap_exited_threads(pool);
+                if (needs_thread())
+                    add_background_thread(pool);
+            }
         }
     }
-    queue.cv.notify_one();
+
+    wake_idle_thread(queue);
 }
 
 background_job_controller
@@ -370,10 +988,39 @@ add_background_job(
 {
     auto ptr = std::make_shared<detail::background_job_execution_data>(
         std::move(job), flags, priority);
+    ptr->queue = pool.queue;
     queue_background_job(pool, ptr, flags);
     return background_job_controller(ptr);
 }
 
+background_job_controller
+add_background_job(
+    background_execution_pool& pool,
+    std::unique_ptr<background_job_interface> job,
+    std::vector<background_job_controller> const& inputs,
+    background_job_flag_set flags,
+    int priority)
+{
+    auto ptr = std::make_shared<detail::background_job_execution_data>(
+        std::move(job), flags, priority);
+    ptr->queue = pool.queue;
+    // The job may be released from another pool's thread, so it's released
+    // through its queue rather than :pool.
+    ptr->release = [flags](background_job_ptr const& job) {
+        release_held_job(job, flags);
+    };
+    {
+        auto& queue = *pool.queue;
+        std::scoped_lock<std::mutex> lock(queue.mutex);
+        if (queue.terminating)
+            ptr->cancel = true;
+        else
+            queue.held_jobs.insert(ptr);
+    }
+    add_job_inputs(ptr, inputs);
+    return background_job_controller(ptr);
+}
+
 } // namespace detail
 
 } // namespace cradle
@@ -1,12 +1,19 @@
 #ifndef CRADLE_BACKGROUND_EXECUTION_POOL_H
 #define CRADLE_BACKGROUND_EXECUTION_POOL_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <iterator>
 #include <mutex>
-#include <queue>
+#include <set>
 #include <thread>
+#include <vector>
 
 #include <cradle/background/job.h>
+#include <cradle/background/os.h>
+#include <cradle/background/telemetry.h>
 
 // This file defines CRADLE's system for executing background jobs in thread
 // pools. As with most of the rest of the CRADLE background system, this is a
@@ -15,17 +22,19 @@
 
 namespace cradle {
 
-namespace detail {
-
-struct background_job_sorter
+// the sizing parameters for an elastic pool (see initialize_elastic_pool())
+struct elastic_pool_config
 {
-    bool
-    operator()(background_job_ptr const& a, background_job_ptr const& b)
-    {
-        return a->priority > b->priority;
-    }
+    // the number of threads that are kept around even when idle
+    size_t min_thread_count = 0;
+    // the maximum number of threads that the pool will grow to
+    size_t max_thread_count = 256;
+    // how long a thread can be idle before it exits
+    std::chrono::milliseconds idle_timeout = std::chrono::seconds(30);
 };
 
+namespace detail {
+
 struct background_job_canceled
 {
 };
@@ -39,10 +48,7 @@ struct background_job_check_in : check_in_interface
     operator()()
     {
         if (job->cancel)
-        {
-            job->state = background_job_state::CANCELED;
             throw background_job_canceled();
-        }
     }
     background_job_ptr job;
 };
@@ -60,12 +66,6 @@ struct background_job_progress_reporter : progress_reporter_interface
     background_job_ptr job;
 };
 
-typedef std::priority_queue<
-    background_job_ptr,
-    std::vector<background_job_ptr>,
-    background_job_sorter>
-    job_priority_queue;
-
 struct background_job_failure
 {
     // the job that failed
@@ -77,30 +77,212 @@ struct background_job_failure
     string message;
 };
 
+// background_job_heap is a binary max-heap of queued jobs, ordered by
+// priority (and then by submission order among jobs with equal priority).
+// Each job records its own position within the heap, so specific jobs can be
+// removed or reprioritized in O(log n) time.
+//
+// A job can only be in one heap at a time. The heap isn't thread-safe on its
+// own. It's always protected by the mutex of the worker queue that owns it.
+//
+struct background_job_heap
+{
+    bool
+    empty() const
+    {
+        return jobs.empty();
+    }
+
+    size_t
+    size() const
+    {
+        return jobs.size();
+    }
+
+    background_job_ptr const&
+    top() const
+    {
+        return jobs.front();
+    }
+
+    void
+    push(background_job_ptr job);
+
+    background_job_ptr
+    pop();
+
+    // Remove :job, which must be in this heap.
+    void
+    remove(background_job_execution_data& job);
+
+    // Restore the heap ordering after :job's sort key has changed.
+    void
+    update(background_job_execution_data& job);
+
+    // Remove all jobs that match :predicate and return them.
+    template<class Predicate>
+    std::vector<background_job_ptr>
+    remove_if(Predicate&& predicate)
+    {
+        auto kept = std::stable_partition(
+            jobs.begin(), jobs.end(), [&](background_job_ptr const& job) {
+                return !predicate(job);
+            });
+        std::vector<background_job_ptr> removed(
+            std::make_move_iterator(kept),
+            std::make_move_iterator(jobs.end()));
+        jobs.erase(kept, jobs.end());
+        if (!removed.empty())
+            rebuild();
+        return removed;
+    }
+
+    std::vector<background_job_ptr> jobs;
+
+ private:
+    void
+    place(size_t index, background_job_ptr job);
+
+    void
+    sift_up(size_t index);
+
+    void
+    sift_down(size_t index);
+
+    void
+    rebuild();
+};
+
+// Does :a go before :b in a background_job_heap?
+inline bool
+background_job_precedes(
+    background_job_execution_data const& a,
+    background_job_execution_data const& b)
+{
+    return a.queued_priority > b.queued_priority
+           || (a.queued_priority == b.queued_priority
+               && a.sequence < b.sequence);
+}
+
+// background_worker_queue holds queued jobs that are waiting to be picked up
+// by a worker thread. Each worker thread has its own (which holds the jobs
+// that it submitted itself), and each job queue has one for jobs that are
+// submitted from outside the pool. Workers take the best job from their own
+// queue and the shared one, and they steal from other workers' queues when
+// both of those are empty. (Jobs that skip the queue have a separate worker
+// queue that takes precedence over all of these.)
+struct background_worker_queue : noncopyable
+{
+    // This is only ever held briefly.
+    std::mutex mutex;
+    background_job_heap jobs;
+    // the number of jobs in :jobs - This is only updated with :mutex held,
+    // but it can be read without it, so workers looking for jobs don't have
+    // to lock queues that are empty.
+    std::atomic<size_t> size{0};
+};
+
+typedef std::vector<std::shared_ptr<background_worker_queue>>
+    background_worker_queue_list;
+
+struct background_execution_pool;
+
 struct background_job_queue : noncopyable
 {
     // used to track changes in the queue
-    unsigned version = 0;
-    // jobs that might be ready to run
-    job_priority_queue jobs;
-    // jobs that have failed
+    std::atomic<unsigned> version{0};
+    // jobs submitted from outside the pool's threads
+    background_worker_queue shared;
+    // jobs submitted with BACKGROUND_JOB_SKIP_QUEUE - Workers take these
+    // before anything else.
+    background_worker_queue express;
+    // the queues of the threads that are servicing this queue - This list is
+    // replaced (rather than modified) when a thread is added or removed, so
+    // readers can simply take a snapshot of it (via std::atomic_load).
+    std::shared_ptr<background_worker_queue_list const> workers
+        = std::make_shared<background_worker_queue_list const>();
+    // the total number of jobs that are waiting in the worker queues
+    std::atomic<size_t> queued_count{0};
+    // the source of job sequence numbers, which preserve submission order
+    // among jobs with the same priority
+    std::atomic<uint64_t> next_sequence{0};
+    // jobs that have failed (protected by :mutex) - Only the most recent
+    // failures are kept. (See record_failure().)
     std::list<background_job_failure> failed_jobs;
-    // this provides info about all jobs in the queue
+    // statistics about the jobs that have passed through the queue
+    background_pool_counters counters;
+    // this provides info about all (non-hidden) jobs in the queue
     std::map<background_job_execution_data*, background_job_info> job_info;
-    // for controlling access to the job queue
+    std::mutex info_mutex;
+    // for putting idle threads to sleep and waking them up - Submitting a job
+    // only acquires this when there are threads sleeping on :cv.
     std::mutex mutex;
-    // for signalling when new jobs arrive
     std::condition_variable cv;
-    // # of threads currently monitoring this queue for work
-    size_t n_idle_threads = 0;
+    // # of threads currently looking for work
+    std::atomic<size_t> n_idle_threads{0};
+    // # of threads currently blocked on :cv
+    std::atomic<size_t> n_sleeping_threads{0};
+    // # of threads servicing this queue
+    std::atomic<size_t> thread_count{0};
+    // If this is nonzero, threads that have been idle for this long exit
+    // (as long as there are more than :min_thread_count threads).
+    std::chrono::milliseconds idle_timeout{0};
+    size_t min_thread_count = 0;
     // reported size of the queue
-    // Internally, this is maintained as being the number of jobs in the jobs
-    // queue that aren't marked as hidden.
-    size_t reported_size = 0;
+    // Internally, this is maintained as being the number of queued jobs that
+    // aren't marked as hidden.
+    std::atomic<size_t> reported_size{0};
     // flag to tell active threads that the queue is shutting down
-    bool terminating = false;
+    std::atomic<bool> terminating{false};
+
+    // Jobs that are waiting on their inputs are released into the pool by
+    // whichever thread finishes their last input, which may belong to another
+    // pool. Those threads reach the pool through the queue, and the pool
+    // waits for them before it shuts down. The following are protected by
+    // :mutex.
+    //
+    // the pool that owns the queue (or null once it's shutting down)
+    background_execution_pool* pool = nullptr;
+    // jobs that are being held back until their inputs complete
+    std::set<background_job_ptr> held_jobs;
+    // the number of held jobs that are currently being released
+    size_t releasing_count = 0;
+    // for signaling when releases finish
+    std::condition_variable releases_finished;
 };
 
+// Register the calling thread as a worker for :queue and get its own queue.
+std::shared_ptr<background_worker_queue>
+register_background_worker(background_job_queue& queue);
+
+// Get the next job that the calling worker thread should execute, blocking
+// until one is available. (Jobs that have been canceled in the meantime are
+// discarded along the way.) The job's start time is recorded here.
+// If the queue is shutting down or the calling thread has been idle for too
+// long, this returns an empty pointer, and the thread should exit.
+background_job_ptr
+wait_for_background_job(
+    background_job_queue& queue, background_worker_queue& own);
+
+// Do the bookkeeping for a job that a worker has finished executing.
+// :state is the job's final state.
+void
+finish_background_job(
+    background_job_queue& queue,
+    background_job_ptr const& job,
+    background_job_state state);
+
+// the maximum number of failures that a queue keeps in its :failed_jobs list
+static constexpr size_t max_recorded_job_failures = 1000;
+
+// Record that :job failed with the given error message.
+void
+record_failure(
+    background_job_queue& queue,
+    background_job_ptr const& job,
+    string message,
+    bool is_transient);
+
 // This is used for communication between the threads in a thread pool and
 // outside entities.
 struct background_thread_data_proxy
@@ -109,6 +291,8 @@ struct background_thread_data_proxy
     std::mutex mutex;
     // the job currently being executed in this thread (if any)
     background_job_ptr active_job;
+    // set when the thread has exited its execution loop
+    std::atomic<bool> exited{false};
 };
 
 struct background_execution_thread
@@ -126,6 +310,9 @@ struct background_execution_thread
 
     std::thread thread;
     std::shared_ptr<background_thread_data_proxy> data_proxy;
+    // the thread's placement slot within its pool (which determines the
+    // CPUs that it's pinned to)
+    size_t placement = 0;
 };
 
 template<class Executor>
@@ -144,39 +331,16 @@ struct background_execution_loop
     void
     operator()()
     {
+        auto& queue = *queue_;
+        auto own = register_background_worker(queue);
         while (1)
         {
-            auto& queue = *queue_;
-
-            // Wait until the queue has a job in it, and then grab the job.
-            background_job_ptr job;
+            // Wait until there's a job for this thread, and then grab it.
+            background_job_ptr job = wait_for_background_job(queue, *own);
+            if (!job)
             {
-                std::unique_lock<std::mutex> lock(queue.mutex);
-                ++queue.version;
-                ++queue.n_idle_threads;
-                // TODO: If this queue is allocating threads on demand and
-                // there are already a lot of idle threads, just end this one.
-
-                while (queue.jobs.empty())
-                {
-                    queue.cv.wait(lock);
-                    if (queue.terminating)
-                        return;
-                }
-                job = queue.jobs.top();
-                ++queue.version;
-                queue.jobs.pop();
-                if (!(job->flags & BACKGROUND_JOB_HIDDEN))
-                    --queue.reported_size;
-                --queue.n_idle_threads;
-
-                // If it's already been instructed to cancel, cancel it.
-                if (job->cancel)
-                {
-                    job->state = background_job_state::CANCELED;
-                    queue.job_info.erase(&*job);
-                    continue;
-                }
+                data_proxy_->exited = true;
+                return;
             }
 
             {
@@ -184,46 +348,41 @@ struct background_execution_loop
                 data_proxy_->active_job = job;
             }
 
+            auto state = background_job_state::COMPLETED;
             try
             {
                 job->state = background_job_state::RUNNING;
                 background_job_check_in check_in(job);
                 background_job_progress_reporter reporter(job);
                 executor_.execute(check_in, reporter, *job->job);
-                job->state = background_job_state::COMPLETED;
             }
             catch (background_job_canceled&)
             {
+                state = background_job_state::CANCELED;
             }
-            catch (boost::exception&)
+            catch (boost::exception& e)
             {
-                // string msg = "(bjc) " + job->job->get_info().description
-                //              + string("\n") + string(e.what());
-                // record_failure(queue, job, msg, e.is_transient());
+                state = background_job_state::FAILED;
+                record_failure(
+                    queue, job, boost::diagnostic_information(e), false);
             }
             catch (std::bad_alloc&)
             {
-                // string msg = "(bj) " + job->job->get_info().description
-                //              + string("\n") + string(" out of memory");
-                // record_failure(queue, job, msg, true);
+                state = background_job_state::FAILED;
+                record_failure(queue, job, "out of memory", true);
             }
-            catch (std::exception&)
+            catch (std::exception& e)
             {
-                // string msg = "(bjs) " + job->job->get_info().description
-                //              + string("\n") + string(e.what());
-                // record_failure(queue, job, msg, false);
+                state = background_job_state::FAILED;
+                record_failure(queue, job, e.what(), false);
             }
             catch (...)
             {
-                // string msg = "(bj) " + job->job->get_info().description;
-                // record_failure(queue, job, msg, false);
+                state = background_job_state::FAILED;
+                record_failure(queue, job, "unknown error", false);
             }
 
-            {
-                std::scoped_lock<std::mutex> lock(queue.mutex);
-                queue.job_info.erase(&*job);
-                ++queue.version;
-            }
+            finish_background_job(queue, job, state);
 
             {
                 std::scoped_lock<std::mutex> lock(data_proxy_->mutex);
@@ -243,24 +402,50 @@ struct background_execution_loop
 struct background_execution_pool : noncopyable
 {
     std::shared_ptr<background_job_queue> queue;
+    // Once the pool is running, this is protected by the queue's mutex.
+    // (It can include threads that have exited but haven't been joined yet.)
     std::vector<std::shared_ptr<background_execution_thread>> threads;
     std::function<std::thread(
         std::shared_ptr<background_job_queue>,
         std::shared_ptr<background_thread_data_proxy>)>
         create_thread;
+    // If this is nonzero, the pool is elastic: threads are added whenever
+    // queued jobs outnumber idle threads, up to this limit.
+    size_t max_thread_count = 0;
+    // the number of threads that can be added beyond the pool's normal size
+    // (:max_thread_count for elastic pools and the initial thread count
+    // otherwise) to run jobs that skip the queue
+    size_t max_express_thread_count = 8;
+    // how the pool's threads are placed on the machine's CPUs
+    thread_affinity_policy affinity = thread_affinity_policy::UNPINNED;
 };
 
+// Add a thread to the pool.
+// Once the pool is running, this must be called with the queue's mutex held.
 void
 add_background_thread(background_execution_pool& pool);
 
+// Initialize a pool with a fixed number of threads.
+//
+// :affinity controls how the threads are placed on the machine's CPUs. (If
+// the machine's topology isn't available, the threads are left unpinned.)
+//
 template<class Executor, class CreateExecutor>
 void
 initialize_pool(
     background_execution_pool& pool,
     size_t initial_thread_count,
-    CreateExecutor create_executor)
+    CreateExecutor create_executor,
+    thread_affinity_policy affinity = thread_affinity_policy::UNPINNED)
 {
     pool.queue = std::make_shared<background_job_queue>();
+    pool.queue->pool = &pool;
+    pool.affinity = affinity;
+    // The pool can grow beyond its initial size to accommodate jobs that skip
+    // the queue, but those extra threads exit once they've been idle for a
+    // while.
+    pool.queue->min_thread_count = initial_thread_count;
+    pool.queue->idle_timeout = elastic_pool_config().idle_timeout;
     pool.create_thread
         = [create_executor](
               std::shared_ptr<background_job_queue> queue,
@@ -272,18 +457,59 @@ initialize_pool(
         add_background_thread(pool);
 }
 
+// Initialize an elastic pool, which starts out with the minimum number of
+// threads and grows and shrinks with demand.
+//
+// This is intended for pools whose jobs spend most of their time waiting
+// (e.g., on network requests), so more concurrency is generally better.
+//
+template<class Executor, class CreateExecutor>
+void
+initialize_elastic_pool(
+    background_execution_pool& pool,
+    elastic_pool_config const& config,
+    CreateExecutor create_executor,
+    thread_affinity_policy affinity = thread_affinity_policy::UNPINNED)
+{
+    initialize_pool<Executor>(
+        pool, 0, std::move(create_executor), affinity);
+    pool.max_thread_count = std::max(config.max_thread_count, size_t(1));
+    pool.queue->min_thread_count = config.min_thread_count;
+    pool.queue->idle_timeout = config.idle_timeout;
+    for (size_t i = 0; i != config.min_thread_count; ++i)
+        add_background_thread(pool);
+}
+
 void
 shut_down_pool(background_execution_pool& pool);
 
 bool
 is_pool_idle(background_execution_pool& pool);
 
+// Get a snapshot of the statistics that :pool has collected about its jobs.
+background_pool_telemetry
+get_pool_telemetry(background_execution_pool& pool);
+
+// Clear all the jobs in the pool, including those that are currently
+// executing. (Executing jobs are canceled.)
+void
+clear_all_jobs(background_execution_pool& pool);
+
 void
 clear_canceled_jobs(background_execution_pool& pool);
 
 // Add a background job to the given execution pool and take care of the
 // mechanics for ensuring that a thread gets woken up to handle it (or created,
-// depending on the flags).
+// depending on the flags and whether or not the pool is elastic).
+//
+// Jobs with the BACKGROUND_JOB_SKIP_QUEUE flag bypass the pool's normal
+// queues. They're picked up before any other jobs, and a thread is created
+// for them if there aren't enough idle threads to take all the jobs that are
+// skipping the queue, even if that takes the pool beyond its normal size.
+// (At most :max_express_thread_count threads are added this way, though.
+// Once that limit is reached, those jobs wait for a thread like any others.)
+//
+// If the pool is shutting down, the job is canceled instead.
 //
 void
 queue_background_job(
@@ -305,6 +531,17 @@ queue_background_job(
 // priority. Negative numbers are OK, and 0 is taken to be the default/neutral
 // priority.
 //
+// Queued jobs are started in order of decreasing priority, and jobs with
+// equal priority are started in the order in which they were queued. (With
+// multiple threads, this holds within each worker's queue and the pool's
+// shared queue, but stealing between workers can reorder jobs that were
+// queued on different threads.)
+//
+// Note that the original implementation's std::priority_queue compared
+// priorities with '>' and thus actually started the LOWEST priority first,
+// in no particular order among ties. Higher numbers now run first, as
+// documented above.
+//
 background_job_controller
 add_background_job(
     background_execution_pool& pool,
@@ -312,6 +549,21 @@ add_background_job(
     background_job_flag_set flags = NO_FLAGS,
     int priority = 0);
 
+// Add a job that depends on the results of other jobs (:inputs).
+//
+// The job isn't queued until all of its inputs have completed, so it doesn't
+// occupy a thread while it's waiting. If any of the inputs fails or is
+// canceled, the job is canceled as well (without being executed), and so on
+// down the chain of dependents. The inputs can belong to any pool.
+//
+background_job_controller
+add_background_job(
+    background_execution_pool& pool,
+    std::unique_ptr<background_job_interface> job,
+    std::vector<background_job_controller> const& inputs,
+    background_job_flag_set flags = NO_FLAGS,
+    int priority = 0);
+
 struct basic_executor
 {
     void
@@ -342,12 +594,6 @@ struct basic_executor
 //     std::shared_ptr<background_thread_data_proxy> data_proxy_;
 // };
 
-// void
-// record_failure(
-//     background_job_execution_data& job,
-//     char const* msg,
-//     bool transient_failure);
-
 } // namespace cradle
 
 #endif
@@ -26,113 +26,86 @@ void
 background_job_controller::cancel()
 {
     if (job_)
+    {
         job_->cancel = true;
+        // If the job is still waiting on its inputs, release it now so that
+        // the cancellation takes effect (and cascades) immediately.
+        if (!job_->released.exchange(true))
+            job_->release(job_);
+        detail::remove_canceled_job(job_);
+    }
+}
+void
+background_job_controller::set_priority(int priority)
+{
+    if (job_)
+    {
+        job_->priority = priority;
+        detail::reprioritize_job(job_);
+    }
 }
 
 namespace detail {
 
-// enum class background_job_queue_type
-// {
-//     // Calculation jobs are run in parallel according to the number of
-//     // available process cores.
-//     CALCULATION = 0,
-
-//     // Disk jobs are run with a much lower level of parallelism since it's
-//     // assumed that disk bandwidth is going to limit parallelism.
-//     DISK,
-
-//     // HTTP job are run with a very high level of parallelism.
-//     // (It would be essentially infinite, but we've determined that this can
-//     // cause issues with routers/ISPs getting upset when clients have too
-//     many
-//     // open connections.)
-//     HTTP,
-
-//     // Jobs in the following queues are long-lived network request jobs that
-//     // may run indefinitely but consume very little bandwidth, so they each
-//     get
-//     // their own thread.
-//     NOTIFICATION_WATCH,
-//     REMOTE_CALCULATION,
-
-//     // This is just here to capture the count of queue types.
-//     COUNT
-// };
-
-// Queue a background job to the requested queue within the background
-// execution system.
-// void
-// queue_background_job(
-//     background_execution_system& system,
-//     background_job_queue_type queue,
-//     background_job_ptr job_ptr)
-// {
-//     // switch (queue)
-//     // {
-//     //     case background_job_queue_type::CALCULATION:
-//     //         queue_background_job<background_job_execution_loop>(
-//     //             system.pools[int(queue)], std::move(job_ptr));
-//     //         break;
-//     //     case background_job_queue_type::DISK:
-//     //         queue_background_job<background_job_execution_loop>(
-//     //             system.pools[int(queue)], std::move(job_ptr));
-//     //         break;
-//     //     case background_job_queue_type::HTTP:
-//     //         queue_background_job<http_request_processing_loop>(
-//     //             system.pools[int(queue)], std::move(job_ptr));
-//     //         break;
-//     //     case background_job_queue_type::NOTIFICATION_WATCH:
-//     //         queue_background_job<http_request_processing_loop>(
-//     //             system.pools[int(queue)], std::move(job_ptr), true);
-//     //         break;
-//     //     case background_job_queue_type::REMOTE_CALCULATION:
-//     //         queue_background_job<http_request_processing_loop>(
-//     //             system.pools[int(queue)], std::move(job_ptr), true);
-//     //         break;
-//     //     case background_job_queue_type::COUNT: // To silence warnings.
-//     //         break;
-//     // }
-// }
+void
+add_job_inputs(
+    background_job_ptr const& job,
+    std::vector<background_job_controller> const& inputs)
+{
+    // The extra count keeps the job from being released while we're still
+    // adding its inputs.
+    job->released = false;
+    job->pending_input_count = inputs.size() + 1;
+    bool input_failed = false;
+    for (auto const& input : inputs)
+    {
+        if (input.is_valid())
+        {
+            auto& input_job = *input.job_;
+            std::scoped_lock<std::mutex> lock(input_job.dependents_mutex);
+            if (!input_job.finished)
+            {
+                input_job.dependents.push_back(job);
+                continue;
+            }
+            if (input_job.state != background_job_state::COMPLETED)
+                input_failed = true;
+        }
+        --job->pending_input_count;
+    }
+    if (input_failed)
+        job->cancel = true;
+    if ((--job->pending_input_count == 0 || job->cancel)
+        && !job->released.exchange(true))
+    {
+        job->release(job);
+    }
+}
 
-// void static
-// initialize_system(background_execution_system_impl& system)
-// {
-//     // Only enable full concurrency in release mode.
-//     // I've had issues with running inside the debugger with too many
-//     threads,
-//     // and it's just easier to see what's going on with less concurrency.
-//     // (The app even feels faster in debug mode with fewer threads.)
-//   #ifdef _DEBUG
-//     bool const full_concurrency = false;
-//   #else
-//     bool const full_concurrency = true;
-//   #endif
-//     // Initialize all the queues.
-//     initialize_pool<background_job_execution_loop>(
-//         system.pools[int(background_job_queue_type::CALCULATION)],
-//         full_concurrency ? boost::thread::hardware_concurrency() : 1);
-//     initialize_pool<web_request_processing_loop>(
-//         system.pools[int(background_job_queue_type::WEB_READ)],
-//         full_concurrency ? 16 : 1);
-//     initialize_pool<web_request_processing_loop>(
-//         system.pools[int(background_job_queue_type::WEB_WRITE)], 1);
-//     initialize_pool<web_request_processing_loop>(
-//         system.pools[int(background_job_queue_type::NOTIFICATION_WATCH)],
-//         1);
-//     initialize_pool<web_request_processing_loop>(
-//         system.pools[int(background_job_queue_type::REMOTE_CALCULATION)],
-//         1);
-//     initialize_pool<background_job_execution_loop>(
-//         system.pools[int(background_job_queue_type::DISK)],
-//         full_concurrency ? 2 : 1);
-//     // Invalidate the session data.
-//     system.authentication.status =
-//         background_authentication_status(
-//             background_authentication_state::NO_CREDENTIALS);
-//     system.context.status =
-//         background_context_request_status(
-//             background_context_request_state::NO_REQUEST);
-// }
+void
+finish_job_dependencies(background_job_ptr const& job)
+{
+    std::vector<background_job_ptr> dependents;
+    {
+        std::scoped_lock<std::mutex> lock(job->dependents_mutex);
+        job->finished = true;
+        dependents.swap(job->dependents);
+    }
+    bool succeeded = job->state == background_job_state::COMPLETED;
+    for (auto const& dependent : dependents)
+    {
+        // If this job didn't succeed, its dependents are released
+        // immediately so that the pool can cancel them (which in turn
+        // cascades to their dependents).
+        if (!succeeded)
+            dependent->cancel = true;
+        if ((--dependent->pending_input_count == 0 || !succeeded)
+            && !dependent->released.exchange(true))
+        {
+            dependent->release(dependent);
+        }
+    }
+}
 
 } // namespace detail
 
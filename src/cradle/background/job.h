@@ -2,6 +2,11 @@
 #define CRADLE_BACKGROUND_JOB_H
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
 
 #include <cradle/background/encoded_progress.h>
 #include <cradle/core.h>
@@ -55,11 +60,16 @@ CRADLE_DEFINE_FLAG_TYPE(background_job)
 // Don't include this job (by default) in reports about what jobs are running
 // in the system.
 CRADLE_DEFINE_FLAG(background_job, 0b01, BACKGROUND_JOB_HIDDEN)
-// Ensure that an idle thread exists to pick up the job.
-CRADLE_DEFINE_FLAG(background_job, 0b01, BACKGROUND_JOB_SKIP_QUEUE)
+// Run the job immediately, ahead of any other queued jobs. The pool ensures
+// that an idle thread exists to pick up the job (creating one if necessary).
+// This is intended for latency-critical jobs.
+CRADLE_DEFINE_FLAG(background_job, 0b10, BACKGROUND_JOB_SKIP_QUEUE)
 
 namespace detail {
 
+struct background_job_queue;
+struct background_worker_queue;
+
 struct background_job_execution_data : noncopyable
 {
     background_job_execution_data(
@@ -78,8 +88,9 @@ struct background_job_execution_data : noncopyable
     std::unique_ptr<background_job_interface> job;
 
     // the flags and priority level supplied by whoever created the job
+    // (The priority can be changed while the job is queued.)
     background_job_flag_set flags;
-    int priority;
+    std::atomic<int> priority;
 
     // the current state of the job
     std::atomic<background_job_state> state;
@@ -89,6 +100,48 @@ struct background_job_execution_data : noncopyable
     // cancellation flag - If this is set, the job will be canceled next time
     // it checks in.
     std::atomic<bool> cancel;
+
+    // when the job entered its pool's queue, started executing and reached
+    // its final state - These are recorded by the execution pool. The start
+    // and finish times are written before the corresponding changes in
+    // :state, so they're safe to read once those changes are visible.
+    std::chrono::steady_clock::time_point enqueue_time, start_time,
+        finish_time;
+
+    // Jobs can depend on the results of other jobs (their inputs), in which
+    // case they're held back until their inputs have completed. If any of
+    // them fails or is canceled, the job is canceled as well.
+
+    // the number of inputs that haven't completed yet (plus one while the
+    // job's dependencies are still being set up)
+    std::atomic<size_t> pending_input_count{0};
+    // Has the job been released into its execution pool? - This is set
+    // exactly once, either when all of the job's inputs complete or when the
+    // job is canceled.
+    std::atomic<bool> released{true};
+    // the function that releases the job into its execution pool
+    std::function<void(std::shared_ptr<background_job_execution_data> const&)>
+        release;
+
+    // protects :finished and :dependents
+    std::mutex dependents_mutex;
+    // Has the job reached a final state (COMPLETED, FAILED or CANCELED)?
+    bool finished = false;
+    // jobs that are waiting on this one
+    std::vector<std::shared_ptr<background_job_execution_data>> dependents;
+
+    // The rest of this is managed by the execution pool so that queued jobs
+    // can be found (and removed or reprioritized) without searching.
+
+    // the queue that the job belongs to
+    std::weak_ptr<background_job_queue> queue;
+    // the worker queue whose heap currently holds the job (if any)
+    std::atomic<background_worker_queue*> queued_in{nullptr};
+    // the job's sort key and its position within that heap - These are
+    // protected by the worker queue's mutex.
+    int queued_priority = 0;
+    uint64_t sequence = 0;
+    size_t heap_index = 0;
 };
 
 } // namespace detail
@@ -117,10 +170,16 @@ struct background_job_controller
         return job_ ? true : false;
     }
 
-    // Cancel the job.
+    // Cancel the job. (This also cancels any jobs that depend on it.)
+    // If the job is still queued, it's removed from the queue immediately.
     void
     cancel();
 
+    // Change the priority of the job.
+    // This only has an effect if the job hasn't started executing yet.
+    void
+    set_priority(int priority);
+
     background_job_state
     state() const;
 
@@ -132,6 +191,33 @@ struct background_job_controller
     background_job_ptr job_;
 };
 
+namespace detail {
+
+// Hold back :job until all of :inputs have completed. The job must have been
+// given a release function.
+void
+add_job_inputs(
+    background_job_ptr const& job,
+    std::vector<background_job_controller> const& inputs);
+
+// Record that :job has reached a final state (COMPLETED, FAILED or CANCELED)
+// and release or cancel its dependents accordingly. This is called by the
+// execution pools.
+void
+finish_job_dependencies(background_job_ptr const& job);
+
+// If :job is sitting in an execution pool's queue, remove it and record it
+// as canceled. (This is implemented by the execution pool.)
+void
+remove_canceled_job(background_job_ptr const& job);
+
+// If :job is sitting in an execution pool's queue, update its position to
+// reflect its current priority. (This is implemented by the execution pool.)
+void
+reprioritize_job(background_job_ptr const& job);
+
+} // namespace detail
+
 } // namespace cradle
 
 #endif
@@ -1,5 +1,15 @@
 #include <cradle/background/os.h>
 
+#include <algorithm>
+#include <sstream>
+#include <tuple>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include <cradle/fs/file_io.h>
+#include <cradle/utilities/text.h>
+
 // LOWER_THREAD_PRIORITY
 
 #ifdef WIN32
@@ -30,3 +40,245 @@ lower_thread_priority(std::thread&)
 } // namespace cradle
 
 #endif
+
+// CPU TOPOLOGY
+
+namespace cradle {
+
+namespace {
+
+// Read a file from the topology directory that should contain a single
+// integer. (Some virtual machines report -1 for unknown values, so those
+// are treated as 0.)
+unsigned
+read_topology_value(file_path const& path)
+{
+    auto contents = read_file_contents(path);
+    boost::algorithm::trim(contents);
+    return unsigned(std::max(lexical_cast<int>(contents), 0));
+}
+
+// Get the NUMA node of the CPU whose directory is :cpu_dir.
+// On NUMA systems, this shows up as a "nodeN" link in the directory.
+unsigned
+read_numa_node(file_path const& cpu_dir)
+{
+    for (auto const& entry : std::filesystem::directory_iterator(cpu_dir))
+    {
+        auto name = entry.path().filename().string();
+        if (boost::algorithm::starts_with(name, "node") && name.size() > 4
+            && std::all_of(name.begin() + 4, name.end(), [](char c) {
+                   return c >= '0' && c <= '9';
+               }))
+        {
+            return lexical_cast<unsigned>(name.substr(4));
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+std::vector<unsigned>
+parse_cpu_list(string const& list)
+{
+    std::vector<unsigned> cpus;
+    std::istringstream stream(list);
+    string range;
+    while (std::getline(stream, range, ','))
+    {
+        boost::algorithm::trim(range);
+        if (range.empty())
+            continue;
+        auto dash = range.find('-');
+        if (dash == string::npos)
+        {
+            cpus.push_back(lexical_cast<unsigned>(range));
+        }
+        else
+        {
+            auto first = lexical_cast<unsigned>(range.substr(0, dash));
+            auto last = lexical_cast<unsigned>(range.substr(dash + 1));
+            for (auto cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+optional<cpu_topology>
+read_cpu_topology(file_path const& cpu_dir)
+{
+    try
+    {
+        auto online = read_file_contents(cpu_dir / "online");
+        boost::algorithm::trim(online);
+        cpu_topology topology;
+        for (auto id : parse_cpu_list(online))
+        {
+            auto dir = cpu_dir / ("cpu" + std::to_string(id));
+            logical_cpu cpu;
+            cpu.id = id;
+            auto topology_dir = dir / "topology";
+            cpu.package
+                = read_topology_value(topology_dir / "physical_package_id");
+            cpu.core = read_topology_value(topology_dir / "core_id");
+            cpu.numa_node = read_numa_node(dir);
+            topology.cpus.push_back(cpu);
+        }
+        if (topology.cpus.empty())
+            return none;
+        std::sort(
+            topology.cpus.begin(),
+            topology.cpus.end(),
+            [](logical_cpu const& a, logical_cpu const& b) {
+                return a.id < b.id;
+            });
+        return topology;
+    }
+    catch (...)
+    {
+        return none;
+    }
+}
+
+std::vector<unsigned>
+get_thread_cpu_set(
+    cpu_topology const& topology,
+    thread_affinity_policy policy,
+    size_t index)
+{
+    std::vector<unsigned> cpus;
+    switch (policy)
+    {
+        case thread_affinity_policy::UNPINNED:
+            break;
+        case thread_affinity_policy::PER_CORE: {
+            // Order the cores by NUMA node (and then by package and core ID)
+            // and pick one. Each core's CPUs are adjacent in this order.
+            auto ordered = topology.cpus;
+            std::stable_sort(
+                ordered.begin(),
+                ordered.end(),
+                [](logical_cpu const& a, logical_cpu const& b) {
+                    return std::tie(a.numa_node, a.package, a.core)
+                           < std::tie(b.numa_node, b.package, b.core);
+                });
+            std::vector<std::vector<unsigned>> cores;
+            for (size_t i = 0; i != ordered.size(); ++i)
+            {
+                if (i == 0 || ordered[i].package != ordered[i - 1].package
+                    || ordered[i].core != ordered[i - 1].core)
+                {
+                    cores.emplace_back();
+                }
+                cores.back().push_back(ordered[i].id);
+            }
+            cpus = cores[index % cores.size()];
+            break;
+        }
+        case thread_affinity_policy::PER_NUMA_NODE: {
+            std::vector<unsigned> nodes;
+            for (auto const& cpu : topology.cpus)
+                nodes.push_back(cpu.numa_node);
+            std::sort(nodes.begin(), nodes.end());
+            nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+            auto node = nodes[index % nodes.size()];
+            for (auto const& cpu : topology.cpus)
+            {
+                if (cpu.numa_node == node)
+                    cpus.push_back(cpu.id);
+            }
+            break;
+        }
+    }
+    return cpus;
+}
+
+} // namespace cradle
+
+// THREAD AFFINITY
+
+#if defined(WIN32)
+
+namespace cradle {
+
+optional<cpu_topology> const&
+get_cpu_topology()
+{
+    static optional<cpu_topology> const topology;
+    return topology;
+}
+
+bool
+set_thread_affinity(std::thread& thread, std::vector<unsigned> const& cpus)
+{
+    DWORD_PTR mask = 0;
+    for (auto cpu : cpus)
+    {
+        if (cpu >= sizeof(DWORD_PTR) * 8)
+            return false;
+        mask |= DWORD_PTR(1) << cpu;
+    }
+    if (mask == 0)
+        return false;
+    return SetThreadAffinityMask(thread.native_handle(), mask) != 0;
+}
+
+} // namespace cradle
+
+#elif defined(__linux__)
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace cradle {
+
+optional<cpu_topology> const&
+get_cpu_topology()
+{
+    static optional<cpu_topology> const topology
+        = read_cpu_topology("/sys/devices/system/cpu");
+    return topology;
+}
+
+bool
+set_thread_affinity(std::thread& thread, std::vector<unsigned> const& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus)
+    {
+        if (cpu >= CPU_SETSIZE)
+            return false;
+        CPU_SET(cpu, &set);
+    }
+    if (CPU_COUNT(&set) == 0)
+        return false;
+    return pthread_setaffinity_np(
+               thread.native_handle(), sizeof(cpu_set_t), &set)
+           == 0;
+}
+
+} // namespace cradle
+
+#else
+
+namespace cradle {
+
+optional<cpu_topology> const&
+get_cpu_topology()
+{
+    static optional<cpu_topology> const topology;
+    return topology;
+}
+
+bool
+set_thread_affinity(std::thread&, std::vector<unsigned> const&)
+{
+    return false;
+}
+
+} // namespace cradle
+
+#endif
@@ -2,6 +2,9 @@
 #define CRADLE_BACKGROUND_OS_HPP
 
 #include <thread>
+#include <vector>
+
+#include <cradle/fs/types.hpp>
 
 // This file defines some thread-related functions that are still require
 // OS-specific implementations at this point.
@@ -12,6 +15,66 @@ namespace cradle {
 void
 lower_thread_priority(std::thread& thread);
 
+// a logical CPU (i.e., a hardware thread) and its place in the machine
+struct logical_cpu
+{
+    // the OS's ID for the CPU
+    unsigned id = 0;
+    // the physical package (socket) that it's in
+    unsigned package = 0;
+    // the ID of its core within that package
+    unsigned core = 0;
+    // the NUMA node that it belongs to
+    unsigned numa_node = 0;
+};
+
+struct cpu_topology
+{
+    // the online CPUs, sorted by ID
+    std::vector<logical_cpu> cpus;
+};
+
+// Parse a list of CPUs in the format that Linux uses (e.g., "0-3,8,10-11").
+std::vector<unsigned>
+parse_cpu_list(string const& list);
+
+// Read the CPU topology from a directory laid out like Linux's
+// /sys/devices/system/cpu. The result is none if it can't be read.
+optional<cpu_topology>
+read_cpu_topology(file_path const& cpu_dir);
+
+// Get the CPU topology of this machine. (It's only read once.)
+// The result is none if it's not available on this OS.
+optional<cpu_topology> const&
+get_cpu_topology();
+
+// the policies for placing the threads of a pool on the machine's CPUs
+enum class thread_affinity_policy
+{
+    // Let the OS schedule threads wherever it likes.
+    UNPINNED,
+    // Pin each thread to a single physical core (including any hyperthreads
+    // on that core). Threads are assigned to cores in order, so cores on the
+    // same NUMA node are filled together.
+    PER_CORE,
+    // Pin each thread to a NUMA node (i.e., all of the CPUs in it). Threads
+    // are distributed across the nodes round robin.
+    PER_NUMA_NODE
+};
+
+// Get the CPUs that the :index'th thread of a pool should be pinned to under
+// :policy. An empty result means that the thread shouldn't be pinned.
+std::vector<unsigned>
+get_thread_cpu_set(
+    cpu_topology const& topology,
+    thread_affinity_policy policy,
+    size_t index);
+
+// Restrict :thread to running on :cpus.
+// The return value is false if this isn't supported or fails.
+bool
+set_thread_affinity(std::thread& thread, std::vector<unsigned> const& cpus);
+
 } // namespace cradle
 
 #endif
@@ -1,13 +1,275 @@
 #include <cradle/background/requests.h>
 
+#include <algorithm>
+#include <mutex>
+
+#include <cradle/background/execution_pool.h>
+#include <cradle/caching/immutable/consumption.h>
+#include <cradle/caching/immutable/internals.h>
+#include <cradle/caching/immutable/production.h>
+
 namespace cradle {
 
 namespace detail {
 
 struct request_resolution_system
 {
+    cradle::immutable_cache* cache;
+    background_execution_pool pool;
+};
+
+} // namespace detail
+
+request_resolution_system::request_resolution_system(
+    immutable_cache& cache, size_t thread_count)
+    : impl_(new detail::request_resolution_system)
+{
+    impl_->cache = &cache;
+    detail::initialize_pool<detail::basic_executor>(
+        impl_->pool, std::max(thread_count, size_t(1)), [] {
+            return detail::basic_executor();
+        });
+}
+
+request_resolution_system::~request_resolution_system()
+{
+    detail::shut_down_pool(impl_->pool);
+}
+
+namespace detail {
+
+namespace {
+
+// request_resolution_watcher watches a cache entry on behalf of a single
+// resolution and delivers the result to that resolution's callbacks.
+//
+// While the resolution is pending, the watcher keeps itself (and its handle
+// on the cache entry) alive. These references are dropped once the result is
+// delivered.
+struct request_resolution_watcher : immutable_cache_entry_watcher
+{
+    request_resolution_watcher(
+        untyped_value_callback value_callback,
+        request_failure_callback failure_callback)
+        : value_callback(std::move(value_callback)),
+          failure_callback(std::move(failure_callback))
+    {
+    }
+
+    void
+    on_ready(untyped_immutable value) override
+    {
+        if (this->finish())
+            value_callback(std::move(value));
+    }
+
+    void
+    on_failure() override
+    {
+        this->fail(std::make_exception_ptr(request_resolution_failure()));
+    }
+
+    void
+    fail(std::exception_ptr error)
+    {
+        if (this->finish())
+            failure_callback(std::move(error));
+    }
+
+    // Keep this watcher and :handle alive until a result is delivered.
+    // If a result has already been delivered, this does nothing.
+    void
+    retain(
+        std::shared_ptr<request_resolution_watcher> self,
+        immutable_cache_entry_handle handle)
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        if (!done)
+        {
+            this->self = std::move(self);
+            this->handle = std::move(handle);
+        }
+    }
+
+    // Mark the resolution as done.
+    // The return value is true iff this call is the one that did so, in which
+    // case the caller is responsible for delivering the result.
+    bool
+    finish()
+    {
+        std::shared_ptr<request_resolution_watcher> released_self;
+        immutable_cache_entry_handle released_handle;
+        {
+            std::scoped_lock<std::mutex> lock(mutex);
+            if (done)
+                return false;
+            done = true;
+            released_self = std::move(self);
+            released_handle = std::move(handle);
+        }
+        // The references are released here, outside the mutex. (The caller
+        // of on_ready()/on_failure() holds its own reference to the watcher,
+        // so this doesn't destroy it.)
+        return true;
+    }
+
+    bool
+    is_done()
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        return done;
+    }
+
+    untyped_value_callback value_callback;
+    request_failure_callback failure_callback;
+
+    std::mutex mutex;
+    bool done = false;
+    std::shared_ptr<request_resolution_watcher> self;
+    immutable_cache_entry_handle handle;
 };
 
+} // namespace
+
+void
+resolve_memoized(
+    cradle::request_resolution_system& system,
+    id_interface const& key,
+    function_view<void(
+        untyped_value_callback on_value,
+        request_failure_callback on_failure)> const& compute,
+    untyped_value_callback on_value,
+    request_failure_callback on_failure)
+{
+    auto& cache = *system.impl_->cache;
+
+    auto watcher = std::make_shared<request_resolution_watcher>(
+        std::move(on_value), std::move(on_failure));
+
+    bool is_producer = false;
+    immutable_cache_entry_handle handle(
+        cache,
+        key,
+        [&] {
+            is_producer = true;
+            return background_job_controller();
+        },
+        watcher);
+
+    auto* record = handle.record();
+    if (!is_producer)
+    {
+        std::unique_lock<std::mutex> lock(record->stripe->mutex);
+        switch (record->state.load(std::memory_order_relaxed))
+        {
+            case immutable_cache_entry_state::READY: {
+                auto data = record->data;
+                lock.unlock();
+                watcher->on_ready(std::move(data));
+                return;
+            }
+            case immutable_cache_entry_state::LOADING:
+                // Someone else is producing the value, so the watcher will
+                // receive it when it's ready.
+                lock.unlock();
+                watcher->retain(watcher, std::move(handle));
+                return;
+            case immutable_cache_entry_state::FAILED:
+                // A previous attempt failed, so try it again (unless the
+                // watcher already heard about the failure, in which case
+                // it's already been reported to our caller). The entry goes
+                // back to LOADING before the lock is released so that any
+                // other resolutions that come along in the meantime wait on
+                // this attempt rather than starting their own.
+                if (watcher->is_done())
+                    return;
+                record->state.store(
+                    immutable_cache_entry_state::LOADING,
+                    std::memory_order_relaxed);
+                lock.unlock();
+                break;
+        }
+    }
+
+    watcher->retain(watcher, handle);
+
+    // The watcher is notified of the value through the cache. However, if
+    // the computation fails, the producer gets the original error, so that's
+    // delivered before the failure is reported to the cache.
+    captured_id captured_key(key);
+    compute(
+        [&cache, captured_key](untyped_immutable value) {
+            set_immutable_cache_data(cache, *captured_key, std::move(value));
+        },
+        [&cache, captured_key, watcher](std::exception_ptr error) {
+            watcher->fail(std::move(error));
+            report_immutable_cache_loading_failure(cache, *captured_key);
+        });
+}
+
+background_job_controller
+add_request_job(
+    cradle::request_resolution_system& system,
+    std::unique_ptr<background_job_interface> job)
+{
+    return add_background_job(
+        system.impl_->pool, std::move(job), NO_FLAGS, 0);
+}
+
+bool
+composite_id::equals(id_interface const& other) const
+{
+    auto const& other_id = static_cast<composite_id const&>(other);
+    if (components_.size() != other_id.components_.size())
+        return false;
+    for (size_t i = 0; i != components_.size(); ++i)
+    {
+        if (*components_[i] != *other_id.components_[i])
+            return false;
+    }
+    return true;
+}
+
+bool
+composite_id::less_than(id_interface const& other) const
+{
+    auto const& other_id = static_cast<composite_id const&>(other);
+    if (components_.size() != other_id.components_.size())
+        return components_.size() < other_id.components_.size();
+    for (size_t i = 0; i != components_.size(); ++i)
+    {
+        if (*components_[i] < *other_id.components_[i])
+            return true;
+        if (*other_id.components_[i] < *components_[i])
+            return false;
+    }
+    return false;
+}
+
+void
+composite_id::stream(std::ostream& o) const
+{
+    o << "(";
+    for (size_t i = 0; i != components_.size(); ++i)
+    {
+        if (i != 0)
+            o << ",";
+        o << *components_[i];
+    }
+    o << ")";
+}
+
+size_t
+composite_id::hash() const
+{
+    // Unlike id_pair, the order of the components matters here, so they
+    // can't simply be XORed together.
+    size_t h = components_.size();
+    for (auto const& component : components_)
+        h ^= (*component).hash() + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+}
+
 } // namespace detail
 
 } // namespace cradle
@@ -1,13 +1,41 @@
 #ifndef CRADLE_BACKGROUND_REQUESTS_H
 #define CRADLE_BACKGROUND_REQUESTS_H
 
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
 #include <memory>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
 
-#include <cradle/core/id.h>
+#include <cradle/background/execution_pool.h>
+#include <cradle/background/job.h>
+#include <cradle/caching/immutable/cache.hpp>
+#include <cradle/utilities/errors.h>
 #include <cradle/utilities/functional.h>
 
+// Requests describe values that are to be computed. They can be composed
+// into graphs (e.g., the result of applying a function to the results of
+// other requests) and then resolved asynchronously by a
+// request_resolution_system.
+//
+// Every request has a value ID that identifies the value that it produces.
+// Results are memoized in an immutable cache under that ID, so resolving a
+// request whose value is already cached (or is currently being computed on
+// behalf of someone else) doesn't repeat the work. Since subrequests are
+// resolved through the same system, this also deduplicates subrequests that
+// are shared within (or across) request graphs.
+
 namespace cradle {
 
+struct request_resolution_system;
+
 struct untyped_request_interface
 {
     virtual bool
@@ -17,11 +45,32 @@ struct untyped_request_interface
     value_id() const = 0;
 };
 
+typedef std::function<void(std::exception_ptr error)>
+    request_failure_callback;
+
 template<class Value>
 struct request_interface : untyped_request_interface
 {
+    typedef Value value_type;
+
+    // If the request is resolved, this passes its value to :callback.
     virtual void
     dispatch(function_view<void(Value value)> callback) const = 0;
+
+    // Compute the value of the request, eventually invoking exactly one of
+    // :on_value or :on_failure (possibly from another thread, possibly
+    // before this returns). Any subrequests should be resolved through
+    // :system.
+    //
+    // This is only invoked when the value isn't already available in the
+    // system's cache. Since the callbacks may be invoked after this returns,
+    // implementations must copy anything that they need from the request.
+    //
+    virtual void
+    compute(
+        request_resolution_system& system,
+        std::function<void(Value value)> on_value,
+        request_failure_callback on_failure) const = 0;
 };
 
 template<class T>
@@ -31,20 +80,294 @@ namespace detail {
 
 struct request_resolution_system;
 
-}
+} // namespace detail
 
-struct request_resolution_system
+struct request_resolution_system : noncopyable
 {
+    // Create a system that memoizes results in :cache and executes
+    // asynchronous requests on :thread_count background threads.
+    request_resolution_system(
+        immutable_cache& cache,
+        size_t thread_count = std::thread::hardware_concurrency());
+
     ~request_resolution_system();
 
     std::unique_ptr<detail::request_resolution_system> impl_;
 };
 
+// This is the error that's reported to a resolution that was waiting on
+// another resolution of the same request when that other resolution failed.
+// (The original error is only reported to the resolution that actually
+// performed the computation.)
+CRADLE_DEFINE_EXCEPTION(request_resolution_failure)
+
+namespace detail {
+
+typedef std::function<void(untyped_immutable value)> untyped_value_callback;
+
+// Resolve the value identified by :key. If the value is already cached, it's
+// passed directly to :on_value. If another resolution is already computing
+// it, this waits for that result. Otherwise, :compute is invoked with
+// callbacks that store the result in the cache (and then pass it along to
+// :on_value or :on_failure).
+void
+resolve_memoized(
+    cradle::request_resolution_system& system,
+    id_interface const& key,
+    function_view<void(
+        untyped_value_callback on_value,
+        request_failure_callback on_failure)> const& compute,
+    untyped_value_callback on_value,
+    request_failure_callback on_failure);
+
+// Execute :job on the system's background threads.
+background_job_controller
+add_request_job(
+    cradle::request_resolution_system& system,
+    std::unique_ptr<background_job_interface> job);
+
+// composite_id identifies a value by a list of component IDs (e.g., a
+// function and its arguments).
+struct composite_id : id_interface
+{
+    composite_id()
+    {
+    }
+
+    composite_id(std::vector<captured_id> components)
+        : components_(std::move(components))
+    {
+    }
+
+    id_interface*
+    clone() const override
+    {
+        return new composite_id(components_);
+    }
+
+    bool
+    equals(id_interface const& other) const override;
+
+    bool
+    less_than(id_interface const& other) const override;
+
+    void
+    deep_copy(id_interface* copy) const override
+    {
+        static_cast<composite_id*>(copy)->components_ = components_;
+    }
+
+    void
+    stream(std::ostream& o) const override;
+
+    size_t
+    hash() const override;
+
+ private:
+    std::vector<captured_id> components_;
+};
+
+// Get an ID that identifies :function for memoization purposes.
+// Function pointers are identified by address. Other function objects must
+// be stateless (e.g., lambdas without captures), and they're identified by
+// their type.
+template<class Function>
+captured_id
+get_function_id(Function const& function)
+{
+    if constexpr (std::is_pointer_v<Function>)
+    {
+        return captured_id(
+            make_id(reinterpret_cast<std::uintptr_t>(function)));
+    }
+    else
+    {
+        static_assert(
+            std::is_empty_v<Function>,
+            "functions in requests must be stateless");
+        return captured_id(make_id(string(typeid(Function).name())));
+    }
+}
+
+// Create the value ID for the result of applying :function to :args.
+template<class Function, class... Args>
+composite_id
+make_application_id(Function const& function, Args const&... args)
+{
+    return composite_id(std::vector<captured_id>{
+        get_function_id(function), captured_id(args.value_id())...});
+}
+
+} // namespace detail
+
+// Resolve :request through :system, eventually invoking exactly one of
+// :on_value or :on_failure (possibly from another thread, possibly before
+// this returns).
+template<class Value>
+void
+resolve_request(
+    request_resolution_system& system,
+    request_interface<Value> const& request,
+    std::function<void(Value value)> on_value,
+    request_failure_callback on_failure)
+{
+    if (request.is_resolved())
+    {
+        request.dispatch(on_value);
+        return;
+    }
+    detail::resolve_memoized(
+        system,
+        request.value_id(),
+        [&](detail::untyped_value_callback on_untyped_value,
+            request_failure_callback on_computation_failure) {
+            request.compute(
+                system,
+                [on_untyped_value](Value value) {
+                    on_untyped_value(swap_in_and_erase_type(value));
+                },
+                std::move(on_computation_failure));
+        },
+        [on_value](untyped_immutable value) {
+            on_value(*cast_immutable<Value>(value));
+        },
+        std::move(on_failure));
+}
+
+// Resolve :request through :system and get a future for the result.
+template<class Value>
+std::future<Value>
+resolve_request(
+    request_resolution_system& system, request_interface<Value> const& request)
+{
+    auto promise = std::make_shared<std::promise<Value>>();
+    auto future = promise->get_future();
+    resolve_request(
+        system,
+        request,
+        std::function<void(Value)>(
+            [promise](Value value) { promise->set_value(std::move(value)); }),
+        [promise](std::exception_ptr error) {
+            promise->set_exception(std::move(error));
+        });
+    return future;
+}
+
+namespace detail {
+
+template<size_t... Indices>
+auto
+make_index_tuple(std::index_sequence<Indices...>)
+{
+    return std::make_tuple(std::integral_constant<size_t, Indices>()...);
+}
+
+// Resolve all the requests in :args and pass their values to :on_values.
+// If any of them fails, the first failure is passed to :on_failure instead.
+template<class... Args, class OnValues>
+void
+resolve_args(
+    cradle::request_resolution_system& system,
+    std::tuple<Args...> const& args,
+    OnValues on_values,
+    request_failure_callback on_failure)
+{
+    if constexpr (sizeof...(Args) == 0)
+    {
+        on_values(std::tuple<>());
+    }
+    else
+    {
+        struct resolution_state
+        {
+            std::tuple<optional<typename Args::value_type>...> values;
+            std::atomic<size_t> remaining{sizeof...(Args)};
+            std::atomic<bool> failed{false};
+            std::function<void(std::tuple<typename Args::value_type...>)>
+                on_values;
+            request_failure_callback on_failure;
+
+            void
+            finish_one()
+            {
+                if (--remaining == 0 && !failed)
+                {
+                    on_values(std::apply(
+                        [](auto&... values) {
+                            return std::make_tuple(std::move(*values)...);
+                        },
+                        this->values));
+                }
+            }
+
+            void
+            fail(std::exception_ptr error)
+            {
+                if (!failed.exchange(true))
+                    on_failure(std::move(error));
+            }
+        };
+        auto state = std::make_shared<resolution_state>();
+        state->on_values = std::move(on_values);
+        state->on_failure = std::move(on_failure);
+        auto resolve_arg = [&](auto index) {
+            auto const& arg = std::get<decltype(index)::value>(args);
+            typedef typename std::remove_reference_t<decltype(arg)>::value_type
+                arg_value_type;
+            resolve_request(
+                system,
+                arg,
+                std::function<void(arg_value_type)>(
+                    [state](arg_value_type value) {
+                        std::get<decltype(index)::value>(state->values)
+                            = std::move(value);
+                        state->finish_one();
+                    }),
+                [state](std::exception_ptr error) {
+                    state->fail(std::move(error));
+                });
+        };
+        std::apply(
+            [&](auto... indices) { (resolve_arg(indices), ...); },
+            make_index_tuple(std::index_sequence_for<Args...>()));
+    }
+}
+
+} // namespace detail
+
 template<class Value>
 struct value_request : request_interface<Value>
 {
-    value_request(Value value) : value_(std::move(value))
+    // The ID refers to this request's own copy of the value, so it's built
+    // once here (rather than on demand, which would race when the request is
+    // resolved concurrently), and copies rebind it to their own values.
+    value_request(Value value)
+        : value_(std::move(value)), id_(make_id_by_reference(value_))
+    {
+    }
+
+    value_request(value_request const& other)
+        : value_(other.value_), id_(make_id_by_reference(value_))
+    {
+    }
+
+    value_request(value_request&& other)
+        : value_(std::move(other.value_)), id_(make_id_by_reference(value_))
+    {
+    }
+
+    value_request&
+    operator=(value_request const& other)
     {
+        value_ = other.value_;
+        return *this;
+    }
+
+    value_request&
+    operator=(value_request&& other)
+    {
+        value_ = std::move(other.value_);
+        return *this;
     }
 
     bool
@@ -56,7 +379,6 @@ struct value_request : request_interface<Value>
     id_interface const&
     value_id() const override
     {
-        id_ = make_id_by_reference(value_);
         return id_;
     }
 
@@ -66,9 +388,235 @@ struct value_request : request_interface<Value>
         callback(value_);
     }
 
+    void
+    compute(
+        request_resolution_system& system,
+        std::function<void(Value value)> on_value,
+        request_failure_callback on_failure) const override
+    {
+        on_value(value_);
+    }
+
  private:
     Value value_;
-    simple_id_by_reference<Value> mutable id_;
+    simple_id_by_reference<Value> id_;
+};
+
+// apply_request represents the result of applying a function to the results
+// of other requests. The function is invoked in whichever thread delivers the
+// last of its arguments, so it should be fairly cheap. (Use async_request for
+// more substantial work.)
+template<class Function, class... Args>
+struct apply_request : request_interface<std::invoke_result_t<
+                           Function,
+                           typename Args::value_type...>>
+{
+    typedef std::invoke_result_t<Function, typename Args::value_type...>
+        value_type;
+
+    apply_request(Function function, Args... args)
+        : id_(detail::make_application_id(function, args...)),
+          function_(std::move(function)),
+          args_(std::move(args)...)
+    {
+    }
+
+    bool
+    is_resolved() const override
+    {
+        return false;
+    }
+
+    id_interface const&
+    value_id() const override
+    {
+        return id_;
+    }
+
+    void
+    dispatch(function_view<void(value_type value)> callback) const override
+    {
+        CRADLE_THROW(
+            internal_check_failed() << internal_error_message_info(
+                "dispatch() called on an unresolved request"));
+    }
+
+    void
+    compute(
+        request_resolution_system& system,
+        std::function<void(value_type value)> on_value,
+        request_failure_callback on_failure) const override
+    {
+        detail::resolve_args(
+            system,
+            args_,
+            [function = function_, on_value, on_failure](
+                std::tuple<typename Args::value_type...> values) {
+                try
+                {
+                    on_value(std::apply(function, std::move(values)));
+                }
+                catch (...)
+                {
+                    on_failure(std::current_exception());
+                }
+            },
+            on_failure);
+    }
+
+ private:
+    detail::composite_id id_;
+    Function function_;
+    std::tuple<Args...> args_;
+};
+
+namespace detail {
+
+template<class Value, class Function, class... ArgValues>
+struct async_request_job : background_job_interface
+{
+    async_request_job(
+        Function function,
+        std::tuple<ArgValues...> args,
+        std::function<void(Value value)> on_value,
+        request_failure_callback on_failure)
+        : function_(std::move(function)),
+          args_(std::move(args)),
+          on_value_(std::move(on_value)),
+          on_failure_(std::move(on_failure))
+    {
+    }
+
+    // If the job is discarded without ever being executed (e.g., because it
+    // was canceled or its queue was cleared), the failure is reported here,
+    // since otherwise anyone waiting on the result would wait forever.
+    ~async_request_job()
+    {
+        if (!reported_)
+        {
+            try
+            {
+                on_failure_(
+                    std::make_exception_ptr(background_job_canceled()));
+            }
+            catch (...)
+            {
+            }
+        }
+    }
+
+    void
+    execute(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter) override
+    {
+        optional<Value> result;
+        try
+        {
+            result = std::apply(
+                [&](auto&&... args) {
+                    return function_(
+                        check_in, reporter, std::move(args)...);
+                },
+                std::move(args_));
+        }
+        catch (background_job_canceled&)
+        {
+            reported_ = true;
+            on_failure_(std::current_exception());
+            throw;
+        }
+        catch (...)
+        {
+            reported_ = true;
+            on_failure_(std::current_exception());
+            return;
+        }
+        reported_ = true;
+        on_value_(std::move(*result));
+    }
+
+ private:
+    Function function_;
+    std::tuple<ArgValues...> args_;
+    std::function<void(Value value)> on_value_;
+    request_failure_callback on_failure_;
+    // Has the outcome been reported through one of the callbacks?
+    bool reported_ = false;
+};
+
+} // namespace detail
+
+// async_request is like apply_request, but the function is executed as a
+// job on the system's background threads, and it's passed a check-in
+// interface and a progress reporter (before the argument values).
+template<class Function, class... Args>
+struct async_request : request_interface<std::invoke_result_t<
+                           Function,
+                           check_in_interface&,
+                           progress_reporter_interface&,
+                           typename Args::value_type...>>
+{
+    typedef std::invoke_result_t<
+        Function,
+        check_in_interface&,
+        progress_reporter_interface&,
+        typename Args::value_type...>
+        value_type;
+
+    async_request(Function function, Args... args)
+        : id_(detail::make_application_id(function, args...)),
+          function_(std::move(function)),
+          args_(std::move(args)...)
+    {
+    }
+
+    bool
+    is_resolved() const override
+    {
+        return false;
+    }
+
+    id_interface const&
+    value_id() const override
+    {
+        return id_;
+    }
+
+    void
+    dispatch(function_view<void(value_type value)> callback) const override
+    {
+        CRADLE_THROW(
+            internal_check_failed() << internal_error_message_info(
+                "dispatch() called on an unresolved request"));
+    }
+
+    void
+    compute(
+        request_resolution_system& system,
+        std::function<void(value_type value)> on_value,
+        request_failure_callback on_failure) const override
+    {
+        detail::resolve_args(
+            system,
+            args_,
+            [&system, function = function_, on_value, on_failure](
+                std::tuple<typename Args::value_type...> values) {
+                detail::add_request_job(
+                    system,
+                    std::make_unique<detail::async_request_job<
+                        value_type,
+                        Function,
+                        typename Args::value_type...>>(
+                        function, std::move(values), on_value, on_failure));
+            },
+            on_failure);
+    }
+
+ private:
+    detail::composite_id id_;
+    Function function_;
+    std::tuple<Args...> args_;
 };
 
 namespace rq {
@@ -80,6 +628,25 @@ value(Value value)
     return value_request<Value>(std::move(value));
 }
 
+// Request the result of applying :function to the results of :args.
+template<class Function, class... Args>
+apply_request<Function, Args...>
+apply(Function function, Args... args)
+{
+    return apply_request<Function, Args...>(
+        std::move(function), std::move(args)...);
+}
+
+// Request the result of executing :function as a background job on the
+// results of :args.
+template<class Function, class... Args>
+async_request<Function, Args...>
+async(Function function, Args... args)
+{
+    return async_request<Function, Args...>(
+        std::move(function), std::move(args)...);
+}
+
 } // namespace rq
 
 } // namespace cradle
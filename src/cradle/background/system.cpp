@@ -0,0 +1,203 @@
+#include <cradle/background/system.h>
+
+#include <algorithm>
+
+#include <cradle/background/execution_pool.h>
+#include <cradle/fs/disk_executor.h>
+#include <cradle/io/http_executor.h>
+
+namespace cradle {
+
+namespace detail {
+
+struct background_execution_system
+{
+    background_execution_pool pools[size_t(background_job_queue_type::COUNT)];
+};
+
+namespace {
+
+background_execution_pool&
+get_pool(
+    cradle::background_execution_system& system,
+    background_job_queue_type queue)
+{
+    return system.impl_->pools[size_t(queue)];
+}
+
+background_execution_pool_status
+get_pool_status(background_execution_pool& pool)
+{
+    background_execution_pool_status status;
+    auto& queue = *pool.queue;
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::scoped_lock<std::mutex> lock(queue.mutex);
+        for (auto const& thread : pool.threads)
+        {
+            std::scoped_lock<std::mutex> lock(thread->data_proxy->mutex);
+            auto const& job = thread->data_proxy->active_job;
+            if (job)
+            {
+                status.running_jobs.push_back(background_running_job_report{
+                    job.get(), now - job->start_time});
+            }
+        }
+        status.thread_count = queue.thread_count;
+        status.idle_thread_count = std::min(
+            queue.n_idle_threads.load(), status.thread_count);
+        for (auto const& f : queue.failed_jobs)
+        {
+            if (f.is_transient)
+            {
+                status.transient_failures.push_back(
+                    background_job_failure_report{f.job.get(), f.message});
+            }
+        }
+    }
+    status.queued_job_count = queue.reported_size;
+    {
+        std::scoped_lock<std::mutex> lock(queue.info_mutex);
+        status.job_info = queue.job_info;
+    }
+    status.telemetry = get_pool_telemetry(pool);
+    return status;
+}
+
+void
+get_permanent_failures(
+    std::list<background_job_failure_report>& failures,
+    background_execution_pool& pool)
+{
+    auto& queue = *pool.queue;
+    std::scoped_lock<std::mutex> lock(queue.mutex);
+    for (auto i = queue.failed_jobs.begin(); i != queue.failed_jobs.end();)
+    {
+        if (!i->is_transient)
+        {
+            failures.push_back(
+                background_job_failure_report{i->job.get(), i->message});
+            i = queue.failed_jobs.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+} // namespace
+
+} // namespace detail
+
+background_execution_system::background_execution_system(
+    http_request_system& http_system,
+    background_execution_system_config const& config)
+    : impl_(new detail::background_execution_system)
+{
+    auto calculation_thread_count = config.calculation_thread_count;
+    if (calculation_thread_count == 0)
+    {
+        calculation_thread_count
+            = std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+    }
+    detail::initialize_pool<detail::basic_executor>(
+        detail::get_pool(*this, background_job_queue_type::CALCULATION),
+        calculation_thread_count,
+        [] { return detail::basic_executor(); },
+        config.calculation_thread_affinity);
+    detail::initialize_elastic_pool<http_request_executor>(
+        detail::get_pool(*this, background_job_queue_type::HTTP),
+        config.http_pool,
+        [&http_system, concurrency = config.http_concurrency] {
+            return http_request_executor(http_system, concurrency);
+        },
+        config.http_thread_affinity);
+    detail::initialize_pool<disk_executor>(
+        detail::get_pool(*this, background_job_queue_type::DISK),
+        config.disk_thread_count,
+        [] { return disk_executor(); },
+        config.disk_thread_affinity);
+}
+
+background_execution_system::~background_execution_system()
+{
+    for (auto& pool : impl_->pools)
+        detail::shut_down_pool(pool);
+}
+
+background_job_controller
+add_calculation_job(
+    background_execution_system& system,
+    std::unique_ptr<background_job_interface> job,
+    background_job_flag_set flags,
+    int priority)
+{
+    return detail::add_background_job(
+        detail::get_pool(system, background_job_queue_type::CALCULATION),
+        std::move(job),
+        flags,
+        priority);
+}
+
+background_job_controller
+add_http_job(
+    background_execution_system& system,
+    std::unique_ptr<http_request_job> job,
+    background_job_flag_set flags,
+    int priority)
+{
+    return detail::add_background_job(
+        detail::get_pool(system, background_job_queue_type::HTTP),
+        std::move(job),
+        flags,
+        priority);
+}
+
+background_job_controller
+add_disk_job(
+    background_execution_system& system,
+    std::unique_ptr<disk_job> job,
+    background_job_flag_set flags,
+    int priority)
+{
+    return detail::add_background_job(
+        detail::get_pool(system, background_job_queue_type::DISK),
+        std::move(job),
+        flags,
+        priority);
+}
+
+void
+clear_all_jobs(background_execution_system& system)
+{
+    for (auto& pool : system.impl_->pools)
+        detail::clear_all_jobs(pool);
+}
+
+void
+clear_canceled_jobs(background_execution_system& system)
+{
+    for (auto& pool : system.impl_->pools)
+        detail::clear_canceled_jobs(pool);
+}
+
+background_execution_system_status
+get_status(background_execution_system& system)
+{
+    background_execution_system_status status;
+    for (size_t i = 0; i != size_t(background_job_queue_type::COUNT); ++i)
+        status.pools[i] = detail::get_pool_status(system.impl_->pools[i]);
+    return status;
+}
+
+std::list<background_job_failure_report>
+get_permanent_failures(background_execution_system& system)
+{
+    std::list<background_job_failure_report> failures;
+    for (auto& pool : system.impl_->pools)
+        detail::get_permanent_failures(failures, pool);
+    return failures;
+}
+
+} // namespace cradle
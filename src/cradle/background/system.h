@@ -1,10 +1,12 @@
 #ifndef CRADLE_BACKGROUND_SYSTEM_H
 #define CRADLE_BACKGROUND_SYSTEM_H
 
+#include <cradle/background/execution_pool.h>
 #include <cradle/background/job.h>
 #include <cradle/core.h>
 
 #include <list>
+#include <map>
 
 // A background_execution_system is a flexible means of executing jobs in
 // background threads.
@@ -22,17 +24,23 @@
 //
 // For web queries, it's assumed that more concurrency is always better, so
 // the system allocates threads as needed to ensure that all pending queries
-// can execute immediately.
+// can execute immediately. Threads that sit idle for a while are released,
+// and there's a (configurable) ceiling on the total number of threads.
 //
 // A small, fixed number of threads service disk jobs, as it's assumed that
 // they'll mostly be contending for the same resource.
 
 // This file provides the interface for creating and managing a
-// background_system as a whole. The API for data retrieval and job creation
-// can be found in api.hpp.
+// background_execution_system as a whole, as well as for submitting jobs to
+// its pools.
 
 namespace cradle {
 
+struct http_concurrency_policy;
+struct http_request_system;
+struct http_request_job;
+struct disk_job;
+
 namespace detail {
 
 struct background_execution_system;
@@ -40,14 +48,85 @@ struct background_job_execution_data;
 
 } // namespace detail
 
+enum class background_job_queue_type
+{
+    // Calculation jobs are run in parallel according to the number of
+    // available processor cores.
+    CALCULATION = 0,
+
+    // HTTP jobs are run with a very high level of parallelism.
+    HTTP,
+
+    // Disk jobs are run with a much lower level of parallelism since it's
+    // assumed that disk bandwidth is going to limit parallelism.
+    DISK,
+
+    // This is just here to capture the count of queue types.
+    COUNT
+};
+
+struct background_execution_system_config
+{
+    // the number of threads in the calculation pool - 0 means one thread
+    // per processor core.
+    size_t calculation_thread_count = 0;
+    // the sizing of the HTTP pool
+    elastic_pool_config http_pool
+        = elastic_pool_config{4, 256, std::chrono::seconds(30)};
+    // the number of threads in the disk pool
+    size_t disk_thread_count = 2;
+    // how the threads in each pool are placed on the machine's CPUs
+    thread_affinity_policy calculation_thread_affinity
+        = thread_affinity_policy::UNPINNED;
+    thread_affinity_policy http_thread_affinity
+        = thread_affinity_policy::UNPINNED;
+    thread_affinity_policy disk_thread_affinity
+        = thread_affinity_policy::UNPINNED;
+    // If this is provided, HTTP jobs are held to the concurrency limits that
+    // it specifies. (It must outlive the system.)
+    http_concurrency_policy* http_concurrency = nullptr;
+};
+
 struct background_execution_system : noncopyable
 {
-    background_execution_system();
+    background_execution_system(
+        http_request_system& http_system,
+        background_execution_system_config const& config
+        = background_execution_system_config());
     ~background_execution_system();
 
     std::unique_ptr<detail::background_execution_system> impl_;
 };
 
+// Add a job to the calculation pool.
+//
+// As with detail::add_background_job(), the returned controller can be used
+// to monitor and cancel the job, but it doesn't own the job.
+//
+background_job_controller
+add_calculation_job(
+    background_execution_system& system,
+    std::unique_ptr<background_job_interface> job,
+    background_job_flag_set flags = NO_FLAGS,
+    int priority = 0);
+
+// Add a job to the HTTP pool. The job will be given an HTTP connection to use
+// when it executes.
+background_job_controller
+add_http_job(
+    background_execution_system& system,
+    std::unique_ptr<http_request_job> job,
+    background_job_flag_set flags = NO_FLAGS,
+    int priority = 0);
+
+// Add a job to the disk pool.
+background_job_controller
+add_disk_job(
+    background_execution_system& system,
+    std::unique_ptr<disk_job> job,
+    background_job_flag_set flags = NO_FLAGS,
+    int priority = 0);
+
 // Clear all the jobs in the system, including those that are currently
 // executing.
 void
@@ -57,51 +136,62 @@ clear_all_jobs(background_execution_system& system);
 void
 clear_canceled_jobs(background_execution_system& system);
 
-// struct background_job_failure_report
-// {
-//     // the job that failed
-//     background_job_execution_data* job;
-//     // the associated error message
-//     string message;
-// };
-
-// struct background_execution_pool_status
-// {
-//     size_t queued_job_count, thread_count, idle_thread_count;
-//     std::list<background_job_failure_report> transient_failures;
-//     std::map<background_job_execution_data*, background_job_info> job_info;
-// };
-
-// inline size_t
-// get_active_thread_count(background_execution_pool_status const& status)
-// {
-//     return status.thread_count - status.idle_thread_count;
-// }
-
-// inline size_t
-// get_total_job_count(background_execution_pool_status const& status)
-// {
-//     return get_active_thread_count(status) + status.queued_job_count
-//            + status.transient_failures.size();
-// }
-
-// struct background_execution_system_status
-// {
-//     background_execution_pool_status
-//         pools[size_t(background_job_queue_type::COUNT)];
-// };
-
-// // Update a view of the status of a background execution system.
-// void
-// update_status(
-//     background_execution_system_status& status,
-//     background_execution_system& system);
-
-// // Get a list of jobs that have failed permanently since the last check.
-// // (This also clears the system's internal list.)
-// std::list<background_job_failure_report>
-// get_permanent_failures(background_execution_system& system);
+struct background_job_failure_report
+{
+    // the job that failed
+    detail::background_job_execution_data* job;
+    // the associated error message
+    string message;
+};
+
+struct background_running_job_report
+{
+    // the job that's running
+    detail::background_job_execution_data* job;
+    // how long it's been running
+    std::chrono::steady_clock::duration elapsed;
+};
+
+struct background_execution_pool_status
+{
+    size_t queued_job_count = 0, thread_count = 0, idle_thread_count = 0;
+    std::list<background_job_failure_report> transient_failures;
+    std::map<detail::background_job_execution_data*, background_job_info>
+        job_info;
+    // the jobs that are currently executing (useful for finding stragglers)
+    std::list<background_running_job_report> running_jobs;
+    // statistics about all the jobs that have passed through the pool
+    background_pool_telemetry telemetry;
+};
+
+inline size_t
+get_active_thread_count(background_execution_pool_status const& status)
+{
+    return status.thread_count - status.idle_thread_count;
+}
+
+inline size_t
+get_total_job_count(background_execution_pool_status const& status)
+{
+    return get_active_thread_count(status) + status.queued_job_count
+           + status.transient_failures.size();
+}
+
+struct background_execution_system_status
+{
+    background_execution_pool_status
+        pools[size_t(background_job_queue_type::COUNT)];
+};
+
+// Get a snapshot of the current status of a background execution system.
+background_execution_system_status
+get_status(background_execution_system& system);
+
+// Get a list of jobs that have failed permanently since the last check.
+// (This also clears the system's internal list.)
+std::list<background_job_failure_report>
+get_permanent_failures(background_execution_system& system);
 
 } // namespace cradle
 
-#endif
\ No newline at end of file
+#endif
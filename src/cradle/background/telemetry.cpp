@@ -0,0 +1,110 @@
+#include <cradle/background/telemetry.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace cradle {
+
+size_t
+get_latency_bucket(std::chrono::microseconds duration)
+{
+    auto count = duration.count();
+    size_t bucket = 0;
+    while (count > 0 && bucket != latency_histogram::bucket_count - 1)
+    {
+        count >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+void
+record_latency(
+    latency_histogram& histogram, std::chrono::microseconds duration)
+{
+    ++histogram.counts[get_latency_bucket(duration)];
+    ++histogram.total_count;
+    histogram.total_duration += duration;
+    histogram.max_duration = std::max(histogram.max_duration, duration);
+}
+
+std::chrono::microseconds
+get_mean_latency(latency_histogram const& histogram)
+{
+    if (histogram.total_count == 0)
+        return std::chrono::microseconds(0);
+    return histogram.total_duration / histogram.total_count;
+}
+
+std::chrono::microseconds
+get_latency_percentile(latency_histogram const& histogram, double fraction)
+{
+    if (histogram.total_count == 0)
+        return std::chrono::microseconds(0);
+    auto target = std::max(
+        uint64_t(std::ceil(fraction * double(histogram.total_count))),
+        uint64_t(1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i != latency_histogram::bucket_count - 1; ++i)
+    {
+        seen += histogram.counts[i];
+        if (seen >= target)
+        {
+            return std::min(
+                std::chrono::microseconds(int64_t(1) << i),
+                histogram.max_duration);
+        }
+    }
+    return histogram.max_duration;
+}
+
+namespace detail {
+
+void
+record_latency(
+    atomic_latency_histogram& histogram, std::chrono::microseconds duration)
+{
+    auto microseconds = uint64_t(std::max(duration.count(), int64_t(0)));
+    histogram.counts[get_latency_bucket(duration)].fetch_add(
+        1, std::memory_order_relaxed);
+    histogram.total_count.fetch_add(1, std::memory_order_relaxed);
+    histogram.total_microseconds.fetch_add(
+        microseconds, std::memory_order_relaxed);
+    auto max = histogram.max_microseconds.load(std::memory_order_relaxed);
+    while (microseconds > max
+           && !histogram.max_microseconds.compare_exchange_weak(
+               max, microseconds, std::memory_order_relaxed))
+    {
+    }
+}
+
+latency_histogram
+read_latency_histogram(atomic_latency_histogram const& histogram)
+{
+    latency_histogram snapshot;
+    for (size_t i = 0; i != latency_histogram::bucket_count; ++i)
+        snapshot.counts[i] = histogram.counts[i].load();
+    snapshot.total_count = histogram.total_count;
+    snapshot.total_duration
+        = std::chrono::microseconds(histogram.total_microseconds.load());
+    snapshot.max_duration
+        = std::chrono::microseconds(histogram.max_microseconds.load());
+    return snapshot;
+}
+
+background_pool_telemetry
+read_pool_counters(background_pool_counters const& counters)
+{
+    background_pool_telemetry telemetry;
+    telemetry.queue_wait = read_latency_histogram(counters.queue_wait);
+    telemetry.run_time = read_latency_histogram(counters.run_time);
+    telemetry.completed_count = counters.completed_count;
+    telemetry.failed_count = counters.failed_count;
+    telemetry.transient_failure_count = counters.transient_failure_count;
+    telemetry.canceled_count = counters.canceled_count;
+    return telemetry;
+}
+
+} // namespace detail
+
+} // namespace cradle
@@ -0,0 +1,106 @@
+#ifndef CRADLE_BACKGROUND_TELEMETRY_H
+#define CRADLE_BACKGROUND_TELEMETRY_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// This file defines the timing statistics that the background execution
+// pools keep about the jobs that pass through them.
+
+namespace cradle {
+
+// latency_histogram records a distribution of durations in buckets whose
+// bounds grow exponentially: bucket 0 counts durations under 1 microsecond,
+// bucket i counts durations in [2^(i-1), 2^i) microseconds, and the last
+// bucket counts everything longer than that.
+struct latency_histogram
+{
+    static constexpr size_t bucket_count = 32;
+
+    std::array<uint64_t, bucket_count> counts{};
+    // the number of durations recorded
+    uint64_t total_count = 0;
+    // the sum of the durations recorded
+    std::chrono::microseconds total_duration{0};
+    // the longest duration recorded
+    std::chrono::microseconds max_duration{0};
+};
+
+// Get the index of the bucket that :duration falls into.
+size_t
+get_latency_bucket(std::chrono::microseconds duration);
+
+void
+record_latency(
+    latency_histogram& histogram, std::chrono::microseconds duration);
+
+// Get the average of the durations recorded in :histogram.
+std::chrono::microseconds
+get_mean_latency(latency_histogram const& histogram);
+
+// Estimate the duration that :fraction (e.g., 0.99) of the recorded durations
+// fall under. Since only the buckets are known, this is the upper bound of
+// the bucket containing that percentile (capped at the longest duration).
+std::chrono::microseconds
+get_latency_percentile(latency_histogram const& histogram, double fraction);
+
+// a snapshot of the statistics that an execution pool has collected
+struct background_pool_telemetry
+{
+    // how long jobs waited in the queue before starting to execute - For
+    // jobs with inputs, this starts when the inputs are done.
+    latency_histogram queue_wait;
+    // how long jobs spent executing (whether they succeeded or not)
+    latency_histogram run_time;
+    // how jobs ended up
+    uint64_t completed_count = 0;
+    uint64_t failed_count = 0;
+    // (This is a subset of :failed_count.)
+    uint64_t transient_failure_count = 0;
+    // (This includes jobs that were canceled while still queued.)
+    uint64_t canceled_count = 0;
+};
+
+namespace detail {
+
+// This is the concurrent counterpart of latency_histogram. Durations can be
+// recorded from any thread without locking.
+struct atomic_latency_histogram
+{
+    std::array<std::atomic<uint64_t>, latency_histogram::bucket_count>
+        counts{};
+    std::atomic<uint64_t> total_count{0};
+    std::atomic<uint64_t> total_microseconds{0};
+    std::atomic<uint64_t> max_microseconds{0};
+};
+
+void
+record_latency(
+    atomic_latency_histogram& histogram, std::chrono::microseconds duration);
+
+// Get a snapshot of :histogram. (If durations are being recorded
+// concurrently, the snapshot won't necessarily be perfectly consistent.)
+latency_histogram
+read_latency_histogram(atomic_latency_histogram const& histogram);
+
+// the statistics that an execution pool collects as jobs pass through it
+struct background_pool_counters
+{
+    atomic_latency_histogram queue_wait;
+    atomic_latency_histogram run_time;
+    std::atomic<uint64_t> completed_count{0};
+    std::atomic<uint64_t> failed_count{0};
+    std::atomic<uint64_t> transient_failure_count{0};
+    std::atomic<uint64_t> canceled_count{0};
+};
+
+background_pool_telemetry
+read_pool_counters(background_pool_counters const& counters);
+
+} // namespace detail
+
+} // namespace cradle
+
+#endif
@@ -6,6 +6,17 @@
 
 #include <boost/algorithm/string/replace.hpp>
 
+// Boost.Crc triggers some warnings on MSVC.
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4245)
+#pragma warning(disable : 4701)
+#include <boost/crc.hpp>
+#pragma warning(pop)
+#else
+#include <boost/crc.hpp>
+#endif
+
 #include <sqlite3.h>
 
 #include <hashids.h>
@@ -885,4 +896,12 @@ disk_cache::do_idle_processing()
     }
 }
 
+uint32_t
+compute_crc32(string const& data)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(data.data(), data.length());
+    return crc.checksum();
+}
+
 } // namespace cradle
@@ -183,6 +183,11 @@ struct disk_cache
     std::unique_ptr<disk_cache_impl> impl_;
 };
 
+// Compute the 32-bit CRC of :data, as recorded in disk_cache_entry::crc32
+// (and passed to finish_insert()).
+uint32_t
+compute_crc32(string const& data);
+
 } // namespace cradle
 
 #endif
@@ -0,0 +1,215 @@
+#include <cradle/caching/immutable/adaptive_sizing.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include <boost/algorithm/string/trim.hpp>
+
+#include <cradle/fs/file_io.h>
+#include <cradle/utilities/text.h>
+
+namespace cradle {
+
+namespace {
+
+// Read a file that should contain a single integer (or "max", in which case
+// the result is none).
+optional<size_t>
+read_cgroup_value(file_path const& path)
+{
+    auto contents = read_file_contents(path);
+    boost::algorithm::trim(contents);
+    if (contents == "max")
+        return none;
+    return lexical_cast<size_t>(contents);
+}
+
+// Read a single value from a file in the format of the cgroup memory.stat
+// file (i.e., lines of the form "<label> <value>").
+optional<size_t>
+read_cgroup_stat(file_path const& path, string const& label)
+{
+    std::istringstream stats(read_file_contents(path));
+    string line;
+    while (std::getline(stats, line))
+    {
+        std::istringstream fields(line);
+        string field_label;
+        size_t value;
+        if (fields >> field_label >> value && field_label == label)
+            return value;
+    }
+    return none;
+}
+
+} // namespace
+
+optional<double>
+read_memory_pressure(file_path const& pressure_path)
+{
+    try
+    {
+        std::istringstream pressure(read_file_contents(pressure_path));
+        string line;
+        while (std::getline(pressure, line))
+        {
+            // The relevant line looks like this:
+            // "some avg10=1.53 avg60=0.87 avg300=0.22 total=1234567"
+            std::istringstream fields(line);
+            string kind, average;
+            if (fields >> kind >> average && kind == "some"
+                && average.compare(0, 6, "avg10=") == 0)
+            {
+                return lexical_cast<double>(average.substr(6));
+            }
+        }
+    }
+    catch (...)
+    {
+    }
+    return none;
+}
+
+optional<memory_status>
+read_cgroup_memory_status(file_path const& cgroup_dir)
+{
+    try
+    {
+        auto limit = read_cgroup_value(cgroup_dir / "memory.max");
+        if (!limit)
+            return none;
+        auto usage = read_cgroup_value(cgroup_dir / "memory.current");
+        if (!usage)
+            return none;
+
+        // memory.current includes the page cache, much of which the kernel
+        // can reclaim whenever it needs to, so inactive file pages aren't
+        // counted as being in use. (Otherwise, the cache would shrink just
+        // because the process is doing file I/O.)
+        try
+        {
+            auto inactive_file = read_cgroup_stat(
+                cgroup_dir / "memory.stat", "inactive_file");
+            if (inactive_file)
+                *usage -= (std::min)(*inactive_file, *usage);
+        }
+        catch (...)
+        {
+        }
+
+        return memory_status{
+            *limit,
+            *usage,
+            read_memory_pressure(cgroup_dir / "memory.pressure")
+                .value_or(0.)};
+    }
+    catch (...)
+    {
+        return none;
+    }
+}
+
+optional<memory_status>
+read_meminfo_memory_status(file_path const& meminfo_path)
+{
+    try
+    {
+        std::istringstream meminfo(read_file_contents(meminfo_path));
+        optional<size_t> total, available;
+        string line;
+        while (std::getline(meminfo, line))
+        {
+            // Lines look like this: "MemTotal:       16318460 kB"
+            std::istringstream fields(line);
+            string label;
+            size_t kilobytes;
+            if (!(fields >> label >> kilobytes))
+                continue;
+            if (label == "MemTotal:")
+                total = kilobytes * 1024;
+            else if (label == "MemAvailable:")
+                available = kilobytes * 1024;
+        }
+        if (!total || !available || *available > *total)
+            return none;
+        return memory_status{*total, *total - *available};
+    }
+    catch (...)
+    {
+        return none;
+    }
+}
+
+size_t
+compute_adaptive_cache_limit(
+    adaptive_cache_sizing_config const& config,
+    memory_status const& status,
+    size_t unused_size)
+{
+    // The cache's unused entries are already part of the process's memory
+    // usage, so the memory that they could occupy is their current size plus
+    // whatever memory is still free.
+    size_t free
+        = status.limit > status.usage ? status.limit - status.usage : 0;
+    // If tasks are stalling for lack of memory, the cache doesn't lay claim
+    // to any free memory, so it shrinks regardless of what the usage figures
+    // say.
+    if (status.pressure >= config.pressure_threshold)
+        free = 0;
+    auto target = size_t(double(unused_size + free) * config.target_fraction);
+    return std::clamp(target, config.min_size, config.max_size);
+}
+
+adaptive_cache_sizer::adaptive_cache_sizer(
+    immutable_cache& cache, adaptive_cache_sizing_config config)
+    : cache_(cache), config_(std::move(config))
+{
+    this->update();
+    thread_ = std::thread([this] { this->run(); });
+}
+
+adaptive_cache_sizer::~adaptive_cache_sizer()
+{
+    {
+        std::scoped_lock<std::mutex> lock(mutex_);
+        terminating_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+void
+adaptive_cache_sizer::update()
+{
+    auto status = read_cgroup_memory_status(config_.cgroup_dir);
+    if (!status)
+    {
+        status = read_meminfo_memory_status(config_.meminfo_path);
+        if (!status)
+            return;
+        status->pressure
+            = read_memory_pressure(config_.pressure_path).value_or(0.);
+    }
+    set_unused_size_limit(
+        cache_,
+        compute_adaptive_cache_limit(
+            config_, *status, get_unused_size(cache_)));
+}
+
+void
+adaptive_cache_sizer::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!terminating_)
+    {
+        cv_.wait_for(
+            lock, config_.poll_interval, [&] { return terminating_; });
+        if (terminating_)
+            break;
+        lock.unlock();
+        this->update();
+        lock.lock();
+    }
+}
+
+} // namespace cradle
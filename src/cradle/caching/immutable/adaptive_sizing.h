@@ -0,0 +1,123 @@
+#ifndef CRADLE_CACHING_IMMUTABLE_ADAPTIVE_SIZING_H
+#define CRADLE_CACHING_IMMUTABLE_ADAPTIVE_SIZING_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <cradle/caching/immutable/cache.hpp>
+#include <cradle/fs/types.hpp>
+
+// This provides an adaptive mode for sizing immutable caches, in which the
+// limit on unused entries follows the memory that's actually available to the
+// process (rather than being a fixed byte count).
+//
+// Memory availability is determined from the process's cgroup (v2) when it
+// has a memory limit, which is the case when running inside a container.
+// Otherwise, it's determined from /proc/meminfo. Reclaimable page cache isn't
+// counted as being in use, and memory pressure (as reported by the kernel's
+// pressure stall information) forces the cache to shrink.
+
+namespace cradle {
+
+// a snapshot of the memory situation of the process
+struct memory_status
+{
+    // the total amount of memory available to the process, in bytes
+    size_t limit;
+    // the amount of that memory that's currently in use, in bytes (not
+    // counting page cache that could easily be reclaimed)
+    size_t usage;
+    // the percentage of time that tasks have recently spent stalled waiting
+    // for memory (the "some avg10" figure from the kernel's pressure stall
+    // information), or 0 if that's not available
+    double pressure = 0;
+};
+
+// Read the memory status from the cgroup (v2) directory :cgroup_dir.
+// The result is none if the files can't be read or the cgroup doesn't have
+// a memory limit. (memory.stat and memory.pressure are optional.)
+optional<memory_status>
+read_cgroup_memory_status(file_path const& cgroup_dir);
+
+// Read the memory status from a file in the format of /proc/meminfo.
+// The result is none if the file can't be read or parsed.
+// (This doesn't fill in the pressure.)
+optional<memory_status>
+read_meminfo_memory_status(file_path const& meminfo_path);
+
+// Read the "some avg10" figure from a pressure stall information file (e.g.,
+// /proc/pressure/memory). The result is none if it can't be read.
+optional<double>
+read_memory_pressure(file_path const& pressure_path);
+
+struct adaptive_cache_sizing_config
+{
+    // the cgroup directory for the process
+    file_path cgroup_dir = "/sys/fs/cgroup";
+
+    // the fallback location of meminfo
+    file_path meminfo_path = "/proc/meminfo";
+
+    // the fallback location of the system-wide memory pressure information
+    file_path pressure_path = "/proc/pressure/memory";
+
+    // the fraction of the memory that's available to the cache (i.e., its
+    // current unused entries plus any free memory) that the cache's unused
+    // entries are allowed to occupy
+    double target_fraction = 0.5;
+
+    // the memory pressure (as a percentage of time stalled) at or above
+    // which the cache shrinks, regardless of how much memory appears free
+    double pressure_threshold = 10;
+
+    // bounds on the unused size limit (in bytes)
+    size_t min_size = 0x1'00'00'00;
+    size_t max_size = 0x10'00'00'00'00;
+
+    // how often memory status is checked
+    std::chrono::milliseconds poll_interval = std::chrono::seconds(1);
+};
+
+// Compute the unused size limit that an immutable cache should have, given
+// the current memory status and the current total size of its unused
+// entries.
+size_t
+compute_adaptive_cache_limit(
+    adaptive_cache_sizing_config const& config,
+    memory_status const& status,
+    size_t unused_size);
+
+// adaptive_cache_sizer periodically adjusts the unused size limit of an
+// immutable cache according to memory pressure. It runs a background thread
+// for as long as it exists, so it must be destroyed before the cache.
+struct adaptive_cache_sizer : noncopyable
+{
+    adaptive_cache_sizer(
+        immutable_cache& cache, adaptive_cache_sizing_config config);
+
+    ~adaptive_cache_sizer();
+
+    // Check the memory status and update the cache's limit immediately.
+    // (This is what the background thread does periodically.)
+    // If the memory status can't be determined, the limit is left as is.
+    void
+    update();
+
+ private:
+    void
+    run();
+
+    immutable_cache& cache_;
+    adaptive_cache_sizing_config config_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool terminating_ = false;
+    std::thread thread_;
+};
+
+} // namespace cradle
+
+#endif
@@ -18,6 +18,8 @@ void
 immutable_cache::reset(immutable_cache_config config)
 {
     this->impl = std::make_unique<detail::immutable_cache>();
+    this->impl->unused_size_limit.store(
+        size_t(config.unused_size_limit), std::memory_order_relaxed);
     this->impl->config = std::move(config);
 }
 
@@ -33,32 +35,56 @@ clear_unused_entries(immutable_cache& cache)
     detail::reduce_memory_cache_size(*cache.impl, 0);
 }
 
+void
+set_unused_size_limit(immutable_cache& cache, size_t limit)
+{
+    cache.impl->unused_size_limit.store(limit, std::memory_order_relaxed);
+    detail::reduce_memory_cache_size(*cache.impl, limit);
+}
+
+size_t
+get_unused_size(immutable_cache& cache)
+{
+    return detail::get_unused_size(*cache.impl);
+}
+
+void
+set_eviction_handler(
+    immutable_cache& cache_object, immutable_cache_eviction_handler handler)
+{
+    auto& cache = *cache_object.impl;
+    std::scoped_lock<std::mutex> lock(cache.eviction_handler_mutex);
+    cache.eviction_handler = std::move(handler);
+}
+
 immutable_cache_snapshot
 get_cache_snapshot(immutable_cache& cache_object)
 {
     auto& cache = *cache_object.impl;
-    std::scoped_lock<std::mutex> lock(cache.mutex);
     immutable_cache_snapshot snapshot;
-    snapshot.in_use.reserve(cache.records.size());
-    for (auto const& [key, record] : cache.records)
+    for (auto& stripe : cache.stripes)
     {
-        auto const& data = record->data;
-        immutable_cache_entry_snapshot entry{
-            lexical_cast<string>(*record->key),
-            record->state.load(std::memory_order_relaxed),
-            decode_progress(record->progress.load(std::memory_order_relaxed)),
-            is_initialized(data) ? some(data.ptr->type_info()) : none,
-            is_initialized(data) ? data.ptr->deep_size() : 0};
-        // Put the entry's info the appropriate list depending on whether
-        // or not its in the eviction list.
-        if (record->eviction_list_iterator
-            != cache.eviction_list.records.end())
-        {
-            snapshot.pending_eviction.push_back(std::move(entry));
-        }
-        else
+        std::scoped_lock<std::mutex> lock(stripe.mutex);
+        for (auto const& [key, record] : stripe.records)
         {
-            snapshot.in_use.push_back(std::move(entry));
+            auto const& data = record->data;
+            immutable_cache_entry_snapshot entry{
+                lexical_cast<string>(*record->key),
+                record->state.load(std::memory_order_relaxed),
+                decode_progress(
+                    record->progress.load(std::memory_order_relaxed)),
+                is_initialized(data) ? some(data.ptr->type_info()) : none,
+                record->size};
+            // Put the entry's info the appropriate list depending on
+            // whether or not its in the eviction list.
+            if (record->in_eviction_list)
+            {
+                snapshot.pending_eviction.push_back(std::move(entry));
+            }
+            else
+            {
+                snapshot.in_use.push_back(std::move(entry));
+            }
         }
     }
     return snapshot;
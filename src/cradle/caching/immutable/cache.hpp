@@ -1,6 +1,7 @@
 #ifndef CRADLE_CACHING_IMMUTABLE_CACHE_HPP
 #define CRADLE_CACHING_IMMUTABLE_CACHE_HPP
 
+#include <functional>
 #include <memory>
 
 #include <cradle/core.h>
@@ -13,12 +14,31 @@ struct immutable_cache;
 
 } // namespace detail
 
+api(enum)
+enum class immutable_cache_eviction_policy
+{
+    // Unused entries are evicted in least-recently-used order.
+    LRU,
+
+    // Unused entries that have only been used once are kept separately from
+    // entries that have been used repeatedly. Entries in each group are
+    // evicted in LRU order, but once-used entries are evicted first (as long
+    // as they occupy more than a quarter of the unused size limit). This
+    // prevents large scans of one-off results from flushing out the working
+    // set.
+    TWO_QUEUE
+};
+
 api(struct)
 struct immutable_cache_config
 {
     // The maximum amount of memory to use for caching results that are no
     // longer in use, in bytes.
     integer unused_size_limit;
+
+    // the policy for deciding which unused results to evict first (defaults
+    // to LRU)
+    omissible<immutable_cache_eviction_policy> eviction_policy;
 };
 
 struct immutable_cache
@@ -115,6 +135,33 @@ get_cache_snapshot(immutable_cache& cache);
 void
 clear_unused_entries(immutable_cache& cache);
 
+// Set the limit on the total size of unused entries in :cache, overriding the
+// limit that was specified in its config. If the cache currently holds more
+// than this, unused entries are evicted immediately.
+void
+set_unused_size_limit(immutable_cache& cache, size_t limit);
+
+// Get the total size of the unused entries that are currently in :cache.
+size_t
+get_unused_size(immutable_cache& cache);
+
+// An eviction handler is notified of each entry that's evicted from the cache
+// while it holds data (i.e., while its state is READY). It receives the key
+// and data associated with the entry.
+//
+// Handlers are always invoked outside of the cache's internal lock, but they
+// may be invoked from whichever thread happens to trigger the eviction.
+//
+typedef std::function<void(
+    id_interface const& key, untyped_immutable const& data)>
+    immutable_cache_eviction_handler;
+
+// Set the handler that's invoked when entries are evicted from :cache.
+// (Passing an empty handler disables notification.)
+void
+set_eviction_handler(
+    immutable_cache& cache, immutable_cache_eviction_handler handler);
+
 } // namespace cradle
 
 #endif
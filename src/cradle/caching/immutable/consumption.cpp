@@ -7,29 +7,16 @@ namespace detail {
 
 namespace {
 
-void
-remove_from_eviction_list(
-    immutable_cache& cache, immutable_cache_record* record)
-{
-    auto& list = cache.eviction_list;
-    assert(record->eviction_list_iterator != list.records.end());
-    list.records.erase(record->eviction_list_iterator);
-    record->eviction_list_iterator = list.records.end();
-    if (record->data.ptr)
-        list.total_size -= record->data.ptr->deep_size();
-}
-
 void
 acquire_cache_record_no_lock(
     immutable_cache_record* record,
     std::shared_ptr<immutable_cache_entry_watcher> const& watcher)
 {
     ++record->ref_count;
-    auto& evictions = record->owner_cache->eviction_list.records;
-    if (record->eviction_list_iterator != evictions.end())
+    if (record->in_eviction_list)
     {
         assert(record->ref_count == 1);
-        remove_from_eviction_list(*record->owner_cache, record);
+        remove_from_eviction_list(record);
     }
     if (watcher)
         record->watchers.push_back(watcher);
@@ -42,21 +29,33 @@ acquire_cache_record(
     function_view<background_job_controller()> const& create_job,
     std::shared_ptr<immutable_cache_entry_watcher> const& watcher)
 {
-    std::scoped_lock<std::mutex> lock(cache.mutex);
-    cache_record_map::iterator i = cache.records.find(&key);
-    if (i == cache.records.end())
+    auto& stripe = get_stripe(cache, key);
+    std::scoped_lock<std::mutex> lock(stripe.mutex);
+    cache_record_map::iterator i = stripe.records.find(&key);
+    if (i == stripe.records.end())
     {
         auto record = std::make_unique<immutable_cache_record>();
         record->owner_cache = &cache;
-        record->eviction_list_iterator = cache.eviction_list.records.end();
+        record->stripe = &stripe;
+        record->in_eviction_list = false;
+        record->queue = eviction_queue::PROBATIONARY;
+        record->eviction_prev = nullptr;
+        record->eviction_next = nullptr;
+        record->eviction_tick = 0;
+        record->reused = false;
         record->key.capture(key);
         record->state.store(
             immutable_cache_entry_state::LOADING, std::memory_order_relaxed);
         record->progress.store(
             encoded_optional_progress(), std::memory_order_relaxed);
         record->ref_count = 0;
+        record->size = 0;
         record->job = create_job();
-        i = cache.records.emplace(&*record->key, std::move(record)).first;
+        i = stripe.records.emplace(&*record->key, std::move(record)).first;
+    }
+    else
+    {
+        i->second->reused = true;
     }
     immutable_cache_record* record = i->second.get();
     acquire_cache_record_no_lock(record, watcher);
@@ -68,23 +67,10 @@ acquire_cache_record(
     immutable_cache_record* record,
     std::shared_ptr<immutable_cache_entry_watcher> const& watcher)
 {
-    std::scoped_lock<std::mutex> lock(record->owner_cache->mutex);
+    std::scoped_lock<std::mutex> lock(record->stripe->mutex);
     acquire_cache_record_no_lock(record, watcher);
 }
 
-void
-add_to_eviction_list(immutable_cache& cache, immutable_cache_record* record)
-{
-    auto& list = cache.eviction_list;
-    assert(record->eviction_list_iterator == list.records.end());
-    record->eviction_list_iterator
-        = list.records.insert(list.records.end(), record);
-    if (record->data.ptr)
-    {
-        list.total_size += record->data.ptr->deep_size();
-    }
-}
-
 bool
 same_owner(
     std::shared_ptr<immutable_cache_entry_watcher> const& shared,
@@ -101,7 +87,7 @@ release_cache_record(
     auto& cache = *record->owner_cache;
     bool do_lru_eviction = false;
     {
-        std::scoped_lock<std::mutex> lock(cache.mutex);
+        std::scoped_lock<std::mutex> lock(record->stripe->mutex);
         --record->ref_count;
         if (watcher)
         {
@@ -112,12 +98,15 @@ release_cache_record(
         }
         if (record->ref_count == 0)
         {
-            add_to_eviction_list(cache, record);
+            add_to_eviction_list(record);
             do_lru_eviction = true;
         }
     }
     if (do_lru_eviction)
-        reduce_memory_cache_size(cache, cache.config.unused_size_limit);
+    {
+        reduce_memory_cache_size(
+            cache, cache.unused_size_limit.load(std::memory_order_relaxed));
+    }
 }
 
 } // namespace
@@ -226,7 +215,7 @@ untyped_immutable_cache_ptr::update()
         progress_ = record->progress.load(std::memory_order_relaxed);
         if (state_ == immutable_cache_entry_state::READY)
         {
-            std::scoped_lock<std::mutex> lock(record->owner_cache->mutex);
+            std::scoped_lock<std::mutex> lock(record->stripe->mutex);
             data_ = record->data;
         }
     }
@@ -8,28 +8,169 @@ namespace cradle {
 
 namespace detail {
 
+namespace {
+
+// This must be called with the stripe's mutex held whenever the front of
+// :list changes.
+void
+update_oldest_eviction_tick(cache_record_eviction_list& list)
+{
+    list.oldest_eviction_tick.store(
+        list.front ? list.front->eviction_tick
+                   : std::numeric_limits<uint64_t>::max(),
+        std::memory_order_relaxed);
+}
+
+cache_record_eviction_list&
+get_eviction_list(immutable_cache_record* record)
+{
+    return record->stripe->eviction_lists[size_t(record->queue)];
+}
+
+// Find the stripe whose least recently used entry in :queue is the oldest in
+// the cache. This is done without locking, so the result is only a hint.
+// If there are no entries in :queue in any stripe, this returns nullptr.
+immutable_cache_stripe*
+find_oldest_stripe(immutable_cache& cache, eviction_queue queue)
+{
+    immutable_cache_stripe* oldest = nullptr;
+    uint64_t oldest_tick = std::numeric_limits<uint64_t>::max();
+    for (auto& stripe : cache.stripes)
+    {
+        auto tick = stripe.eviction_lists[size_t(queue)]
+                        .oldest_eviction_tick.load(std::memory_order_relaxed);
+        if (tick < oldest_tick)
+        {
+            oldest = &stripe;
+            oldest_tick = tick;
+        }
+    }
+    return oldest;
+}
+
+// Decide which queue the next eviction should come from.
+eviction_queue
+choose_eviction_queue(immutable_cache& cache, size_t desired_size)
+{
+    // Under the TWO_QUEUE policy, probationary entries are evicted first as
+    // long as they're taking up more than a quarter of the desired size.
+    // This is what keeps one-off scans from flushing out the working set.
+    // (Under the LRU policy, the protected queue is always empty.)
+    auto probationary_size
+        = cache.queue_sizes[size_t(eviction_queue::PROBATIONARY)].load(
+            std::memory_order_relaxed);
+    return probationary_size > desired_size / 4 ? eviction_queue::PROBATIONARY
+                                                : eviction_queue::PROTECTED;
+}
+
+} // namespace
+
+void
+add_to_eviction_list(immutable_cache_record* record)
+{
+    auto& cache = *record->owner_cache;
+    assert(!record->in_eviction_list);
+    auto const& policy = cache.config.eviction_policy;
+    bool use_two_queues
+        = policy && *policy == immutable_cache_eviction_policy::TWO_QUEUE;
+    record->queue = use_two_queues && record->reused
+                        ? eviction_queue::PROTECTED
+                        : eviction_queue::PROBATIONARY;
+    record->in_eviction_list = true;
+    record->eviction_tick
+        = cache.eviction_clock.fetch_add(1, std::memory_order_relaxed);
+
+    auto& list = get_eviction_list(record);
+    record->eviction_prev = list.back;
+    record->eviction_next = nullptr;
+    if (list.back)
+    {
+        list.back->eviction_next = record;
+    }
+    else
+    {
+        list.front = record;
+        update_oldest_eviction_tick(list);
+    }
+    list.back = record;
+
+    list.total_size += record->size;
+    cache.queue_sizes[size_t(record->queue)].fetch_add(
+        record->size, std::memory_order_relaxed);
+}
+
+void
+remove_from_eviction_list(immutable_cache_record* record)
+{
+    auto& cache = *record->owner_cache;
+    assert(record->in_eviction_list);
+    auto& list = get_eviction_list(record);
+
+    if (record->eviction_prev)
+        record->eviction_prev->eviction_next = record->eviction_next;
+    else
+        list.front = record->eviction_next;
+    if (record->eviction_next)
+        record->eviction_next->eviction_prev = record->eviction_prev;
+    else
+        list.back = record->eviction_prev;
+    if (!record->eviction_prev)
+        update_oldest_eviction_tick(list);
+    record->eviction_prev = nullptr;
+    record->eviction_next = nullptr;
+    record->in_eviction_list = false;
+
+    list.total_size -= record->size;
+    cache.queue_sizes[size_t(record->queue)].fetch_sub(
+        record->size, std::memory_order_relaxed);
+}
+
 void
 reduce_memory_cache_size(immutable_cache& cache, size_t desired_size)
 {
     // We need to keep the jobs around until after the mutex is released
     // because they may recursively release other records.
     std::list<background_job_controller> evicted_jobs;
+    // Evicted data is also passed to the eviction handler (if any) outside
+    // the mutex.
+    std::list<std::pair<captured_id, untyped_immutable>> evicted_data;
+    immutable_cache_eviction_handler handler;
+    if (get_unused_size(cache) > desired_size)
+    {
+        std::scoped_lock<std::mutex> lock(cache.eviction_handler_mutex);
+        handler = cache.eviction_handler;
+    }
+    while (get_unused_size(cache) > desired_size)
     {
-        std::scoped_lock<std::mutex> lock(cache.mutex);
-        while (!cache.eviction_list.records.empty()
-               && cache.eviction_list.total_size > desired_size)
+        auto queue = choose_eviction_queue(cache, desired_size);
+        auto* stripe = find_oldest_stripe(cache, queue);
+        if (!stripe)
         {
-            auto const& record = cache.eviction_list.records.front();
-            auto data_size
-                = record->data.ptr ? record->data.ptr->deep_size() : 0;
-            evicted_jobs.push_back(std::move(record->job));
-            cache.records.erase(&*record->key);
-            cache.eviction_list.records.pop_front();
-            cache.eviction_list.total_size -= data_size;
+            // Fall back to the other queue.
+            queue = queue == eviction_queue::PROBATIONARY
+                        ? eviction_queue::PROTECTED
+                        : eviction_queue::PROBATIONARY;
+            stripe = find_oldest_stripe(cache, queue);
+            if (!stripe)
+                break;
         }
+        std::scoped_lock<std::mutex> lock(stripe->mutex);
+        // Other threads may have changed things since we checked.
+        if (get_unused_size(cache) <= desired_size)
+            break;
+        auto* record = stripe->eviction_lists[size_t(queue)].front;
+        if (!record)
+            continue;
+        if (handler && is_initialized(record->data))
+            evicted_data.emplace_back(record->key, record->data);
+        evicted_jobs.push_back(std::move(record->job));
+        remove_from_eviction_list(record);
+        stripe->records.erase(&*record->key);
     }
     for (auto& job : evicted_jobs)
         job.cancel();
+    for (auto const& [key, data] : evicted_data)
+        handler(*key, data);
 }
 
 } // namespace detail
@@ -1,7 +1,9 @@
 #ifndef CRADLE_CACHING_IMMUTABLE_INTERNALS_H
 #define CRADLE_CACHING_IMMUTABLE_INTERNALS_H
 
+#include <array>
 #include <atomic>
+#include <limits>
 #include <list>
 #include <mutex>
 #include <unordered_map>
@@ -17,17 +19,33 @@ struct immutable_cache_entry_watcher;
 namespace detail {
 
 struct immutable_cache;
+struct immutable_cache_stripe;
+
+// Unused records are kept in one of two eviction queues, depending on how
+// they've been used. (Under the LRU policy, only the probationary queue is
+// used.)
+enum class eviction_queue
+{
+    // records that have only been acquired once
+    PROBATIONARY,
+    // records that have been acquired repeatedly
+    PROTECTED
+};
+
+static constexpr size_t eviction_queue_count = 2;
 
 struct immutable_cache_record
 {
     // These remain constant for the life of the record.
     immutable_cache* owner_cache;
+    immutable_cache_stripe* stripe;
     captured_id key;
 
-    // All of the following fields are protected by the cache mutex. The only
-    // exception is that the :state and :progress fields can be polled for
-    // informational purposes. However, before accessing any other fields based
-    // on the value of :state, you should acquire the mutex and recheck state.
+    // All of the following fields are protected by the mutex of the stripe
+    // that owns the record. The only exception is that the :state and
+    // :progress fields can be polled for informational purposes. However,
+    // before accessing any other fields based on the value of :state, you
+    // should acquire the mutex and recheck state.
 
     std::atomic<immutable_cache_entry_state> state;
 
@@ -35,12 +53,29 @@ struct immutable_cache_record
 
     // This is a count of how many active pointers reference this data.
     // If this is 0, the data is just hanging around because it was recently
-    // used, in which case :eviction_list_iterator points to this record's
-    // entry in the eviction list.
+    // used, in which case :in_eviction_list is true and :queue indicates
+    // which of the stripe's eviction lists the record is in.
     unsigned ref_count;
 
     // (See :ref_count comment.)
-    std::list<immutable_cache_record*>::iterator eviction_list_iterator;
+    bool in_eviction_list;
+    eviction_queue queue;
+
+    // the record's neighbors in its eviction list (if it's in one) - The
+    // lists are intrusive so that records can move in and out of them
+    // without any allocation.
+    immutable_cache_record* eviction_prev;
+    immutable_cache_record* eviction_next;
+
+    // If the record is in an eviction list, this is the value of the
+    // cache's eviction clock when it was added. (This is what allows LRU
+    // order to be maintained across stripes.)
+    uint64_t eviction_tick;
+
+    // Has the record been acquired again (by key) since it was created?
+    // The TWO_QUEUE policy uses this to distinguish records that are part of
+    // the working set from ones that were only touched once.
+    bool reused;
 
     // a list of watchers
     std::list<std::weak_ptr<immutable_cache_entry_watcher>> watchers;
@@ -50,6 +85,10 @@ struct immutable_cache_record
 
     // If state is READY, this is the associated data.
     untyped_immutable data;
+
+    // the deep size of :data (or 0 if there's no data) - This is computed
+    // once when the data is set, since computing it can be expensive.
+    size_t size;
 };
 
 typedef std::unordered_map<
@@ -61,25 +100,97 @@ typedef std::unordered_map<
     id_interface_pointer_equality_test>
     cache_record_map;
 
+// an intrusive list of unused records, ordered from least to most recently
+// used
 struct cache_record_eviction_list
 {
-    std::list<immutable_cache_record*> records;
-    size_t total_size;
-    cache_record_eviction_list() : total_size(0)
-    {
-    }
+    immutable_cache_record* front = nullptr;
+    immutable_cache_record* back = nullptr;
+
+    size_t total_size = 0;
+
+    // the eviction tick of the record at the front of the list (or the
+    // maximum value if the list is empty) - This is only modified while
+    // holding the stripe's mutex, but it can be read without it to decide
+    // which stripe to evict from.
+    std::atomic<uint64_t> oldest_eviction_tick{
+        std::numeric_limits<uint64_t>::max()};
 };
 
-struct immutable_cache : noncopyable
+// The records in a cache are split across independently locked stripes
+// (according to the hash of their keys) so that concurrent accesses to
+// different entries don't all contend on the same mutex.
+struct immutable_cache_stripe : noncopyable
 {
-    immutable_cache_config config;
     cache_record_map records;
-    cache_record_eviction_list eviction_list;
+
+    // eviction lists, indexed by eviction_queue
+    std::array<cache_record_eviction_list, eviction_queue_count>
+        eviction_lists;
+
     std::mutex mutex;
 };
 
-// Evict unused entries (in LRU order) until the total size of unused entries
-// in the cache is at most :desired_size (in bytes).
+static constexpr size_t immutable_cache_stripe_count = 16;
+
+struct immutable_cache : noncopyable
+{
+    immutable_cache_config config;
+
+    // the current limit on the total size of unused entries - This starts
+    // out as :config.unused_size_limit but can be adjusted while the cache
+    // is in use. (See set_unused_size_limit().)
+    std::atomic<size_t> unused_size_limit{0};
+
+    std::array<immutable_cache_stripe, immutable_cache_stripe_count> stripes;
+
+    // the total size of all unused entries in each eviction queue (across
+    // all stripes) - These are updated while holding the relevant stripe's
+    // mutex, but they're checked against the cache's budget without any
+    // locking.
+    std::array<std::atomic<size_t>, eviction_queue_count> queue_sizes{};
+
+    // This is incremented every time a record is added to an eviction list.
+    std::atomic<uint64_t> eviction_clock{0};
+
+    // (See set_eviction_handler().)
+    immutable_cache_eviction_handler eviction_handler;
+    std::mutex eviction_handler_mutex;
+};
+
+// Get the stripe that's responsible for the record with the given key.
+inline immutable_cache_stripe&
+get_stripe(immutable_cache& cache, id_interface const& key)
+{
+    return cache.stripes[key.hash() % immutable_cache_stripe_count];
+}
+
+// Get the total size of all unused entries in the cache.
+inline size_t
+get_unused_size(immutable_cache const& cache)
+{
+    size_t total = 0;
+    for (auto const& size : cache.queue_sizes)
+        total += size.load(std::memory_order_relaxed);
+    return total;
+}
+
+// Add :record to the back of the appropriate eviction list for its stripe,
+// according to the cache's eviction policy.
+// This must be called with the stripe's mutex held.
+void
+add_to_eviction_list(immutable_cache_record* record);
+
+// Remove :record from the eviction list that it's in.
+// This must be called with the stripe's mutex held.
+void
+remove_from_eviction_list(immutable_cache_record* record);
+
+// Evict unused entries until the total size of unused entries in the cache
+// is at most :desired_size (in bytes). Entries are evicted in LRU order
+// within each eviction queue, and the cache's eviction policy determines
+// which queue to evict from.
+// Evicted entries that hold data are passed to the cache's eviction handler.
 void
 reduce_memory_cache_size(immutable_cache& cache, size_t desired_size);
 
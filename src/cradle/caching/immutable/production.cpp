@@ -14,10 +14,11 @@ report_immutable_cache_loading_progress(
 
     // Update the cache record.
     {
-        std::scoped_lock<std::mutex> lock(cache.mutex);
+        auto& stripe = detail::get_stripe(cache, key);
+        std::scoped_lock<std::mutex> lock(stripe.mutex);
 
-        auto i = cache.records.find(&key);
-        if (i == cache.records.end())
+        auto i = stripe.records.find(&key);
+        if (i == stripe.records.end())
             return;
 
         detail::immutable_cache_record* record = i->second.get();
@@ -42,24 +43,51 @@ set_immutable_cache_data(
 {
     auto& cache = *cache_object.impl;
 
+    // Computing the size can involve walking the entire value, so do it
+    // before acquiring the lock.
+    size_t size = value.ptr ? value.ptr->deep_size() : 0;
+
     std::list<std::weak_ptr<immutable_cache_entry_watcher>> watchers;
 
     // Update the cache record.
+    bool do_lru_eviction = false;
     {
-        std::scoped_lock<std::mutex> lock(cache.mutex);
+        auto& stripe = detail::get_stripe(cache, key);
+        std::scoped_lock<std::mutex> lock(stripe.mutex);
 
-        auto i = cache.records.find(&key);
-        if (i == cache.records.end())
+        auto i = stripe.records.find(&key);
+        if (i == stripe.records.end())
             return;
 
         detail::immutable_cache_record* record = i->second.get();
-        record->data = value;
+        // If the record is already unused, its size is included in the
+        // eviction accounting, so it has to be re-added to its eviction list
+        // to account for the new size. (And since that size has grown, the
+        // cache may now be over its limit.)
+        if (record->in_eviction_list)
+        {
+            detail::remove_from_eviction_list(record);
+            record->data = value;
+            record->size = size;
+            detail::add_to_eviction_list(record);
+            do_lru_eviction = true;
+        }
+        else
+        {
+            record->data = value;
+            record->size = size;
+        }
         record->state.store(
             immutable_cache_entry_state::READY, std::memory_order_relaxed);
         record->progress.store(encoded_optional_progress());
         record->job.reset();
         watchers = record->watchers;
     }
+    if (do_lru_eviction)
+    {
+        detail::reduce_memory_cache_size(
+            cache, cache.unused_size_limit.load(std::memory_order_relaxed));
+    }
 
     // Invoke all the watchers outside of the mutex lock.
     for (auto& watcher : watchers)
@@ -79,10 +107,11 @@ report_immutable_cache_loading_failure(
 
     // Update the cache record.
     {
-        std::scoped_lock<std::mutex> lock(cache.mutex);
+        auto& stripe = detail::get_stripe(cache, key);
+        std::scoped_lock<std::mutex> lock(stripe.mutex);
 
-        auto i = cache.records.find(&key);
-        if (i == cache.records.end())
+        auto i = stripe.records.find(&key);
+        if (i == stripe.records.end())
             return;
 
         detail::immutable_cache_record* record = i->second.get();
@@ -0,0 +1,232 @@
+#include <cradle/caching/tiered_cache.h>
+
+#include <condition_variable>
+#include <mutex>
+
+#include <cradle/caching/immutable/internals.h>
+#include <cradle/encodings/msgpack.h>
+#include <cradle/fs/file_io.h>
+#include <cradle/utilities/text.h>
+
+namespace cradle {
+
+static string
+get_disk_cache_key(id_interface const& key)
+{
+    return lexical_cast<string>(key);
+}
+
+// Try to load the value associated with :key from the disk tier.
+static optional<untyped_immutable>
+load_from_disk(
+    disk_cache& disk,
+    id_interface const& key,
+    function_view<untyped_immutable(dynamic const& value)> const& decode)
+{
+    try
+    {
+        auto entry = disk.find(get_disk_cache_key(key));
+        // Values are always stored externally in files.
+        if (entry && !entry->value)
+        {
+            auto data = read_file_contents(disk.get_path_for_id(entry->id));
+            if (compute_crc32(data) == entry->crc32)
+                return decode(parse_msgpack_value(data));
+        }
+    }
+    catch (...)
+    {
+        // Something went wrong trying to load the cached value, so just
+        // pretend it's not there. (It will be overwritten.)
+    }
+    return none;
+}
+
+// Write a value out to the disk tier (if it's not already there).
+static void
+write_to_disk(
+    disk_cache& disk, id_interface const& key, untyped_immutable const& data)
+{
+    try
+    {
+        auto disk_key = get_disk_cache_key(key);
+
+        // If the value is already on disk (probably because it was promoted
+        // from there in the first place), there's nothing to do.
+        if (disk.find(disk_key))
+            return;
+
+        auto msgpack = value_to_msgpack_string(data.ptr->as_dynamic());
+        auto cache_id = disk.initiate_insert(disk_key);
+        {
+            auto entry_path = disk.get_path_for_id(cache_id);
+            std::ofstream output;
+            open_file(
+                output,
+                entry_path,
+                std::ios::out | std::ios::trunc | std::ios::binary);
+            output << msgpack;
+        }
+        disk.finish_insert(cache_id, compute_crc32(msgpack));
+    }
+    catch (...)
+    {
+        // The disk tier is just an optimization, so if something goes wrong,
+        // the value simply isn't stored there.
+    }
+}
+
+tiered_cache::tiered_cache() = default;
+
+tiered_cache::tiered_cache(
+    immutable_cache_config const& memory_config,
+    disk_cache_config const& disk_config)
+{
+    this->reset(memory_config, disk_config);
+}
+
+tiered_cache::~tiered_cache()
+{
+    this->reset();
+}
+
+void
+tiered_cache::reset(
+    immutable_cache_config const& memory_config,
+    disk_cache_config const& disk_config)
+{
+    this->reset();
+    this->disk.reset(disk_config);
+    this->memory.reset(memory_config);
+    set_eviction_handler(
+        this->memory,
+        [this](id_interface const& key, untyped_immutable const& data) {
+            write_to_disk(this->disk, key, data);
+        });
+}
+
+void
+tiered_cache::reset()
+{
+    if (this->is_initialized())
+        clear_unused_entries(this->memory);
+    this->memory.reset();
+    this->disk.reset();
+}
+
+namespace {
+
+// tiered_cache_waiter is used to wait for a value that's being produced by
+// another caller.
+struct tiered_cache_waiter : immutable_cache_entry_watcher
+{
+    void
+    on_failure() override
+    {
+        {
+            std::scoped_lock<std::mutex> lock(mutex);
+            failed = true;
+        }
+        cv.notify_all();
+    }
+
+    void
+    on_ready(untyped_immutable value) override
+    {
+        {
+            std::scoped_lock<std::mutex> lock(mutex);
+            this->value = std::move(value);
+        }
+        cv.notify_all();
+    }
+
+    // Wait for the producer to either supply the value or fail.
+    // The return value is empty iff the producer failed.
+    optional<untyped_immutable>
+    wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return failed || is_initialized(value); });
+        return failed ? none : some(value);
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    untyped_immutable value;
+    bool failed = false;
+};
+
+} // namespace
+
+namespace detail {
+
+untyped_immutable
+look_up_or_compute_untyped(
+    tiered_cache& cache,
+    id_interface const& key,
+    function_view<untyped_immutable(dynamic const& value)> const& decode,
+    function_view<untyped_immutable()> const& compute)
+{
+    auto waiter = std::make_shared<tiered_cache_waiter>();
+    bool is_producer = false;
+    immutable_cache_entry_handle handle(
+        cache.memory,
+        key,
+        [&] {
+            is_producer = true;
+            return background_job_controller();
+        },
+        waiter);
+
+    // If the entry already existed, someone else has produced (or is
+    // producing) the value.
+    if (!is_producer)
+    {
+        auto* record = handle.record();
+        switch (record->state.load(std::memory_order_relaxed))
+        {
+            case immutable_cache_entry_state::READY: {
+                std::scoped_lock<std::mutex> lock(record->stripe->mutex);
+                return record->data;
+            }
+            case immutable_cache_entry_state::LOADING:
+                if (auto value = waiter->wait())
+                    return *value;
+                // If the other producer failed, try it ourselves.
+                break;
+            case immutable_cache_entry_state::FAILED:
+                // A previous attempt failed, so try it again.
+                break;
+        }
+    }
+
+    // Try the disk tier.
+    if (auto value = load_from_disk(cache.disk, key, decode))
+    {
+        set_immutable_cache_data(cache.memory, key, *value);
+        return *value;
+    }
+
+    // Compute the value and add it to the memory tier.
+    untyped_immutable value;
+    try
+    {
+        value = compute();
+    }
+    catch (...)
+    {
+        report_immutable_cache_loading_failure(cache.memory, key);
+        throw;
+    }
+    set_immutable_cache_data(cache.memory, key, value);
+
+    // Write it through to disk right away so that it survives even if the
+    // process doesn't shut down cleanly.
+    write_to_disk(cache.disk, key, value);
+
+    return value;
+}
+
+} // namespace detail
+
+} // namespace cradle
@@ -0,0 +1,116 @@
+#ifndef CRADLE_CACHING_TIERED_CACHE_H
+#define CRADLE_CACHING_TIERED_CACHE_H
+
+#include <cradle/caching/disk_cache.hpp>
+#include <cradle/caching/immutable.h>
+#include <cradle/core.h>
+#include <cradle/utilities/functional.h>
+
+// A tiered cache combines an in-memory immutable cache with a disk cache
+// behind a single lookup interface.
+//
+// Values are looked up first in memory and then on disk. Values that are
+// found on disk are promoted back into the memory tier, so frequently used
+// values are served directly from memory without being reread and reparsed.
+//
+// Since values must be serialized to be stored on disk, values stored in a
+// tiered cache must be convertible to and from dynamic values. On disk, they
+// are stored as MessagePack, using the textual form of their key as the disk
+// cache key.
+//
+// Newly computed values are written through to disk immediately, so they
+// survive even if the process terminates abnormally. Values that are evicted
+// from the memory tier (or left in it when the cache is reset/destroyed) are
+// also written to disk if they're somehow not already there (e.g., because the
+// original write failed).
+
+namespace cradle {
+
+struct tiered_cache : noncopyable
+{
+    // The default constructor creates an invalid cache that must be
+    // initialized via reset().
+    tiered_cache();
+
+    // Create a cache that's initialized with the given configs.
+    tiered_cache(
+        immutable_cache_config const& memory_config,
+        disk_cache_config const& disk_config);
+
+    ~tiered_cache();
+
+    // Reset the cache with new configs.
+    // After a successful call to this, the cache is considered initialized.
+    void
+    reset(
+        immutable_cache_config const& memory_config,
+        disk_cache_config const& disk_config);
+
+    // Reset the cache to an uninitialized state.
+    // Any unused values in the memory tier are spilled to disk first.
+    void
+    reset();
+
+    // Is the cache initialized?
+    bool
+    is_initialized()
+    {
+        return memory.is_initialized() && disk.is_initialized();
+    }
+
+    // the two tiers - These can also be used directly.
+    immutable_cache memory;
+    disk_cache disk;
+};
+
+namespace detail {
+
+// This implements look_up_or_compute (below) without compile-time knowledge
+// of the value type.
+//
+// :decode is used to convert values loaded from the disk tier into
+// immutables, and :compute is used to produce the value when it's not
+// available in either tier.
+//
+untyped_immutable
+look_up_or_compute_untyped(
+    tiered_cache& cache,
+    id_interface const& key,
+    function_view<untyped_immutable(dynamic const& value)> const& decode,
+    function_view<untyped_immutable()> const& compute);
+
+} // namespace detail
+
+// Look up the value associated with :key in the tiered cache.
+//
+// If the value is in the memory tier, it's returned directly. If it's only
+// on disk, it's loaded, promoted into the memory tier, and returned. If it's
+// in neither, :compute is invoked to produce it, and the result is stored in
+// both tiers.
+//
+// If another caller is already producing the value for :key, this waits for
+// that result rather than duplicating the effort.
+//
+// Any exception thrown by :compute is propagated to the caller.
+//
+template<class Value, class Compute>
+immutable<Value>
+look_up_or_compute(
+    tiered_cache& cache, id_interface const& key, Compute const& compute)
+{
+    auto decode = [](dynamic const& value) {
+        Value decoded;
+        from_dynamic(&decoded, value);
+        return swap_in_and_erase_type(decoded);
+    };
+    auto compute_untyped = [&]() {
+        Value computed = compute();
+        return swap_in_and_erase_type(computed);
+    };
+    return cast_immutable<Value>(detail::look_up_or_compute_untyped(
+        cache, key, decode, compute_untyped));
+}
+
+} // namespace cradle
+
+#endif
@@ -2,6 +2,7 @@
 #define CRADLE_CONFIG_HPP
 
 #include <cradle/caching/disk_cache.hpp>
+#include <cradle/caching/immutable/cache.hpp>
 
 namespace cradle {
 
@@ -10,11 +11,19 @@ struct server_config
 {
     // config for the disk cache
     omissible<cradle::disk_cache_config> disk_cache;
+    // config for the in-memory cache that sits in front of the disk cache -
+    // If this is omitted, the memory cache is sized adaptively according to
+    // the memory that's available to the process.
+    omissible<cradle::immutable_cache_config> memory_cache;
     // whether or not the server should be open to connections from other
     // machines (defaults to false)
     omissible<bool> open;
     // the WebSocket port on which the server will listen
     omissible<cradle::integer> port;
+    // how long (in seconds) cached copies of mutable Thinknode data (e.g.,
+    // the contents of contexts) are trusted before they're revalidated with
+    // Thinknode (defaults to 60)
+    omissible<cradle::integer> mutable_data_max_age;
 };
 
 } // namespace cradle
@@ -1,5 +1,7 @@
 #include <cradle/encodings/msgpack.h>
 
+#include <cstring>
+
 #include <cradle/encodings/msgpack_internals.h>
 #include <cradle/utilities/text.h>
 
@@ -155,6 +157,68 @@ parse_msgpack_value(
     return read_msgpack_value(ownership, handle.get());
 }
 
+struct msgpack_stream_parser_impl
+{
+    // By default, the unpacker references strings and blobs in its buffer
+    // (which the resulting object's zone keeps alive) rather than copying
+    // them.
+    msgpack::unpacker unpacker;
+    std::shared_ptr<msgpack::object_handle> handle
+        = std::make_shared<msgpack::object_handle>();
+    bool is_complete = false;
+};
+
+msgpack_stream_parser::msgpack_stream_parser()
+    : impl_(new msgpack_stream_parser_impl)
+{
+}
+
+msgpack_stream_parser::~msgpack_stream_parser()
+{
+}
+
+void
+msgpack_stream_parser::reserve(size_t size)
+{
+    impl_->unpacker.reserve_buffer(size);
+}
+
+void
+msgpack_stream_parser::feed(uint8_t const* data, size_t size)
+{
+    if (size == 0)
+        return;
+    if (impl_->is_complete)
+    {
+        CRADLE_THROW(
+            parsing_error() << expected_format_info("MessagePack")
+                            << parsing_error_info(
+                                   "extra data after MessagePack value"));
+    }
+    auto& unpacker = impl_->unpacker;
+    unpacker.reserve_buffer(size);
+    std::memcpy(unpacker.buffer(), data, size);
+    unpacker.buffer_consumed(size);
+    // The unpacker retains its progress, so this only has to parse the new
+    // data.
+    impl_->is_complete = unpacker.next(*impl_->handle);
+}
+
+dynamic
+msgpack_stream_parser::finish()
+{
+    if (!impl_->is_complete)
+    {
+        CRADLE_THROW(
+            parsing_error()
+            << expected_format_info("MessagePack")
+            << parsing_error_info("incomplete MessagePack value"));
+    }
+    ownership_holder ownership;
+    ownership = impl_->handle;
+    return read_msgpack_value(ownership, impl_->handle->get());
+}
+
 string
 value_to_msgpack_string(dynamic const& v)
 {
@@ -21,6 +21,36 @@ dynamic
 parse_msgpack_value(
     ownership_holder const& ownership, uint8_t const* data, size_t size);
 
+// msgpack_stream_parser parses a MessagePack value whose encoding arrives
+// in pieces (e.g., over the network). Each piece is parsed as it arrives, so
+// parsing overlaps with whatever is producing the data. Blobs in the parsed
+// value reference the parser's buffer rather than being copied out of it.
+struct msgpack_stream_parser_impl;
+
+struct msgpack_stream_parser : noncopyable
+{
+    msgpack_stream_parser();
+    ~msgpack_stream_parser();
+
+    // Reserve buffer space for :size more bytes. This is optional, but if the
+    // total size of the data is known in advance, it saves growing the
+    // buffer as the data arrives.
+    void
+    reserve(size_t size);
+
+    // Add the next piece of the encoding.
+    void
+    feed(uint8_t const* data, size_t size);
+
+    // Get the parsed value. This throws a parsing_error if the data that
+    // was fed to the parser didn't form a complete value.
+    dynamic
+    finish();
+
+ private:
+    std::unique_ptr<msgpack_stream_parser_impl> impl_;
+};
+
 string
 value_to_msgpack_string(dynamic const& v);
 
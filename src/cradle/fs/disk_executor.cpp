@@ -0,0 +1,24 @@
+#include <cradle/fs/disk_executor.h>
+
+#include <cradle/utilities/errors.h>
+
+namespace cradle {
+
+void
+disk_executor::execute(
+    check_in_interface& check_in,
+    progress_reporter_interface& reporter,
+    background_job_interface& job_object)
+{
+    disk_job* job = dynamic_cast<disk_job*>(&job_object);
+    if (!job)
+    {
+        CRADLE_THROW(
+            internal_check_failed() << internal_error_message_info(
+                "non-disk job scheduled on disk executor"));
+    }
+
+    job->execute(check_in, reporter);
+}
+
+} // namespace cradle
@@ -0,0 +1,26 @@
+#ifndef CRADLE_FS_DISK_EXECUTOR_H
+#define CRADLE_FS_DISK_EXECUTOR_H
+
+#include <cradle/background/execution_pool.h>
+
+namespace cradle {
+
+// disk_job is the base class for jobs that are executed on a disk pool.
+// Jobs in a disk pool are expected to spend most of their time waiting on
+// the file system, so the pool is kept small.
+struct disk_job : background_job_interface
+{
+};
+
+struct disk_executor
+{
+    void
+    execute(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter,
+        background_job_interface& job);
+};
+
+} // namespace cradle
+
+#endif
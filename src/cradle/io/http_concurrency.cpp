@@ -0,0 +1,181 @@
+#include <cradle/io/http_concurrency.h>
+
+#include <algorithm>
+
+#include <cradle/core/monitoring.h>
+
+namespace cradle {
+
+http_request_outcome
+classify_http_status(int status_code)
+{
+    switch (status_code)
+    {
+        case 429: // Too Many Requests
+        case 503: // Service Unavailable
+            return http_request_outcome::OVERLOADED;
+        default:
+            return (status_code >= 200 && status_code <= 399)
+                       ? http_request_outcome::SUCCESS
+                       : http_request_outcome::IGNORED;
+    }
+}
+
+adaptive_concurrency_limiter::adaptive_concurrency_limiter(
+    adaptive_concurrency_config const& config)
+    : config_(config)
+{
+    // A limit of zero would never let anything through.
+    config_.min_limit = (std::max)(config_.min_limit, 1u);
+    config_.max_limit = (std::max)(config_.max_limit, config_.min_limit);
+    limit_ = std::clamp(
+        double(config_.initial_limit),
+        double(config_.min_limit),
+        double(config_.max_limit));
+}
+
+http_concurrency_ticket
+adaptive_concurrency_limiter::acquire(check_in_interface& check_in, bool timed)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (in_flight_ >= unsigned(limit_))
+    {
+        // Wake up periodically to check in (in case the request has been
+        // canceled while waiting).
+        slot_released_.wait_for(lock, std::chrono::milliseconds(10));
+        lock.unlock();
+        check_in();
+        lock.lock();
+    }
+    ++in_flight_;
+    return http_concurrency_ticket{
+        std::chrono::steady_clock::now(), decrease_count_, timed};
+}
+
+void
+adaptive_concurrency_limiter::release(
+    http_concurrency_ticket const& ticket, http_request_outcome outcome)
+{
+    double latency = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - ticket.start_time)
+                         .count();
+    {
+        std::scoped_lock<std::mutex> lock(mutex_);
+        --in_flight_;
+
+        bool congested = outcome == http_request_outcome::OVERLOADED;
+        if (outcome == http_request_outcome::SUCCESS && ticket.timed)
+        {
+            if (baseline_latency_ != 0
+                && latency > baseline_latency_ * config_.latency_tolerance)
+            {
+                congested = true;
+            }
+            // The baseline tracks the fastest recent latencies, drifting
+            // slowly upward so that it can adapt if the upstream gets
+            // permanently slower.
+            if (baseline_latency_ == 0 || latency < baseline_latency_)
+                baseline_latency_ = latency;
+            else
+                baseline_latency_ += (latency - baseline_latency_) * 0.01;
+        }
+
+        if (congested)
+        {
+            if (ticket.decrease_count == decrease_count_)
+            {
+                limit_ = (std::max)(
+                    limit_ * config_.backoff_ratio, double(config_.min_limit));
+                ++decrease_count_;
+            }
+        }
+        else if (outcome == http_request_outcome::SUCCESS)
+        {
+            // Growing by 1/limit per success adds one slot for each full
+            // window of successful requests.
+            limit_ = (std::min)(
+                limit_ + 1 / limit_, double(config_.max_limit));
+        }
+    }
+    slot_released_.notify_all();
+}
+
+unsigned
+adaptive_concurrency_limiter::limit() const
+{
+    std::scoped_lock<std::mutex> lock(mutex_);
+    return unsigned(limit_);
+}
+
+unsigned
+adaptive_concurrency_limiter::in_flight() const
+{
+    std::scoped_lock<std::mutex> lock(mutex_);
+    return in_flight_;
+}
+
+// Perform a request (via :perform) while holding a slot from the limiter
+// for :request (if any). :streaming indicates whether the response is being
+// streamed (in which case its latency isn't meaningful).
+template<class Perform>
+static http_response
+perform_limited_request(
+    http_concurrency_policy& policy,
+    check_in_interface& check_in,
+    http_request const& request,
+    bool streaming,
+    Perform&& perform)
+{
+    auto* limiter = policy.get_limiter(request);
+    if (!limiter)
+        return perform();
+
+    auto ticket = limiter->acquire(
+        check_in, !streaming && policy.is_latency_meaningful(request));
+    http_response response;
+    try
+    {
+        response = perform();
+    }
+    catch (bad_http_status_code& e)
+    {
+        limiter->release(
+            ticket,
+            classify_http_status(
+                get_required_error_info<http_response_info>(e).status_code));
+        throw;
+    }
+    catch (...)
+    {
+        limiter->release(ticket, http_request_outcome::IGNORED);
+        throw;
+    }
+    limiter->release(ticket, classify_http_status(response.status_code));
+    return response;
+}
+
+http_response
+limited_http_connection::perform_request(
+    check_in_interface& check_in,
+    progress_reporter_interface& reporter,
+    http_request const& request)
+{
+    return perform_limited_request(*policy_, check_in, request, false, [&] {
+        return connection_->perform_request(check_in, reporter, request);
+    });
+}
+
+http_response
+limited_http_connection::perform_streaming_request(
+    check_in_interface& check_in,
+    progress_reporter_interface& reporter,
+    http_request const& request,
+    http_response_sink& sink)
+{
+    return perform_limited_request(*policy_, check_in, request, true, [&] {
+        return connection_->perform_streaming_request(
+            check_in, reporter, request, sink);
+    });
+}
+
+} // namespace cradle
@@ -0,0 +1,159 @@
+#ifndef CRADLE_IO_HTTP_CONCURRENCY_H
+#define CRADLE_IO_HTTP_CONCURRENCY_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include <cradle/io/http_requests.hpp>
+
+// This file provides adaptive limits on the number of HTTP requests that are
+// in flight to a particular upstream service at once.
+//
+// Limits are adjusted according to AIMD (additive increase, multiplicative
+// decrease): a limit grows by one for each window of requests that complete
+// without signs of congestion and is cut by a fixed ratio when the upstream
+// shows signs of overload (429/503 responses or latency well above what it
+// normally takes). This keeps the request rate near what the upstream can
+// actually handle rather than bursting past it and triggering retries.
+//
+// Latency is only a useful signal for requests whose duration reflects how
+// busy the upstream is. Streaming downloads (whose duration depends on their
+// size) and long polls (which wait for something to change on purpose) are
+// judged by their status codes alone.
+
+namespace cradle {
+
+struct adaptive_concurrency_config
+{
+    // the limit to start with
+    unsigned initial_limit = 8;
+    // the bounds on the limit (which is never less than one)
+    unsigned min_limit = 1;
+    unsigned max_limit = 64;
+    // the ratio by which the limit is multiplied when congestion is detected
+    double backoff_ratio = 0.5;
+    // A request whose latency exceeds this multiple of the baseline (i.e.,
+    // typical uncongested) latency is considered a sign of congestion.
+    double latency_tolerance = 3;
+};
+
+// the outcome of a request, as far as concurrency limiting is concerned
+enum class http_request_outcome
+{
+    // The request succeeded.
+    SUCCESS,
+    // The upstream indicated that it's overloaded.
+    OVERLOADED,
+    // The request failed for reasons that say nothing about load (e.g., a
+    // 404 or a canceled request). These are ignored.
+    IGNORED
+};
+
+// Classify an HTTP status code.
+http_request_outcome
+classify_http_status(int status_code);
+
+// An http_concurrency_ticket represents a slot that's been acquired from a
+// limiter. It must be released (exactly once) when the request finishes.
+struct http_concurrency_ticket
+{
+    std::chrono::steady_clock::time_point start_time;
+    // the limiter's decrease count when the ticket was issued
+    unsigned decrease_count;
+    // Is the request's latency a meaningful sign of congestion?
+    bool timed;
+};
+
+struct adaptive_concurrency_limiter : noncopyable
+{
+    adaptive_concurrency_limiter(
+        adaptive_concurrency_config const& config
+        = adaptive_concurrency_config());
+
+    // Wait for a slot to become available.
+    // This calls :check_in periodically while waiting.
+    // If :timed is false, the latency of the request that holds the slot is
+    // ignored, and only its outcome affects the limit.
+    http_concurrency_ticket
+    acquire(check_in_interface& check_in, bool timed = true);
+
+    // Release the slot held by :ticket and adjust the limit according to
+    // the outcome of the request that held it.
+    void
+    release(
+        http_concurrency_ticket const& ticket, http_request_outcome outcome);
+
+    // the current limit
+    unsigned
+    limit() const;
+
+    // the number of slots that are currently held
+    unsigned
+    in_flight() const;
+
+ private:
+    adaptive_concurrency_config config_;
+    mutable std::mutex mutex_;
+    std::condition_variable slot_released_;
+    // the limit (which grows fractionally)
+    double limit_;
+    unsigned in_flight_ = 0;
+    // the baseline latency (in seconds) - This is zero until the first
+    // request succeeds.
+    double baseline_latency_ = 0;
+    // the number of times the limit has been decreased - Requests that were
+    // already in flight when the limit was decreased can't have been
+    // affected by that decrease, so their congestion signals are ignored.
+    unsigned decrease_count_ = 0;
+};
+
+// http_concurrency_policy decides which limiter (if any) governs a request.
+struct http_concurrency_policy
+{
+    // Get the limiter for :request. (If this returns nullptr, the request
+    // isn't limited.)
+    virtual adaptive_concurrency_limiter*
+    get_limiter(http_request const& request)
+        = 0;
+
+    // Does :request's latency say anything about how congested the upstream
+    // is? (Streaming requests are never timed, regardless of this.)
+    virtual bool
+    is_latency_meaningful(http_request const& request)
+    {
+        return true;
+    }
+};
+
+// limited_http_connection wraps another connection and holds a slot from the
+// appropriate limiter for the duration of each request.
+struct limited_http_connection : http_connection_interface
+{
+    limited_http_connection(
+        http_connection_interface& connection, http_concurrency_policy& policy)
+        : connection_(&connection), policy_(&policy)
+    {
+    }
+
+    http_response
+    perform_request(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter,
+        http_request const& request) override;
+
+    http_response
+    perform_streaming_request(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter,
+        http_request const& request,
+        http_response_sink& sink) override;
+
+ private:
+    http_connection_interface* connection_;
+    http_concurrency_policy* policy_;
+};
+
+} // namespace cradle
+
+#endif
@@ -18,8 +18,17 @@ http_request_executor::execute(
                 "non-HTTP job scheduled on HTTP executor"));
     }
 
-    job->connection = &this->connection_;
-    job->execute(check_in, reporter);
+    if (concurrency_)
+    {
+        limited_http_connection limited(connection_, *concurrency_);
+        job->connection = &limited;
+        job->execute(check_in, reporter);
+    }
+    else
+    {
+        job->connection = &this->connection_;
+        job->execute(check_in, reporter);
+    }
 }
 
 } // namespace cradle
@@ -2,18 +2,24 @@
 #define CRADLE_IO_HTTP_EXECUTOR_H
 
 #include <cradle/background/execution_pool.h>
+#include <cradle/io/http_concurrency.h>
 #include <cradle/io/http_requests.hpp>
 
 namespace cradle {
 
 struct http_request_job : background_job_interface
 {
-    http_connection* connection;
+    http_connection_interface* connection;
 };
 
 struct http_request_executor
 {
-    http_request_executor(http_request_system& system) : connection_(system)
+    // If :concurrency is provided, requests are held to the limits that it
+    // specifies. (It must outlive the executor.)
+    http_request_executor(
+        http_request_system& system,
+        http_concurrency_policy* concurrency = nullptr)
+        : connection_(system), concurrency_(concurrency)
     {
     }
 
@@ -25,6 +31,7 @@ struct http_request_executor
 
  private:
     http_connection connection_;
+    http_concurrency_policy* concurrency_;
 };
 
 } // namespace cradle
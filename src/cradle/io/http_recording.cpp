@@ -0,0 +1,630 @@
+#include <cradle/io/asio.h>
+
+#include <cradle/io/http_recording.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <tuple>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <cradle/core/monitoring.h>
+#include <cradle/encodings/msgpack.h>
+#include <cradle/fs/file_io.h>
+#include <cradle/io/raw_memory_io.h>
+#include <cradle/utilities/errors.h>
+
+namespace cradle {
+
+namespace asio = boost::asio;
+using asio::ip::tcp;
+
+// A recording file is a sequence of exchanges. Each is encoded as a
+// MessagePack value, preceded by its length (as a 64-bit big-endian
+// integer).
+
+std::vector<http_exchange>
+read_http_recording(file_path const& path)
+{
+    auto contents = read_file_contents(path);
+    raw_input_buffer buffer(
+        reinterpret_cast<uint8_t const*>(contents.data()), contents.size());
+    raw_memory_reader<raw_input_buffer> reader(buffer);
+    std::vector<http_exchange> exchanges;
+    while (buffer.size() != 0)
+    {
+        auto length = read_int<uint64_t>(reader);
+        if (length > buffer.size())
+        {
+            CRADLE_THROW(
+                corrupt_data() << file_path_info(path)
+                               << internal_error_message_info(
+                                      "truncated HTTP recording"));
+        }
+        exchanges.push_back(from_dynamic<http_exchange>(
+            parse_msgpack_value(buffer.data(), length)));
+        buffer.advance(length);
+    }
+    return exchanges;
+}
+
+struct http_recorder_impl
+{
+    std::mutex mutex;
+    std::ofstream file;
+};
+
+http_recorder::http_recorder(file_path const& path)
+    : impl_(new http_recorder_impl)
+{
+    open_file(
+        impl_->file, path, std::ios::out | std::ios::trunc | std::ios::binary);
+}
+
+http_recorder::~http_recorder()
+{
+}
+
+void
+http_recorder::record(http_exchange const& exchange)
+{
+    auto encoded = value_to_msgpack_string(to_dynamic(exchange));
+    std::scoped_lock<std::mutex> lock(impl_->mutex);
+    raw_memory_writer<std::ofstream> writer(impl_->file);
+    write_string<uint64_t>(writer, encoded);
+    impl_->file.flush();
+}
+
+http_response
+recording_http_connection::perform_request(
+    check_in_interface& check_in,
+    progress_reporter_interface& reporter,
+    http_request const& request)
+{
+    try
+    {
+        auto response
+            = connection_->perform_request(check_in, reporter, request);
+        recorder_->record(http_exchange{redact_request(request), response});
+        return response;
+    }
+    catch (bad_http_status_code& e)
+    {
+        recorder_->record(http_exchange{
+            redact_request(request),
+            get_required_error_info<http_response_info>(e)});
+        throw;
+    }
+}
+
+// Get the target of an HTTP request (i.e., the path and query portion of
+// :url).
+static string
+get_url_target(string const& url)
+{
+    auto scheme_end = url.find("://");
+    auto path_start = url.find_first_of(
+        "/?", scheme_end == string::npos ? 0 : scheme_end + 3);
+    if (path_start == string::npos)
+        return "/";
+    if (url[path_start] == '?')
+        return "/" + url.substr(path_start);
+    return url.substr(path_start);
+}
+
+static string
+get_body_string(blob const& body)
+{
+    return string(reinterpret_cast<char const*>(body.data), body.size);
+}
+
+typedef std::tuple<http_request_method, string, string> http_replay_key;
+
+static http_replay_key
+get_replay_key(http_request const& request)
+{
+    return http_replay_key(
+        request.method,
+        get_url_target(request.url),
+        get_body_string(request.body));
+}
+
+// the recorded responses for a particular request
+struct http_replay_queue
+{
+    std::vector<http_response> responses;
+    // the index of the next response to replay
+    size_t next = 0;
+};
+
+struct http_replayer_impl
+{
+    std::mutex mutex;
+    std::map<http_replay_key, http_replay_queue> queues;
+};
+
+http_replayer::http_replayer(std::vector<http_exchange> const& exchanges)
+    : impl_(new http_replayer_impl)
+{
+    for (auto const& exchange : exchanges)
+    {
+        impl_->queues[get_replay_key(exchange.request)].responses.push_back(
+            exchange.response);
+    }
+}
+
+http_replayer::~http_replayer()
+{
+}
+
+http_response
+http_replayer::next_response(http_request const& request)
+{
+    std::scoped_lock<std::mutex> lock(impl_->mutex);
+    auto queue = impl_->queues.find(get_replay_key(request));
+    if (queue == impl_->queues.end())
+    {
+        CRADLE_THROW(
+            http_request_failure()
+            << attempted_http_request_info(redact_request(request))
+            << internal_error_message_info(
+                   "no matching response in HTTP recording"));
+    }
+    auto& responses = queue->second.responses;
+    auto& next = queue->second.next;
+    auto const& response = responses[next];
+    if (next + 1 < responses.size())
+        ++next;
+    return response;
+}
+
+// Get the size of the pieces in which a response body is delivered at the
+// given bandwidth if a piece is delivered every :interval.
+static size_t
+get_replay_piece_size(
+    optional<size_t> const& bandwidth,
+    size_t body_size,
+    std::chrono::milliseconds interval)
+{
+    if (!bandwidth)
+        return (std::max)(body_size, size_t(1));
+    return (std::max)(
+        *bandwidth * size_t(interval.count()) / 1000, size_t(1));
+}
+
+// the interval at which replayed response bodies are delivered
+static std::chrono::milliseconds const replay_interval(10);
+
+// Sleep for :duration, checking in periodically.
+static void
+replay_delay(check_in_interface& check_in, std::chrono::milliseconds duration)
+{
+    auto end = std::chrono::steady_clock::now() + duration;
+    while (true)
+    {
+        check_in();
+        auto now = std::chrono::steady_clock::now();
+        if (now >= end)
+            break;
+        std::this_thread::sleep_for((std::min)(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                replay_interval),
+            end - now));
+    }
+}
+
+// Deliver the body of :response in pieces (at the rate dictated by
+// :options), passing each piece to :receive.
+template<class Receive>
+void
+replay_response_body(
+    check_in_interface& check_in,
+    progress_reporter_interface& reporter,
+    http_replay_options const& options,
+    http_response const& response,
+    Receive&& receive)
+{
+    auto data = reinterpret_cast<uint8_t const*>(response.body.data);
+    auto size = response.body.size;
+    auto piece_size
+        = get_replay_piece_size(options.bandwidth, size, replay_interval);
+    for (size_t offset = 0; offset < size; offset += piece_size)
+    {
+        if (offset != 0)
+            replay_delay(check_in, replay_interval);
+        receive(data + offset, (std::min)(piece_size, size - offset));
+        reporter(float((std::min)(offset + piece_size, size)) / size);
+    }
+}
+
+// Get the response to :request (after the configured latency) and check its
+// status code.
+static http_response
+start_replayed_response(
+    http_replayer& replayer,
+    http_replay_options const& options,
+    check_in_interface& check_in,
+    http_request const& request)
+{
+    auto response = replayer.next_response(request);
+    replay_delay(check_in, options.latency);
+    if (!is_successful_http_status(request, response.status_code))
+    {
+        CRADLE_THROW(
+            bad_http_status_code()
+            << attempted_http_request_info(redact_request(request))
+            << http_response_info(response));
+    }
+    return response;
+}
+
+http_response
+replaying_http_connection::perform_request(
+    check_in_interface& check_in,
+    progress_reporter_interface& reporter,
+    http_request const& request)
+{
+    auto response
+        = start_replayed_response(*replayer_, options_, check_in, request);
+    replay_response_body(
+        check_in, reporter, options_, response, [](uint8_t const*, size_t) {
+        });
+    return response;
+}
+
+http_response
+replaying_http_connection::perform_streaming_request(
+    check_in_interface& check_in,
+    progress_reporter_interface& reporter,
+    http_request const& request,
+    http_response_sink& sink)
+{
+    auto response
+        = start_replayed_response(*replayer_, options_, check_in, request);
+    if (response.status_code == 304)
+        return response;
+    sink.on_start(response.body.size);
+    replay_response_body(
+        check_in,
+        reporter,
+        options_,
+        response,
+        [&](uint8_t const* data, size_t size) { sink.on_data(data, size); });
+    sink.on_finish();
+    response.body = blob();
+    return response;
+}
+
+// REPLAY SERVER
+
+static optional<http_request_method>
+parse_http_method_name(string const& name)
+{
+    for (auto method :
+         {http_request_method::POST,
+          http_request_method::GET,
+          http_request_method::PUT,
+          http_request_method::DELETE,
+          http_request_method::PATCH,
+          http_request_method::HEAD})
+    {
+        if (boost::to_upper_copy(string(get_value_id(method))) == name)
+            return method;
+    }
+    return none;
+}
+
+struct http_replay_server_impl
+{
+    http_replayer* replayer;
+    http_replay_options options;
+    asio::io_context io_context;
+    tcp::acceptor acceptor;
+    string url;
+    std::thread thread;
+
+    http_replay_server_impl(
+        http_replayer& replayer, http_replay_options const& options)
+        : replayer(&replayer),
+          options(options),
+          acceptor(
+              io_context,
+              tcp::endpoint(asio::ip::address_v4::loopback(), 0))
+    {
+    }
+};
+
+// an individual connection to the replay server
+struct http_replay_session
+    : std::enable_shared_from_this<http_replay_session>
+{
+    http_replay_session(http_replay_server_impl& server)
+        : server(&server),
+          socket(server.io_context),
+          timer(server.io_context)
+    {
+    }
+
+    http_replay_server_impl* server;
+    tcp::socket socket;
+    asio::steady_timer timer;
+    asio::streambuf input;
+
+    // the request currently being processed
+    http_request request;
+    bool keep_alive = true;
+
+    // the response currently being sent
+    string response_head;
+    http_response response;
+    size_t body_offset = 0;
+};
+
+static void
+read_replay_request(std::shared_ptr<http_replay_session> session);
+
+static void
+finish_replay_response(std::shared_ptr<http_replay_session> session)
+{
+    if (session->keep_alive)
+    {
+        read_replay_request(session);
+    }
+    else
+    {
+        boost::system::error_code ignored;
+        session->socket.shutdown(tcp::socket::shutdown_both, ignored);
+    }
+}
+
+static void
+send_replay_body(std::shared_ptr<http_replay_session> session)
+{
+    auto const& body = session->response.body;
+    if (session->request.method == http_request_method::HEAD
+        || session->body_offset >= body.size)
+    {
+        finish_replay_response(session);
+        return;
+    }
+    auto piece_size = (std::min)(
+        get_replay_piece_size(
+            session->server->options.bandwidth, body.size, replay_interval),
+        body.size - session->body_offset);
+    auto send_piece = [session, piece_size] {
+        auto data = reinterpret_cast<char const*>(session->response.body.data)
+                    + session->body_offset;
+        asio::async_write(
+            session->socket,
+            asio::buffer(data, piece_size),
+            [session, piece_size](boost::system::error_code error, size_t) {
+                if (error)
+                    return;
+                session->body_offset += piece_size;
+                send_replay_body(session);
+            });
+    };
+    if (session->body_offset == 0)
+    {
+        send_piece();
+    }
+    else
+    {
+        session->timer.expires_after(replay_interval);
+        session->timer.async_wait(
+            [send_piece](boost::system::error_code error) {
+                if (!error)
+                    send_piece();
+            });
+    }
+}
+
+static void
+send_replay_response(std::shared_ptr<http_replay_session> session)
+{
+    std::ostringstream head;
+    head << "HTTP/1.1 " << session->response.status_code << " \r\n";
+    for (auto const& [name, value] : session->response.headers)
+    {
+        // The body is sent as-is, so any headers describing how it was
+        // originally transferred no longer apply.
+        auto lowercase_name = boost::to_lower_copy(name);
+        if (lowercase_name != "content-length"
+            && lowercase_name != "content-encoding"
+            && lowercase_name != "transfer-encoding"
+            && lowercase_name != "connection")
+        {
+            head << name << ": " << value << "\r\n";
+        }
+    }
+    head << "Content-Length: " << session->response.body.size << "\r\n";
+    if (!session->keep_alive)
+        head << "Connection: close\r\n";
+    head << "\r\n";
+    session->response_head = head.str();
+    session->body_offset = 0;
+
+    auto send_head = [session] {
+        asio::async_write(
+            session->socket,
+            asio::buffer(session->response_head),
+            [session](boost::system::error_code error, size_t) {
+                if (!error)
+                    send_replay_body(session);
+            });
+    };
+    session->timer.expires_after(session->server->options.latency);
+    session->timer.async_wait([send_head](boost::system::error_code error) {
+        if (!error)
+            send_head();
+    });
+}
+
+static void
+respond_to_replay_request(std::shared_ptr<http_replay_session> session)
+{
+    try
+    {
+        session->response
+            = session->server->replayer->next_response(session->request);
+    }
+    catch (http_request_failure&)
+    {
+        session->response = make_http_200_response(
+            "no matching response in HTTP recording");
+        session->response.status_code = 404;
+    }
+    send_replay_response(session);
+}
+
+static void
+read_replay_request_body(
+    std::shared_ptr<http_replay_session> session, size_t content_length)
+{
+    auto& input = session->input;
+    if (input.size() < content_length)
+    {
+        asio::async_read(
+            session->socket,
+            input,
+            asio::transfer_exactly(content_length - input.size()),
+            [session, content_length](
+                boost::system::error_code error, size_t) {
+                if (!error)
+                    read_replay_request_body(session, content_length);
+            });
+        return;
+    }
+    auto data = asio::buffers_begin(input.data());
+    session->request.body
+        = make_string_blob(string(data, data + content_length));
+    input.consume(content_length);
+    respond_to_replay_request(session);
+}
+
+// Process the head of a request (which has been read into the session's input
+// buffer and is :head_length bytes long).
+static void
+process_replay_request_head(
+    std::shared_ptr<http_replay_session> session, size_t head_length)
+{
+    auto data = asio::buffers_begin(session->input.data());
+    std::istringstream head(string(data, data + head_length));
+    session->input.consume(head_length);
+
+    string line;
+    std::getline(head, line);
+    std::vector<string> request_line;
+    boost::split(
+        request_line,
+        boost::trim_copy(line),
+        boost::is_any_of(" "),
+        boost::token_compress_on);
+    auto method = request_line.size() == 3
+                      ? parse_http_method_name(request_line[0])
+                      : none;
+    if (!method)
+    {
+        session->response = make_http_200_response("bad request");
+        session->response.status_code = 400;
+        session->keep_alive = false;
+        send_replay_response(session);
+        return;
+    }
+
+    session->request
+        = http_request{*method, request_line[1], {}, blob(), none};
+    session->keep_alive = request_line[2] != "HTTP/1.0";
+    size_t content_length = 0;
+    bool expects_continue = false;
+    while (std::getline(head, line) && line != "\r")
+    {
+        auto index = line.find(':');
+        if (index == string::npos)
+            continue;
+        auto name = boost::trim_copy(line.substr(0, index));
+        auto value = boost::trim_copy(line.substr(index + 1));
+        auto lowercase_name = boost::to_lower_copy(name);
+        if (lowercase_name == "content-length")
+            content_length = boost::lexical_cast<size_t>(value);
+        else if (lowercase_name == "connection")
+            session->keep_alive = !boost::iequals(value, "close");
+        else if (lowercase_name == "expect")
+            expects_continue = boost::iequals(value, "100-continue");
+        session->request.headers[name] = value;
+    }
+
+    if (expects_continue)
+    {
+        static string const continue_response
+            = "HTTP/1.1 100 Continue\r\n\r\n";
+        asio::async_write(
+            session->socket,
+            asio::buffer(continue_response),
+            [session, content_length](
+                boost::system::error_code error, size_t) {
+                if (!error)
+                    read_replay_request_body(session, content_length);
+            });
+    }
+    else
+    {
+        read_replay_request_body(session, content_length);
+    }
+}
+
+static void
+read_replay_request(std::shared_ptr<http_replay_session> session)
+{
+    asio::async_read_until(
+        session->socket,
+        session->input,
+        "\r\n\r\n",
+        [session](boost::system::error_code error, size_t head_length) {
+            if (!error)
+                process_replay_request_head(session, head_length);
+        });
+}
+
+static void
+accept_replay_connection(http_replay_server_impl& server)
+{
+    auto session = std::make_shared<http_replay_session>(server);
+    server.acceptor.async_accept(
+        session->socket, [&server, session](boost::system::error_code error) {
+            if (error)
+                return;
+            read_replay_request(session);
+            accept_replay_connection(server);
+        });
+}
+
+http_replay_server::http_replay_server(
+    http_replayer& replayer, http_replay_options const& options)
+    : impl_(new http_replay_server_impl(replayer, options))
+{
+    impl_->url = "http://127.0.0.1:"
+                 + std::to_string(impl_->acceptor.local_endpoint().port());
+    accept_replay_connection(*impl_);
+    impl_->thread = std::thread(
+        [impl = impl_.get()] { impl->io_context.run(); });
+}
+
+http_replay_server::~http_replay_server()
+{
+    impl_->io_context.stop();
+    impl_->thread.join();
+}
+
+string const&
+http_replay_server::url() const
+{
+    return impl_->url;
+}
+
+} // namespace cradle
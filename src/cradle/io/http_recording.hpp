@@ -0,0 +1,183 @@
+#ifndef CRADLE_IO_HTTP_RECORDING_HPP
+#define CRADLE_IO_HTTP_RECORDING_HPP
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <cradle/io/http_requests.hpp>
+
+// This file provides facilities for recording the HTTP traffic that passes
+// through an http_connection_interface and for replaying it later (either
+// through a connection or through a local stand-in HTTP server), so that
+// code that talks to remote services can be exercised and benchmarked
+// without network access.
+
+namespace cradle {
+
+// An HTTP exchange is a single request and the response it received.
+// (Requests are recorded with their Authorization headers redacted.)
+api(struct internal)
+struct http_exchange
+{
+    http_request request;
+    http_response response;
+};
+
+// RECORDING
+
+// Read all the exchanges in the recording file at :path.
+std::vector<http_exchange>
+read_http_recording(file_path const& path);
+
+struct http_recorder_impl;
+
+// http_recorder writes exchanges to a recording file (replacing whatever was
+// already there). Exchanges are written out as they're recorded, so the file
+// is usable even if the recording process doesn't shut down cleanly.
+//
+// A recorder is internally protected by a mutex, so any number of recording
+// connections (on any number of threads) can share one.
+//
+struct http_recorder : noncopyable
+{
+    http_recorder(file_path const& path);
+    ~http_recorder();
+
+    void
+    record(http_exchange const& exchange);
+
+ private:
+    std::unique_ptr<http_recorder_impl> impl_;
+};
+
+// recording_http_connection wraps another connection and records every
+// exchange that passes through it (including ones that produce bad status
+// codes).
+struct recording_http_connection : http_connection_interface
+{
+    recording_http_connection(
+        http_connection_interface& connection, http_recorder& recorder)
+        : connection_(&connection), recorder_(&recorder)
+    {
+    }
+
+    http_response
+    perform_request(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter,
+        http_request const& request) override;
+
+ private:
+    http_connection_interface* connection_;
+    http_recorder* recorder_;
+};
+
+// REPLAYING
+
+struct http_replayer_impl;
+
+// http_replayer answers requests from a set of recorded exchanges.
+//
+// Requests are matched on their method, the path and query portion of their
+// URL, and their body. (Headers are ignored, as is the host, so traffic
+// that was recorded against one server can be replayed in place of
+// another.) If the same request was recorded several times (e.g., polling a
+// calculation's status), the recorded responses are replayed in order, and
+// the last one is repeated once they run out.
+//
+// A replayer is internally protected by a mutex, so it can be shared by any
+// number of connections and servers.
+//
+struct http_replayer : noncopyable
+{
+    http_replayer(std::vector<http_exchange> const& exchanges);
+    ~http_replayer();
+
+    // Get the response to :request.
+    // If nothing in the recording matches :request, this throws
+    // http_request_failure.
+    http_response
+    next_response(http_request const& request);
+
+ private:
+    std::unique_ptr<http_replayer_impl> impl_;
+};
+
+// http_replay_options controls how realistically responses are delivered.
+struct http_replay_options
+{
+    // the delay before each response starts to arrive
+    std::chrono::milliseconds latency = std::chrono::milliseconds(0);
+
+    // the rate (in bytes per second) at which response bodies are delivered
+    // - If this is omitted, bodies are delivered instantly.
+    optional<size_t> bandwidth;
+};
+
+// replaying_http_connection answers requests from an http_replayer, so it
+// can stand in for an http_connection without any network access.
+//
+// Like a real connection, it throws bad_http_status_code for responses
+// outside the 2xx range, and it calls check_in and reports progress while
+// responses are (artificially) arriving.
+//
+struct replaying_http_connection : http_connection_interface
+{
+    replaying_http_connection(
+        http_replayer& replayer,
+        http_replay_options const& options = http_replay_options())
+        : replayer_(&replayer), options_(options)
+    {
+    }
+
+    http_response
+    perform_request(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter,
+        http_request const& request) override;
+
+    http_response
+    perform_streaming_request(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter,
+        http_request const& request,
+        http_response_sink& sink) override;
+
+ private:
+    http_replayer* replayer_;
+    http_replay_options options_;
+};
+
+struct http_replay_server_impl;
+
+// http_replay_server is a local HTTP server that answers requests from an
+// http_replayer. It listens on an ephemeral port on the loopback interface,
+// so (unlike replaying_http_connection) it exercises the real HTTP stack,
+// and code that only knows how to talk to a URL (e.g., a Thinknode session's
+// API URL) can be pointed at it.
+//
+// Requests that don't match anything in the recording receive a 404
+// response.
+//
+// The server runs on a thread of its own from construction until
+// destruction.
+//
+struct http_replay_server : noncopyable
+{
+    http_replay_server(
+        http_replayer& replayer,
+        http_replay_options const& options = http_replay_options());
+    ~http_replay_server();
+
+    // the URL of the server (e.g., "http://127.0.0.1:41234")
+    string const&
+    url() const;
+
+ private:
+    std::unique_ptr<http_replay_server_impl> impl_;
+};
+
+} // namespace cradle
+
+#endif
@@ -1,7 +1,13 @@
 #include <cradle/io/http_requests.hpp>
 
+#include <atomic>
 #include <cstring>
 #include <filesystem>
+#include <map>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
 
 #include <boost/algorithm/string.hpp>
 
@@ -43,35 +49,152 @@ make_http_200_response(string body)
     return response;
 }
 
+optional<string>
+find_http_header(http_header_list const& headers, string const& name)
+{
+    for (auto const& [header_name, value] : headers)
+    {
+        if (boost::iequals(header_name, name))
+            return value;
+    }
+    return none;
+}
+
+http_validators
+get_http_validators(http_response const& response)
+{
+    return http_validators{
+        find_http_header(response.headers, "ETag"),
+        find_http_header(response.headers, "Last-Modified")};
+}
+
+http_request
+make_conditional_request(
+    http_request request, http_validators const& validators)
+{
+    if (validators.etag)
+        request.headers["If-None-Match"] = *validators.etag;
+    if (validators.last_modified)
+        request.headers["If-Modified-Since"] = *validators.last_modified;
+    return request;
+}
+
+bool
+is_conditional_request(http_request const& request)
+{
+    return find_http_header(request.headers, "If-None-Match")
+           || find_http_header(request.headers, "If-Modified-Since");
+}
+
+bool
+is_successful_http_status(http_request const& request, int status_code)
+{
+    return (status_code >= 200 && status_code <= 299)
+           || (status_code == 304 && is_conditional_request(request));
+}
+
 static string
 get_method_name(http_request_method method)
 {
     return boost::to_upper_copy(string(get_value_id(method)));
 };
 
+struct http_request_system_impl
+{
+    // the data that's shared across all the system's CURL handles
+    CURLSH* share = nullptr;
+    // CURL requires us to do the locking for the shared data.
+    std::mutex share_mutexes[CURL_LOCK_DATA_LAST];
+    // (See http_transfer_counts.)
+    std::atomic<size_t> transfer_count{0};
+    std::atomic<size_t> new_connection_count{0};
+};
+
+static void
+lock_shared_curl_data(
+    CURL* curl, curl_lock_data data, curl_lock_access access, void* userptr)
+{
+    static_cast<http_request_system_impl*>(userptr)
+        ->share_mutexes[data]
+        .lock();
+}
+
+static void
+unlock_shared_curl_data(CURL* curl, curl_lock_data data, void* userptr)
+{
+    static_cast<http_request_system_impl*>(userptr)
+        ->share_mutexes[data]
+        .unlock();
+}
+
 http_request_system::http_request_system()
 {
     if (curl_global_init(CURL_GLOBAL_ALL))
     {
         CRADLE_THROW(http_request_system_error());
     }
+
+    impl_.reset(new http_request_system_impl);
+    CURLSH* share = curl_share_init();
+    if (!share)
+    {
+        curl_global_cleanup();
+        CRADLE_THROW(http_request_system_error());
+    }
+    impl_->share = share;
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock_shared_curl_data);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock_shared_curl_data);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, impl_.get());
+    // Note that connections themselves aren't shared this way, since libcurl
+    // doesn't support using a shared connection cache from concurrent
+    // threads. (Use an http_request_loop to share connections.)
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
 }
 http_request_system::~http_request_system()
 {
+    curl_share_cleanup(impl_->share);
     curl_global_cleanup();
 }
 
+http_transfer_counts
+http_request_system::transfer_counts() const
+{
+    http_transfer_counts counts;
+    counts.transfer_count = impl_->transfer_count;
+    counts.new_connection_count = impl_->new_connection_count;
+    return counts;
+}
+
+// Record the transfer that :curl just finished in :system's counts.
+static void
+count_transfer(http_request_system_impl& system, CURL* curl)
+{
+    long new_connections = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connections);
+    ++system.transfer_count;
+    system.new_connection_count
+        += boost::numeric_cast<size_t>(new_connections);
+}
+
 struct http_connection_impl
 {
     CURL* curl;
+    http_request_system_impl* system;
 };
 
+// Reset :curl to the options that all requests share.
 static void
-reset_curl_connection(http_connection_impl& connection)
+reset_curl_handle(CURL* curl, CURLSH* share)
 {
-    CURL* curl = connection.curl;
     curl_easy_reset(curl);
 
+    // Use the system's shared DNS and TLS session caches.
+    curl_easy_setopt(curl, CURLOPT_SHARE, share);
+
+    // Use HTTP/2 for HTTPS requests when the server supports it.
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+
     // Allow requests to be redirected.
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
 
@@ -85,6 +208,12 @@ reset_curl_connection(http_connection_impl& connection)
     curl_easy_setopt(curl, CURLOPT_SSL_OPTIONS, CURLSSLOPT_NATIVE_CA);
 }
 
+static void
+reset_curl_connection(http_connection_impl& connection)
+{
+    reset_curl_handle(connection.curl, connection.system->share);
+}
+
 http_connection::http_connection(http_request_system& system)
 {
     impl_.reset(new http_connection_impl);
@@ -95,6 +224,7 @@ http_connection::http_connection(http_request_system& system)
         CRADLE_THROW(http_request_system_error());
     }
     impl_->curl = curl;
+    impl_->system = system.impl_.get();
 }
 http_connection::~http_connection()
 {
@@ -137,6 +267,20 @@ struct receive_transmission_state
     size_t buffer_length = 0;
     size_t write_position = 0;
 
+    // The rest of this is only used for response bodies.
+
+    // the handle that's receiving the body (for querying the response)
+    CURL* curl = nullptr;
+    // If this is set, successful response bodies are passed here rather than
+    // being accumulated in :buffer.
+    http_response_sink* sink = nullptr;
+    // Has the body started arriving?
+    bool started = false;
+    // Is the body being passed to :sink?
+    bool streaming = false;
+    // an exception that was thrown while receiving the body
+    std::exception_ptr error;
+
     receive_transmission_state() : buffer(nullptr, free)
     {
     }
@@ -180,6 +324,76 @@ record_http_response(void* ptr, size_t size, size_t nmemb, void* userdata)
     return n_bytes;
 }
 
+// Get the size of the response body that :curl is receiving (if known).
+static optional<size_t>
+get_content_length(CURL* curl)
+{
+    curl_off_t length = -1;
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+    if (length < 0)
+        return none;
+    return size_t(length);
+}
+
+static bool
+is_successful_status(long status_code)
+{
+    return status_code >= 200 && status_code <= 299;
+}
+
+// This is called when the response body starts arriving (at which point the
+// status code and headers are known).
+static void
+start_http_body(receive_transmission_state& state)
+{
+    state.started = true;
+    auto content_length = get_content_length(state.curl);
+    long status_code = 0;
+    curl_easy_getinfo(state.curl, CURLINFO_RESPONSE_CODE, &status_code);
+    if (state.sink && is_successful_status(status_code))
+    {
+        state.streaming = true;
+        state.sink->on_start(content_length);
+    }
+    else if (content_length && *content_length > 4096)
+    {
+        // Allocate the whole buffer up front rather than growing it as the
+        // body arrives. (The body may be compressed, in which case it will
+        // still have to grow, but this is still a much better starting
+        // point.)
+        char* allocation = reinterpret_cast<char*>(malloc(*content_length));
+        if (!allocation)
+            throw std::bad_alloc();
+        state.buffer = malloc_buffer_ptr(allocation, free);
+        state.buffer_length = *content_length;
+        state.write_position = 0;
+    }
+}
+
+static size_t
+receive_http_body(void* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    receive_transmission_state& state
+        = *reinterpret_cast<receive_transmission_state*>(userdata);
+    try
+    {
+        if (!state.started)
+            start_http_body(state);
+        if (state.streaming)
+        {
+            size_t n_bytes = size * nmemb;
+            state.sink->on_data(reinterpret_cast<uint8_t*>(ptr), n_bytes);
+            return n_bytes;
+        }
+    }
+    catch (...)
+    {
+        state.error = std::current_exception();
+        return 0;
+    }
+    return record_http_response(ptr, size, nmemb, userdata);
+}
+
 static void
 set_up_send_transmission(
     CURL* curl,
@@ -194,8 +408,12 @@ set_up_send_transmission(
 
 struct curl_progress_data
 {
-    check_in_interface* check_in;
-    progress_reporter_interface* reporter;
+    // Either of these can be null, in which case it's simply skipped.
+    check_in_interface* check_in = nullptr;
+    progress_reporter_interface* reporter = nullptr;
+    // If the check-in (or reporter) throws, the transfer is aborted and the
+    // exception is saved here.
+    std::exception_ptr error;
 };
 
 static int
@@ -205,14 +423,19 @@ curl_progress_callback(
     curl_progress_data* data = reinterpret_cast<curl_progress_data*>(clientp);
     try
     {
-        (*data->check_in)();
-        (*data->reporter)(
-            (dltotal + ultotal == 0)
-                ? 0.f
-                : float((dlnow + ulnow) / (dltotal + ultotal)));
+        if (data->check_in)
+            (*data->check_in)();
+        if (data->reporter)
+        {
+            (*data->reporter)(
+                (dltotal + ultotal == 0)
+                    ? 0.f
+                    : float((dlnow + ulnow) / (dltotal + ultotal)));
+        }
     }
     catch (...)
     {
+        data->error = std::current_exception();
         return 1;
     }
     return 0;
@@ -224,7 +447,7 @@ struct scoped_curl_slist
     {
         curl_slist_free_all(list);
     }
-    curl_slist* list;
+    curl_slist* list = NULL;
 };
 
 static blob
@@ -247,28 +470,35 @@ redact_request(http_request request)
     return request;
 }
 
-http_response
-http_connection::perform_request(
-    check_in_interface& check_in,
-    progress_reporter_interface& reporter,
-    http_request const& request)
+// curl_transfer holds everything that CURL needs access to while it's
+// performing a request.
+struct curl_transfer
 {
-    CRADLE_LOG_CALL(<< CRADLE_LOG_ARG(request))
+    http_request request;
+    // If this is set, the response body is streamed here.
+    http_response_sink* sink = nullptr;
+    scoped_curl_slist headers;
+    send_transmission_state send_state;
+    receive_transmission_state body_receive_state;
+    receive_transmission_state header_receive_state;
+    curl_progress_data progress_data;
+};
 
-    CURL* curl = impl_->curl;
-    assert(curl);
-    reset_curl_connection(*impl_);
+// Configure :curl to perform the request in :transfer.
+// (:curl is assumed to be freshly reset.)
+static void
+set_up_curl_transfer(CURL* curl, curl_transfer& transfer)
+{
+    auto const& request = transfer.request;
 
     // Set the headers for the request.
-    scoped_curl_slist curl_headers;
-    curl_headers.list = NULL;
     for (auto const& header : request.headers)
     {
         auto header_string = header.first + ":" + header.second;
-        curl_headers.list
-            = curl_slist_append(curl_headers.list, header_string.c_str());
+        transfer.headers.list
+            = curl_slist_append(transfer.headers.list, header_string.c_str());
     }
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, curl_headers.list);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer.headers.list);
 
     curl_easy_setopt(curl, CURLOPT_URL, request.url.c_str());
     if (request.socket)
@@ -278,22 +508,22 @@ http_connection::perform_request(
     }
 
     // Set up for receiving the response body.
-    receive_transmission_state body_receive_state;
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, record_http_response);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body_receive_state);
+    transfer.body_receive_state.curl = curl;
+    transfer.body_receive_state.sink = transfer.sink;
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, receive_http_body);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer.body_receive_state);
 
     // Set up for receiving the response headers.
-    receive_transmission_state header_receive_state;
     curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, record_http_response);
-    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &header_receive_state);
+    curl_easy_setopt(
+        curl, CURLOPT_HEADERDATA, &transfer.header_receive_state);
 
     // Let CURL know what the method is and set up for sending the body if
     // necessary.
-    send_transmission_state send_state;
     switch (request.method)
     {
         case http_request_method::PUT:
-            set_up_send_transmission(curl, send_state, request);
+            set_up_send_transmission(curl, transfer.send_state, request);
             curl_easy_setopt(curl, CURLOPT_UPLOAD, 1);
             curl_easy_setopt(
                 curl, CURLOPT_INFILESIZE_LARGE, curl_off_t(request.body.size));
@@ -304,7 +534,7 @@ http_connection::perform_request(
             // uses a custom request type.
             curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PATCH");
         case http_request_method::POST:
-            set_up_send_transmission(curl, send_state, request);
+            set_up_send_transmission(curl, transfer.send_state, request);
             curl_easy_setopt(curl, CURLOPT_POST, 1);
             curl_easy_setopt(
                 curl,
@@ -326,20 +556,27 @@ http_connection::perform_request(
     }
 
     // Set up progress monitoring.
-    curl_progress_data progress_data;
-    progress_data.check_in = &check_in;
-    progress_data.reporter = &reporter;
     curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0);
     curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, curl_progress_callback);
-    curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, &progress_data);
-
-    // Perform the request.
-    CURLcode result = curl_easy_perform(curl);
+    curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, &transfer.progress_data);
+}
 
-    // Check in again here because if the job was canceled inside the above
-    // call, it will just look like an error. We need the cancellation
-    // exception to be rethrown.
-    check_in();
+// Construct the response to a transfer that CURL has finished (with
+// :result). This throws if the transfer failed.
+static http_response
+finish_curl_transfer(CURL* curl, curl_transfer& transfer, CURLcode result)
+{
+    auto const& request = transfer.request;
+
+    // If the transfer was aborted by the check-in (e.g., because the job was
+    // canceled), it will just look like an error, so rethrow the original
+    // exception.
+    if (transfer.progress_data.error)
+        std::rethrow_exception(transfer.progress_data.error);
+    // Similarly, if something went wrong while receiving the body (e.g., the
+    // sink rejected it), report that.
+    if (transfer.body_receive_state.error)
+        std::rethrow_exception(transfer.body_receive_state.error);
 
     // Check for low-level CURL errors.
     if (result != CURLE_OK)
@@ -353,6 +590,7 @@ http_connection::perform_request(
     // Parse the response headers.
     http_header_list response_headers;
     {
+        auto const& header_receive_state = transfer.header_receive_state;
         std::istringstream response_header_text(string(
             header_receive_state.buffer.get(),
             header_receive_state.buffer_length));
@@ -373,14 +611,14 @@ http_connection::perform_request(
 
     // Construct the response.
     http_response response;
-    response.body = make_blob(std::move(body_receive_state));
+    response.body = make_blob(std::move(transfer.body_receive_state));
     response.headers = std::move(response_headers);
     long status_code;
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
     response.status_code = boost::numeric_cast<int>(status_code);
 
     // Check the status code.
-    if (status_code < 200 || status_code > 299)
+    if (!is_successful_http_status(request, response.status_code))
     {
         CRADLE_THROW(
             bad_http_status_code()
@@ -388,7 +626,339 @@ http_connection::perform_request(
             << http_response_info(response));
     }
 
+    // Let the sink know that the body is done. (If the body was empty, the
+    // sink hasn't heard anything about it yet.)
+    if (transfer.sink && response.status_code != 304)
+    {
+        if (!transfer.body_receive_state.started)
+            transfer.sink->on_start(get_content_length(curl));
+        transfer.sink->on_finish();
+    }
+
     return response;
 }
 
+static http_response
+perform_connection_request(
+    http_connection_impl& connection,
+    check_in_interface& check_in,
+    progress_reporter_interface& reporter,
+    http_request const& request,
+    http_response_sink* sink)
+{
+    CRADLE_LOG_CALL(<< CRADLE_LOG_ARG(request))
+
+    CURL* curl = connection.curl;
+    assert(curl);
+    reset_curl_connection(connection);
+
+    curl_transfer transfer;
+    transfer.request = request;
+    transfer.sink = sink;
+    transfer.progress_data.check_in = &check_in;
+    transfer.progress_data.reporter = &reporter;
+    set_up_curl_transfer(curl, transfer);
+
+    // Perform the request.
+    CURLcode result = curl_easy_perform(curl);
+    count_transfer(*connection.system, curl);
+
+    // Check in again here because if the job was canceled inside the above
+    // call, it will just look like an error. We need the cancellation
+    // exception to be rethrown.
+    check_in();
+
+    return finish_curl_transfer(curl, transfer, result);
+}
+
+http_response
+http_connection::perform_request(
+    check_in_interface& check_in,
+    progress_reporter_interface& reporter,
+    http_request const& request)
+{
+    return perform_connection_request(
+        *impl_, check_in, reporter, request, nullptr);
+}
+
+http_response
+http_connection::perform_streaming_request(
+    check_in_interface& check_in,
+    progress_reporter_interface& reporter,
+    http_request const& request,
+    http_response_sink& sink)
+{
+    return perform_connection_request(
+        *impl_, check_in, reporter, request, &sink);
+}
+
+// HTTP REQUEST LOOP
+
+// a request that's been submitted to an http_request_loop
+struct http_loop_request
+{
+    curl_transfer transfer;
+    http_response_callback on_response;
+    http_failure_callback on_failure;
+};
+
+struct http_request_loop_impl
+{
+    CURLM* multi = nullptr;
+    http_request_system_impl* system = nullptr;
+
+    // Everything up to the thread is protected by this mutex.
+    std::mutex mutex;
+    // requests that have been submitted but not yet started
+    std::vector<std::unique_ptr<http_loop_request>> submitted;
+    // Has the loop been asked to stop?
+    bool stopping = false;
+
+    // The rest is only accessed by the loop's thread.
+
+    // the requests that CURL is currently performing
+    std::map<CURL*, std::unique_ptr<http_loop_request>> active;
+    // easy handles that are available for new requests
+    std::vector<CURL*> idle_handles;
+
+    std::thread thread;
+};
+
+static void
+fail_loop_request(http_loop_request& request, char const* message)
+{
+    try
+    {
+        CRADLE_THROW(
+            http_request_failure()
+            << attempted_http_request_info(
+                   redact_request(request.transfer.request))
+            << internal_error_message_info(message));
+    }
+    catch (...)
+    {
+        request.on_failure(std::current_exception());
+    }
+}
+
+static void
+start_loop_request(
+    http_request_loop_impl& loop, std::unique_ptr<http_loop_request> request)
+{
+    CURL* curl;
+    if (loop.idle_handles.empty())
+    {
+        curl = curl_easy_init();
+        if (!curl)
+        {
+            fail_loop_request(*request, "failed to create CURL handle");
+            return;
+        }
+    }
+    else
+    {
+        curl = loop.idle_handles.back();
+        loop.idle_handles.pop_back();
+    }
+
+    reset_curl_handle(curl, loop.system->share);
+    // If there's already a connection to the host that's still negotiating
+    // whether it can multiplex, wait for it rather than opening another one.
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    set_up_curl_transfer(curl, request->transfer);
+    if (curl_multi_add_handle(loop.multi, curl) != CURLM_OK)
+    {
+        loop.idle_handles.push_back(curl);
+        fail_loop_request(*request, "failed to add CURL handle");
+        return;
+    }
+    loop.active[curl] = std::move(request);
+}
+
+static void
+finish_loop_request(http_request_loop_impl& loop, CURL* curl, CURLcode result)
+{
+    auto i = loop.active.find(curl);
+    if (i == loop.active.end())
+        return;
+    auto request = std::move(i->second);
+    loop.active.erase(i);
+    curl_multi_remove_handle(loop.multi, curl);
+    count_transfer(*loop.system, curl);
+
+    optional<http_response> response;
+    std::exception_ptr error;
+    try
+    {
+        response = finish_curl_transfer(curl, request->transfer, result);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    loop.idle_handles.push_back(curl);
+
+    if (response)
+        request->on_response(std::move(*response));
+    else
+        request->on_failure(std::move(error));
+}
+
+static void
+run_http_request_loop(http_request_loop_impl& loop)
+{
+    while (true)
+    {
+        std::vector<std::unique_ptr<http_loop_request>> submitted;
+        bool stopping;
+        {
+            std::scoped_lock<std::mutex> lock(loop.mutex);
+            std::swap(submitted, loop.submitted);
+            stopping = loop.stopping;
+        }
+
+        if (stopping)
+        {
+            for (auto& request : submitted)
+                fail_loop_request(*request, "request loop shut down");
+            for (auto& [curl, request] : loop.active)
+            {
+                curl_multi_remove_handle(loop.multi, curl);
+                loop.idle_handles.push_back(curl);
+                fail_loop_request(*request, "request loop shut down");
+            }
+            loop.active.clear();
+            return;
+        }
+
+        for (auto& request : submitted)
+            start_loop_request(loop, std::move(request));
+
+        int running_count;
+        curl_multi_perform(loop.multi, &running_count);
+
+        CURLMsg* message;
+        int remaining_count;
+        while ((message = curl_multi_info_read(loop.multi, &remaining_count)))
+        {
+            if (message->msg == CURLMSG_DONE)
+            {
+                finish_loop_request(
+                    loop, message->easy_handle, message->data.result);
+            }
+        }
+
+        // Wait for network activity (or a new request). The timeout bounds
+        // how long it can be between check-ins.
+        curl_multi_poll(loop.multi, nullptr, 0, 100, nullptr);
+    }
+}
+
+http_request_loop::http_request_loop(http_request_system& system)
+    : impl_(new http_request_loop_impl)
+{
+    impl_->multi = curl_multi_init();
+    if (!impl_->multi)
+    {
+        CRADLE_THROW(http_request_system_error());
+    }
+    curl_multi_setopt(impl_->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    impl_->system = system.impl_.get();
+    impl_->thread = std::thread(run_http_request_loop, std::ref(*impl_));
+}
+
+http_request_loop::~http_request_loop()
+{
+    {
+        std::scoped_lock<std::mutex> lock(impl_->mutex);
+        impl_->stopping = true;
+    }
+    curl_multi_wakeup(impl_->multi);
+    impl_->thread.join();
+    for (CURL* curl : impl_->idle_handles)
+        curl_easy_cleanup(curl);
+    curl_multi_cleanup(impl_->multi);
+}
+
+void
+http_request_loop::start_request(
+    http_request request,
+    http_response_callback on_response,
+    http_failure_callback on_failure,
+    check_in_interface* check_in,
+    progress_reporter_interface* reporter,
+    http_response_sink* sink)
+{
+    CRADLE_LOG_CALL(<< CRADLE_LOG_ARG(request))
+
+    auto loop_request = std::make_unique<http_loop_request>();
+    loop_request->transfer.request = std::move(request);
+    loop_request->transfer.sink = sink;
+    loop_request->transfer.progress_data.check_in = check_in;
+    loop_request->transfer.progress_data.reporter = reporter;
+    loop_request->on_response = std::move(on_response);
+    loop_request->on_failure = std::move(on_failure);
+    {
+        std::scoped_lock<std::mutex> lock(impl_->mutex);
+        impl_->submitted.push_back(std::move(loop_request));
+    }
+    curl_multi_wakeup(impl_->multi);
+}
+
+static std::future<http_response>
+start_request_with_future(
+    http_request_loop& loop,
+    http_request request,
+    check_in_interface* check_in,
+    progress_reporter_interface* reporter,
+    http_response_sink* sink)
+{
+    auto promise = std::make_shared<std::promise<http_response>>();
+    auto future = promise->get_future();
+    loop.start_request(
+        std::move(request),
+        [promise](http_response response) {
+            promise->set_value(std::move(response));
+        },
+        [promise](std::exception_ptr error) {
+            promise->set_exception(std::move(error));
+        },
+        check_in,
+        reporter,
+        sink);
+    return future;
+}
+
+std::future<http_response>
+start_http_request(http_request_loop& loop, http_request request)
+{
+    return start_request_with_future(
+        loop, std::move(request), nullptr, nullptr, nullptr);
+}
+
+http_response
+multiplexed_http_connection::perform_request(
+    check_in_interface& check_in,
+    progress_reporter_interface& reporter,
+    http_request const& request)
+{
+    // Since this waits for the request to finish, the check-in and reporter
+    // remain valid for as long as the loop needs them.
+    return start_request_with_future(
+               *loop_, request, &check_in, &reporter, nullptr)
+        .get();
+}
+
+http_response
+multiplexed_http_connection::perform_streaming_request(
+    check_in_interface& check_in,
+    progress_reporter_interface& reporter,
+    http_request const& request,
+    http_response_sink& sink)
+{
+    return start_request_with_future(
+               *loop_, request, &check_in, &reporter, &sink)
+        .get();
+}
+
 } // namespace cradle
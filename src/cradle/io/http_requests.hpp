@@ -3,6 +3,9 @@
 
 #include <cradle/fs/types.hpp>
 
+#include <exception>
+#include <functional>
+#include <future>
 #include <memory>
 
 // This file defines a low-level facility for doing authenticated HTTP
@@ -89,6 +92,55 @@ parse_msgpack_response(http_response const& response);
 http_response
 make_http_200_response(string body);
 
+// Find the value of the header called :name in :headers.
+// Header names are compared case-insensitively (since HTTP/2 servers send
+// them in lowercase).
+optional<string>
+find_http_header(http_header_list const& headers, string const& name);
+
+// CONDITIONAL REQUESTS
+
+// The validators for an HTTP resource are what the server provides to
+// identify a particular version of it, so that a client with a cached copy
+// can ask whether it's still current without downloading it again.
+api(struct internal)
+struct http_validators
+{
+    // the resource's entity tag (from the ETag header)
+    optional<string> etag;
+    // the resource's Last-Modified timestamp (as sent by the server)
+    optional<string> last_modified;
+};
+
+// Get the validators (if any) that the server provided with :response.
+http_validators
+get_http_validators(http_response const& response);
+
+// Do :validators actually identify anything?
+inline bool
+has_validators(http_validators const& validators)
+{
+    return validators.etag || validators.last_modified;
+}
+
+// Make :request conditional on the resource having changed since the
+// version identified by :validators (by adding If-None-Match and/or
+// If-Modified-Since headers).
+http_request
+make_conditional_request(
+    http_request request, http_validators const& validators);
+
+// Is :request conditional?
+bool
+is_conditional_request(http_request const& request);
+
+// Is :status_code a successful outcome for :request?
+// This is true of 2xx codes, and it's also true of 304 (Not Modified) if
+// :request is conditional, since that's just the server confirming that the
+// requester's copy is current. (A 304 response has no body.)
+bool
+is_successful_http_status(http_request const& request, int status_code);
+
 // This exception indicates a general failure in the HTTP request
 // system (e.g., a failure to initialize).
 CRADLE_DEFINE_EXCEPTION(http_request_system_error)
@@ -101,7 +153,8 @@ CRADLE_DEFINE_EXCEPTION(http_request_failure)
 CRADLE_DEFINE_ERROR_INFO(http_request, attempted_http_request)
 
 // This exception indicates that an HTTP request was resolved but
-// resulted in a status code outside the 2xx range. The full response
+// resulted in an unsuccessful status code (i.e., one outside the 2xx range,
+// not counting 304 responses to conditional requests). The full response
 // is included.
 CRADLE_DEFINE_EXCEPTION(bad_http_status_code)
 // This exception also provides attempted_http_request_info.
@@ -111,11 +164,67 @@ CRADLE_DEFINE_ERROR_INFO(http_response, http_response)
 // request system. Exactly one of these objects must be instantiated by the
 // application, and its scope must dominate the scope of all http_connection
 // objects.
+//
+// All connections (and request loops) created through the system share a
+// DNS cache and a TLS session cache, so a new connection to a host that
+// another connection has already talked to can skip the DNS lookup and
+// resume the existing TLS session rather than doing a full handshake.
+
+// http_transfer_counts summarizes the transfers that have been performed
+// through an http_request_system.
+struct http_transfer_counts
+{
+    // the number of transfers that have finished (successfully or not)
+    size_t transfer_count = 0;
+    // the number of new connections that those transfers had to open - A
+    // transfer that reuses an existing connection (or is multiplexed onto
+    // one) doesn't open any.
+    size_t new_connection_count = 0;
+};
+
+struct http_request_system_impl;
 
 struct http_request_system : noncopyable
 {
     http_request_system();
     ~http_request_system();
+
+    // Get the counts for all the transfers that have been performed through
+    // the system so far.
+    http_transfer_counts
+    transfer_counts() const;
+
+ private:
+    friend struct http_connection;
+    friend struct http_request_loop;
+
+    std::unique_ptr<http_request_system_impl> impl_;
+};
+
+// http_response_sink receives the body of an HTTP response incrementally, as
+// it arrives, so that it can be processed (e.g., parsed or written to disk)
+// while the rest of it is still downloading.
+struct http_response_sink
+{
+    // This is called once before any data arrives, with the size of the body
+    // if the server reported one. (Since the body may be compressed in
+    // transit, this is only a hint.)
+    virtual void
+    on_start(optional<size_t> content_length)
+    {
+    }
+
+    // Receive the next piece of the body.
+    virtual void
+    on_data(uint8_t const* data, size_t size)
+        = 0;
+
+    // This is called once the whole body has been received. (It's not called
+    // if the request fails.)
+    virtual void
+    on_finish()
+    {
+    }
 };
 
 // http_connection provides a network connection over which HTTP requests can
@@ -133,6 +242,35 @@ struct http_connection_interface
         progress_reporter_interface& reporter,
         http_request const& request)
         = 0;
+
+    // Perform an HTTP request, passing the body of the response to :sink as
+    // it arrives rather than accumulating it. The returned response has an
+    // empty body. (Responses with status codes outside the 2xx range are
+    // accumulated as usual, since they're reported as errors, and :sink
+    // isn't used at all for 304 responses to conditional requests.)
+    //
+    // The default implementation simply performs the request and then
+    // passes the body along, so connections that can actually stream
+    // responses should override this.
+    //
+    virtual http_response
+    perform_streaming_request(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter,
+        http_request const& request,
+        http_response_sink& sink)
+    {
+        auto response = perform_request(check_in, reporter, request);
+        if (response.status_code == 304)
+            return response;
+        sink.on_start(response.body.size);
+        sink.on_data(
+            reinterpret_cast<uint8_t const*>(response.body.data),
+            response.body.size);
+        sink.on_finish();
+        response.body = blob();
+        return response;
+    }
 };
 
 struct http_connection_impl;
@@ -150,12 +288,102 @@ struct http_connection : http_connection_interface
     perform_request(
         check_in_interface& check_in,
         progress_reporter_interface& reporter,
-        http_request const& request);
+        http_request const& request) override;
+
+    http_response
+    perform_streaming_request(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter,
+        http_request const& request,
+        http_response_sink& sink) override;
 
  private:
     std::unique_ptr<http_connection_impl> impl_;
 };
 
+// http_request_loop performs HTTP requests asynchronously. It drives any
+// number of concurrent transfers from a single thread of its own (using
+// libcurl's multi interface), so requests don't each need a thread (or a
+// connection) of their own.
+//
+// All of a loop's requests share a single pool of connections. HTTP/2 is
+// negotiated where the server supports it, in which case concurrent requests
+// to the same host are multiplexed as streams on a single connection.
+
+typedef std::function<void(http_response response)> http_response_callback;
+
+typedef std::function<void(std::exception_ptr error)> http_failure_callback;
+
+struct http_request_loop_impl;
+
+struct http_request_loop : noncopyable
+{
+    http_request_loop(http_request_system& system);
+    // Any requests that are still in progress fail with
+    // http_request_failure.
+    ~http_request_loop();
+
+    // Start performing :request.
+    //
+    // Exactly one of :on_response or :on_failure will eventually be invoked
+    // (from the loop's thread, so they should return quickly and not
+    // throw). As with http_connection, a response with a status code
+    // outside the 2xx range is considered a failure.
+    //
+    // :check_in and :reporter are optional. If supplied, they're invoked
+    // periodically from the loop's thread while the request is in progress
+    // (so they must be thread-safe), and they must remain valid until the
+    // request finishes. If :check_in throws, the request is aborted and its
+    // exception is passed to :on_failure.
+    //
+    // :sink is also optional. If supplied, the response body is streamed
+    // into it (from the loop's thread), as with perform_streaming_request.
+    // It must also remain valid until the request finishes.
+    //
+    void
+    start_request(
+        http_request request,
+        http_response_callback on_response,
+        http_failure_callback on_failure,
+        check_in_interface* check_in = nullptr,
+        progress_reporter_interface* reporter = nullptr,
+        http_response_sink* sink = nullptr);
+
+ private:
+    std::unique_ptr<http_request_loop_impl> impl_;
+};
+
+// Start performing :request on :loop and get a future for the response.
+std::future<http_response>
+start_http_request(http_request_loop& loop, http_request request);
+
+// multiplexed_http_connection is an http_connection_interface that performs
+// its requests through an http_request_loop. Unlike http_connection, it can
+// be used by any number of threads concurrently. (Each call still waits for
+// its response, but the transfers themselves are all driven by the loop.)
+struct multiplexed_http_connection : http_connection_interface
+{
+    multiplexed_http_connection(http_request_loop& loop) : loop_(&loop)
+    {
+    }
+
+    http_response
+    perform_request(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter,
+        http_request const& request) override;
+
+    http_response
+    perform_streaming_request(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter,
+        http_request const& request,
+        http_response_sink& sink) override;
+
+ private:
+    http_request_loop* loop_;
+};
+
 } // namespace cradle
 
 #endif
@@ -0,0 +1,132 @@
+#include <cradle/io/http_response_sinks.h>
+
+// Boost.Crc triggers some warnings on MSVC.
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4245)
+#pragma warning(disable : 4701)
+#include <boost/crc.hpp>
+#pragma warning(pop)
+#else
+#include <boost/crc.hpp>
+#endif
+
+#include <cradle/fs/file_io.h>
+
+namespace cradle {
+
+// MSGPACK
+
+void
+msgpack_response_sink::on_start(optional<size_t> content_length)
+{
+    if (content_length)
+        parser_.reserve(*content_length);
+}
+
+void
+msgpack_response_sink::on_data(uint8_t const* data, size_t size)
+{
+    parser_.feed(data, size);
+}
+
+dynamic
+msgpack_response_sink::value()
+{
+    return parser_.finish();
+}
+
+// TEE
+
+void
+tee_response_sink::on_start(optional<size_t> content_length)
+{
+    first_->on_start(content_length);
+    second_->on_start(content_length);
+}
+
+void
+tee_response_sink::on_data(uint8_t const* data, size_t size)
+{
+    first_->on_data(data, size);
+    second_->on_data(data, size);
+}
+
+void
+tee_response_sink::on_finish()
+{
+    first_->on_finish();
+    second_->on_finish();
+}
+
+// DISK CACHE
+
+void
+disk_cache_response_sink::on_start(optional<size_t> content_length)
+{
+    crc_state_ = boost::crc_32_type().get_interim_remainder();
+    try
+    {
+        entry_id_ = cache_->initiate_insert(key_);
+        open_file(
+            output_,
+            cache_->get_path_for_id(*entry_id_),
+            std::ios::out | std::ios::trunc | std::ios::binary);
+    }
+    catch (...)
+    {
+        abandon();
+    }
+}
+
+void
+disk_cache_response_sink::on_data(uint8_t const* data, size_t size)
+{
+    if (!entry_id_)
+        return;
+    output_.write(reinterpret_cast<char const*>(data), size);
+    if (!output_)
+    {
+        abandon();
+        return;
+    }
+    // Boost.Crc can pick up where it left off given the previous remainder.
+    boost::crc_32_type crc(crc_state_);
+    crc.process_bytes(data, size);
+    crc_state_ = crc.get_interim_remainder();
+}
+
+void
+disk_cache_response_sink::on_finish()
+{
+    if (!entry_id_)
+        return;
+    try
+    {
+        output_.close();
+        if (!output_)
+        {
+            abandon();
+            return;
+        }
+        boost::crc_32_type crc(crc_state_);
+        cache_->finish_insert(*entry_id_, crc.checksum());
+        is_written_ = true;
+    }
+    catch (...)
+    {
+        abandon();
+    }
+}
+
+void
+disk_cache_response_sink::abandon()
+{
+    // The entry is marked as invalid until it's finished, so it's fine to
+    // simply leave it.
+    entry_id_ = none;
+    if (output_.is_open())
+        output_.close();
+}
+
+} // namespace cradle
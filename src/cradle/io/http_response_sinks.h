@@ -0,0 +1,103 @@
+#ifndef CRADLE_IO_HTTP_RESPONSE_SINKS_H
+#define CRADLE_IO_HTTP_RESPONSE_SINKS_H
+
+#include <fstream>
+
+#include <cradle/caching/disk_cache.hpp>
+#include <cradle/encodings/msgpack.h>
+#include <cradle/io/http_requests.hpp>
+
+// This file provides some http_response_sinks for processing response bodies
+// as they download. They can be combined with tee_response_sink so that, for
+// example, a response is parsed and written to the disk cache as it arrives.
+
+namespace cradle {
+
+// msgpack_response_sink parses a MessagePack response body as it arrives.
+struct msgpack_response_sink : http_response_sink
+{
+    void
+    on_start(optional<size_t> content_length) override;
+
+    void
+    on_data(uint8_t const* data, size_t size) override;
+
+    // Get the parsed value. This is only valid once the request has
+    // completed successfully.
+    dynamic
+    value();
+
+ private:
+    msgpack_stream_parser parser_;
+};
+
+// tee_response_sink passes a response body along to two other sinks.
+struct tee_response_sink : http_response_sink
+{
+    tee_response_sink(http_response_sink& first, http_response_sink& second)
+        : first_(&first), second_(&second)
+    {
+    }
+
+    void
+    on_start(optional<size_t> content_length) override;
+
+    void
+    on_data(uint8_t const* data, size_t size) override;
+
+    void
+    on_finish() override;
+
+ private:
+    http_response_sink* first_;
+    http_response_sink* second_;
+};
+
+// disk_cache_response_sink writes a response body into a new disk cache
+// entry as it arrives. The body is stored exactly as it's received, so this
+// is intended for responses that are already in the form that the cache
+// stores (i.e., MessagePack). The entry only becomes valid once the whole
+// body has been written.
+//
+// Since caching is an optimization, a failure to write the entry doesn't
+// fail the request. The entry is simply abandoned.
+//
+struct disk_cache_response_sink : http_response_sink
+{
+    disk_cache_response_sink(disk_cache& cache, string key)
+        : cache_(&cache), key_(std::move(key))
+    {
+    }
+
+    void
+    on_start(optional<size_t> content_length) override;
+
+    void
+    on_data(uint8_t const* data, size_t size) override;
+
+    void
+    on_finish() override;
+
+    // Was the entry successfully written?
+    bool
+    is_written() const
+    {
+        return is_written_;
+    }
+
+ private:
+    void
+    abandon();
+
+    disk_cache* cache_;
+    string key_;
+    optional<int64_t> entry_id_;
+    std::ofstream output_;
+    // the CRC of the data written so far (as an interim remainder)
+    uint32_t crc_state_ = 0;
+    bool is_written_ = false;
+};
+
+} // namespace cradle
+
+#endif
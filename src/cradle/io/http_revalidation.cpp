@@ -0,0 +1,49 @@
+#include <cradle/io/http_revalidation.hpp>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <cradle/core/monitoring.h>
+
+namespace cradle {
+
+bool
+is_fresh(
+    http_cached_resource const& cached,
+    http_freshness_policy const& policy,
+    boost::posix_time::ptime now)
+{
+    return now - cached.checked_at
+           < boost::posix_time::seconds(long(policy.max_age.count()));
+}
+
+http_cached_resource
+revalidate_http_resource(
+    http_connection_interface& connection,
+    http_request const& request,
+    optional<http_cached_resource> const& cached,
+    http_freshness_policy const& policy,
+    function_view<dynamic(http_response const& response)> const& parse)
+{
+    auto now = boost::posix_time::microsec_clock::universal_time();
+    if (cached && is_fresh(*cached, policy, now))
+        return *cached;
+
+    null_check_in check_in;
+    null_progress_reporter reporter;
+    bool conditional = cached && has_validators(cached->validators);
+    auto response = connection.perform_request(
+        check_in,
+        reporter,
+        conditional ? make_conditional_request(request, cached->validators)
+                    : request);
+    if (conditional && response.status_code == 304)
+    {
+        http_cached_resource revalidated = *cached;
+        revalidated.checked_at = now;
+        return revalidated;
+    }
+    return http_cached_resource{
+        parse(response), get_http_validators(response), now};
+}
+
+} // namespace cradle
@@ -0,0 +1,67 @@
+#ifndef CRADLE_IO_HTTP_REVALIDATION_HPP
+#define CRADLE_IO_HTTP_REVALIDATION_HPP
+
+#include <chrono>
+
+#include <cradle/io/http_requests.hpp>
+#include <cradle/utilities/functional.h>
+
+// This file provides support for caching values derived from mutable HTTP
+// resources (ones that can change on the server) and keeping them current
+// via conditional requests, so that confirming that a cached value is still
+// correct only costs a round trip rather than a full transfer.
+
+namespace cradle {
+
+// a cached value that was derived from a mutable HTTP resource
+api(struct internal)
+struct http_cached_resource
+{
+    // the value itself
+    dynamic value;
+    // the validators that the server provided along with it
+    http_validators validators;
+    // when the value was last known to be current (in UTC)
+    boost::posix_time::ptime checked_at;
+};
+
+// http_freshness_policy determines how long a cached copy of a mutable
+// resource is trusted before it's revalidated with the server.
+struct http_freshness_policy
+{
+    // how long a cached value is used without checking with the server -
+    // Zero means that it's revalidated every time it's used.
+    std::chrono::seconds max_age = std::chrono::seconds(60);
+};
+
+// Is :cached still fresh (as of :now) according to :policy?
+bool
+is_fresh(
+    http_cached_resource const& cached,
+    http_freshness_policy const& policy,
+    boost::posix_time::ptime now);
+
+// Get the current value of the resource that :request retrieves, given a
+// (possibly) cached copy of it.
+//
+// If :cached is fresh according to :policy, it's simply returned.
+// Otherwise, :request is performed. If the cached copy has validators, the
+// request is made conditional, so if the resource hasn't changed, the server
+// only has to confirm that (with a 304 response), and the cached copy is
+// returned with an updated :checked_at time. If the resource has changed (or
+// there's no cached copy), :parse derives the new value from the response.
+//
+// The caller can tell whether its cache needs updating by comparing the
+// :checked_at time of the result against that of :cached.
+//
+http_cached_resource
+revalidate_http_resource(
+    http_connection_interface& connection,
+    http_request const& request,
+    optional<http_cached_resource> const& cached,
+    http_freshness_policy const& policy,
+    function_view<dynamic(http_response const& response)> const& parse);
+
+} // namespace cradle
+
+#endif
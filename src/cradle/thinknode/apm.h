@@ -1,11 +1,19 @@
 #ifndef CRADLE_THINKNODE_APM_H
 #define CRADLE_THINKNODE_APM_H
 
+#include <cradle/io/http_requests.hpp>
 #include <cradle/thinknode/types.hpp>
 
 namespace cradle {
 
-struct http_connection_interface;
+// Make the request that queries a particular version of an app.
+// (The response is the JSON form of a thinknode_app_version_info.)
+http_request
+make_app_version_info_request(
+    thinknode_session const& session,
+    string const& account,
+    string const& app,
+    string const& version);
 
 // Query a particular version of an app.
 thinknode_app_version_info
@@ -48,6 +48,9 @@ retrieve_calculation_request(
 // status to :process_status, until no further progress is possible or an
 // error occurs.
 //
+// This ties up the calling thread (and :connection) for the duration. To
+// watch many calculations at once, see calculation_status_watcher.
+//
 void
 long_poll_calculation_status(
     check_in_interface& check_in,
@@ -0,0 +1,351 @@
+#include <cradle/thinknode/calc_watcher.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#include <cradle/core/monitoring.h>
+#include <cradle/encodings/json.h>
+#include <cradle/io/http_requests.hpp>
+#include <cradle/thinknode/calc.h>
+
+namespace cradle {
+
+namespace {
+
+// thrown (via the check-in) to abort the poll for a calculation that no
+// longer has any subscribers
+struct calculation_watch_abandoned
+{
+};
+
+struct abandonment_check_in : check_in_interface
+{
+    void
+    operator()() override
+    {
+        if (abandoned)
+            throw calculation_watch_abandoned();
+    }
+
+    std::atomic<bool> abandoned = false;
+};
+
+struct calculation_subscriber
+{
+    calculation_status_callback on_status;
+    calculation_watch_failure_callback on_failure;
+};
+
+typedef std::tuple<string, string, string> watched_calculation_key;
+
+struct watched_calculation
+{
+    watched_calculation(
+        thinknode_session const& session,
+        string const& context_id,
+        string const& calc_id)
+        : session(session), context_id(context_id), calc_id(calc_id)
+    {
+    }
+
+    thinknode_session session;
+    string context_id;
+    string calc_id;
+
+    // This serializes the delivery of updates to subscribers. It's always
+    // acquired before the watcher's mutex. (It's recursive so that callbacks
+    // can watch and unwatch the calculation that they're being invoked for.)
+    std::recursive_mutex delivery_mutex;
+
+    // The following are protected by the watcher's mutex.
+    std::map<calculation_watch_id, calculation_subscriber> subscribers;
+    optional<calculation_status> status;
+    // Once a calculation is retired, it's no longer in the watcher's
+    // :calculations map, and a new watch on it will start a fresh poll.
+    bool retired = false;
+
+    // the check-in for the calculation's poll
+    abandonment_check_in check_in;
+};
+
+watched_calculation_key
+get_key(watched_calculation const& calc)
+{
+    return watched_calculation_key(
+        calc.session.api_url, calc.context_id, calc.calc_id);
+}
+
+} // namespace
+
+struct calculation_status_watcher_impl
+{
+    http_request_loop* loop;
+
+    mutable std::mutex mutex;
+    std::map<watched_calculation_key, std::shared_ptr<watched_calculation>>
+        calculations;
+    std::map<calculation_watch_id, std::shared_ptr<watched_calculation>>
+        watches;
+    calculation_watch_id next_watch_id = 1;
+
+    // the number of polls that are in progress - The watcher can't be
+    // destroyed until this is zero.
+    unsigned active_polls = 0;
+    std::condition_variable polls_finished;
+};
+
+// Retire :calc so that it's no longer associated with the watcher.
+// The watcher's mutex must be held.
+static void
+retire_calculation(
+    calculation_status_watcher_impl& impl, watched_calculation& calc)
+{
+    if (calc.retired)
+        return;
+    for (auto const& [id, subscriber] : calc.subscribers)
+        impl.watches.erase(id);
+    impl.calculations.erase(get_key(calc));
+    calc.retired = true;
+}
+
+static void
+finish_poll(calculation_status_watcher_impl& impl)
+{
+    std::scoped_lock<std::mutex> lock(impl.mutex);
+    --impl.active_polls;
+    impl.polls_finished.notify_all();
+}
+
+static std::vector<calculation_subscriber>
+get_subscribers(watched_calculation const& calc)
+{
+    std::vector<calculation_subscriber> subscribers;
+    subscribers.reserve(calc.subscribers.size());
+    for (auto const& [id, subscriber] : calc.subscribers)
+        subscribers.push_back(subscriber);
+    return subscribers;
+}
+
+static void
+poll_calculation(
+    calculation_status_watcher_impl& impl,
+    std::shared_ptr<watched_calculation> const& calc,
+    optional<calculation_status> const& next_status);
+
+static void
+handle_poll_failure(
+    calculation_status_watcher_impl& impl,
+    std::shared_ptr<watched_calculation> const& calc,
+    std::exception_ptr error)
+{
+    if (!calc->check_in.abandoned)
+    {
+        std::scoped_lock<std::recursive_mutex> delivery(calc->delivery_mutex);
+        std::vector<calculation_subscriber> recipients;
+        {
+            std::scoped_lock<std::mutex> lock(impl.mutex);
+            recipients = get_subscribers(*calc);
+            retire_calculation(impl, *calc);
+        }
+        for (auto const& recipient : recipients)
+            recipient.on_failure(error);
+    }
+    finish_poll(impl);
+}
+
+static void
+handle_poll_response(
+    calculation_status_watcher_impl& impl,
+    std::shared_ptr<watched_calculation> const& calc,
+    http_response const& response)
+{
+    calculation_status status;
+    try
+    {
+        status
+            = from_dynamic<calculation_status>(parse_json_response(response));
+    }
+    catch (...)
+    {
+        handle_poll_failure(impl, calc, std::current_exception());
+        return;
+    }
+
+    auto next_status = get_next_calculation_status(status);
+    bool keep_polling;
+    {
+        std::scoped_lock<std::recursive_mutex> delivery(calc->delivery_mutex);
+        std::vector<calculation_subscriber> recipients;
+        {
+            std::scoped_lock<std::mutex> lock(impl.mutex);
+            calc->status = status;
+            recipients = get_subscribers(*calc);
+            keep_polling = next_status && !recipients.empty();
+            if (!keep_polling)
+                retire_calculation(impl, *calc);
+        }
+        for (auto const& recipient : recipients)
+            recipient.on_status(status);
+    }
+
+    // If the calculation can progress further, the same poll carries on
+    // (so it remains active).
+    if (keep_polling)
+        poll_calculation(impl, calc, next_status);
+    else
+        finish_poll(impl);
+}
+
+// Issue the next long poll for :calc. If :next_status is none, this queries
+// the current status instead.
+static void
+poll_calculation(
+    calculation_status_watcher_impl& impl,
+    std::shared_ptr<watched_calculation> const& calc,
+    optional<calculation_status> const& next_status)
+{
+    auto const& session = calc->session;
+    auto url = session.api_url + "/calc/" + calc->calc_id + "/status?"
+               + (next_status ? calc_status_as_query_string(*next_status)
+                                    + "&timeout=120&"
+                              : string())
+               + "context=" + calc->context_id;
+    impl.loop->start_request(
+        make_get_request(
+            url,
+            {{"Authorization", "Bearer " + session.access_token},
+             {"Accept", "application/json"}}),
+        [&impl, calc](http_response response) {
+            handle_poll_response(impl, calc, response);
+        },
+        [&impl, calc](std::exception_ptr error) {
+            handle_poll_failure(impl, calc, error);
+        },
+        &calc->check_in);
+}
+
+calculation_status_watcher::calculation_status_watcher(
+    http_request_loop& loop)
+    : impl_(new calculation_status_watcher_impl)
+{
+    impl_->loop = &loop;
+}
+
+calculation_status_watcher::~calculation_status_watcher()
+{
+    std::unique_lock<std::mutex> lock(impl_->mutex);
+    for (auto const& [key, calc] : impl_->calculations)
+    {
+        calc->check_in.abandoned = true;
+        calc->subscribers.clear();
+        calc->retired = true;
+    }
+    impl_->calculations.clear();
+    impl_->watches.clear();
+    impl_->polls_finished.wait(
+        lock, [&] { return impl_->active_polls == 0; });
+}
+
+calculation_watch_id
+calculation_status_watcher::watch(
+    thinknode_session const& session,
+    string const& context_id,
+    string const& calc_id,
+    calculation_status_callback on_status,
+    calculation_watch_failure_callback on_failure)
+{
+    auto& impl = *impl_;
+    auto key = watched_calculation_key(session.api_url, context_id, calc_id);
+    calculation_subscriber subscriber{
+        std::move(on_status), std::move(on_failure)};
+
+    while (true)
+    {
+        std::shared_ptr<watched_calculation> calc;
+        optional<calculation_watch_id> new_calc_watch;
+        {
+            std::scoped_lock<std::mutex> lock(impl.mutex);
+            auto existing = impl.calculations.find(key);
+            if (existing != impl.calculations.end())
+            {
+                calc = existing->second;
+            }
+            else
+            {
+                // This is a new calculation. Since there's no status to
+                // deliver yet, the subscriber can be added right away.
+                calc = std::make_shared<watched_calculation>(
+                    session, context_id, calc_id);
+                impl.calculations[key] = calc;
+                auto id = impl.next_watch_id++;
+                calc->subscribers[id] = std::move(subscriber);
+                impl.watches[id] = calc;
+                ++impl.active_polls;
+                new_calc_watch = id;
+            }
+        }
+        if (new_calc_watch)
+        {
+            poll_calculation(impl, calc, none);
+            return *new_calc_watch;
+        }
+
+        // The calculation is already being polled. The delivery mutex has
+        // to be acquired before the watcher's mutex so that the initial
+        // status is delivered in order with the poll's updates.
+        std::scoped_lock<std::recursive_mutex> delivery(calc->delivery_mutex);
+        optional<calculation_status> status;
+        calculation_watch_id id;
+        {
+            std::scoped_lock<std::mutex> lock(impl.mutex);
+            // If the calculation was retired in the meantime, start over.
+            if (calc->retired)
+                continue;
+            id = impl.next_watch_id++;
+            calc->subscribers[id] = subscriber;
+            impl.watches[id] = calc;
+            status = calc->status;
+        }
+        if (status)
+            subscriber.on_status(*status);
+        return id;
+    }
+}
+
+void
+calculation_status_watcher::unwatch(calculation_watch_id watch)
+{
+    auto& impl = *impl_;
+    std::shared_ptr<watched_calculation> calc;
+    {
+        std::scoped_lock<std::mutex> lock(impl.mutex);
+        auto existing = impl.watches.find(watch);
+        if (existing == impl.watches.end())
+            return;
+        calc = existing->second;
+    }
+
+    // Acquiring the delivery mutex ensures that any update that's currently
+    // being delivered finishes first.
+    std::scoped_lock<std::recursive_mutex> delivery(calc->delivery_mutex);
+    std::scoped_lock<std::mutex> lock(impl.mutex);
+    calc->subscribers.erase(watch);
+    impl.watches.erase(watch);
+    if (calc->subscribers.empty())
+    {
+        retire_calculation(impl, *calc);
+        calc->check_in.abandoned = true;
+    }
+}
+
+size_t
+calculation_status_watcher::watched_calculation_count() const
+{
+    std::scoped_lock<std::mutex> lock(impl_->mutex);
+    return impl_->calculations.size();
+}
+
+} // namespace cradle
@@ -0,0 +1,84 @@
+#ifndef CRADLE_THINKNODE_CALC_WATCHER_H
+#define CRADLE_THINKNODE_CALC_WATCHER_H
+
+#include <functional>
+#include <memory>
+
+#include <cradle/core.h>
+#include <cradle/thinknode/types.hpp>
+
+// This file provides a service for watching the status of many Thinknode
+// calculations at once.
+//
+// Rather than dedicating a thread (and a connection) to long polling each
+// calculation, the watcher drives all of its long polls through a shared
+// http_request_loop. Any number of subscribers can watch the same
+// calculation, but each calculation is only polled once, and its status
+// updates are fanned out to all of its subscribers.
+
+namespace cradle {
+
+struct http_request_loop;
+
+typedef std::function<void(calculation_status const& status)>
+    calculation_status_callback;
+
+typedef std::function<void(std::exception_ptr error)>
+    calculation_watch_failure_callback;
+
+typedef uint64_t calculation_watch_id;
+
+struct calculation_status_watcher_impl;
+
+struct calculation_status_watcher : noncopyable
+{
+    // :loop must outlive the watcher.
+    calculation_status_watcher(http_request_loop& loop);
+    // Any calculations that are still being watched are abandoned (without
+    // notifying their subscribers).
+    ~calculation_status_watcher();
+
+    // Watch the status of a calculation.
+    //
+    // :on_status is invoked with the calculation's status as it progresses
+    // (in the same sequence that long_poll_calculation_status would produce)
+    // until no further progress is possible. If the calculation is already
+    // being watched, :on_status is first invoked with its most recent status
+    // (if there is one).
+    //
+    // If polling fails, :on_failure is invoked with the error, and the watch
+    // ends.
+    //
+    // Callbacks are invoked from the loop's thread (or from the calling
+    // thread, for the initial status), so they should return quickly and not
+    // throw. Updates for a particular calculation are never delivered
+    // concurrently, and callbacks can safely watch and unwatch calculations.
+    //
+    // The returned ID can be used to stop watching early. (There's no need
+    // to unwatch a calculation once it's finished.)
+    //
+    calculation_watch_id
+    watch(
+        thinknode_session const& session,
+        string const& context_id,
+        string const& calc_id,
+        calculation_status_callback on_status,
+        calculation_watch_failure_callback on_failure);
+
+    // Stop watching a calculation. Once this returns, the callbacks for
+    // :watch won't be invoked again. If this was the last subscriber for a
+    // calculation, polling for that calculation is abandoned.
+    void
+    unwatch(calculation_watch_id watch);
+
+    // the number of distinct calculations that are currently being polled
+    size_t
+    watched_calculation_count() const;
+
+ private:
+    std::unique_ptr<calculation_status_watcher_impl> impl_;
+};
+
+} // namespace cradle
+
+#endif
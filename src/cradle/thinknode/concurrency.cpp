@@ -0,0 +1,82 @@
+#include <cradle/thinknode/concurrency.h>
+
+#include <cradle/thinknode/utilities.h>
+
+namespace cradle {
+
+thinknode_concurrency_policy::thinknode_concurrency_policy(
+    adaptive_concurrency_config const& config)
+{
+    for (auto service :
+         {thinknode_service_id::IAM,
+          thinknode_service_id::APM,
+          thinknode_service_id::ISS,
+          thinknode_service_id::CALC,
+          thinknode_service_id::CAS,
+          thinknode_service_id::RKS,
+          thinknode_service_id::IMMUTABLE})
+    {
+        limiters_[service]
+            = std::make_unique<adaptive_concurrency_limiter>(config);
+    }
+}
+
+adaptive_concurrency_limiter*
+thinknode_concurrency_policy::get_limiter(http_request const& request)
+{
+    auto service = get_thinknode_service_for_url(request.url);
+    return service ? &get_service_limiter(*service) : nullptr;
+}
+
+// Does :url have a query parameter named :name?
+static bool
+has_query_parameter(string const& url, string const& name)
+{
+    auto query_start = url.find('?');
+    if (query_start == string::npos)
+        return false;
+    auto parameter_start = query_start + 1;
+    while (parameter_start < url.length())
+    {
+        auto parameter_end = url.find('&', parameter_start);
+        if (parameter_end == string::npos)
+            parameter_end = url.length();
+        auto name_end = url.find('=', parameter_start);
+        if (name_end == string::npos || name_end > parameter_end)
+            name_end = parameter_end;
+        if (url.compare(
+                parameter_start, name_end - parameter_start, name)
+            == 0)
+        {
+            return true;
+        }
+        parameter_start = parameter_end + 1;
+    }
+    return false;
+}
+
+bool
+thinknode_concurrency_policy::is_latency_meaningful(
+    http_request const& request)
+{
+    // Long polls wait (for up to their timeout) for something to change.
+    if (has_query_parameter(request.url, "timeout"))
+        return false;
+    // ISS uploads take as long as their data takes to transfer.
+    if (request.method == http_request_method::POST
+        && get_thinknode_service_for_url(request.url)
+               == thinknode_service_id::ISS)
+    {
+        return false;
+    }
+    return true;
+}
+
+adaptive_concurrency_limiter&
+thinknode_concurrency_policy::get_service_limiter(
+    thinknode_service_id service)
+{
+    return *limiters_.at(service);
+}
+
+} // namespace cradle
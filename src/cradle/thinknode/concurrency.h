@@ -0,0 +1,53 @@
+#ifndef CRADLE_THINKNODE_CONCURRENCY_H
+#define CRADLE_THINKNODE_CONCURRENCY_H
+
+#include <map>
+#include <memory>
+
+#include <cradle/io/http_concurrency.h>
+#include <cradle/thinknode/types.hpp>
+
+namespace cradle {
+
+// thinknode_concurrency_policy limits requests to Thinknode separately for
+// each service, so that (e.g.) a flood of ISS requests that are backing off
+// doesn't also throttle requests to calc.
+//
+// Requests that don't address a Thinknode service aren't limited.
+//
+// Long polls (e.g., for calculation status, which can legitimately take two
+// minutes) and uploads of ISS data are judged by their status codes alone,
+// since their latency says nothing about load.
+//
+// Nothing installs this policy by default. It's opt-in: supply it as
+// background_execution_system_config::http_concurrency (or wrap connections
+// in limited_http_connection).
+//
+struct thinknode_concurrency_policy : http_concurrency_policy
+{
+    thinknode_concurrency_policy(
+        adaptive_concurrency_config const& config
+        = adaptive_concurrency_config());
+
+    adaptive_concurrency_limiter*
+    get_limiter(http_request const& request) override;
+
+    bool
+    is_latency_meaningful(http_request const& request) override;
+
+    // Get the limiter for a particular service.
+    adaptive_concurrency_limiter&
+    get_service_limiter(thinknode_service_id service);
+
+ private:
+    // All limiters are created up front, so this is never modified after
+    // construction and can be read without locking.
+    std::map<
+        thinknode_service_id,
+        std::unique_ptr<adaptive_concurrency_limiter>>
+        limiters_;
+};
+
+} // namespace cradle
+
+#endif
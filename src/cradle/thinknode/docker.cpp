@@ -0,0 +1,334 @@
+#include <cradle/thinknode/docker.h>
+
+#include <future>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include <cradle/core/monitoring.h>
+#include <cradle/encodings/json.h>
+
+namespace cradle {
+
+struct docker_client_impl
+{
+    docker_client_impl(
+        http_request_system& system, docker_client_config const& config)
+        : system(system), config(config), connection(system)
+    {
+    }
+
+    http_request_system& system;
+
+    docker_client_config config;
+
+    // This protects the connection and the service type. It's only held for
+    // the duration of a single request.
+    std::mutex connection_mutex;
+
+    // All requests (other than pulls) go through this connection, so the
+    // underlying socket stays open between them.
+    http_connection connection;
+
+    optional<docker_service_type> service_type;
+
+    // This protects the image state below.
+    std::mutex mutex;
+
+    // images that are known to be present, along with when that was last
+    // confirmed
+    std::map<string, std::chrono::steady_clock::time_point> present_images;
+
+    // images that are currently being checked on (and possibly pulled) -
+    // Other callers that need the same image wait on these rather than
+    // issuing their own pulls.
+    std::map<string, std::shared_future<void>> image_checks;
+};
+
+static http_request
+make_docker_request(
+    docker_client_config const& config,
+    docker_service_type service_type,
+    http_request_method method,
+    string const& path,
+    http_header_list const& headers,
+    http_body const& body)
+{
+    switch (service_type)
+    {
+        case docker_service_type::WINDOWS:
+            return make_http_request(
+                method, config.tcp_url + path, headers, body);
+        case docker_service_type::LINUX:
+        case docker_service_type::WSL:
+            return http_request{
+                method,
+                "http://localhost" + path,
+                headers,
+                body,
+                some(config.socket_path)};
+        default:
+            CRADLE_THROW(
+                invalid_enum_value()
+                << enum_id_info("docker_service_type")
+                << enum_value_info(static_cast<int>(service_type)));
+    }
+}
+
+static http_response
+perform_docker_request(
+    http_connection& connection,
+    docker_client_config const& config,
+    docker_service_type service_type,
+    http_request_method method,
+    string const& path,
+    http_header_list const& headers = http_header_list(),
+    http_body const& body = http_body())
+{
+    null_check_in check_in;
+    null_progress_reporter reporter;
+    return connection.perform_request(
+        check_in,
+        reporter,
+        make_docker_request(
+            config, service_type, method, path, headers, body));
+}
+
+// Perform a request over the client's shared connection.
+// The client's connection mutex must be held.
+static http_response
+perform_docker_request(
+    docker_client_impl& impl,
+    docker_service_type service_type,
+    http_request_method method,
+    string const& path,
+    http_header_list const& headers = http_header_list(),
+    http_body const& body = http_body())
+{
+    return perform_docker_request(
+        impl.connection,
+        impl.config,
+        service_type,
+        method,
+        path,
+        headers,
+        body);
+}
+
+static docker_service_type
+detect_docker(docker_client_impl& impl)
+{
+    // Try Linux.
+    try
+    {
+        auto response = perform_docker_request(
+            impl,
+            docker_service_type::LINUX,
+            http_request_method::GET,
+            "/v1.38/info");
+
+        // Check which OS the actual Docker server is running on. It's possible
+        // that we are running inside WSL, where the server runs in Windows but
+        // the client runs inside Linux and can still connect in the Linux way.
+        auto info = parse_json_response(response);
+        if (cast<std::string>(
+                get_field(cast<dynamic_map>(info), "KernelVersion"))
+                .find("microsoft")
+            != std::string::npos)
+        {
+            return docker_service_type::WSL;
+        }
+
+        return docker_service_type::LINUX;
+    }
+    catch (...)
+    {
+    }
+
+    // If the Linux way didn't work, assume Windows (but check it).
+    perform_docker_request(
+        impl,
+        docker_service_type::WINDOWS,
+        http_request_method::GET,
+        "/v1.38/info");
+    return docker_service_type::WINDOWS;
+}
+
+// Get the service type, detecting it if necessary.
+// The client's connection mutex must be held.
+static docker_service_type
+get_service_type(docker_client_impl& impl)
+{
+    if (!impl.service_type)
+        impl.service_type = detect_docker(impl);
+    return *impl.service_type;
+}
+
+// Check the progress messages that Docker streams back from a pull.
+// The pull's HTTP status only reflects whether it started. If it fails
+// partway through, the status is still 200, and the failure is reported as
+// a message with an "error" field.
+static void
+check_pull_progress(string const& image, http_response const& response)
+{
+    std::istringstream messages(string(
+        reinterpret_cast<char const*>(response.body.data),
+        response.body.size));
+    string line;
+    while (std::getline(messages, line))
+    {
+        if (line.find_first_not_of(" \t\r") == string::npos)
+            continue;
+        auto message = parse_json_value(line);
+        if (message.type() != value_type::MAP)
+            continue;
+        dynamic const* error;
+        if (get_field(&error, cast<dynamic_map>(message), "error"))
+        {
+            CRADLE_THROW(
+                docker_image_pull_failure() << internal_error_message_info(
+                    "failed to pull " + image + ": "
+                    + (error->type() == value_type::STRING
+                           ? cast<string>(*error)
+                           : value_to_json(*error))));
+        }
+    }
+}
+
+// Make sure :image is present, pulling it if it's not.
+static void
+fetch_image(
+    docker_client_impl& impl,
+    string const& image,
+    string const& repository,
+    string const& tag,
+    http_header_list const& pull_headers)
+{
+    docker_service_type service_type;
+    {
+        std::scoped_lock<std::mutex> lock(impl.connection_mutex);
+        service_type = get_service_type(impl);
+
+        // Inspect the image to see if it's already present.
+        try
+        {
+            perform_docker_request(
+                impl,
+                service_type,
+                http_request_method::GET,
+                "/v1.38/images/" + image + "/json");
+            return;
+        }
+        catch (bad_http_status_code& e)
+        {
+            if (get_required_error_info<http_response_info>(e).status_code
+                != 404)
+            {
+                throw;
+            }
+        }
+    }
+
+    // Pulls can take minutes, so they get their own connection rather than
+    // tying up the shared one.
+    http_connection pull_connection(impl.system);
+    auto response = perform_docker_request(
+        pull_connection,
+        impl.config,
+        service_type,
+        http_request_method::POST,
+        "/v1.38/images/create?fromImage=" + repository + "&tag=" + tag,
+        pull_headers);
+    check_pull_progress(image, response);
+}
+
+docker_client::docker_client(
+    http_request_system& system, docker_client_config const& config)
+    : impl_(new docker_client_impl(system, config))
+{
+}
+
+docker_client::~docker_client()
+{
+}
+
+docker_service_type
+docker_client::service_type()
+{
+    std::scoped_lock<std::mutex> lock(impl_->connection_mutex);
+    return get_service_type(*impl_);
+}
+
+http_response
+docker_client::perform_request(
+    http_request_method method,
+    string const& path,
+    http_header_list const& headers,
+    http_body const& body)
+{
+    std::scoped_lock<std::mutex> lock(impl_->connection_mutex);
+    return perform_docker_request(
+        *impl_, get_service_type(*impl_), method, path, headers, body);
+}
+
+void
+docker_client::ensure_image(
+    string const& repository,
+    string const& tag,
+    http_header_list const& pull_headers)
+{
+    auto& impl = *impl_;
+
+    // Digests are separated from the repository by '@' rather than ':'.
+    auto image
+        = repository + (tag.find(':') != string::npos ? "@" : ":") + tag;
+
+    std::promise<void> check;
+    {
+        std::unique_lock<std::mutex> lock(impl.mutex);
+
+        auto now = std::chrono::steady_clock::now();
+        auto known = impl.present_images.find(image);
+        if (known != impl.present_images.end()
+            && now - known->second < impl.config.image_ttl)
+        {
+            return;
+        }
+
+        // If someone else is already checking on the image, just wait for
+        // them (and share their outcome).
+        auto in_progress = impl.image_checks.find(image);
+        if (in_progress != impl.image_checks.end())
+        {
+            auto outcome = in_progress->second;
+            lock.unlock();
+            outcome.get();
+            return;
+        }
+
+        impl.image_checks[image] = check.get_future().share();
+    }
+
+    try
+    {
+        fetch_image(impl, image, repository, tag, pull_headers);
+    }
+    catch (...)
+    {
+        {
+            std::scoped_lock<std::mutex> lock(impl.mutex);
+            impl.image_checks.erase(image);
+        }
+        check.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        std::scoped_lock<std::mutex> lock(impl.mutex);
+        impl.present_images[image] = std::chrono::steady_clock::now();
+        impl.image_checks.erase(image);
+    }
+    check.set_value();
+}
+
+} // namespace cradle
@@ -0,0 +1,91 @@
+#ifndef CRADLE_THINKNODE_DOCKER_H
+#define CRADLE_THINKNODE_DOCKER_H
+
+#include <chrono>
+#include <memory>
+
+#include <cradle/io/http_requests.hpp>
+
+// This file provides a client for the Docker Engine API, as used by the
+// supervisor to run providers locally.
+//
+// A docker_client is meant to be long-lived. It detects the type of Docker
+// service once, performs its requests over a single persistent connection,
+// and remembers which images are already present, so repeated local
+// calculations don't each pay for those round trips. (Image pulls are the
+// exception. They can take minutes, so each one gets its own connection
+// rather than holding up everything else.)
+
+namespace cradle {
+
+CRADLE_DEFINE_EXCEPTION(docker_image_pull_failure)
+// This exception provides internal_error_message_info.
+
+enum class docker_service_type
+{
+    WINDOWS,
+    LINUX,
+    WSL
+};
+
+struct docker_client_config
+{
+    // the Unix socket that the Docker daemon listens on (on Linux and WSL)
+    string socket_path = "/var/run/docker.sock";
+    // the URL of the Docker daemon's TCP endpoint (on Windows)
+    string tcp_url = "http://localhost:2375";
+    // how long an image that's known to be present is assumed to still be
+    // present before it's inspected again
+    std::chrono::seconds image_ttl = std::chrono::seconds(300);
+};
+
+struct docker_client_impl;
+
+struct docker_client : noncopyable
+{
+    docker_client(
+        http_request_system& system,
+        docker_client_config const& config = docker_client_config());
+    ~docker_client();
+
+    // Get the type of Docker service that's running on this machine.
+    // (This is detected on first use and then cached.)
+    docker_service_type
+    service_type();
+
+    // Perform a request to the Docker API.
+    // :path is relative to the root of the API (e.g., "/v1.38/info").
+    // As with http_connection, a non-2xx response throws
+    // bad_http_status_code.
+    http_response
+    perform_request(
+        http_request_method method,
+        string const& path,
+        http_header_list const& headers = http_header_list(),
+        http_body const& body = http_body());
+
+    // Ensure that the image :repository:tag is present locally, pulling it
+    // if necessary. (:tag can also be a digest, e.g., "sha256:...".)
+    // :pull_headers are supplied with the pull request (e.g., for registry
+    // authentication).
+    //
+    // Once an image is known to be present, it's assumed to remain present
+    // for the configured TTL, so this usually doesn't need to contact the
+    // daemon at all. Concurrent calls for the same image share a single
+    // check (and pull).
+    //
+    // If the pull fails, this throws docker_image_pull_failure.
+    //
+    void
+    ensure_image(
+        string const& repository,
+        string const& tag,
+        http_header_list const& pull_headers = http_header_list());
+
+ private:
+    std::unique_ptr<docker_client_impl> impl_;
+};
+
+} // namespace cradle
+
+#endif
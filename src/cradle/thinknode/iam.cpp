@@ -5,16 +5,23 @@
 
 namespace cradle {
 
+http_request
+make_context_contents_request(
+    thinknode_session const& session, string const& context_id)
+{
+    return make_get_request(
+        session.api_url + "/iam/contexts/" + context_id,
+        {{"Authorization", "Bearer " + session.access_token},
+         {"Accept", "application/json"}});
+}
+
 thinknode_context_contents
 get_context_contents(
     http_connection_interface& connection,
     thinknode_session const& session,
     string const& context_id)
 {
-    auto query = make_get_request(
-        session.api_url + "/iam/contexts/" + context_id,
-        {{"Authorization", "Bearer " + session.access_token},
-         {"Accept", "application/json"}});
+    auto query = make_context_contents_request(session, context_id);
     null_check_in check_in;
     null_progress_reporter reporter;
     auto response = connection.perform_request(check_in, reporter, query);
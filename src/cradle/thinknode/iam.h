@@ -1,11 +1,16 @@
 #ifndef CRADLE_THINKNODE_IAM_H
 #define CRADLE_THINKNODE_IAM_H
 
+#include <cradle/io/http_requests.hpp>
 #include <cradle/thinknode/types.hpp>
 
 namespace cradle {
 
-struct http_connection_interface;
+// Make the request that queries the contents of a context.
+// (The response is the JSON form of a thinknode_context_contents.)
+http_request
+make_context_contents_request(
+    thinknode_session const& session, string const& context_id);
 
 // Query the contents of a context.
 thinknode_context_contents
@@ -5,6 +5,7 @@
 #include <cradle/core/monitoring.h>
 #include <cradle/encodings/msgpack.h>
 #include <cradle/io/http_requests.hpp>
+#include <cradle/io/http_response_sinks.h>
 #include <cradle/thinknode/calc.h>
 #include <cradle/thinknode/utilities.h>
 #include <cradle/utilities/text.h>
@@ -121,8 +122,10 @@ retrieve_immutable(
          {"Accept", "application/octet-stream"}});
     null_check_in check_in;
     null_progress_reporter reporter;
-    auto response = connection.perform_request(check_in, reporter, query);
-    return parse_msgpack_response(response);
+    // Immutables can be large, so parse them as they download.
+    msgpack_response_sink sink;
+    connection.perform_streaming_request(check_in, reporter, query, sink);
+    return sink.value();
 }
 
 string
@@ -0,0 +1,601 @@
+#include <cradle/io/asio.h>
+
+#include <cradle/thinknode/provider_pool.h>
+
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+#include <spdlog/spdlog.h>
+
+#include <cradle/thinknode/ipc.h>
+#include <cradle/thinknode/messages.h>
+#include <cradle/utilities/errors.h>
+
+namespace asio = boost::asio;
+
+namespace cradle {
+
+uint8_t static const ipc_version = 1;
+
+// the largest registration message that will be accepted
+size_t static const max_registration_size = 1024;
+
+// Make a code of the fixed length (32 characters) that the protocol uses for
+// PIDs and pings.
+static string
+make_fixed_length_code(uint64_t n)
+{
+    auto code = std::to_string(n);
+    code.insert(0, 32 - code.size(), '0');
+    return code;
+}
+
+bool
+operator==(provider_pool_key const& a, provider_pool_key const& b)
+{
+    return std::tie(a.account, a.app, a.image)
+           == std::tie(b.account, b.app, b.image);
+}
+
+bool
+operator<(provider_pool_key const& a, provider_pool_key const& b)
+{
+    return std::tie(a.account, a.app, a.image)
+           < std::tie(b.account, b.app, b.image);
+}
+
+namespace {
+
+// warm_provider is the supervisor's end of the connection to a registered
+// provider.
+struct warm_provider
+{
+    warm_provider(tcp::socket socket) : socket(std::move(socket))
+    {
+    }
+
+    tcp::socket socket;
+
+    // when the provider went idle
+    std::chrono::steady_clock::time_point idle_since;
+    // when the provider was last confirmed to be healthy
+    std::chrono::steady_clock::time_point last_checked;
+};
+
+// incoming_connection is a connection that has been accepted but hasn't
+// registered yet.
+struct incoming_connection
+{
+    incoming_connection(asio::io_context& io_context)
+        : socket(io_context), deadline(io_context)
+    {
+    }
+
+    tcp::socket socket;
+    // for abandoning connections that don't register in time
+    asio::steady_timer deadline;
+
+    uint8_t header[ipc_message_header_size];
+    message_header parsed_header;
+    boost::shared_array<uint8_t> body;
+};
+
+} // namespace
+
+struct provider_pool_impl
+{
+    provider_pool_impl(
+        provider_launcher_interface& launcher,
+        provider_pool_config const& config)
+        : launcher(&launcher),
+          config(config),
+          acceptor(
+              io_context,
+              tcp::endpoint(
+                  asio::ip::make_address("127.0.0.1"), config.port)),
+          port(acceptor.local_endpoint().port())
+    {
+    }
+
+    provider_launcher_interface* launcher;
+    provider_pool_config config;
+
+    // This runs the acceptor and the registration of incoming connections
+    // (on :io_thread). Registered providers' sockets also belong to it, but
+    // they're only used synchronously, by whichever thread holds the
+    // provider.
+    asio::io_context io_context;
+    // This listens for providers throughout the pool's lifetime, so it's
+    // already listening by the time any provider is launched.
+    tcp::acceptor acceptor;
+    // the port that :acceptor is actually listening on
+    uint16_t port;
+    std::thread io_thread;
+
+    // This protects all of the following.
+    mutable std::mutex mutex;
+    std::map<provider_pool_key, std::vector<std::unique_ptr<warm_provider>>>
+        idle;
+    // the number of idle providers (for each key) that are temporarily out
+    // of :idle while they're being checked
+    std::map<provider_pool_key, size_t> checking;
+    // for signaling when checks finish
+    std::condition_variable checks_finished;
+    // the providers that have been launched but not yet claimed by their
+    // launchers, by PID - The entry is null until the provider registers.
+    std::map<string, std::unique_ptr<warm_provider>> launching;
+    // for signaling when providers register
+    std::condition_variable registrations;
+    uint64_t launch_count = 0;
+    uint64_t ping_count = 0;
+    bool stopping = false;
+
+    // for waking the maintenance thread when the pool is destroyed
+    std::condition_variable maintenance_wakeup;
+    std::thread maintenance_thread;
+};
+
+// Hand a newly registered provider over to whoever launched it.
+static void
+finish_registration(provider_pool_impl& impl, incoming_connection& connection)
+{
+    thinknode_provider_message message;
+    try
+    {
+        read_message_body(
+            &message,
+            connection.parsed_header.code,
+            connection.body,
+            size_t(connection.parsed_header.body_length));
+    }
+    catch (...)
+    {
+        return;
+    }
+
+    std::scoped_lock<std::mutex> lock(impl.mutex);
+    auto launched = impl.launching.find(as_registration(message).pid);
+    // Providers that this pool isn't waiting on (e.g., ones whose launches
+    // timed out) are simply disconnected.
+    if (launched == impl.launching.end() || launched->second)
+        return;
+    launched->second
+        = std::make_unique<warm_provider>(std::move(connection.socket));
+    impl.registrations.notify_all();
+}
+
+// Read the registration message from an incoming connection.
+// This runs on the I/O thread.
+static void
+register_connection(
+    provider_pool_impl& impl,
+    std::shared_ptr<incoming_connection> const& connection)
+{
+    connection->deadline.expires_after(impl.config.registration_timeout);
+    connection->deadline.async_wait(
+        [connection](boost::system::error_code const& error) {
+            if (!error)
+            {
+                boost::system::error_code ignored;
+                connection->socket.close(ignored);
+            }
+        });
+
+    asio::async_read(
+        connection->socket,
+        asio::buffer(connection->header),
+        [&impl, connection](boost::system::error_code const& error, size_t) {
+            auto& header = connection->parsed_header;
+            if (!error)
+                header = deserialize_message_header(connection->header);
+            if (error || header.ipc_version != ipc_version
+                || header.code != uint8_t(calc_message_code::REGISTER)
+                || header.body_length > max_registration_size)
+            {
+                connection->deadline.cancel();
+                return;
+            }
+            connection->body.reset(new uint8_t[header.body_length]);
+            asio::async_read(
+                connection->socket,
+                asio::buffer(
+                    connection->body.get(), size_t(header.body_length)),
+                [&impl, connection](
+                    boost::system::error_code const& error, size_t) {
+                    connection->deadline.cancel();
+                    if (!error)
+                        finish_registration(impl, *connection);
+                });
+        });
+}
+
+// Accept connections from providers (until the pool shuts down).
+// This runs on the I/O thread.
+static void
+accept_providers(provider_pool_impl& impl)
+{
+    auto connection = std::make_shared<incoming_connection>(impl.io_context);
+    impl.acceptor.async_accept(
+        connection->socket,
+        [&impl, connection](boost::system::error_code const& error) {
+            if (error == asio::error::operation_aborted)
+                return;
+            if (!error)
+                register_connection(impl, connection);
+            accept_providers(impl);
+        });
+}
+
+// Wait (for up to :timeout) for :provider to have something to read.
+static bool
+wait_for_input(
+    provider_pool_impl& impl,
+    warm_provider& provider,
+    std::chrono::milliseconds timeout)
+{
+    auto ready = std::make_shared<std::promise<bool>>();
+    auto result = ready->get_future();
+    provider.socket.async_wait(
+        tcp::socket::wait_read,
+        [ready](boost::system::error_code const& error) {
+            ready->set_value(!error);
+        });
+    if (result.wait_for(timeout) != std::future_status::ready)
+    {
+        // The wait is being handled on the I/O thread, so it has to be
+        // canceled there.
+        std::promise<void> canceled;
+        asio::post(impl.io_context, [&] {
+            provider.socket.cancel();
+            canceled.set_value();
+        });
+        canceled.get_future().wait();
+    }
+    return result.get();
+}
+
+// Check that :provider is still responsive.
+static bool
+ping_provider(provider_pool_impl& impl, warm_provider& provider)
+{
+    string code;
+    {
+        std::scoped_lock<std::mutex> lock(impl.mutex);
+        code = make_fixed_length_code(++impl.ping_count);
+    }
+
+    auto deadline
+        = std::chrono::steady_clock::now() + impl.config.ping_timeout;
+    try
+    {
+        write_message(
+            provider.socket,
+            ipc_version,
+            make_thinknode_supervisor_message_with_ping(code));
+        while (true)
+        {
+            auto remaining
+                = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0
+                || !wait_for_input(impl, provider, remaining))
+            {
+                return false;
+            }
+            auto message = read_message<thinknode_provider_message>(
+                provider.socket, ipc_version);
+            if (get_tag(message) == thinknode_provider_message_tag::PONG
+                && as_pong(message) == code)
+            {
+                provider.last_checked = std::chrono::steady_clock::now();
+                return true;
+            }
+        }
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+static std::unique_ptr<warm_provider>
+launch_provider(provider_pool_impl& impl, provider_pool_key const& key)
+{
+    // Each launch gets its own PID so that its registration can be picked
+    // out from any others that are happening at the same time.
+    string pid;
+    {
+        std::scoped_lock<std::mutex> lock(impl.mutex);
+        pid = make_fixed_length_code(++impl.launch_count);
+        impl.launching[pid] = nullptr;
+    }
+
+    spdlog::get("cradle")->info(
+        "launching provider for {}/{} ({})", key.account, key.app, key.image);
+    string id;
+    try
+    {
+        id = impl.launcher->launch(key, impl.port, pid);
+    }
+    catch (...)
+    {
+        std::scoped_lock<std::mutex> lock(impl.mutex);
+        impl.launching.erase(pid);
+        throw;
+    }
+
+    // Wait for it to register.
+    std::unique_ptr<warm_provider> provider;
+    {
+        std::unique_lock<std::mutex> lock(impl.mutex);
+        impl.registrations.wait_for(
+            lock, impl.config.registration_timeout, [&] {
+                return impl.launching[pid] != nullptr;
+            });
+        provider = std::move(impl.launching[pid]);
+        impl.launching.erase(pid);
+    }
+    if (!provider)
+    {
+        // Whatever was launched is still running (or at least still
+        // around), so clean it up.
+        try
+        {
+            impl.launcher->stop(id);
+        }
+        catch (std::exception& e)
+        {
+            spdlog::get("cradle")->warn(
+                "failed to stop unregistered provider {}: {}", id, e.what());
+        }
+        CRADLE_THROW(
+            provider_registration_failure()
+            << internal_error_message_info("provider didn't register"));
+    }
+
+    provider->last_checked = std::chrono::steady_clock::now();
+    return provider;
+}
+
+// Get a provider for :key, either from the pool or by launching one.
+static std::unique_ptr<warm_provider>
+acquire_provider(provider_pool_impl& impl, provider_pool_key const& key)
+{
+    while (true)
+    {
+        std::unique_ptr<warm_provider> provider;
+        {
+            std::unique_lock<std::mutex> lock(impl.mutex);
+            // If this key's idle providers are being checked, wait for one
+            // of them to pass (or for all of them to fail) rather than
+            // launching another provider.
+            auto idle = impl.idle.find(key);
+            impl.checks_finished.wait(lock, [&] {
+                idle = impl.idle.find(key);
+                return impl.checking.count(key) == 0
+                       || (idle != impl.idle.end() && !idle->second.empty());
+            });
+            if (idle != impl.idle.end() && !idle->second.empty())
+            {
+                // Take the most recently used one, since it's the least
+                // likely to have been disrupted.
+                provider = std::move(idle->second.back());
+                idle->second.pop_back();
+                if (idle->second.empty())
+                    impl.idle.erase(idle);
+            }
+        }
+        if (!provider)
+            return launch_provider(impl, key);
+        if (ping_provider(impl, *provider))
+            return provider;
+        // That one is dead, so try the next one.
+    }
+}
+
+// Return :provider to the pool (if there's room for it).
+static void
+release_provider(
+    provider_pool_impl& impl,
+    provider_pool_key const& key,
+    std::unique_ptr<warm_provider> provider)
+{
+    std::scoped_lock<std::mutex> lock(impl.mutex);
+    auto& idle = impl.idle[key];
+    if (idle.size() < impl.config.max_idle_per_key)
+    {
+        provider->idle_since = std::chrono::steady_clock::now();
+        idle.push_back(std::move(provider));
+    }
+}
+
+static dynamic
+run_calculation(
+    warm_provider& provider,
+    string const& function_name,
+    std::vector<dynamic> const& args)
+{
+    write_message(
+        provider.socket,
+        ipc_version,
+        make_thinknode_supervisor_message_with_function(
+            make_thinknode_supervisor_calculation_request(
+                function_name, args)));
+    while (true)
+    {
+        auto message = read_message<thinknode_provider_message>(
+            provider.socket, ipc_version);
+        switch (get_tag(message))
+        {
+            case thinknode_provider_message_tag::RESULT:
+                return as_result(message);
+            case thinknode_provider_message_tag::FAILURE:
+                CRADLE_THROW(
+                    local_calculation_failure() << internal_error_message_info(
+                        as_failure(message).code + ": "
+                        + as_failure(message).message));
+            default:
+                // Progress updates (and stray pongs) are ignored.
+                break;
+        }
+    }
+}
+
+// Finish checking on an idle provider, returning it to the pool if it's
+// still :healthy.
+static void
+finish_check(
+    provider_pool_impl& impl,
+    provider_pool_key const& key,
+    std::unique_ptr<warm_provider> provider,
+    bool healthy)
+{
+    std::scoped_lock<std::mutex> lock(impl.mutex);
+    if (healthy)
+    {
+        auto& idle = impl.idle[key];
+        if (idle.size() < impl.config.max_idle_per_key)
+            idle.push_back(std::move(provider));
+    }
+    auto checking = impl.checking.find(key);
+    if (--checking->second == 0)
+        impl.checking.erase(checking);
+    impl.checks_finished.notify_all();
+}
+
+// Periodically check on idle providers, shutting down the ones that have
+// died or been idle for too long.
+static void
+maintain_idle_providers(provider_pool_impl& impl)
+{
+    std::unique_lock<std::mutex> lock(impl.mutex);
+    while (true)
+    {
+        impl.maintenance_wakeup.wait_for(
+            lock, impl.config.ping_interval, [&] { return impl.stopping; });
+        if (impl.stopping)
+            return;
+
+        // Take the providers that are due for a check out of the pool while
+        // they're being checked, so that no one else uses them in the
+        // meantime.
+        auto now = std::chrono::steady_clock::now();
+        std::vector<
+            std::pair<provider_pool_key, std::unique_ptr<warm_provider>>>
+            due;
+        for (auto i = impl.idle.begin(); i != impl.idle.end();)
+        {
+            auto& providers = i->second;
+            for (auto j = providers.begin(); j != providers.end();)
+            {
+                if (now - (*j)->last_checked >= impl.config.ping_interval)
+                {
+                    due.emplace_back(i->first, std::move(*j));
+                    j = providers.erase(j);
+                }
+                else
+                {
+                    ++j;
+                }
+            }
+            if (providers.empty())
+                i = impl.idle.erase(i);
+            else
+                ++i;
+        }
+        if (due.empty())
+            continue;
+
+        for (auto const& [key, provider] : due)
+            ++impl.checking[key];
+        lock.unlock();
+
+        // Check them all at once, and return each one to the pool as soon as
+        // it passes, so a caller waiting on this key only waits for the
+        // first healthy provider (rather than for a whole sweep of pings).
+        std::vector<std::future<void>> checks;
+        for (auto& [key, provider] : due)
+        {
+            checks.push_back(std::async(
+                std::launch::async,
+                [&impl, now, key = key, provider = std::move(provider)]()
+                    mutable {
+                    bool healthy
+                        = now - provider->idle_since
+                              < impl.config.max_idle_time
+                          && ping_provider(impl, *provider);
+                    // (Unhealthy providers are disconnected here.)
+                    finish_check(impl, key, std::move(provider), healthy);
+                }));
+        }
+        for (auto& check : checks)
+            check.get();
+
+        lock.lock();
+    }
+}
+
+provider_pool::provider_pool(
+    provider_launcher_interface& launcher, provider_pool_config const& config)
+    : impl_(new provider_pool_impl(launcher, config))
+{
+    accept_providers(*impl_);
+    impl_->io_thread = std::thread([this] { impl_->io_context.run(); });
+    impl_->maintenance_thread
+        = std::thread([this] { maintain_idle_providers(*impl_); });
+}
+
+provider_pool::~provider_pool()
+{
+    {
+        std::scoped_lock<std::mutex> lock(impl_->mutex);
+        impl_->stopping = true;
+        impl_->maintenance_wakeup.notify_all();
+    }
+    impl_->maintenance_thread.join();
+    impl_->io_context.stop();
+    impl_->io_thread.join();
+}
+
+dynamic
+provider_pool::perform_calculation(
+    provider_pool_key const& key,
+    string const& function_name,
+    std::vector<dynamic> const& args)
+{
+    auto& impl = *impl_;
+    auto provider = acquire_provider(impl, key);
+    dynamic result;
+    try
+    {
+        result = run_calculation(*provider, function_name, args);
+    }
+    catch (local_calculation_failure&)
+    {
+        // The provider itself is still fine.
+        release_provider(impl, key, std::move(provider));
+        throw;
+    }
+    // (If anything else went wrong, the provider is in an unknown state, so
+    // it's simply disconnected.)
+    release_provider(impl, key, std::move(provider));
+    return result;
+}
+
+size_t
+provider_pool::idle_provider_count() const
+{
+    std::scoped_lock<std::mutex> lock(impl_->mutex);
+    size_t count = 0;
+    for (auto const& [key, providers] : impl_->idle)
+        count += providers.size();
+    for (auto const& [key, n] : impl_->checking)
+        count += n;
+    return count;
+}
+
+} // namespace cradle
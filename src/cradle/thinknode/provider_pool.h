@@ -0,0 +1,126 @@
+#ifndef CRADLE_THINKNODE_PROVIDER_POOL_H
+#define CRADLE_THINKNODE_PROVIDER_POOL_H
+
+#include <chrono>
+#include <memory>
+
+#include <cradle/core.h>
+
+// This file provides a pool of warm calculation providers for the
+// supervisor.
+//
+// Launching a provider (e.g., starting a Docker container) and waiting for it
+// to register is far more expensive than most of the calculations that it
+// performs. Providers are happy to perform any number of calculations over a
+// single connection, so rather than launching one for each calculation, the
+// pool keeps registered providers alive between calculations and reuses them.
+// Idle providers are kept healthy with the protocol's PING/PONG messages, and
+// ones that stop responding (or sit idle for too long) are shut down.
+//
+// Each launch is given a unique PID, and registrations are matched to
+// launches by that PID, so any number of providers can be launched (and any
+// number of calculations performed) concurrently.
+
+namespace cradle {
+
+CRADLE_DEFINE_EXCEPTION(local_calculation_failure)
+// This exception provides internal_error_message_info.
+
+CRADLE_DEFINE_EXCEPTION(provider_registration_failure)
+// This exception provides internal_error_message_info.
+
+// provider_pool_key identifies the providers that are interchangeable with
+// one another.
+struct provider_pool_key
+{
+    string account;
+    string app;
+    // the tag (or digest) of the app's provider image
+    string image;
+};
+
+bool
+operator==(provider_pool_key const& a, provider_pool_key const& b);
+bool
+operator<(provider_pool_key const& a, provider_pool_key const& b);
+
+// provider_launcher_interface abstracts away how providers are actually
+// launched (e.g., via Docker).
+struct provider_launcher_interface
+{
+    // Launch a new provider for :key.
+    // The provider should connect to the supervisor at :port (on the local
+    // machine) and register itself with :pid.
+    // This returns an ID for the launched provider (e.g., its container ID)
+    // that can be passed to stop().
+    // This may be called from multiple threads at once.
+    virtual string
+    launch(provider_pool_key const& key, uint16_t port, string const& pid)
+        = 0;
+
+    // Stop the provider that was launched as :id and clean up after it.
+    // (This is used for providers that don't register in time. Ones that do
+    // register shut themselves down when they're disconnected.)
+    // This may be called from multiple threads at once.
+    virtual void
+    stop(string const& id) = 0;
+};
+
+struct provider_pool_config
+{
+    // the port that the supervisor listens on for provider connections
+    // (on the loopback interface) - By default, an ephemeral port is chosen,
+    // so any number of pools can coexist on the same machine.
+    uint16_t port = 0;
+    // how long to wait for a newly launched provider to register
+    std::chrono::milliseconds registration_timeout
+        = std::chrono::seconds(120);
+    // how often idle providers are checked on
+    std::chrono::milliseconds ping_interval = std::chrono::seconds(30);
+    // how long a provider has to respond to a ping before it's considered
+    // dead
+    std::chrono::milliseconds ping_timeout = std::chrono::seconds(5);
+    // how long a provider can sit idle before it's shut down
+    std::chrono::milliseconds max_idle_time = std::chrono::minutes(10);
+    // the maximum number of idle providers to keep for each key
+    unsigned max_idle_per_key = 4;
+};
+
+struct provider_pool_impl;
+
+struct provider_pool : noncopyable
+{
+    // :launcher must outlive the pool.
+    provider_pool(
+        provider_launcher_interface& launcher,
+        provider_pool_config const& config = provider_pool_config());
+    // All providers are disconnected (which shuts them down).
+    ~provider_pool();
+
+    // Perform a calculation using a provider for :key.
+    // This can be called concurrently from any number of threads.
+    //
+    // If there's an idle provider for :key, it's checked and reused.
+    // Otherwise, a new one is launched. Either way, once the calculation is
+    // finished, the provider goes back into the pool.
+    //
+    // If the provider reports that the calculation failed, this throws
+    // local_calculation_failure.
+    //
+    dynamic
+    perform_calculation(
+        provider_pool_key const& key,
+        string const& function_name,
+        std::vector<dynamic> const& args);
+
+    // the number of providers that are currently idle in the pool
+    size_t
+    idle_provider_count() const;
+
+ private:
+    std::unique_ptr<provider_pool_impl> impl_;
+};
+
+} // namespace cradle
+
+#endif
@@ -2,16 +2,39 @@
 #define CRADLE_THINKNODE_SUPERVISOR_H
 
 #include <cradle/core.h>
+#include <cradle/thinknode/provider_pool.h>
 #include <cradle/thinknode/types.hpp>
 
 namespace cradle {
 
-struct http_connection;
+struct docker_client;
 
-// Execute a local Thinknode calculation by invoking a provider via Docker.
+// docker_provider_launcher launches providers as Docker containers (pulling
+// their images as needed).
+struct docker_provider_launcher : provider_launcher_interface
+{
+    // :docker must outlive the launcher.
+    docker_provider_launcher(docker_client& docker) : docker_(&docker)
+    {
+    }
+
+    string
+    launch(provider_pool_key const& key, uint16_t port, string const& pid)
+        override;
+
+    void
+    stop(string const& id) override;
+
+ private:
+    docker_client* docker_;
+};
+
+// Execute a local Thinknode calculation using a provider from :providers.
+// If the provider reports that the calculation failed, this throws
+// local_calculation_failure.
 dynamic
 supervise_thinknode_calculation(
-    http_connection& connection,
+    provider_pool& providers,
     string const& account,
     string const& app,
     thinknode_provider_image_info const& image,
@@ -106,4 +106,44 @@ get_thinknode_service_id(string const& thinknode_id)
     }
 }
 
+optional<thinknode_service_id>
+get_thinknode_service_for_url(string const& url)
+{
+    static std::pair<char const*, thinknode_service_id> const services[]
+        = {{"iam", thinknode_service_id::IAM},
+           {"apm", thinknode_service_id::APM},
+           {"iss", thinknode_service_id::ISS},
+           {"calc", thinknode_service_id::CALC},
+           {"cas", thinknode_service_id::CAS},
+           {"rks", thinknode_service_id::RKS}};
+
+    // Skip the scheme and host and ignore the query string.
+    auto scheme_end = url.find("://");
+    auto path_start
+        = url.find('/', scheme_end == string::npos ? 0 : scheme_end + 3);
+    if (path_start == string::npos)
+        return none;
+    auto path_end = url.find('?', path_start);
+    if (path_end == string::npos)
+        path_end = url.length();
+
+    // The service is identified by the first path segment that names one.
+    // (The segments before it are the API prefix, e.g., "/api/v1.0".)
+    auto segment_start = path_start + 1;
+    while (segment_start <= path_end)
+    {
+        auto segment_end = url.find('/', segment_start);
+        if (segment_end == string::npos || segment_end > path_end)
+            segment_end = path_end;
+        auto segment = url.substr(segment_start, segment_end - segment_start);
+        for (auto const& [name, service] : services)
+        {
+            if (segment == name)
+                return service;
+        }
+        segment_start = segment_end + 1;
+    }
+    return none;
+}
+
 } // namespace cradle
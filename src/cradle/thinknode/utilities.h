@@ -15,6 +15,12 @@ get_account_name(thinknode_session const& session);
 thinknode_service_id
 get_thinknode_service_id(string const& thinknode_id);
 
+// Get the service that handles requests to the given Thinknode API URL
+// (e.g., "https://mgh.thinknode.io/api/v1.0/iss/immutable/..." is handled by
+// ISS). If the URL doesn't address a known service, this returns none.
+optional<thinknode_service_id>
+get_thinknode_service_for_url(string const& url);
+
 } // namespace cradle
 
 #endif
@@ -2,20 +2,8 @@
 
 #include <picosha2.h>
 
-// Boost.Crc triggers some warnings on MSVC.
-#if defined(_MSC_VER)
-#pragma warning(push)
-#pragma warning(disable : 4245)
-#pragma warning(disable : 4701)
-#include <boost/crc.hpp>
-#pragma warning(pop)
-#else
-#include <boost/crc.hpp>
-#endif
-
 #include <cradle/core/dynamic.h>
 #include <cradle/encodings/msgpack.h>
-#include <cradle/fs/file_io.h>
 #include <cradle/thinknode/supervisor.h>
 #include <cradle/thinknode/utilities.h>
 #include <cradle/utilities/functional.h>
@@ -27,7 +15,7 @@ namespace cradle {
 
 dynamic
 get_iss_object(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -36,7 +24,7 @@ get_iss_object(
 
 api_type_info
 resolve_named_type_reference(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -44,7 +32,7 @@ resolve_named_type_reference(
 
 thinknode_app_version_info
 resolve_context_app(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -53,19 +41,11 @@ resolve_context_app(
 
 // end of temporary borrowing
 
-// TODO: This is also copied from server.cpp.
-static uint32_t
-compute_crc32(string const& s)
-{
-    boost::crc_32_type crc;
-    crc.process_bytes(s.data(), s.length());
-    return crc.checksum();
-}
-
 dynamic
 perform_local_function_calc(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
+    provider_pool& providers,
     thinknode_session const& session,
     string const& context_id,
     string const& account,
@@ -73,7 +53,6 @@ perform_local_function_calc(
     string const& name,
     std::vector<dynamic> const& args)
 {
-    // Try the disk cache.
     auto cache_key
         = picosha2::hash256_hex_string(value_to_msgpack_string(dynamic(
             {"local_function_calc",
@@ -83,60 +62,27 @@ perform_local_function_calc(
              app,
              name,
              args})));
-    try
-    {
-        auto entry = cache.find(cache_key);
-        // Cached calculation results are stored externally in files.
-        if (entry && !entry->value)
-        {
-            auto data = read_file_contents(cache.get_path_for_id(entry->id));
-            if (compute_crc32(data) == entry->crc32)
-            {
-                spdlog::get("cradle")->info("cache hit on {}", cache_key);
-                return parse_msgpack_value(data);
-            }
-        }
-    }
-    catch (...)
-    {
-        // Something went wrong trying to load the cached value, so just
-        // pretend it's not there. (It will be overwritten.)
-        spdlog::get("cradle")->warn("error on cache entry {}", cache_key);
-    }
-    spdlog::get("cradle")->info("cache miss on {}", cache_key);
-
-    auto version_info = resolve_context_app(
-        cache, connection, session, context_id, account, app);
-
-    auto result = supervise_thinknode_calculation(
-        connection,
-        account,
-        app,
-        as_private(*version_info.manifest->provider).image,
-        name,
-        args);
-
-    // Cache the result.
-    auto cache_id = cache.initiate_insert(cache_key);
-    auto msgpack = value_to_msgpack_string(result);
-    {
-        auto entry_path = cache.get_path_for_id(cache_id);
-        std::ofstream output;
-        open_file(
-            output,
-            entry_path,
-            std::ios::out | std::ios::trunc | std::ios::binary);
-        output << msgpack;
-    }
-    cache.finish_insert(cache_id, compute_crc32(msgpack));
-
-    return result;
+    return *look_up_or_compute<dynamic>(cache, make_id(cache_key), [&] {
+        spdlog::get("cradle")->info("cache miss on {}", cache_key);
+
+        auto version_info = resolve_context_app(
+            cache, connection, session, context_id, account, app);
+
+        return supervise_thinknode_calculation(
+            providers,
+            account,
+            app,
+            as_private(*version_info.manifest->provider).image,
+            name,
+            args);
+    });
 }
 
 dynamic
 perform_local_calc(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
+    provider_pool& providers,
     thinknode_session const& session,
     string const& context_id,
     std::map<string, dynamic> const& environment,
@@ -144,7 +90,13 @@ perform_local_calc(
 {
     auto recursive_call = [&](calculation_request const& request) {
         return perform_local_calc(
-            cache, connection, session, context_id, environment, request);
+            cache,
+            connection,
+            providers,
+            session,
+            context_id,
+            environment,
+            request);
     };
     auto coercive_call
         = [&](thinknode_type_info const& schema, dynamic const& value) {
@@ -168,6 +120,7 @@ perform_local_calc(
             return perform_local_function_calc(
                 cache,
                 connection,
+                providers,
                 session,
                 context_id,
                 as_function(request).account,
@@ -206,6 +159,7 @@ perform_local_calc(
             return perform_local_calc(
                 cache,
                 connection,
+                providers,
                 session,
                 context_id,
                 extended_environment,
@@ -232,14 +186,15 @@ perform_local_calc(
 
 dynamic
 perform_local_calc(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
+    provider_pool& providers,
     thinknode_session const& session,
     string const& context_id,
     calculation_request const& request)
 {
     return perform_local_calc(
-        cache, connection, session, context_id, {}, request);
+        cache, connection, providers, session, context_id, {}, request);
 }
 
 } // namespace cradle
@@ -1,16 +1,19 @@
 #ifndef CRADLE_WEBSOCKET_LOCAL_CALCS_H
 #define CRADLE_WEBSOCKET_LOCAL_CALCS_H
 
-#include <cradle/caching/disk_cache.hpp>
+#include <cradle/caching/tiered_cache.h>
 #include <cradle/io/http_requests.hpp>
 #include <cradle/thinknode/types.hpp>
 
 namespace cradle {
 
+struct provider_pool;
+
 dynamic
 perform_local_calc(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
+    provider_pool& providers,
     thinknode_session const& session,
     string const& context_id,
     calculation_request const& request);
@@ -4,17 +4,6 @@
 
 #include <thread>
 
-// Boost.Crc triggers some warnings on MSVC.
-#if defined(_MSC_VER)
-#pragma warning(push)
-#pragma warning(disable : 4245)
-#pragma warning(disable : 4701)
-#include <boost/crc.hpp>
-#pragma warning(pop)
-#else
-#include <boost/crc.hpp>
-#endif
-
 #include <picosha2.h>
 
 #include <websocketpp/config/asio_no_tls.hpp>
@@ -28,7 +17,8 @@
 #include <spdlog/sinks/ansicolor_sink.h>
 #endif
 
-#include <cradle/caching/disk_cache.hpp>
+#include <cradle/caching/immutable/adaptive_sizing.h>
+#include <cradle/caching/tiered_cache.h>
 #include <cradle/encodings/base64.h>
 #include <cradle/encodings/json.h>
 #include <cradle/encodings/msgpack.h>
@@ -36,10 +26,13 @@
 #include <cradle/fs/app_dirs.h>
 #include <cradle/fs/file_io.h>
 #include <cradle/io/http_requests.hpp>
+#include <cradle/io/http_revalidation.hpp>
 #include <cradle/thinknode/apm.h>
 #include <cradle/thinknode/calc.h>
+#include <cradle/thinknode/docker.h>
 #include <cradle/thinknode/iam.h>
 #include <cradle/thinknode/iss.h>
+#include <cradle/thinknode/supervisor.h>
 #include <cradle/thinknode/utilities.h>
 #include <cradle/utilities/diff.hpp>
 #include <cradle/utilities/errors.h>
@@ -201,9 +194,19 @@ struct websocket_server_impl
 {
     server_config config;
     http_request_system http_system;
+    // the client for running providers locally (which keeps its connection
+    // to the Docker daemon and what it knows about images across local
+    // calculations)
+    docker_client docker{http_system};
+    docker_provider_launcher provider_launcher{docker};
+    // the warm providers that are reused across local calculations
+    provider_pool providers{provider_launcher};
     ws_server_type ws;
     client_connection_list clients;
-    disk_cache cache;
+    tiered_cache cache;
+    // If the memory cache isn't explicitly configured, this adapts its size
+    // to the memory that's available.
+    std::unique_ptr<adaptive_cache_sizer> cache_sizer;
     synchronized_job_queue<client_request> requests;
 };
 
@@ -225,17 +228,9 @@ send(
     }
 }
 
-static uint32_t
-compute_crc32(string const& s)
-{
-    boost::crc_32_type crc;
-    crc.process_bytes(s.data(), s.length());
-    return crc.checksum();
-}
-
 static dynamic
 retrieve_immutable(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -244,64 +239,18 @@ retrieve_immutable(
     CRADLE_LOG_CALL(
         << CRADLE_LOG_ARG(context_id) << CRADLE_LOG_ARG(immutable_id));
 
-    // Try the disk cache.
     auto cache_key = picosha2::hash256_hex_string(value_to_msgpack_string(
         dynamic({"retrieve_immutable", session.api_url, immutable_id})));
-    try
-    {
-        auto entry = cache.find(cache_key);
-        // Cached immutables are stored externally in files.
-        if (entry && !entry->value)
-        {
-            auto data = read_file_contents(cache.get_path_for_id(entry->id));
-            if (compute_crc32(data) == entry->crc32)
-            {
-                spdlog::get("cradle")->info("cache hit on {}", cache_key);
-                return parse_msgpack_value(data);
-            }
-        }
-    }
-    catch (...)
-    {
-        // Something went wrong trying to load the cached value, so just
-        // pretend it's not there. (It will be overwritten.)
-        spdlog::get("cradle")->warn("error on cache entry {}", cache_key);
-    }
-    spdlog::get("cradle")->info("cache miss on {}", cache_key);
-
-    // Query Thinknode.
-    auto object
-        = retrieve_immutable(connection, session, context_id, immutable_id);
-
-    // Cache the result.
-    try
-    {
-        auto cache_id = cache.initiate_insert(cache_key);
-        auto msgpack = value_to_msgpack_string(object);
-        {
-            auto entry_path = cache.get_path_for_id(cache_id);
-            std::ofstream output;
-            open_file(
-                output,
-                entry_path,
-                std::ios::out | std::ios::trunc | std::ios::binary);
-            output << msgpack;
-        }
-        cache.finish_insert(cache_id, compute_crc32(msgpack));
-    }
-    catch (...)
-    {
-        // Something went wrong trying to write the cached value, so issue a
-        // warning and move on.
-        spdlog::get("cradle")->warn("error writing cache entry {}", cache_key);
-    }
-
-    return object;
+    return *look_up_or_compute<dynamic>(cache, make_id(cache_key), [&] {
+        spdlog::get("cradle")->info("cache miss on {}", cache_key);
+        return retrieve_immutable(
+            connection, session, context_id, immutable_id);
+    });
 }
 
 static string
 resolve_iss_object_to_immutable(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -321,7 +270,7 @@ resolve_iss_object_to_immutable(
              object_id})));
     try
     {
-        auto entry = cache.find(cache_key);
+        auto entry = cache.disk.find(cache_key);
         // Cached immutable IDs are stored internally, so if the entry exists,
         // there should also be a value.
         if (entry && entry->value)
@@ -345,7 +294,7 @@ resolve_iss_object_to_immutable(
     // Cache the result.
     try
     {
-        cache.insert(cache_key, immutable_id);
+        cache.disk.insert(cache_key, immutable_id);
     }
     catch (...)
     {
@@ -376,7 +325,7 @@ encode_object(output_data_encoding encoding, dynamic const& object)
 
 dynamic
 get_iss_object(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -398,7 +347,7 @@ get_iss_object(
 
 static std::map<string, string>
 get_iss_object_metadata(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -413,11 +362,12 @@ get_iss_object_metadata(
              object_id})));
     try
     {
-        auto entry = cache.find(cache_key);
+        auto entry = cache.disk.find(cache_key);
         // Cached metadata are stored externally in files.
         if (entry && !entry->value)
         {
-            auto data = read_file_contents(cache.get_path_for_id(entry->id));
+            auto data
+                = read_file_contents(cache.disk.get_path_for_id(entry->id));
             if (compute_crc32(data) == entry->crc32)
             {
                 spdlog::get("cradle")->info("cache hit on {}", cache_key);
@@ -441,10 +391,10 @@ get_iss_object_metadata(
     // Cache the result.
     try
     {
-        auto cache_id = cache.initiate_insert(cache_key);
+        auto cache_id = cache.disk.initiate_insert(cache_key);
         auto msgpack = value_to_msgpack_string(to_dynamic(metadata));
         {
-            auto entry_path = cache.get_path_for_id(cache_id);
+            auto entry_path = cache.disk.get_path_for_id(cache_id);
             std::ofstream output;
             open_file(
                 output,
@@ -452,7 +402,7 @@ get_iss_object_metadata(
                 std::ios::out | std::ios::trunc | std::ios::binary);
             output << msgpack;
         }
-        cache.finish_insert(cache_id, compute_crc32(msgpack));
+        cache.disk.finish_insert(cache_id, compute_crc32(msgpack));
     }
     catch (...)
     {
@@ -464,65 +414,107 @@ get_iss_object_metadata(
     return metadata;
 }
 
-thinknode_app_version_info
-get_app_version_info(
-    disk_cache& cache,
+// Mutable Thinknode data (e.g., the contents of a context) is cached, but
+// since it can change, cached copies are periodically revalidated with
+// Thinknode (according to this policy) rather than being trusted forever.
+static http_freshness_policy the_mutable_data_freshness;
+
+// Get the value of a mutable Thinknode resource (as parsed from the JSON
+// response to :request), using both the memory and disk caches.
+static dynamic
+get_mutable_thinknode_value(
+    tiered_cache& cache,
     http_connection_interface& connection,
-    thinknode_session const& session,
-    string const& account,
-    string const& app,
-    string const& version)
+    string const& cache_key,
+    http_request const& request)
 {
-    auto cache_key
-        = picosha2::hash256_hex_string(value_to_msgpack_string(dynamic(
-            {"get_app_version_info",
-             session.api_url,
-             account,
-             app,
-             version})));
+    static std::mutex memory_cache_mutex;
+    static std::unordered_map<string, http_cached_resource> memory_cache;
 
-    static std::unordered_map<string, thinknode_app_version_info> memory_cache;
-    auto cache_entry = memory_cache.find(cache_key);
-    if (cache_entry != memory_cache.end())
-        return cache_entry->second;
+    // Try the memory cache.
+    optional<http_cached_resource> cached;
+    {
+        std::scoped_lock<std::mutex> lock(memory_cache_mutex);
+        auto cache_entry = memory_cache.find(cache_key);
+        if (cache_entry != memory_cache.end())
+            cached = cache_entry->second;
+    }
 
     // Try the disk cache.
-    try
+    bool from_disk = false;
+    if (!cached)
     {
-        auto entry = cache.find(cache_key);
-        // Cached app version info is stored externally in files.
-        if (entry && !entry->value)
+        try
         {
-            auto data = read_file_contents(cache.get_path_for_id(entry->id));
-            if (compute_crc32(data) == entry->crc32)
+            auto entry = cache.disk.find(cache_key);
+            // Cached resources are stored externally in files.
+            if (entry && !entry->value)
             {
-                spdlog::get("cradle")->info("disk cache hit on {}", cache_key);
-                auto result = from_dynamic<thinknode_app_version_info>(
-                    parse_msgpack_value(data));
-                memory_cache[cache_key] = result;
-                return result;
+                auto data = read_file_contents(
+                    cache.disk.get_path_for_id(entry->id));
+                if (compute_crc32(data) == entry->crc32)
+                {
+                    spdlog::get("cradle")->info(
+                        "disk cache hit on {}", cache_key);
+                    cached = from_dynamic<http_cached_resource>(
+                        parse_msgpack_value(data));
+                    from_disk = true;
+                }
             }
         }
+        catch (...)
+        {
+            // Something went wrong trying to load the cached value, so just
+            // pretend it's not there. (It will be overwritten.)
+            spdlog::get("cradle")->warn(
+                "error on cache entry {}", cache_key);
+        }
     }
-    catch (...)
+    if (!cached)
+        spdlog::get("cradle")->info("cache miss on {}", cache_key);
+
+    // Make sure that the value is current.
+    http_cached_resource current;
+    try
     {
-        // Something went wrong trying to load the cached value, so just
-        // pretend it's not there. (It will be overwritten.)
-        spdlog::get("cradle")->warn("error on cache entry {}", cache_key);
+        current = revalidate_http_resource(
+            connection,
+            request,
+            cached,
+            the_mutable_data_freshness,
+            [](http_response const& response) {
+                return parse_json_response(response);
+            });
+    }
+    catch (http_request_failure&)
+    {
+        // If Thinknode can't be reached, a stale value is better than
+        // nothing.
+        if (!cached)
+            throw;
+        spdlog::get("cradle")->warn("using stale cache entry {}", cache_key);
+        return cached->value;
     }
-    spdlog::get("cradle")->info("cache miss on {}", cache_key);
 
-    // Query Thinknode.
-    auto version_info
-        = get_app_version_info(connection, session, account, app, version);
+    // Keep the result in memory. (This includes values that came from disk
+    // unchanged, so they aren't read from disk again while they're fresh.)
+    bool changed = !cached || current.checked_at != cached->checked_at;
+    if (changed || from_disk)
+    {
+        std::scoped_lock<std::mutex> lock(memory_cache_mutex);
+        memory_cache[cache_key] = current;
+    }
+    if (!changed)
+        return current.value;
 
-    // Cache the result.
+    // Cache the result on disk. (Even if only its checked_at time has
+    // changed, this keeps it fresh across restarts.)
     try
     {
-        auto cache_id = cache.initiate_insert(cache_key);
-        auto msgpack = value_to_msgpack_string(to_dynamic(version_info));
+        auto cache_id = cache.disk.initiate_insert(cache_key);
+        auto msgpack = value_to_msgpack_string(to_dynamic(current));
         {
-            auto entry_path = cache.get_path_for_id(cache_id);
+            auto entry_path = cache.disk.get_path_for_id(cache_id);
             std::ofstream output;
             open_file(
                 output,
@@ -530,7 +522,7 @@ get_app_version_info(
                 std::ios::out | std::ios::trunc | std::ios::binary);
             output << msgpack;
         }
-        cache.finish_insert(cache_id, compute_crc32(msgpack));
+        cache.disk.finish_insert(cache_id, compute_crc32(msgpack));
     }
     catch (...)
     {
@@ -539,81 +531,53 @@ get_app_version_info(
         spdlog::get("cradle")->warn("error writing cache entry {}", cache_key);
     }
 
-    memory_cache[cache_key] = version_info;
+    return current.value;
+}
 
-    return version_info;
+thinknode_app_version_info
+get_app_version_info(
+    tiered_cache& cache,
+    http_connection_interface& connection,
+    thinknode_session const& session,
+    string const& account,
+    string const& app,
+    string const& version)
+{
+    auto cache_key
+        = picosha2::hash256_hex_string(value_to_msgpack_string(dynamic(
+            {"get_app_version_info",
+             session.api_url,
+             account,
+             app,
+             version})));
+    return from_dynamic<thinknode_app_version_info>(
+        get_mutable_thinknode_value(
+            cache,
+            connection,
+            cache_key,
+            make_app_version_info_request(session, account, app, version)));
 }
 
 thinknode_context_contents
 get_context_contents(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection_interface& connection,
     thinknode_session const& session,
     string const& context_id)
 {
-    // Try the memory cache.
-    size_t mem_cache_key = invoke_hash(session.api_url);
-    boost::hash_combine(mem_cache_key, invoke_hash(context_id));
-    static std::unordered_map<size_t, thinknode_context_contents> memory_cache;
-    auto cache_entry = memory_cache.find(mem_cache_key);
-    if (cache_entry != memory_cache.end())
-        return cache_entry->second;
-
-    // Try the disk cache.
-    auto disk_cache_key = picosha2::hash256_hex_string(value_to_msgpack_string(
+    auto cache_key = picosha2::hash256_hex_string(value_to_msgpack_string(
         dynamic({"get_context_contents", session.api_url, context_id})));
-    try
-    {
-        auto entry = cache.find(disk_cache_key);
-        // Cached contexts are stored internally, so if the entry exists,
-        // there should also be a value.
-        if (entry && entry->value)
-        {
-            spdlog::get("cradle")->info("cache hit on {}", disk_cache_key);
-            auto result = from_dynamic<thinknode_context_contents>(
-                parse_msgpack_value(base64_decode(
-                    *entry->value, get_mime_base64_character_set())));
-            memory_cache[mem_cache_key] = result;
-            return result;
-        }
-    }
-    catch (...)
-    {
-        // Something went wrong trying to load the cached value, so just
-        // pretend it's not there. (It will be overwritten.)
-        spdlog::get("cradle")->warn("error on cache entry {}", disk_cache_key);
-    }
-    spdlog::get("cradle")->info("cache miss on {}", disk_cache_key);
-
-    // Query Thinknode.
-    auto context_contents
-        = get_context_contents(connection, session, context_id);
-
-    // Cache the result.
-    try
-    {
-        cache.insert(
-            disk_cache_key,
-            base64_encode(
-                value_to_msgpack_string(to_dynamic(context_contents)),
-                get_mime_base64_character_set()));
-    }
-    catch (...)
-    {
-        // Something went wrong trying to write the cached value, so issue a
-        // warning and move on.
-        spdlog::get("cradle")->warn(
-            "error writing cache entry {}", disk_cache_key);
-    }
-
-    memory_cache[mem_cache_key] = context_contents;
-
-    return context_contents;
+    return from_dynamic<thinknode_context_contents>(
+        get_mutable_thinknode_value(
+            cache,
+            connection,
+            cache_key,
+            make_context_contents_request(session, context_id)));
 }
 
 thinknode_app_version_info
 resolve_context_app(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -648,7 +612,7 @@ resolve_context_app(
 
 api_type_info
 resolve_named_type_reference(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -686,7 +650,7 @@ resolve_named_type_reference(
 
 static string
 post_iss_object(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -738,7 +702,7 @@ post_iss_object(
              coerced_object})));
     try
     {
-        auto entry = cache.find(cache_key);
+        auto entry = cache.disk.find(cache_key);
         // Cached ISS IDs are stored internally, so if the entry exists,
         // there should also be a value.
         if (entry && entry->value)
@@ -762,7 +726,7 @@ post_iss_object(
     // Cache the result.
     try
     {
-        cache.insert(cache_key, object_id);
+        cache.disk.insert(cache_key, object_id);
     }
     catch (...)
     {
@@ -931,7 +895,7 @@ visit_references(
 
 static void
 copy_iss_object(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& source_bucket,
@@ -995,7 +959,7 @@ copy_iss_object(
 
 static calculation_request
 get_calculation_request(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -1007,7 +971,7 @@ get_calculation_request(
             {"get_calculation_request", session.api_url, calculation_id})));
     try
     {
-        auto entry = cache.find(cache_key);
+        auto entry = cache.disk.find(cache_key);
         // Cached immutable IDs are stored internally, so if the entry
         // exists, there should also be a value.
         if (entry && entry->value)
@@ -1033,7 +997,7 @@ get_calculation_request(
     // Cache the result.
     try
     {
-        cache.insert(
+        cache.disk.insert(
             cache_key,
             base64_encode(
                 value_to_msgpack_string(to_dynamic(request)),
@@ -1051,11 +1015,11 @@ get_calculation_request(
 
 struct simple_calculation_retriever : calculation_retrieval_interface
 {
-    disk_cache& cache;
+    tiered_cache& cache;
     http_connection& connection;
 
     simple_calculation_retriever(
-        disk_cache& cache, http_connection& connection)
+        tiered_cache& cache, http_connection& connection)
         : cache(cache), connection(connection)
     {
     }
@@ -1075,7 +1039,7 @@ struct simple_calculation_retriever : calculation_retrieval_interface
 // IDs that match :search_string.
 static std::vector<string>
 search_calculation(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -1089,7 +1053,7 @@ search_calculation(
 
 static string
 post_shallow_calculation(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -1107,7 +1071,7 @@ post_shallow_calculation(
              to_dynamic(calculation)})));
     try
     {
-        auto entry = cache.find(cache_key);
+        auto entry = cache.disk.find(cache_key);
         // Cached immutable IDs are stored internally, so if the entry
         // exists, there should also be a value.
         if (entry && entry->value)
@@ -1131,7 +1095,7 @@ post_shallow_calculation(
     // Cache the result.
     try
     {
-        cache.insert(cache_key, calculation_id);
+        cache.disk.insert(cache_key, calculation_id);
     }
     catch (...)
     {
@@ -1145,7 +1109,7 @@ post_shallow_calculation(
 
 static calculation_request
 shallowly_post_calculation(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -1229,7 +1193,7 @@ shallowly_post_calculation(
 
 static string
 post_calculation(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -1242,11 +1206,11 @@ post_calculation(
 
 struct simple_calculation_submitter : calculation_submission_interface
 {
-    disk_cache& cache;
+    tiered_cache& cache;
     http_connection& connection;
 
     simple_calculation_submitter(
-        disk_cache& cache, http_connection& connection)
+        tiered_cache& cache, http_connection& connection)
         : cache(cache), connection(connection)
     {
     }
@@ -1271,7 +1235,7 @@ struct simple_calculation_submitter : calculation_submission_interface
 
 static string
 resolve_meta_chain(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id,
@@ -1326,7 +1290,7 @@ is_iss_id(dynamic const& value)
 
 static object_tree_diff
 compute_iss_tree_diff(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id_a,
@@ -1388,7 +1352,7 @@ compute_iss_tree_diff(
 
 static object_tree_diff
 compute_calc_tree_diff(
-    disk_cache& cache,
+    tiered_cache& cache,
     http_connection& connection,
     thinknode_session const& session,
     string const& context_id_a,
@@ -1515,12 +1479,12 @@ process_message(
         }
         case client_message_content_tag::CACHE_INSERT: {
             auto& insertion = as_cache_insert(content);
-            server.cache.insert(insertion.key, insertion.value);
+            server.cache.disk.insert(insertion.key, insertion.value);
             break;
         }
         case client_message_content_tag::CACHE_QUERY: {
             auto const& key = as_cache_query(content);
-            auto entry = server.cache.find(key);
+            auto entry = server.cache.disk.find(key);
             send_response(
                 server,
                 request,
@@ -1721,6 +1685,7 @@ process_message(
             auto result = perform_local_calc(
                 server.cache,
                 connection,
+                server.providers,
                 get_client(server.clients, request.client).session,
                 pc.context_id,
                 pc.calculation);
@@ -1832,9 +1797,24 @@ initialize(websocket_server_impl& server, server_config const& config)
 {
     server.config = config;
 
+    if (config.mutable_data_max_age)
+    {
+        the_mutable_data_freshness.max_age
+            = std::chrono::seconds(*config.mutable_data_max_age);
+    }
+
     server.cache.reset(
+        config.memory_cache ? *config.memory_cache
+                            : immutable_cache_config(
+                                0x40'00'00'00,
+                                immutable_cache_eviction_policy::TWO_QUEUE),
         config.disk_cache ? *config.disk_cache
                           : disk_cache_config(none, 0x1'00'00'00'00));
+    if (!config.memory_cache)
+    {
+        server.cache_sizer = std::make_unique<adaptive_cache_sizer>(
+            server.cache.memory, adaptive_cache_sizing_config());
+    }
 
     server.ws.clear_access_channels(websocketpp::log::alevel::all);
     server.ws.init_asio();
@@ -0,0 +1,178 @@
+#include <cradle/background/coroutines.h>
+
+#ifdef CRADLE_ENABLE_COROUTINES
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+#include <cradle/caching/immutable.h>
+#include <cradle/caching/immutable/production.h>
+#include <cradle/core/immutable.h>
+#include <cradle/io/http_executor.h>
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+
+static http_request_system the_http_request_system;
+
+namespace {
+
+task<int>
+add_one_in_background(background_execution_system& system, int x)
+{
+    co_await resume_in_background(system);
+    co_return x + 1;
+}
+
+task<int>
+add_two_in_background(background_execution_system& system, int x)
+{
+    int y = co_await add_one_in_background(system, x);
+    co_return co_await add_one_in_background(system, y);
+}
+
+task<void>
+fail_in_background(background_execution_system& system)
+{
+    co_await resume_in_background(system);
+    throw std::runtime_error("failed");
+}
+
+// This job blocks its thread until it's canceled.
+struct blocking_job : background_job_interface
+{
+    blocking_job(std::atomic<bool>* started) : started(started)
+    {
+    }
+
+    void
+    execute(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter) override
+    {
+        *started = true;
+        while (true)
+        {
+            check_in();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    std::atomic<bool>* started;
+};
+
+// This produces a cache value on the calculation pool after a short delay
+// (so that the coroutine awaiting it has a chance to suspend).
+struct delayed_cache_producer : background_job_interface
+{
+    delayed_cache_producer(immutable_cache& cache, int value)
+        : cache(&cache), value(value)
+    {
+    }
+
+    void
+    execute(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter) override
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (value < 0)
+        {
+            report_immutable_cache_loading_failure(*cache, make_id(value));
+        }
+        else
+        {
+            set_immutable_cache_data(
+                *cache, make_id(value), make_immutable(value * 2));
+        }
+    }
+
+    immutable_cache* cache;
+    int value;
+};
+
+task<int>
+get_cached_double(
+    background_execution_system& system, immutable_cache& cache, int value)
+{
+    auto result = co_await await_immutable_cache_entry<int>(
+        system, cache, make_id(value), [&] {
+            return add_calculation_job(
+                system,
+                std::make_unique<delayed_cache_producer>(cache, value));
+        });
+    co_return *result;
+}
+
+} // namespace
+
+TEST_CASE("coroutine tasks", "[background][coroutines]")
+{
+    background_execution_system system(the_http_request_system);
+
+    REQUIRE(start_task(system, add_two_in_background(system, 1)).get() == 3);
+
+    auto failure = start_task(system, fail_in_background(system));
+    REQUIRE_THROWS_AS(failure.get(), std::runtime_error);
+}
+
+TEST_CASE("coroutines with discarded jobs", "[background][coroutines]")
+{
+    background_execution_system_config config;
+    config.calculation_thread_count = 1;
+    background_execution_system system(the_http_request_system, config);
+
+    // Occupy the calculation pool's only thread so that the coroutine's
+    // resumption job stays queued.
+    std::atomic<bool> started(false);
+    add_calculation_job(system, std::make_unique<blocking_job>(&started));
+    while (!started)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // Clearing the jobs still resumes the coroutine, with an error.
+    auto result = start_task(system, add_one_in_background(system, 1));
+    clear_all_jobs(system);
+    REQUIRE_THROWS_AS(result.get(), detail::background_job_canceled);
+}
+
+TEST_CASE("awaitable immutable cache entries", "[background][coroutines]")
+{
+    background_execution_system system(the_http_request_system);
+    immutable_cache cache(immutable_cache_config(1024, none));
+
+    // Several coroutines can wait on the same entry at once.
+    auto a = start_task(system, get_cached_double(system, cache, 4));
+    auto b = start_task(system, get_cached_double(system, cache, 4));
+    REQUIRE(a.get() == 8);
+    REQUIRE(b.get() == 8);
+
+    // Hold the entry so that it stays ready and try again. This time, the
+    // value is available immediately.
+    immutable_cache_ptr<int> held(cache, make_id(4), [] {
+        return background_job_controller();
+    });
+    REQUIRE(start_task(system, get_cached_double(system, cache, 4)).get() == 8);
+
+    // Failures are reported to the awaiting coroutine.
+    REQUIRE_THROWS_AS(
+        start_task(system, get_cached_double(system, cache, -1)).get(),
+        immutable_cache_entry_failure);
+}
+
+TEST_CASE("awaitable HTTP requests", "[background][coroutines]")
+{
+    background_execution_system system(the_http_request_system);
+
+    auto get_status = [&]() -> task<int> {
+        auto response = co_await async_http_request(
+            system,
+            make_get_request(
+                "http://postman-echo.com/get?color=navy",
+                http_header_list()));
+        co_return response.status_code;
+    };
+    REQUIRE(start_task(system, get_status()).get() == 200);
+}
+
+#endif
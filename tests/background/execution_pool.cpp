@@ -1,11 +1,84 @@
 #include <cradle/background/execution_pool.h>
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 #include <cradle/utilities/testing.h>
 
 using namespace cradle;
 
+namespace {
+
+// gate_job blocks its thread until it's released.
+struct gate_job : background_job_interface
+{
+    std::atomic<bool>* open;
+
+    gate_job(std::atomic<bool>* open) : open(open)
+    {
+    }
+
+    void
+    execute(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter) override
+    {
+        while (!*open)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+};
+
+// recording_job appends its label to :order when it executes.
+struct recording_job : background_job_interface
+{
+    std::mutex* mutex;
+    std::vector<int>* order;
+    int label;
+
+    recording_job(std::mutex* mutex, std::vector<int>* order, int label)
+        : mutex(mutex), order(order), label(label)
+    {
+    }
+
+    void
+    execute(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter) override
+    {
+        std::scoped_lock<std::mutex> lock(*mutex);
+        order->push_back(label);
+    }
+};
+
+// Wait (for up to five seconds) for :condition to hold.
+// The return value indicates whether or not it does.
+template<class Condition>
+bool
+wait_until(Condition&& condition)
+{
+    int n = 0;
+    while (n < 500 && !condition())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ++n;
+    }
+    return condition();
+}
+
+bool
+wait_for_state(
+    background_job_controller const& job, background_job_state state)
+{
+    return wait_until([&] { return job.state() == state; });
+}
+
+} // namespace
+
 TEST_CASE("basic execution pool", "[background]")
 {
     struct test_job : background_job_interface
@@ -38,3 +111,537 @@ TEST_CASE("basic execution pool", "[background]")
         detail::shut_down_pool(pool);
     }
 }
+
+TEST_CASE("execution pool job ordering", "[background]")
+{
+    detail::background_execution_pool pool;
+    detail::initialize_pool<detail::basic_executor>(
+        pool, 1, [] { return detail::basic_executor(); });
+
+    std::atomic<bool> open(false);
+    auto gate = detail::add_background_job(
+        pool, std::make_unique<gate_job>(&open));
+    REQUIRE(wait_for_state(gate, background_job_state::RUNNING));
+
+    // the priority of each job (which records its index when it runs)
+    std::vector<int> priorities{0, -2, 3, 0, 3, -2, 1};
+
+    std::mutex mutex;
+    std::vector<int> order;
+    for (int i = 0; i != int(priorities.size()); ++i)
+    {
+        detail::add_background_job(
+            pool,
+            std::make_unique<recording_job>(&mutex, &order, i),
+            NO_FLAGS,
+            priorities[i]);
+    }
+    auto canceled = detail::add_background_job(
+        pool,
+        std::make_unique<recording_job>(&mutex, &order, -1),
+        NO_FLAGS,
+        4);
+    canceled.cancel();
+    open = true;
+
+    REQUIRE(wait_until([&] { return detail::is_pool_idle(pool); }));
+    // Higher priorities go first, and ties go in submission order.
+    REQUIRE(order == std::vector<int>{2, 4, 6, 0, 3, 1, 5});
+    REQUIRE(canceled.state() == background_job_state::CANCELED);
+    detail::shut_down_pool(pool);
+}
+
+TEST_CASE("work stealing execution pool", "[background]")
+{
+    // Each of these jobs optionally spawns more jobs from within the pool.
+    // (Those go into the spawning thread's own deque, so the other threads
+    // have to steal them.)
+    struct spawning_job : background_job_interface
+    {
+        detail::background_execution_pool* pool;
+        std::atomic<int>* count;
+        int depth;
+
+        spawning_job(
+            detail::background_execution_pool* pool,
+            std::atomic<int>* count,
+            int depth)
+            : pool(pool), count(count), depth(depth)
+        {
+        }
+
+        void
+        execute(
+            check_in_interface& check_in,
+            progress_reporter_interface& reporter) override
+        {
+            ++*count;
+            if (depth > 0)
+            {
+                for (int i = 0; i != 4; ++i)
+                {
+                    detail::add_background_job(
+                        *pool,
+                        std::make_unique<spawning_job>(
+                            pool, count, depth - 1),
+                        BACKGROUND_JOB_HIDDEN,
+                        i - 2);
+                }
+            }
+        }
+    };
+
+    detail::background_execution_pool pool;
+    detail::initialize_pool<detail::basic_executor>(
+        pool, 4, [] { return detail::basic_executor(); });
+
+    // 1 + 4 + 16 + 64 jobs per root
+    std::atomic<int> count(0);
+    for (int i = 0; i != 10; ++i)
+    {
+        detail::add_background_job(
+            pool, std::make_unique<spawning_job>(&pool, &count, 3));
+    }
+
+    REQUIRE(wait_until([&] { return count == 850; }));
+    detail::shut_down_pool(pool);
+}
+
+TEST_CASE("elastic execution pool", "[background]")
+{
+    // This job blocks until it's released and then increments a counter.
+    struct gated_job : background_job_interface
+    {
+        std::atomic<bool>* open;
+        std::atomic<int>* count;
+
+        gated_job(std::atomic<bool>* open, std::atomic<int>* count)
+            : open(open), count(count)
+        {
+        }
+
+        void
+        execute(
+            check_in_interface& check_in,
+            progress_reporter_interface& reporter) override
+        {
+            while (!*open)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            ++*count;
+        }
+    };
+
+    detail::background_execution_pool pool;
+    elastic_pool_config config;
+    config.min_thread_count = 1;
+    config.max_thread_count = 4;
+    config.idle_timeout = std::chrono::milliseconds(50);
+    detail::initialize_elastic_pool<detail::basic_executor>(
+        pool, config, [] { return detail::basic_executor(); });
+    auto& queue = *pool.queue;
+    REQUIRE(queue.thread_count == 1);
+
+    // The pool grows to meet demand, but only up to its ceiling.
+    std::atomic<bool> open(false);
+    std::atomic<int> count(0);
+    for (int i = 0; i != 8; ++i)
+    {
+        detail::add_background_job(
+            pool, std::make_unique<gated_job>(&open, &count));
+    }
+    REQUIRE(wait_until([&] { return queue.n_idle_threads == 0; }));
+    REQUIRE(queue.thread_count == 4);
+
+    open = true;
+    REQUIRE(wait_until([&] { return count == 8; }));
+
+    // Once the work is done, the surplus threads exit.
+    REQUIRE(wait_until([&] { return queue.thread_count == 1; }));
+    auto live_placements = [&] {
+        std::scoped_lock<std::mutex> lock(queue.mutex);
+        std::vector<size_t> placements;
+        for (auto const& thread : pool.threads)
+        {
+            if (!thread->data_proxy->exited)
+                placements.push_back(thread->placement);
+        }
+        std::sort(placements.begin(), placements.end());
+        return placements;
+    };
+    REQUIRE(wait_until([&] { return live_placements().size() == 1; }));
+
+    // The pool can grow again afterwards.
+    open = false;
+    for (int i = 0; i != 3; ++i)
+    {
+        detail::add_background_job(
+            pool, std::make_unique<gated_job>(&open, &count));
+    }
+    REQUIRE(wait_until([&] { return queue.thread_count == 3; }));
+    // The new threads reuse the placement slots of the ones that exited.
+    auto placements = live_placements();
+    REQUIRE(placements.size() == 3);
+    REQUIRE(
+        std::adjacent_find(placements.begin(), placements.end())
+        == placements.end());
+    REQUIRE(placements.back() < 4);
+    open = true;
+    REQUIRE(wait_until([&] { return count == 11; }));
+
+    detail::shut_down_pool(pool);
+}
+
+TEST_CASE("execution pool job dependencies", "[background]")
+{
+    // This job checks in until it's released and then records that it
+    // executed (or throws, if it's supposed to fail).
+    struct dependency_test_job : background_job_interface
+    {
+        std::atomic<bool>* open;
+        std::atomic<int>* executed;
+        bool fail;
+
+        dependency_test_job(
+            std::atomic<bool>* open, std::atomic<int>* executed, bool fail)
+            : open(open), executed(executed), fail(fail)
+        {
+        }
+
+        void
+        execute(
+            check_in_interface& check_in,
+            progress_reporter_interface& reporter) override
+        {
+            while (!*open)
+            {
+                check_in();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (fail)
+                throw std::runtime_error("failed");
+            ++*executed;
+        }
+    };
+
+    detail::background_execution_pool pool;
+    detail::initialize_pool<detail::basic_executor>(
+        pool, 2, [] { return detail::basic_executor(); });
+
+    std::atomic<bool> closed(false), open(true);
+    std::atomic<int> executed(0);
+    auto add_job = [&](std::atomic<bool>* gate,
+                       std::vector<background_job_controller> inputs,
+                       bool fail = false) {
+        return detail::add_background_job(
+            pool,
+            std::make_unique<dependency_test_job>(gate, &executed, fail),
+            inputs);
+    };
+
+    SECTION("dependents wait for their inputs")
+    {
+        std::atomic<bool> gate(false);
+        auto a = add_job(&gate, {});
+        auto b = add_job(&gate, {});
+        auto c = add_job(&open, {a, b});
+        REQUIRE(wait_for_state(a, background_job_state::RUNNING));
+        REQUIRE(wait_for_state(b, background_job_state::RUNNING));
+        // Both threads are busy with the inputs, and c is held back without
+        // occupying a queue slot.
+        REQUIRE(c.state() == background_job_state::QUEUED);
+        REQUIRE(pool.queue->queued_count == 0);
+        gate = true;
+        REQUIRE(wait_for_state(c, background_job_state::COMPLETED));
+        REQUIRE(executed == 3);
+
+        // Depending on jobs that have already completed is fine.
+        auto d = add_job(&open, {a, c});
+        REQUIRE(wait_for_state(d, background_job_state::COMPLETED));
+    }
+
+    SECTION("failures cascade")
+    {
+        auto a = add_job(&open, {}, true);
+        auto b = add_job(&open, {a});
+        auto c = add_job(&open, {b});
+        REQUIRE(wait_for_state(c, background_job_state::CANCELED));
+        REQUIRE(a.state() == background_job_state::FAILED);
+        REQUIRE(b.state() == background_job_state::CANCELED);
+        REQUIRE(executed == 0);
+    }
+
+    SECTION("cancellation cascades")
+    {
+        auto a = add_job(&closed, {});
+        auto b = add_job(&open, {a});
+        auto c = add_job(&open, {b});
+        REQUIRE(wait_for_state(a, background_job_state::RUNNING));
+        a.cancel();
+        REQUIRE(wait_for_state(c, background_job_state::CANCELED));
+        REQUIRE(a.state() == background_job_state::CANCELED);
+        REQUIRE(b.state() == background_job_state::CANCELED);
+        REQUIRE(executed == 0);
+    }
+
+    SECTION("waiting jobs can be canceled directly")
+    {
+        auto a = add_job(&closed, {});
+        auto b = add_job(&open, {a});
+        auto c = add_job(&open, {b});
+        b.cancel();
+        REQUIRE(wait_for_state(c, background_job_state::CANCELED));
+        REQUIRE(b.state() == background_job_state::CANCELED);
+        // The input itself is unaffected.
+        REQUIRE(wait_for_state(a, background_job_state::RUNNING));
+        a.cancel();
+        REQUIRE(wait_for_state(a, background_job_state::CANCELED));
+    }
+
+    detail::shut_down_pool(pool);
+}
+
+TEST_CASE("execution pool dependencies across pools", "[background]")
+{
+    detail::background_execution_pool input_pool;
+    detail::initialize_pool<detail::basic_executor>(
+        input_pool, 1, [] { return detail::basic_executor(); });
+
+    std::atomic<bool> open(false);
+    auto input = detail::add_background_job(
+        input_pool, std::make_unique<gate_job>(&open));
+    REQUIRE(wait_for_state(input, background_job_state::RUNNING));
+
+    std::mutex mutex;
+    std::vector<int> order;
+    background_job_controller held, other_held;
+    {
+        auto pool = std::make_unique<detail::background_execution_pool>();
+        detail::initialize_pool<detail::basic_executor>(
+            *pool, 1, [] { return detail::basic_executor(); });
+
+        // Clearing the pool cancels jobs that are waiting on their inputs.
+        other_held = detail::add_background_job(
+            *pool,
+            std::make_unique<recording_job>(&mutex, &order, 0),
+            {input});
+        REQUIRE(other_held.state() == background_job_state::QUEUED);
+        detail::clear_all_jobs(*pool);
+        REQUIRE(other_held.state() == background_job_state::CANCELED);
+
+        // So does shutting it down.
+        held = detail::add_background_job(
+            *pool,
+            std::make_unique<recording_job>(&mutex, &order, 1),
+            {input});
+        REQUIRE(held.state() == background_job_state::QUEUED);
+        detail::shut_down_pool(*pool);
+        REQUIRE(held.state() == background_job_state::CANCELED);
+    }
+
+    // The input can still finish after the dependents' pool is gone.
+    open = true;
+    REQUIRE(wait_for_state(input, background_job_state::COMPLETED));
+    REQUIRE(order.empty());
+
+    detail::shut_down_pool(input_pool);
+}
+
+TEST_CASE("background job heap", "[background]")
+{
+    std::vector<background_job_ptr> jobs;
+    for (int i = 0; i != 200; ++i)
+    {
+        auto job = std::make_shared<detail::background_job_execution_data>(
+            nullptr, NO_FLAGS, 0);
+        // a deterministic mix of priorities, with plenty of ties
+        job->queued_priority = (i * 37) % 11 - 5;
+        job->sequence = i;
+        jobs.push_back(job);
+    }
+
+    detail::background_job_heap heap;
+    for (auto const& job : jobs)
+        heap.push(job);
+    REQUIRE(heap.size() == 200);
+
+    // Remove every third job, and reprioritize every fifth one.
+    std::vector<background_job_ptr> remaining;
+    for (int i = 0; i != 200; ++i)
+    {
+        auto const& job = jobs[i];
+        if (i % 3 == 0)
+        {
+            heap.remove(*job);
+            continue;
+        }
+        if (i % 5 == 0)
+        {
+            job->queued_priority = (i * 13) % 7 - 3;
+            heap.update(*job);
+        }
+        remaining.push_back(job);
+    }
+    REQUIRE(heap.size() == remaining.size());
+
+    // The jobs should come out by priority and then in submission order.
+    std::stable_sort(
+        remaining.begin(),
+        remaining.end(),
+        [](background_job_ptr const& a, background_job_ptr const& b) {
+            return a->queued_priority > b->queued_priority;
+        });
+    std::vector<background_job_ptr> popped;
+    while (!heap.empty())
+        popped.push_back(heap.pop());
+    REQUIRE(popped == remaining);
+}
+
+TEST_CASE("execution pool job removal and reprioritization", "[background]")
+{
+    detail::background_execution_pool pool;
+    detail::initialize_pool<detail::basic_executor>(
+        pool, 1, [] { return detail::basic_executor(); });
+
+    std::atomic<bool> open(false);
+    auto gate = detail::add_background_job(
+        pool, std::make_unique<gate_job>(&open));
+    REQUIRE(wait_for_state(gate, background_job_state::RUNNING));
+
+    std::mutex mutex;
+    std::vector<int> order;
+    auto add_recording_job = [&](int label) {
+        return detail::add_background_job(
+            pool, std::make_unique<recording_job>(&mutex, &order, label));
+    };
+
+    // Canceled jobs leave the queue immediately.
+    std::vector<background_job_controller> canceled;
+    for (int i = 0; i != 1000; ++i)
+        canceled.push_back(add_recording_job(-1));
+    REQUIRE(pool.queue->queued_count == 1000);
+    for (auto& job : canceled)
+        job.cancel();
+    REQUIRE(pool.queue->queued_count == 0);
+    REQUIRE(pool.queue->reported_size == 0);
+    for (auto const& job : canceled)
+        REQUIRE(job.state() == background_job_state::CANCELED);
+
+    // Queued jobs can be moved up or down.
+    std::vector<background_job_controller> jobs;
+    for (int i = 0; i != 4; ++i)
+        jobs.push_back(add_recording_job(i));
+    jobs[2].set_priority(1);
+    jobs[0].set_priority(-1);
+    open = true;
+
+    REQUIRE(wait_until([&] { return detail::is_pool_idle(pool); }));
+    REQUIRE(order == std::vector<int>{2, 1, 3, 0});
+    detail::shut_down_pool(pool);
+}
+
+TEST_CASE("execution pool queue skipping", "[background]")
+{
+    REQUIRE(!(BACKGROUND_JOB_SKIP_QUEUE & BACKGROUND_JOB_HIDDEN));
+
+    detail::background_execution_pool pool;
+    detail::initialize_pool<detail::basic_executor>(
+        pool, 1, [] { return detail::basic_executor(); });
+    pool.max_express_thread_count = 1;
+
+    std::atomic<bool> open(false);
+    auto gate = detail::add_background_job(
+        pool, std::make_unique<gate_job>(&open));
+    REQUIRE(wait_for_state(gate, background_job_state::RUNNING));
+
+    std::mutex mutex;
+    std::vector<int> order;
+    for (int i = 0; i != 4; ++i)
+    {
+        detail::add_background_job(
+            pool,
+            std::make_unique<recording_job>(&mutex, &order, i),
+            NO_FLAGS,
+            10);
+    }
+
+    // The pool's only thread is busy, so a thread is added to run a job that
+    // skips the queue.
+    std::atomic<bool> urgent_open(false);
+    auto urgent_gate = detail::add_background_job(
+        pool,
+        std::make_unique<gate_job>(&urgent_open),
+        BACKGROUND_JOB_SKIP_QUEUE);
+    REQUIRE(wait_for_state(urgent_gate, background_job_state::RUNNING));
+    REQUIRE(pool.queue->thread_count == 2);
+
+    // The pool is already at its limit for extra threads, so the next one
+    // has to wait, but it still runs ahead of the (higher priority) queued
+    // jobs.
+    auto urgent = detail::add_background_job(
+        pool,
+        std::make_unique<recording_job>(&mutex, &order, -1),
+        BACKGROUND_JOB_SKIP_QUEUE);
+    REQUIRE(pool.queue->thread_count == 2);
+    REQUIRE(urgent.state() == background_job_state::QUEUED);
+    urgent_open = true;
+    REQUIRE(wait_for_state(urgent, background_job_state::COMPLETED));
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        REQUIRE(order.front() == -1);
+    }
+
+    open = true;
+    REQUIRE(wait_until([&] { return detail::is_pool_idle(pool); }));
+    REQUIRE(order.size() == 5);
+
+    // When there's an idle thread to take a job that skips the queue, no
+    // thread is added for it.
+    auto idle_urgent = detail::add_background_job(
+        pool,
+        std::make_unique<recording_job>(&mutex, &order, -2),
+        BACKGROUND_JOB_SKIP_QUEUE);
+    REQUIRE(pool.queue->thread_count == 2);
+    REQUIRE(wait_for_state(idle_urgent, background_job_state::COMPLETED));
+
+    detail::shut_down_pool(pool);
+}
+
+TEST_CASE("execution pool shutdown", "[background]")
+{
+    detail::background_execution_pool pool;
+    detail::initialize_pool<detail::basic_executor>(
+        pool, 2, [] { return detail::basic_executor(); });
+
+    // Keep queueing jobs while the pool shuts down.
+    std::mutex mutex;
+    std::vector<int> order;
+    std::vector<background_job_controller> jobs;
+    std::atomic<bool> stop(false);
+    std::thread submitter([&] {
+        while (!stop && jobs.size() != 100000)
+        {
+            jobs.push_back(detail::add_background_job(
+                pool, std::make_unique<recording_job>(&mutex, &order, 0)));
+        }
+    });
+    REQUIRE(wait_until([&] {
+        std::scoped_lock<std::mutex> lock(mutex);
+        return !order.empty();
+    }));
+    detail::shut_down_pool(pool);
+    stop = true;
+    submitter.join();
+
+    // Jobs queued after the pool has shut down are canceled immediately.
+    jobs.push_back(detail::add_background_job(
+        pool, std::make_unique<recording_job>(&mutex, &order, 0)));
+
+    // No job is left waiting in the queue.
+    for (auto const& job : jobs)
+    {
+        auto state = job.state();
+        REQUIRE(
+            (state == background_job_state::COMPLETED
+             || state == background_job_state::CANCELED));
+    }
+}
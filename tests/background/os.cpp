@@ -0,0 +1,135 @@
+#include <cradle/background/os.h>
+
+#include <atomic>
+
+#include <cradle/background/execution_pool.h>
+#include <cradle/fs/file_io.h>
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+
+// Write a fake version of /sys/devices/system/cpu for a machine with two
+// sockets (each its own NUMA node), two cores per socket and two
+// hyperthreads per core. As on real Linux systems, hyperthread siblings are
+// numbered far apart (e.g., 0 and 4).
+static file_path
+write_fake_cpu_dir()
+{
+    file_path dir = "fake_cpu_dir";
+    if (exists(dir))
+        remove_all(dir);
+    create_directory(dir);
+    // (cpu8 exists but is offline, so it should be ignored.)
+    dump_string_to_file(dir / "online", "0-7\n");
+    for (unsigned id = 0; id != 9; ++id)
+    {
+        auto cpu_dir = dir / ("cpu" + std::to_string(id));
+        create_directories(cpu_dir / "topology");
+        unsigned package = (id % 4) / 2;
+        dump_string_to_file(
+            cpu_dir / "topology" / "physical_package_id",
+            std::to_string(package) + "\n");
+        dump_string_to_file(
+            cpu_dir / "topology" / "core_id", std::to_string(id % 2) + "\n");
+        create_directory(cpu_dir / ("node" + std::to_string(package)));
+    }
+    return dir;
+}
+
+TEST_CASE("CPU list parsing", "[background][os]")
+{
+    REQUIRE(parse_cpu_list("") == std::vector<unsigned>{});
+    REQUIRE(parse_cpu_list("3") == std::vector<unsigned>{3});
+    REQUIRE(
+        parse_cpu_list("0-3,8,10-11")
+        == (std::vector<unsigned>{0, 1, 2, 3, 8, 10, 11}));
+}
+
+TEST_CASE("CPU topology reading", "[background][os]")
+{
+    REQUIRE(!read_cpu_topology("nonexistent_cpu_dir"));
+
+    auto topology = read_cpu_topology(write_fake_cpu_dir());
+    REQUIRE(topology);
+    REQUIRE(topology->cpus.size() == 8);
+    auto const& cpu = topology->cpus[6];
+    REQUIRE(cpu.id == 6);
+    REQUIRE(cpu.package == 1);
+    REQUIRE(cpu.core == 0);
+    REQUIRE(cpu.numa_node == 1);
+}
+
+TEST_CASE("thread CPU sets", "[background][os]")
+{
+    auto topology = read_cpu_topology(write_fake_cpu_dir());
+    REQUIRE(topology);
+
+    auto unpinned = get_thread_cpu_set(
+        *topology, thread_affinity_policy::UNPINNED, 0);
+    REQUIRE(unpinned.empty());
+
+    // Each core gets its hyperthreads, and the cores of a node are together.
+    auto per_core = [&](size_t index) {
+        return get_thread_cpu_set(
+            *topology, thread_affinity_policy::PER_CORE, index);
+    };
+    REQUIRE(per_core(0) == (std::vector<unsigned>{0, 4}));
+    REQUIRE(per_core(1) == (std::vector<unsigned>{1, 5}));
+    REQUIRE(per_core(2) == (std::vector<unsigned>{2, 6}));
+    REQUIRE(per_core(3) == (std::vector<unsigned>{3, 7}));
+    REQUIRE(per_core(4) == (std::vector<unsigned>{0, 4}));
+
+    auto per_node = [&](size_t index) {
+        return get_thread_cpu_set(
+            *topology, thread_affinity_policy::PER_NUMA_NODE, index);
+    };
+    REQUIRE(per_node(0) == (std::vector<unsigned>{0, 1, 4, 5}));
+    REQUIRE(per_node(1) == (std::vector<unsigned>{2, 3, 6, 7}));
+    REQUIRE(per_node(2) == (std::vector<unsigned>{0, 1, 4, 5}));
+}
+
+TEST_CASE("pinned execution pool", "[background][os]")
+{
+    struct counting_job : background_job_interface
+    {
+        std::atomic<int>* count;
+
+        counting_job(std::atomic<int>* count) : count(count)
+        {
+        }
+
+        void
+        execute(
+            check_in_interface& check_in,
+            progress_reporter_interface& reporter) override
+        {
+            ++*count;
+        }
+    };
+
+    // Whether or not this machine's topology is available, the pool should
+    // work the same.
+    detail::background_execution_pool pool;
+    detail::initialize_pool<detail::basic_executor>(
+        pool,
+        2,
+        [] { return detail::basic_executor(); },
+        thread_affinity_policy::PER_CORE);
+    std::atomic<int> count(0);
+    for (int i = 0; i != 10; ++i)
+    {
+        detail::add_background_job(
+            pool, std::make_unique<counting_job>(&count));
+    }
+    int n = 0;
+    while (n < 100 && count != 10)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ++n;
+    }
+    REQUIRE(count == 10);
+    REQUIRE(pool.threads.size() == 2);
+    REQUIRE(pool.threads[0]->placement == 0);
+    REQUIRE(pool.threads[1]->placement == 1);
+    detail::shut_down_pool(pool);
+}
@@ -1,5 +1,10 @@
 #include <cradle/background/requests.h>
 
+#include <atomic>
+#include <stdexcept>
+
+#include <cradle/caching/immutable.h>
+
 #include <cradle/utilities/testing.h>
 
 using namespace cradle;
@@ -15,6 +20,13 @@ TEST_CASE("value requests", "[background]")
     REQUIRE(four.value_id() == another_four.value_id());
     REQUIRE(four.value_id() != two.value_id());
 
+    // Copies refer to their own values (not the originals').
+    auto copy_of_temporary = [] {
+        auto original = rq::value(4);
+        return value_request<int>(original);
+    }();
+    REQUIRE(copy_of_temporary.value_id() == four.value_id());
+
     bool was_dispatched = false;
     four.dispatch([&](int value) {
         was_dispatched = true;
@@ -22,3 +34,143 @@ TEST_CASE("value requests", "[background]")
     });
     REQUIRE(was_dispatched);
 }
+
+static std::atomic<int> add_count(0);
+
+static int
+add(int a, int b)
+{
+    ++add_count;
+    return a + b;
+}
+
+TEST_CASE("apply requests", "[background]")
+{
+    immutable_cache cache(immutable_cache_config(0x40'00'00'00, none));
+    request_resolution_system system(cache, 2);
+
+    add_count = 0;
+
+    auto sum = rq::apply(add, rq::value(2), rq::value(3));
+    REQUIRE(!sum.is_resolved());
+    REQUIRE(resolve_request(system, sum).get() == 5);
+    REQUIRE(add_count == 1);
+
+    // Requests for the same value share an ID, so the result is memoized.
+    auto same_sum = rq::apply(add, rq::value(2), rq::value(3));
+    REQUIRE(sum.value_id() == same_sum.value_id());
+    REQUIRE(resolve_request(system, same_sum).get() == 5);
+    REQUIRE(add_count == 1);
+
+    // Different arguments produce a different value.
+    auto other_sum = rq::apply(add, rq::value(2), rq::value(4));
+    REQUIRE(sum.value_id() != other_sum.value_id());
+    REQUIRE(resolve_request(system, other_sum).get() == 6);
+    REQUIRE(add_count == 2);
+
+    // Requests can be nested, and shared subrequests are only computed once.
+    auto nested
+        = rq::apply(add, sum, rq::apply(add, rq::value(2), rq::value(3)));
+    REQUIRE(resolve_request(system, nested).get() == 10);
+    REQUIRE(add_count == 3);
+}
+
+static std::atomic<int> square_count(0);
+
+TEST_CASE("async requests", "[background]")
+{
+    immutable_cache cache(immutable_cache_config(0x40'00'00'00, none));
+    request_resolution_system system(cache, 2);
+
+    square_count = 0;
+
+    auto square = [](check_in_interface& check_in,
+                     progress_reporter_interface& reporter,
+                     int x) {
+        check_in();
+        ++square_count;
+        return x * x;
+    };
+
+    auto nine = rq::async(square, rq::value(3));
+    auto also_nine = rq::async(square, rq::value(3));
+    auto eighty_one = rq::async(square, nine);
+
+    auto eighty_one_future = resolve_request(system, eighty_one);
+    auto nine_future = resolve_request(system, also_nine);
+    REQUIRE(eighty_one_future.get() == 81);
+    REQUIRE(nine_future.get() == 9);
+    REQUIRE(square_count == 2);
+
+    // Applying to async results works too.
+    REQUIRE(
+        resolve_request(system, rq::apply(add, nine, eighty_one)).get() == 90);
+    REQUIRE(square_count == 2);
+}
+
+TEST_CASE("request failures", "[background]")
+{
+    immutable_cache cache(immutable_cache_config(0x40'00'00'00, none));
+    request_resolution_system system(cache, 2);
+
+    auto fail = [](int x) -> int {
+        throw std::runtime_error("failed on " + std::to_string(x));
+    };
+
+    // The original error is reported to the resolution that computed it.
+    auto failing = rq::apply(fail, rq::value(1));
+    auto future = resolve_request(system, failing);
+    REQUIRE_THROWS_AS(future.get(), std::runtime_error);
+
+    // Failures propagate to requests that depend on the failing request.
+    auto dependent = rq::apply(add, rq::value(1), failing);
+    REQUIRE_THROWS(resolve_request(system, dependent).get());
+
+    // Failed requests are retried.
+    REQUIRE_THROWS_AS(
+        resolve_request(system, failing).get(), std::runtime_error);
+}
+
+TEST_CASE("discarded async request jobs", "[background]")
+{
+    auto square
+        = [](check_in_interface&, progress_reporter_interface&, int x) {
+              return x * x;
+          };
+
+    // A job that's discarded without being executed (e.g., because its queue
+    // was cleared) still reports a failure, so nothing waits on it forever.
+    int failure_count = 0;
+    bool got_value = false;
+    {
+        detail::async_request_job<int, decltype(square), int> job(
+            square,
+            std::make_tuple(3),
+            [&](int) { got_value = true; },
+            [&](std::exception_ptr error) {
+                ++failure_count;
+                REQUIRE_THROWS_AS(
+                    std::rethrow_exception(error),
+                    detail::background_job_canceled);
+            });
+    }
+    REQUIRE(failure_count == 1);
+    REQUIRE(!got_value);
+
+    // A job that's executed reports its result exactly once.
+    {
+        detail::async_request_job<int, decltype(square), int> job(
+            square,
+            std::make_tuple(3),
+            [&](int value) {
+                got_value = true;
+                REQUIRE(value == 9);
+            },
+            [&](std::exception_ptr) { ++failure_count; });
+        null_check_in check_in;
+        null_progress_reporter reporter;
+        job.execute(check_in, reporter);
+    }
+    REQUIRE(got_value);
+    REQUIRE(failure_count == 1);
+}
@@ -0,0 +1,288 @@
+#include <cradle/background/system.h>
+
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#include <cradle/fs/disk_executor.h>
+#include <cradle/io/http_executor.h>
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+
+static http_request_system the_http_request_system;
+
+namespace {
+
+struct counting_job : background_job_interface
+{
+    std::atomic<int>* count;
+
+    counting_job(std::atomic<int>* count) : count(count)
+    {
+    }
+
+    void
+    execute(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter) override
+    {
+        ++*count;
+    }
+};
+
+struct counting_disk_job : disk_job
+{
+    std::atomic<int>* count;
+
+    counting_disk_job(std::atomic<int>* count) : count(count)
+    {
+    }
+
+    void
+    execute(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter) override
+    {
+        ++*count;
+    }
+};
+
+// This doesn't actually make a request. It just checks that it's been given
+// a connection.
+struct connection_checking_job : http_request_job
+{
+    std::atomic<int>* count;
+
+    connection_checking_job(std::atomic<int>* count) : count(count)
+    {
+    }
+
+    void
+    execute(
+        check_in_interface& check_in,
+        progress_reporter_interface& reporter) override
+    {
+        if (this->connection)
+            ++*count;
+    }
+};
+
+void
+wait_for_count(std::atomic<int> const& count, int expected)
+{
+    int n = 0;
+    while (n < 500 && count != expected)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ++n;
+    }
+}
+
+} // namespace
+
+TEST_CASE("background execution system", "[background]")
+{
+    background_execution_system_config config;
+    config.calculation_thread_count = 2;
+    config.http_pool.min_thread_count = 3;
+    config.disk_thread_count = 1;
+    background_execution_system system(the_http_request_system, config);
+
+    auto status = get_status(system);
+    REQUIRE(
+        status.pools[size_t(background_job_queue_type::CALCULATION)]
+            .thread_count
+        == 2);
+    REQUIRE(
+        status.pools[size_t(background_job_queue_type::HTTP)].thread_count
+        == 3);
+    REQUIRE(
+        status.pools[size_t(background_job_queue_type::DISK)].thread_count
+        == 1);
+
+    std::atomic<int> count(0);
+    for (int i = 0; i != 10; ++i)
+    {
+        add_calculation_job(system, std::make_unique<counting_job>(&count));
+        add_disk_job(system, std::make_unique<counting_disk_job>(&count));
+        add_http_job(
+            system, std::make_unique<connection_checking_job>(&count));
+    }
+    wait_for_count(count, 30);
+    REQUIRE(count == 30);
+
+    REQUIRE(get_permanent_failures(system).empty());
+}
+
+TEST_CASE("background execution system job clearing", "[background]")
+{
+    background_execution_system_config config;
+    config.calculation_thread_count = 1;
+    config.http_pool.min_thread_count = 1;
+    config.disk_thread_count = 1;
+    background_execution_system system(the_http_request_system, config);
+
+    // This job occupies the calculation pool's only thread until it's
+    // canceled.
+    struct blocking_job : background_job_interface
+    {
+        void
+        execute(
+            check_in_interface& check_in,
+            progress_reporter_interface& reporter) override
+        {
+            while (1)
+            {
+                check_in();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    };
+    auto blocker
+        = add_calculation_job(system, std::make_unique<blocking_job>());
+    while (blocker.state() != background_job_state::RUNNING)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    std::atomic<int> count(0);
+    std::vector<background_job_controller> controllers;
+    for (int i = 0; i != 4; ++i)
+    {
+        controllers.push_back(add_calculation_job(
+            system, std::make_unique<counting_job>(&count)));
+    }
+    auto pool_status = [&] {
+        return get_status(system)
+            .pools[size_t(background_job_queue_type::CALCULATION)];
+    };
+    REQUIRE(pool_status().queued_job_count == 4);
+
+    // Canceled jobs are cleared out of the queue.
+    controllers[0].cancel();
+    controllers[1].cancel();
+    clear_canceled_jobs(system);
+    REQUIRE(pool_status().queued_job_count == 2);
+
+    // Clearing all jobs also cancels the running one.
+    clear_all_jobs(system);
+    REQUIRE(pool_status().queued_job_count == 0);
+    int n = 0;
+    while (n < 100 && blocker.state() != background_job_state::CANCELED)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ++n;
+    }
+    REQUIRE(blocker.state() == background_job_state::CANCELED);
+    REQUIRE(count == 0);
+}
+
+TEST_CASE("background execution system telemetry", "[background]")
+{
+    background_execution_system_config config;
+    config.calculation_thread_count = 1;
+    config.http_pool.min_thread_count = 1;
+    config.disk_thread_count = 1;
+    background_execution_system system(the_http_request_system, config);
+
+    struct blocking_job : background_job_interface
+    {
+        void
+        execute(
+            check_in_interface& check_in,
+            progress_reporter_interface& reporter) override
+        {
+            while (1)
+            {
+                check_in();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    };
+    struct failing_job : background_job_interface
+    {
+        void
+        execute(
+            check_in_interface& check_in,
+            progress_reporter_interface& reporter) override
+        {
+            throw std::runtime_error("no luck");
+        }
+    };
+    struct out_of_memory_job : background_job_interface
+    {
+        void
+        execute(
+            check_in_interface& check_in,
+            progress_reporter_interface& reporter) override
+        {
+            throw std::bad_alloc();
+        }
+    };
+
+    auto pool_status = [&] {
+        return get_status(system)
+            .pools[size_t(background_job_queue_type::CALCULATION)];
+    };
+    auto wait_for_state = [](background_job_controller const& job,
+                             background_job_state state) {
+        int n = 0;
+        while (n < 500 && job.state() != state)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            ++n;
+        }
+        return job.state() == state;
+    };
+
+    std::atomic<int> count(0);
+    auto counted
+        = add_calculation_job(system, std::make_unique<counting_job>(&count));
+    auto failed
+        = add_calculation_job(system, std::make_unique<failing_job>());
+    auto out_of_memory
+        = add_calculation_job(system, std::make_unique<out_of_memory_job>());
+    REQUIRE(wait_for_state(counted, background_job_state::COMPLETED));
+    REQUIRE(wait_for_state(failed, background_job_state::FAILED));
+    REQUIRE(wait_for_state(out_of_memory, background_job_state::FAILED));
+
+    // The job's timeline is recorded.
+    auto const& job = *counted.job_;
+    REQUIRE(job.enqueue_time <= job.start_time);
+    REQUIRE(job.start_time <= job.finish_time);
+
+    // Running jobs are reported along with how long they've been running.
+    auto blocker
+        = add_calculation_job(system, std::make_unique<blocking_job>());
+    REQUIRE(wait_for_state(blocker, background_job_state::RUNNING));
+    auto canceled
+        = add_calculation_job(system, std::make_unique<counting_job>(&count));
+    canceled.cancel();
+    auto status = pool_status();
+    REQUIRE(status.running_jobs.size() == 1);
+    REQUIRE(status.running_jobs.front().job == blocker.job_.get());
+
+    // Transient failures show up in the status, and permanent ones are
+    // reported separately.
+    REQUIRE(status.transient_failures.size() == 1);
+    REQUIRE(status.transient_failures.front().job == out_of_memory.job_.get());
+    auto failures = get_permanent_failures(system);
+    REQUIRE(failures.size() == 1);
+    REQUIRE(failures.front().job == failed.job_.get());
+    REQUIRE(failures.front().message == "no luck");
+    REQUIRE(get_permanent_failures(system).empty());
+
+    auto const& telemetry = status.telemetry;
+    REQUIRE(telemetry.completed_count == 1);
+    REQUIRE(telemetry.failed_count == 2);
+    REQUIRE(telemetry.transient_failure_count == 1);
+    REQUIRE(telemetry.canceled_count == 1);
+    // Everything but the canceled job made it out of the queue, but the
+    // blocker is still running.
+    REQUIRE(telemetry.queue_wait.total_count == 4);
+    REQUIRE(telemetry.run_time.total_count == 3);
+
+    blocker.cancel();
+    REQUIRE(wait_for_state(blocker, background_job_state::CANCELED));
+    REQUIRE(pool_status().telemetry.canceled_count == 2);
+}
@@ -0,0 +1,73 @@
+#include <cradle/background/telemetry.h>
+
+#include <thread>
+#include <vector>
+
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+
+using std::chrono::microseconds;
+
+TEST_CASE("latency buckets", "[background][telemetry]")
+{
+    REQUIRE(get_latency_bucket(microseconds(0)) == 0);
+    REQUIRE(get_latency_bucket(microseconds(1)) == 1);
+    REQUIRE(get_latency_bucket(microseconds(2)) == 2);
+    REQUIRE(get_latency_bucket(microseconds(3)) == 2);
+    REQUIRE(get_latency_bucket(microseconds(4)) == 3);
+    REQUIRE(get_latency_bucket(microseconds(1000)) == 10);
+    REQUIRE(
+        get_latency_bucket(microseconds(int64_t(1) << 40))
+        == latency_histogram::bucket_count - 1);
+}
+
+TEST_CASE("latency histograms", "[background][telemetry]")
+{
+    latency_histogram histogram;
+    REQUIRE(get_mean_latency(histogram) == microseconds(0));
+    REQUIRE(get_latency_percentile(histogram, 0.5) == microseconds(0));
+
+    // 90 fast durations and 10 slow ones
+    for (int i = 0; i != 90; ++i)
+        record_latency(histogram, microseconds(100));
+    for (int i = 0; i != 10; ++i)
+        record_latency(histogram, microseconds(5000));
+    REQUIRE(histogram.total_count == 100);
+    REQUIRE(histogram.max_duration == microseconds(5000));
+    REQUIRE(get_mean_latency(histogram) == microseconds(590));
+    // 100 is in the [64, 128) bucket, and 5000 is in the [4096, 8192) one
+    // (but that's capped at the maximum).
+    REQUIRE(get_latency_percentile(histogram, 0.5) == microseconds(128));
+    REQUIRE(get_latency_percentile(histogram, 0.85) == microseconds(128));
+    REQUIRE(get_latency_percentile(histogram, 0.99) == microseconds(5000));
+    REQUIRE(get_latency_percentile(histogram, 1) == microseconds(5000));
+}
+
+TEST_CASE("atomic latency histograms", "[background][telemetry]")
+{
+    detail::atomic_latency_histogram histogram;
+    std::vector<std::thread> threads;
+    for (int i = 0; i != 4; ++i)
+    {
+        threads.emplace_back([&histogram, i] {
+            for (int j = 0; j != 1000; ++j)
+            {
+                detail::record_latency(
+                    histogram, microseconds(i * 1000 + j));
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    auto snapshot = detail::read_latency_histogram(histogram);
+    REQUIRE(snapshot.total_count == 4000);
+    REQUIRE(snapshot.max_duration == microseconds(3999));
+    // the sum of 0 through 3999
+    REQUIRE(snapshot.total_duration == microseconds(3999 * 4000 / 2));
+    uint64_t bucket_total = 0;
+    for (auto count : snapshot.counts)
+        bucket_total += count;
+    REQUIRE(bucket_total == 4000);
+}
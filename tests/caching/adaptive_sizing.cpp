@@ -0,0 +1,180 @@
+#include <cradle/caching/immutable/adaptive_sizing.h>
+
+#include <cradle/caching/immutable.h>
+#include <cradle/core/immutable.h>
+#include <cradle/fs/file_io.h>
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+
+static void
+reset_directory(file_path const& dir)
+{
+    if (exists(dir))
+        remove_all(dir);
+    create_directory(dir);
+}
+
+static void
+write_fake_cgroup(
+    file_path const& dir, string const& max, string const& current)
+{
+    dump_string_to_file(dir / "memory.max", max + "\n");
+    dump_string_to_file(dir / "memory.current", current + "\n");
+}
+
+TEST_CASE("cgroup memory status", "[immutable_cache][adaptive_sizing]")
+{
+    file_path dir = "fake_cgroup";
+    reset_directory(dir);
+
+    // Missing files
+    REQUIRE(!read_cgroup_memory_status(dir));
+
+    // Limited
+    write_fake_cgroup(dir, "1073741824", "268435456");
+    auto status = read_cgroup_memory_status(dir);
+    REQUIRE(status);
+    REQUIRE(status->limit == 1073741824);
+    REQUIRE(status->usage == 268435456);
+
+    // Reclaimable page cache doesn't count as usage.
+    dump_string_to_file(
+        dir / "memory.stat",
+        "anon 134217728\n"
+        "file 201326592\n"
+        "active_file 67108864\n"
+        "inactive_file 134217728\n");
+    status = read_cgroup_memory_status(dir);
+    REQUIRE(status);
+    REQUIRE(status->usage == 134217728);
+    REQUIRE(status->pressure == 0);
+
+    // Pressure
+    dump_string_to_file(
+        dir / "memory.pressure",
+        "some avg10=12.50 avg60=3.10 avg300=0.80 total=123456\n"
+        "full avg10=4.00 avg60=1.00 avg300=0.20 total=23456\n");
+    status = read_cgroup_memory_status(dir);
+    REQUIRE(status);
+    REQUIRE(status->pressure == 12.5);
+
+    // Unlimited
+    write_fake_cgroup(dir, "max", "268435456");
+    REQUIRE(!read_cgroup_memory_status(dir));
+}
+
+TEST_CASE("memory pressure", "[immutable_cache][adaptive_sizing]")
+{
+    file_path path = "fake_pressure";
+    dump_string_to_file(
+        path,
+        "some avg10=0.25 avg60=0.00 avg300=0.00 total=42\n"
+        "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n");
+    REQUIRE(read_memory_pressure(path) == some(0.25));
+
+    dump_string_to_file(path, "garbage\n");
+    REQUIRE(!read_memory_pressure(path));
+    REQUIRE(!read_memory_pressure("nonexistent_pressure"));
+}
+
+TEST_CASE("meminfo memory status", "[immutable_cache][adaptive_sizing]")
+{
+    file_path path = "fake_meminfo";
+    dump_string_to_file(
+        path,
+        "MemTotal:        1048576 kB\n"
+        "MemFree:          131072 kB\n"
+        "MemAvailable:     262144 kB\n"
+        "Buffers:           65536 kB\n");
+    auto status = read_meminfo_memory_status(path);
+    REQUIRE(status);
+    REQUIRE(status->limit == 1073741824);
+    REQUIRE(status->usage == 805306368);
+
+    dump_string_to_file(path, "garbage\n");
+    REQUIRE(!read_meminfo_memory_status(path));
+}
+
+TEST_CASE(
+    "adaptive cache limit computation", "[immutable_cache][adaptive_sizing]")
+{
+    adaptive_cache_sizing_config config;
+    config.target_fraction = 0.5;
+    config.min_size = 1000;
+    config.max_size = 1'000'000;
+
+    // Half of the unused entries plus free memory
+    REQUIRE(
+        compute_adaptive_cache_limit(
+            config, memory_status{100'000, 60'000}, 20'000)
+        == 30'000);
+    // Over the limit, only the unused entries count.
+    REQUIRE(
+        compute_adaptive_cache_limit(
+            config, memory_status{100'000, 120'000}, 20'000)
+        == 10'000);
+    // Clamping
+    REQUIRE(
+        compute_adaptive_cache_limit(
+            config, memory_status{100'000, 100'000}, 0)
+        == 1000);
+    REQUIRE(
+        compute_adaptive_cache_limit(
+            config, memory_status{100'000'000, 0}, 0)
+        == 1'000'000);
+    // Under memory pressure, free memory doesn't count.
+    config.pressure_threshold = 10;
+    REQUIRE(
+        compute_adaptive_cache_limit(
+            config, memory_status{100'000, 60'000, 9.5}, 20'000)
+        == 30'000);
+    REQUIRE(
+        compute_adaptive_cache_limit(
+            config, memory_status{100'000, 60'000, 25}, 20'000)
+        == 10'000);
+}
+
+TEST_CASE("adaptive cache sizer", "[immutable_cache][adaptive_sizing]")
+{
+    file_path dir = "fake_cgroup";
+    reset_directory(dir);
+
+    immutable_cache cache(immutable_cache_config(0x1'00'00'00, none));
+
+    // Fill the cache with 64 1kB strings that are no longer in use.
+    for (int i = 0; i != 64; ++i)
+    {
+        immutable_cache_ptr<std::string> p(
+            cache, make_id(i), [&] { return background_job_controller(); });
+        set_immutable_cache_data(
+            cache, make_id(i), make_immutable(string(1024, 'a')));
+    }
+    auto full_size = get_unused_size(cache);
+    REQUIRE(full_size == 64 * deep_sizeof(string(1024, 'a')));
+
+    adaptive_cache_sizing_config config;
+    config.cgroup_dir = dir;
+    config.meminfo_path = "nonexistent_meminfo";
+    config.pressure_path = "nonexistent_pressure";
+    config.target_fraction = 0.5;
+    config.min_size = 0;
+    // Make sure the background thread stays out of the way.
+    config.poll_interval = std::chrono::hours(1);
+
+    // With no information available, the sizer leaves the cache alone.
+    adaptive_cache_sizer sizer(cache, config);
+    REQUIRE(get_unused_size(cache) == full_size);
+
+    // With plenty of free memory, nothing is evicted.
+    write_fake_cgroup(dir, "1073741824", "268435456");
+    sizer.update();
+    REQUIRE(get_unused_size(cache) == full_size);
+
+    // Once the cgroup is at its limit, the cache should shrink to half of its
+    // unused entries.
+    write_fake_cgroup(dir, "1073741824", "1073741824");
+    sizer.update();
+    REQUIRE(get_unused_size(cache) <= full_size / 2);
+    REQUIRE(get_unused_size(cache) > 0);
+}
@@ -1,6 +1,8 @@
 #include <cradle/caching/immutable.h>
 
+#include <atomic>
 #include <sstream>
+#include <thread>
 
 #include <cradle/core/immutable.h>
 #include <cradle/utilities/testing.h>
@@ -26,6 +28,24 @@ sort_cache_snapshot(immutable_cache_snapshot snapshot)
     return snapshot;
 }
 
+// Use the entry :id in :cache, creating it (as a 1kB string) if it's not
+// already there. Returns whether it had to be created.
+bool
+use_entry(immutable_cache& cache, int id)
+{
+    bool needed_creation = false;
+    immutable_cache_ptr<std::string> p(cache, make_id(id), [&] {
+        needed_creation = true;
+        return background_job_controller();
+    });
+    if (needed_creation)
+    {
+        set_immutable_cache_data(
+            cache, make_id(id), make_immutable(string(1024, 'a')));
+    }
+    return needed_creation;
+}
+
 } // namespace
 
 TEST_CASE("basic immutable cache usage", "[immutable_cache]")
@@ -34,11 +54,11 @@ TEST_CASE("basic immutable cache usage", "[immutable_cache]")
     {
         INFO("Cache reset() and is_initialized() work as expected.");
         REQUIRE(!cache.is_initialized());
-        cache.reset(immutable_cache_config(1024));
+        cache.reset(immutable_cache_config(1024, none));
         REQUIRE(cache.is_initialized());
         cache.reset();
         REQUIRE(!cache.is_initialized());
-        cache.reset(immutable_cache_config(1024));
+        cache.reset(immutable_cache_config(1024, none));
         REQUIRE(cache.is_initialized());
     }
 
@@ -279,7 +299,7 @@ TEST_CASE("basic immutable cache usage", "[immutable_cache]")
 
 TEST_CASE("immutable cache entry watching", "[immutable_cache]")
 {
-    immutable_cache cache(immutable_cache_config(1024));
+    immutable_cache cache(immutable_cache_config(1024, none));
 
     struct test_watcher : immutable_cache_entry_watcher
     {
@@ -357,7 +377,7 @@ TEST_CASE("immutable cache entry watching", "[immutable_cache]")
 TEST_CASE("immutable cache LRU eviction", "[immutable_cache]")
 {
     // Initialize the cache with 1.5kB of space for unused data.
-    immutable_cache cache(immutable_cache_config(1536));
+    immutable_cache cache(immutable_cache_config(1536, none));
 
     // Declare an interest in ID(1).
     bool p_needed_creation = false;
@@ -404,3 +424,144 @@ TEST_CASE("immutable cache LRU eviction", "[immutable_cache]")
     REQUIRE(!s_needed_creation);
     REQUIRE(s.is_ready());
 }
+
+TEST_CASE("immutable cache LRU eviction across stripes", "[immutable_cache]")
+{
+    // Initialize the cache with 4.5kB of space for unused data.
+    immutable_cache cache(immutable_cache_config(4608, none));
+
+    // Add (and release) enough 1kB strings that they must be spread across
+    // many stripes.
+    for (int i = 0; i != 64; ++i)
+    {
+        immutable_cache_ptr<std::string> p(
+            cache, make_id(i), [&] { return background_job_controller(); });
+        set_immutable_cache_data(
+            cache, make_id(i), make_immutable(string(1024, 'a')));
+    }
+
+    // Only the four most recently used strings should remain.
+    auto snapshot = sort_cache_snapshot(get_cache_snapshot(cache));
+    REQUIRE(snapshot.in_use.empty());
+    REQUIRE(snapshot.pending_eviction.size() == 4);
+    REQUIRE(snapshot.pending_eviction[0].key == "60");
+    REQUIRE(snapshot.pending_eviction[3].key == "63");
+}
+
+TEST_CASE("concurrent immutable cache usage", "[immutable_cache]")
+{
+    // Leave room for roughly 100 unused entries.
+    immutable_cache cache(
+        immutable_cache_config(100 * deep_sizeof(0), none));
+
+    // (Catch assertions aren't thread-safe, so the threads just count
+    // failures.)
+    std::atomic<int> failure_count = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t != 8; ++t)
+    {
+        threads.emplace_back([&cache, &failure_count, t] {
+            for (int i = 0; i != 1000; ++i)
+            {
+                auto key = (i * 7 + t) % 500;
+                immutable_cache_ptr<int> p(cache, make_id(key), [&] {
+                    return background_job_controller();
+                });
+                set_immutable_cache_data(
+                    cache, make_id(key), make_immutable(key));
+                p.update();
+                if (!p.is_ready() || *p != key)
+                    ++failure_count;
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    REQUIRE(failure_count == 0);
+
+    auto snapshot = get_cache_snapshot(cache);
+    REQUIRE(snapshot.in_use.empty());
+    size_t total_size = 0;
+    for (auto const& entry : snapshot.pending_eviction)
+        total_size += entry.size;
+    REQUIRE(total_size <= 100 * deep_sizeof(0));
+
+    clear_unused_entries(cache);
+    snapshot = get_cache_snapshot(cache);
+    REQUIRE(snapshot.in_use.empty());
+    REQUIRE(snapshot.pending_eviction.empty());
+}
+
+TEST_CASE("immutable cache data set after release", "[immutable_cache]")
+{
+    // Initialize the cache with room for one of the values below.
+    immutable_cache cache(immutable_cache_config(3072, none));
+
+    // Release interest in an entry before its data arrives.
+    auto value = string(2048, 'a');
+    auto set_after_release = [&](int id) {
+        {
+            immutable_cache_ptr<std::string> p(cache, make_id(id), [&] {
+                return background_job_controller();
+            });
+        }
+        set_immutable_cache_data(cache, make_id(id), make_immutable(value));
+    };
+    set_after_release(0);
+
+    // The entry's size should be reflected in the snapshot...
+    auto snapshot = get_cache_snapshot(cache);
+    REQUIRE(snapshot.pending_eviction.size() == 1);
+    REQUIRE(snapshot.pending_eviction[0].size == deep_sizeof(value));
+
+    // and in the eviction accounting, so when a second one arrives the same
+    // way, the two don't fit, and the older one is evicted right away.
+    set_after_release(1);
+    snapshot = get_cache_snapshot(cache);
+    REQUIRE(snapshot.pending_eviction.size() == 1);
+    REQUIRE(snapshot.pending_eviction[0].key == "1");
+}
+
+TEST_CASE("immutable cache TWO_QUEUE eviction", "[immutable_cache]")
+{
+    // Initialize the cache with room for four 1kB strings.
+    immutable_cache cache(immutable_cache_config(
+        4608, immutable_cache_eviction_policy::TWO_QUEUE));
+
+    // Establish a working set of two entries by using them repeatedly.
+    for (int i = 0; i != 3; ++i)
+    {
+        use_entry(cache, 0);
+        use_entry(cache, 1);
+    }
+
+    // Scan through a large number of entries that are only used once.
+    for (int i = 100; i != 164; ++i)
+        REQUIRE(use_entry(cache, i));
+
+    // The working set should have survived the scan.
+    REQUIRE(!use_entry(cache, 0));
+    REQUIRE(!use_entry(cache, 1));
+    // But only the most recent entries from the scan should have.
+    REQUIRE(!use_entry(cache, 163));
+    REQUIRE(use_entry(cache, 100));
+}
+
+TEST_CASE("immutable cache LRU eviction under scans", "[immutable_cache]")
+{
+    // This is the same scenario as above, but with plain LRU eviction, the
+    // scan flushes out the working set.
+    immutable_cache cache(
+        immutable_cache_config(4608, immutable_cache_eviction_policy::LRU));
+
+    for (int i = 0; i != 3; ++i)
+    {
+        use_entry(cache, 0);
+        use_entry(cache, 1);
+    }
+    for (int i = 100; i != 164; ++i)
+        REQUIRE(use_entry(cache, i));
+
+    REQUIRE(use_entry(cache, 0));
+    REQUIRE(use_entry(cache, 1));
+}
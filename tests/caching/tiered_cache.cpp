@@ -0,0 +1,147 @@
+#include <cradle/caching/tiered_cache.h>
+
+#include <filesystem>
+
+#include <cradle/core/immutable.h>
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+
+static void
+reset_directory(file_path const& dir)
+{
+    if (exists(dir))
+        remove_all(dir);
+    create_directory(dir);
+}
+
+static disk_cache_config
+make_test_disk_config(string const& cache_dir = "tiered_cache")
+{
+    disk_cache_config config;
+    config.directory = some(cache_dir);
+    config.size_limit = 0x1'00'00'00;
+    return config;
+}
+
+TEST_CASE("tiered cache memory hits", "[tiered_cache]")
+{
+    reset_directory("tiered_cache");
+    tiered_cache cache(
+        immutable_cache_config(1024, none), make_test_disk_config());
+    REQUIRE(cache.is_initialized());
+
+    int compute_count = 0;
+    auto compute = [&] {
+        ++compute_count;
+        return string("the_value");
+    };
+
+    REQUIRE(
+        *look_up_or_compute<string>(cache, make_id(string("key")), compute)
+        == "the_value");
+    REQUIRE(compute_count == 1);
+
+    // The second lookup should be served from memory...
+    REQUIRE(
+        *look_up_or_compute<string>(cache, make_id(string("key")), compute)
+        == "the_value");
+    REQUIRE(compute_count == 1);
+}
+
+TEST_CASE("tiered cache spilling and promotion", "[tiered_cache]")
+{
+    reset_directory("tiered_cache");
+
+    int compute_count = 0;
+    auto compute = [&] {
+        ++compute_count;
+        return string("the_value");
+    };
+
+    {
+        // With no room for unused entries in memory, values should spill to
+        // disk as soon as they're no longer in use.
+        tiered_cache cache(
+            immutable_cache_config(0, none), make_test_disk_config());
+        REQUIRE(
+            *look_up_or_compute<string>(
+                cache, make_id(string("key")), compute)
+            == "the_value");
+        REQUIRE(compute_count == 1);
+        REQUIRE(get_cache_snapshot(cache.memory).pending_eviction.empty());
+        REQUIRE(cache.disk.find("key"));
+
+        // A second lookup is served from disk.
+        REQUIRE(
+            *look_up_or_compute<string>(
+                cache, make_id(string("key")), compute)
+            == "the_value");
+        REQUIRE(compute_count == 1);
+    }
+
+    {
+        // A fresh cache over the same directory should find the value on
+        // disk and promote it into memory.
+        tiered_cache cache(
+            immutable_cache_config(1024, none), make_test_disk_config());
+        REQUIRE(
+            *look_up_or_compute<string>(
+                cache, make_id(string("key")), compute)
+            == "the_value");
+        REQUIRE(compute_count == 1);
+        auto snapshot = get_cache_snapshot(cache.memory);
+        REQUIRE(snapshot.pending_eviction.size() == 1);
+        REQUIRE(snapshot.pending_eviction[0].key == "key");
+        REQUIRE(
+            snapshot.pending_eviction[0].state
+            == immutable_cache_entry_state::READY);
+    }
+}
+
+TEST_CASE("tiered cache write-through", "[tiered_cache]")
+{
+    reset_directory("tiered_cache");
+
+    tiered_cache cache(
+        immutable_cache_config(1024, none), make_test_disk_config());
+    look_up_or_compute<string>(
+        cache, make_id(string("key")), [] { return string("the_value"); });
+
+    // The value should be written to disk right away, even though there's
+    // plenty of room for it in memory.
+    REQUIRE(cache.disk.find("key"));
+    REQUIRE(get_cache_snapshot(cache.memory).pending_eviction.size() == 1);
+
+    // Once the memory tier is reset, the value should come from disk.
+    cache.reset(
+        immutable_cache_config(1024, none), make_test_disk_config());
+    REQUIRE(cache.disk.find("key"));
+    REQUIRE(
+        *look_up_or_compute<string>(
+            cache,
+            make_id(string("key")),
+            [] {
+                FAIL("value should've come from disk");
+                return string();
+            })
+        == "the_value");
+}
+
+TEST_CASE("tiered cache compute failures", "[tiered_cache]")
+{
+    reset_directory("tiered_cache");
+    tiered_cache cache(
+        immutable_cache_config(1024, none), make_test_disk_config());
+
+    REQUIRE_THROWS(look_up_or_compute<string>(
+        cache, make_id(string("key")), []() -> string {
+            throw std::runtime_error("failed");
+        }));
+
+    // A subsequent lookup should try again.
+    REQUIRE(
+        *look_up_or_compute<string>(
+            cache, make_id(string("key")), [] { return string("the_value"); })
+        == "the_value");
+}
@@ -1,5 +1,6 @@
 #include <cradle/encodings/msgpack.h>
 
+#include <algorithm>
 #include <cstring>
 
 #include <cradle/encodings/json.h>
@@ -24,6 +25,13 @@ test_msgpack_encoding(
         reinterpret_cast<char const*>(msgpack) + size));
     REQUIRE(string_converted_value == expected_value);
 
+    // Also try parsing it incrementally, a few bytes at a time.
+    msgpack_stream_parser parser;
+    parser.reserve(size);
+    for (size_t offset = 0; offset < size; offset += 7)
+        parser.feed(msgpack + offset, (std::min)(size_t(7), size - offset));
+    REQUIRE(parser.finish() == expected_value);
+
     // Convert it back to MessagePack and check that that matches the original.
     auto converted_msgpack = value_to_msgpack_string(converted_value);
     REQUIRE(converted_msgpack.size() == size);
@@ -181,3 +189,22 @@ TEST_CASE("blob too large for MessagePack", "[encodings][msgpack]")
             == 0x1'00'00'00'00);
     }
 }
+
+TEST_CASE("incomplete MessagePack stream", "[encodings][msgpack]")
+{
+    auto msgpack = value_to_msgpack_string(
+        dynamic({integer(1), integer(2), string("three")}));
+    auto const* data = reinterpret_cast<uint8_t const*>(msgpack.data());
+
+    msgpack_stream_parser parser;
+    parser.feed(data, msgpack.size() - 1);
+    REQUIRE_THROWS_AS(parser.finish(), parsing_error);
+
+    parser.feed(data + msgpack.size() - 1, 1);
+    REQUIRE(
+        parser.finish()
+        == dynamic({integer(1), integer(2), string("three")}));
+
+    // Anything after the value is an error.
+    REQUIRE_THROWS_AS(parser.feed(data, 1), parsing_error);
+}
@@ -0,0 +1,202 @@
+#include <cradle/io/http_concurrency.h>
+
+#include <atomic>
+#include <thread>
+
+#include <fakeit.h>
+
+#include <cradle/core/monitoring.h>
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+using namespace fakeit;
+
+namespace {
+
+adaptive_concurrency_config
+make_test_config(unsigned initial_limit, unsigned max_limit)
+{
+    adaptive_concurrency_config config;
+    config.initial_limit = initial_limit;
+    config.min_limit = 1;
+    config.max_limit = max_limit;
+    config.backoff_ratio = 0.5;
+    // Make latency irrelevant unless a test is specifically checking it.
+    config.latency_tolerance = 1e9;
+    return config;
+}
+
+void
+perform_fake_request(
+    adaptive_concurrency_limiter& limiter, http_request_outcome outcome)
+{
+    null_check_in check_in;
+    limiter.release(limiter.acquire(check_in), outcome);
+}
+
+struct single_limiter_policy : http_concurrency_policy
+{
+    adaptive_concurrency_limiter*
+    get_limiter(http_request const& request) override
+    {
+        return limiter;
+    }
+
+    adaptive_concurrency_limiter* limiter = nullptr;
+};
+
+} // namespace
+
+TEST_CASE("HTTP status classification", "[io][http]")
+{
+    REQUIRE(classify_http_status(200) == http_request_outcome::SUCCESS);
+    REQUIRE(classify_http_status(304) == http_request_outcome::SUCCESS);
+    REQUIRE(classify_http_status(429) == http_request_outcome::OVERLOADED);
+    REQUIRE(classify_http_status(503) == http_request_outcome::OVERLOADED);
+    REQUIRE(classify_http_status(404) == http_request_outcome::IGNORED);
+    REQUIRE(classify_http_status(500) == http_request_outcome::IGNORED);
+}
+
+TEST_CASE("adaptive concurrency limits", "[io][http]")
+{
+    adaptive_concurrency_limiter limiter(make_test_config(4, 6));
+    REQUIRE(limiter.limit() == 4);
+
+    // The limit grows by roughly one for each window of successes.
+    for (int i = 0; i != 5; ++i)
+        perform_fake_request(limiter, http_request_outcome::SUCCESS);
+    REQUIRE(limiter.limit() == 5);
+
+    // It's capped at the maximum.
+    for (int i = 0; i != 100; ++i)
+        perform_fake_request(limiter, http_request_outcome::SUCCESS);
+    REQUIRE(limiter.limit() == 6);
+
+    // Ignored outcomes don't affect it.
+    perform_fake_request(limiter, http_request_outcome::IGNORED);
+    REQUIRE(limiter.limit() == 6);
+
+    // Overload cuts it.
+    perform_fake_request(limiter, http_request_outcome::OVERLOADED);
+    REQUIRE(limiter.limit() == 3);
+
+    // Requests that were already in flight when the limit was cut don't cut
+    // it again.
+    null_check_in check_in;
+    auto early = limiter.acquire(check_in);
+    auto late = limiter.acquire(check_in);
+    limiter.release(late, http_request_outcome::OVERLOADED);
+    REQUIRE(limiter.limit() == 1);
+    limiter.release(early, http_request_outcome::OVERLOADED);
+    REQUIRE(limiter.limit() == 1);
+    REQUIRE(limiter.in_flight() == 0);
+
+    // It never drops below the minimum.
+    perform_fake_request(limiter, http_request_outcome::OVERLOADED);
+    REQUIRE(limiter.limit() == 1);
+}
+
+TEST_CASE("adaptive concurrency latency detection", "[io][http]")
+{
+    auto config = make_test_config(8, 8);
+    config.latency_tolerance = 3;
+    adaptive_concurrency_limiter limiter(config);
+
+    // Establish a (fast) baseline.
+    perform_fake_request(limiter, http_request_outcome::SUCCESS);
+    REQUIRE(limiter.limit() == 8);
+
+    // Requests that aren't timed (e.g., long polls) can take as long as they
+    // like.
+    null_check_in check_in;
+    auto untimed = limiter.acquire(check_in, false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    limiter.release(untimed, http_request_outcome::SUCCESS);
+    REQUIRE(limiter.limit() == 8);
+
+    // A request that takes much longer than that is treated as a sign of
+    // congestion, even though it succeeds.
+    auto ticket = limiter.acquire(check_in);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    limiter.release(ticket, http_request_outcome::SUCCESS);
+    REQUIRE(limiter.limit() == 4);
+}
+
+TEST_CASE("adaptive concurrency in-flight cap", "[io][http]")
+{
+    adaptive_concurrency_limiter limiter(make_test_config(2, 2));
+
+    std::atomic<int> in_flight = 0;
+    std::atomic<int> max_in_flight = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i != 8; ++i)
+    {
+        threads.emplace_back([&] {
+            null_check_in check_in;
+            auto ticket = limiter.acquire(check_in);
+            int n = ++in_flight;
+            int max = max_in_flight;
+            while (n > max && !max_in_flight.compare_exchange_weak(max, n))
+                ;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            --in_flight;
+            limiter.release(ticket, http_request_outcome::SUCCESS);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    REQUIRE(max_in_flight <= 2);
+    REQUIRE(limiter.in_flight() == 0);
+}
+
+TEST_CASE("limited HTTP connection", "[io][http]")
+{
+    int status = 200;
+    Mock<http_connection_interface> mock_connection;
+    When(Method(mock_connection, perform_request))
+        .AlwaysDo([&](check_in_interface& check_in,
+                      progress_reporter_interface& reporter,
+                      http_request const& request) {
+            auto response = make_http_response(status, {}, blob());
+            if (status != 200)
+            {
+                CRADLE_THROW(
+                    bad_http_status_code()
+                    << attempted_http_request_info(request)
+                    << http_response_info(response));
+            }
+            return response;
+        });
+
+    adaptive_concurrency_limiter limiter(make_test_config(8, 8));
+    single_limiter_policy policy;
+    limited_http_connection connection(mock_connection.get(), policy);
+
+    null_check_in check_in;
+    null_progress_reporter reporter;
+    auto request = make_get_request("https://example.com/resource", {});
+
+    // Without a limiter, requests pass straight through.
+    REQUIRE(
+        connection.perform_request(check_in, reporter, request).status_code
+        == 200);
+    REQUIRE(limiter.limit() == 8);
+
+    // With one, the outcome of each request feeds back into the limit.
+    policy.limiter = &limiter;
+    REQUIRE(
+        connection.perform_request(check_in, reporter, request).status_code
+        == 200);
+    status = 503;
+    REQUIRE_THROWS_AS(
+        connection.perform_request(check_in, reporter, request),
+        bad_http_status_code);
+    REQUIRE(limiter.limit() == 4);
+    status = 404;
+    REQUIRE_THROWS_AS(
+        connection.perform_request(check_in, reporter, request),
+        bad_http_status_code);
+    REQUIRE(limiter.limit() == 4);
+    REQUIRE(limiter.in_flight() == 0);
+}
@@ -0,0 +1,259 @@
+#include <cradle/io/http_recording.hpp>
+
+#include <chrono>
+
+#include <fakeit.h>
+
+#include <cradle/core/monitoring.h>
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+using namespace fakeit;
+
+static http_request_system the_http_request_system;
+
+namespace {
+
+std::vector<http_exchange>
+make_test_exchanges()
+{
+    return {
+        http_exchange{
+            make_get_request("https://example.com/api/status", {}),
+            make_http_200_response("running")},
+        http_exchange{
+            make_get_request("https://example.com/api/status", {}),
+            make_http_200_response("done")},
+        http_exchange{
+            make_http_request(
+                http_request_method::POST,
+                "https://example.com/api/data?context=123",
+                {{"Content-Type", "text/plain"}},
+                make_string_blob("abc")),
+            make_http_200_response("def")},
+        http_exchange{
+            make_get_request("https://example.com/api/missing", {}),
+            make_http_response(404, {}, make_string_blob("not found"))}};
+}
+
+string
+get_body_string(blob const& body)
+{
+    return string(reinterpret_cast<char const*>(body.data), body.size);
+}
+
+} // namespace
+
+TEST_CASE("HTTP recording", "[io][http]")
+{
+    Mock<http_connection_interface> mock_connection;
+
+    When(Method(mock_connection, perform_request))
+        .AlwaysDo([&](check_in_interface& check_in,
+                      progress_reporter_interface& reporter,
+                      http_request const& request) {
+            if (request.url == "https://example.com/api/missing")
+            {
+                CRADLE_THROW(
+                    bad_http_status_code()
+                    << attempted_http_request_info(request)
+                    << http_response_info(make_http_response(
+                           404, {}, make_string_blob("not found"))));
+            }
+            return make_http_200_response("ok");
+        });
+
+    string recording_file = "http_recording_test.msgpack";
+    {
+        http_recorder recorder(recording_file);
+        recording_http_connection connection(mock_connection.get(), recorder);
+        null_check_in check_in;
+        null_progress_reporter reporter;
+
+        auto response = connection.perform_request(
+            check_in,
+            reporter,
+            make_get_request(
+                "https://example.com/api/status",
+                {{"Authorization", "Bearer xyz"}}));
+        REQUIRE(response == make_http_200_response("ok"));
+
+        REQUIRE_THROWS_AS(
+            connection.perform_request(
+                check_in,
+                reporter,
+                make_get_request("https://example.com/api/missing", {})),
+            bad_http_status_code);
+    }
+
+    auto exchanges = read_http_recording(recording_file);
+    REQUIRE(exchanges.size() == 2);
+    // Credentials shouldn't end up in recordings.
+    REQUIRE(
+        exchanges[0].request
+        == make_get_request(
+            "https://example.com/api/status",
+            {{"Authorization", "[redacted]"}}));
+    REQUIRE(exchanges[0].response == make_http_200_response("ok"));
+    REQUIRE(
+        exchanges[1].request
+        == make_get_request("https://example.com/api/missing", {}));
+    REQUIRE(exchanges[1].response.status_code == 404);
+}
+
+TEST_CASE("HTTP replay", "[io][http]")
+{
+    http_replayer replayer(make_test_exchanges());
+    replaying_http_connection connection(replayer);
+    null_check_in check_in;
+    null_progress_reporter reporter;
+
+    // Requests are matched regardless of host and headers, and repeated
+    // requests get the recorded responses in order (with the last one
+    // repeating).
+    auto status_request = make_get_request(
+        "http://localhost:8000/api/status", {{"Authorization", "Bearer xyz"}});
+    REQUIRE(
+        get_body_string(
+            connection.perform_request(check_in, reporter, status_request)
+                .body)
+        == "running");
+    REQUIRE(
+        get_body_string(
+            connection.perform_request(check_in, reporter, status_request)
+                .body)
+        == "done");
+    REQUIRE(
+        get_body_string(
+            connection.perform_request(check_in, reporter, status_request)
+                .body)
+        == "done");
+
+    // Bodies must match.
+    auto data_request = make_http_request(
+        http_request_method::POST,
+        "http://localhost:8000/api/data?context=123",
+        {},
+        make_string_blob("abc"));
+    REQUIRE(
+        get_body_string(
+            connection.perform_request(check_in, reporter, data_request).body)
+        == "def");
+    data_request.body = make_string_blob("abd");
+    REQUIRE_THROWS_AS(
+        connection.perform_request(check_in, reporter, data_request),
+        http_request_failure);
+
+    // Bad status codes are reported like they are for real connections.
+    try
+    {
+        connection.perform_request(
+            check_in,
+            reporter,
+            make_get_request("http://localhost:8000/api/missing", {}));
+        FAIL("no exception thrown");
+    }
+    catch (bad_http_status_code& e)
+    {
+        REQUIRE(
+            get_required_error_info<http_response_info>(e).status_code == 404);
+    }
+}
+
+TEST_CASE("HTTP replay latency and bandwidth", "[io][http]")
+{
+    string body(5000, 'x');
+    http_replayer replayer({http_exchange{
+        make_get_request("https://example.com/big", {}),
+        make_http_200_response(body)}});
+    http_replay_options options;
+    options.latency = std::chrono::milliseconds(20);
+    // At 100 kB/s, the body should take about 40 ms to deliver (in 1 kB
+    // pieces).
+    options.bandwidth = 100000;
+    replaying_http_connection connection(replayer, options);
+    null_check_in check_in;
+    null_progress_reporter reporter;
+
+    struct counting_sink : http_response_sink
+    {
+        void
+        on_data(uint8_t const* data, size_t size) override
+        {
+            ++pieces;
+            received.append(reinterpret_cast<char const*>(data), size);
+        }
+
+        int pieces = 0;
+        string received;
+    };
+    counting_sink sink;
+
+    auto start = std::chrono::steady_clock::now();
+    connection.perform_streaming_request(
+        check_in,
+        reporter,
+        make_get_request("https://example.com/big", {}),
+        sink);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    REQUIRE(sink.received == body);
+    REQUIRE(sink.pieces == 5);
+    REQUIRE(elapsed >= std::chrono::milliseconds(60));
+}
+
+TEST_CASE("HTTP replay server", "[io][http]")
+{
+    http_replayer replayer(make_test_exchanges());
+    http_replay_server server(replayer);
+
+    http_connection connection(the_http_request_system);
+    null_check_in check_in;
+    null_progress_reporter reporter;
+
+    auto status_request
+        = make_get_request(server.url() + "/api/status", {});
+    REQUIRE(
+        get_body_string(
+            connection.perform_request(check_in, reporter, status_request)
+                .body)
+        == "running");
+    REQUIRE(
+        get_body_string(
+            connection.perform_request(check_in, reporter, status_request)
+                .body)
+        == "done");
+
+    auto data_response = connection.perform_request(
+        check_in,
+        reporter,
+        make_http_request(
+            http_request_method::POST,
+            server.url() + "/api/data?context=123",
+            {{"Content-Type", "text/plain"}},
+            make_string_blob("abc")));
+    REQUIRE(get_body_string(data_response.body) == "def");
+
+    try
+    {
+        connection.perform_request(
+            check_in,
+            reporter,
+            make_get_request(server.url() + "/api/missing", {}));
+        FAIL("no exception thrown");
+    }
+    catch (bad_http_status_code& e)
+    {
+        auto const& response = get_required_error_info<http_response_info>(e);
+        REQUIRE(response.status_code == 404);
+        REQUIRE(get_body_string(response.body) == "not found");
+    }
+
+    // Requests that weren't recorded get a 404 from the server.
+    REQUIRE_THROWS_AS(
+        connection.perform_request(
+            check_in,
+            reporter,
+            make_get_request(server.url() + "/api/unknown", {})),
+        bad_http_status_code);
+}
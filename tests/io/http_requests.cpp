@@ -1,5 +1,8 @@
 #include <cradle/io/http_requests.hpp>
 
+#include <atomic>
+#include <thread>
+
 #include <boost/algorithm/string.hpp>
 
 #include <spdlog/sinks/stdout_color_sinks.h>
@@ -258,3 +261,151 @@ TEST_CASE("interrupted request", "[io][http]")
     {
     }
 }
+
+TEST_CASE("concurrent requests on a request loop", "[io][http]")
+{
+    http_request_loop loop(the_http_request_system);
+
+    std::vector<std::future<http_response>> responses;
+    for (int i = 0; i != 16; ++i)
+    {
+        responses.push_back(start_http_request(
+            loop,
+            make_get_request(
+                "http://postman-echo.com/get?index=" + std::to_string(i),
+                http_header_list())));
+    }
+    for (int i = 0; i != 16; ++i)
+    {
+        auto response = responses[i].get();
+        REQUIRE(response.status_code == 200);
+        auto body = parse_json_response(response);
+        REQUIRE(
+            get_field(cast<dynamic_map>(body), "args")
+            == dynamic({{"index", std::to_string(i)}}));
+    }
+
+    REQUIRE_THROWS_AS(
+        start_http_request(
+            loop,
+            make_get_request(
+                "http://postman-echo.com/status/404", http_header_list()))
+            .get(),
+        bad_http_status_code);
+}
+
+TEST_CASE("multiplexed HTTP connection", "[io][http]")
+{
+    http_request_loop loop(the_http_request_system);
+    multiplexed_http_connection connection(loop);
+
+    // The connection can be shared across threads.
+    std::atomic<int> success_count(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i != 4; ++i)
+    {
+        threads.emplace_back([&] {
+            null_check_in check_in;
+            null_progress_reporter reporter;
+            auto response = connection.perform_request(
+                check_in,
+                reporter,
+                make_get_request(
+                    "http://postman-echo.com/get?color=navy",
+                    http_header_list()));
+            if (response.status_code == 200)
+                ++success_count;
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    REQUIRE(success_count == 4);
+
+    // Check-ins still work.
+    struct canceled
+    {
+    };
+    struct canceling_check_in : check_in_interface
+    {
+        void
+        operator()()
+        {
+            throw canceled();
+        }
+    };
+    canceling_check_in check_in;
+    null_progress_reporter reporter;
+    REQUIRE_THROWS_AS(
+        connection.perform_request(
+            check_in,
+            reporter,
+            make_get_request(
+                "http://postman-echo.com/delay/10", http_header_list())),
+        canceled);
+}
+
+TEST_CASE("concurrent HTTPS requests on separate connections", "[io][http]")
+{
+    // Each thread has its own connection, but they all share the system's
+    // DNS and TLS session caches.
+    std::atomic<int> success_count(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i != 4; ++i)
+    {
+        threads.emplace_back([&] {
+            for (int j = 0; j != 2; ++j)
+            {
+                auto response = perform_simple_request(make_get_request(
+                    "https://postman-echo.com/get?color=navy",
+                    http_header_list()));
+                if (response.status_code == 200)
+                    ++success_count;
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    REQUIRE(success_count == 8);
+}
+
+TEST_CASE("HTTP connection reuse", "[io][http]")
+{
+    auto const request = make_get_request(
+        "https://postman-echo.com/get?color=navy", http_header_list());
+    null_check_in check_in;
+    null_progress_reporter reporter;
+
+    // Consecutive requests over a single connection only open one.
+    auto before = the_http_request_system.transfer_counts();
+    {
+        http_connection connection(the_http_request_system);
+        for (int i = 0; i != 3; ++i)
+        {
+            REQUIRE(
+                connection.perform_request(check_in, reporter, request)
+                    .status_code
+                == 200);
+        }
+    }
+    auto after = the_http_request_system.transfer_counts();
+    REQUIRE(after.transfer_count - before.transfer_count == 3);
+    REQUIRE(after.new_connection_count - before.new_connection_count == 1);
+
+    // The same goes for a request loop, even though its requests don't
+    // necessarily use the same CURL handle.
+    before = after;
+    {
+        http_request_loop loop(the_http_request_system);
+        multiplexed_http_connection connection(loop);
+        for (int i = 0; i != 3; ++i)
+        {
+            REQUIRE(
+                connection.perform_request(check_in, reporter, request)
+                    .status_code
+                == 200);
+        }
+    }
+    after = the_http_request_system.transfer_counts();
+    REQUIRE(after.transfer_count - before.transfer_count == 3);
+    REQUIRE(after.new_connection_count - before.new_connection_count == 1);
+}
@@ -0,0 +1,93 @@
+#include <cradle/io/http_response_sinks.h>
+
+#include <algorithm>
+
+#include <boost/crc.hpp>
+
+#include <cradle/fs/file_io.h>
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+
+namespace {
+
+// Feed :body to :sink the way that a connection would, in pieces of
+// :piece_size bytes.
+void
+stream_body(http_response_sink& sink, string const& body, size_t piece_size)
+{
+    auto const* data = reinterpret_cast<uint8_t const*>(body.data());
+    sink.on_start(body.size());
+    for (size_t offset = 0; offset < body.size(); offset += piece_size)
+    {
+        sink.on_data(
+            data + offset, (std::min)(piece_size, body.size() - offset));
+    }
+    sink.on_finish();
+}
+
+void
+init_disk_cache(disk_cache& cache)
+{
+    string cache_dir = "http_sink_disk_cache";
+    if (exists(file_path(cache_dir)))
+        remove_all(file_path(cache_dir));
+    create_directory(file_path(cache_dir));
+
+    disk_cache_config config;
+    config.directory = some(cache_dir);
+    config.size_limit = 0x10000;
+    cache.reset(config);
+}
+
+} // namespace
+
+TEST_CASE("MessagePack response sink", "[io][http]")
+{
+    auto value = dynamic({{"numbers", dynamic({integer(1), integer(2)})}});
+    msgpack_response_sink sink;
+    stream_body(sink, value_to_msgpack_string(value), 3);
+    REQUIRE(sink.value() == value);
+}
+
+TEST_CASE("teeing responses into the disk cache", "[io][http]")
+{
+    disk_cache cache;
+    init_disk_cache(cache);
+
+    auto value = dynamic({string("lorem"), string("ipsum"), integer(42)});
+    auto msgpack = value_to_msgpack_string(value);
+
+    msgpack_response_sink parser;
+    disk_cache_response_sink writer(cache, "the-key");
+    tee_response_sink tee(parser, writer);
+    stream_body(tee, msgpack, 5);
+
+    // The value was parsed...
+    REQUIRE(parser.value() == value);
+
+    // ... and also written to the cache.
+    REQUIRE(writer.is_written());
+    auto entry = cache.find("the-key");
+    REQUIRE(entry);
+    REQUIRE(read_file_contents(cache.get_path_for_id(entry->id)) == msgpack);
+    boost::crc_32_type crc;
+    crc.process_bytes(msgpack.data(), msgpack.size());
+    REQUIRE(entry->crc32 == crc.checksum());
+}
+
+TEST_CASE("abandoned disk cache response", "[io][http]")
+{
+    disk_cache cache;
+    init_disk_cache(cache);
+
+    // If the response never finishes, the entry isn't valid.
+    {
+        disk_cache_response_sink writer(cache, "the-key");
+        writer.on_start(none);
+        uint8_t const data[] = {1, 2, 3};
+        writer.on_data(data, 3);
+        REQUIRE(!writer.is_written());
+    }
+    REQUIRE(!cache.find("the-key"));
+}
@@ -0,0 +1,127 @@
+#include <cradle/io/http_revalidation.hpp>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <fakeit.h>
+
+#include <cradle/core/monitoring.h>
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+using namespace fakeit;
+
+TEST_CASE("HTTP validators", "[io][http]")
+{
+    // Header names are case-insensitive.
+    auto response = make_http_response(
+        200,
+        {{"etag", "\"abc\""},
+         {"Last-Modified", "Wed, 21 Oct 2015 07:28:00 GMT"}},
+        blob());
+    auto validators = get_http_validators(response);
+    REQUIRE(validators.etag == some(string("\"abc\"")));
+    REQUIRE(
+        validators.last_modified
+        == some(string("Wed, 21 Oct 2015 07:28:00 GMT")));
+    REQUIRE(has_validators(validators));
+    REQUIRE(!has_validators(
+        get_http_validators(make_http_200_response("no validators"))));
+
+    auto request = make_get_request("https://example.com/resource", {});
+    REQUIRE(!is_conditional_request(request));
+    REQUIRE(!is_successful_http_status(request, 304));
+
+    auto conditional_request = make_conditional_request(request, validators);
+    REQUIRE(
+        conditional_request
+        == make_get_request(
+            "https://example.com/resource",
+            {{"If-None-Match", "\"abc\""},
+             {"If-Modified-Since", "Wed, 21 Oct 2015 07:28:00 GMT"}}));
+    REQUIRE(is_conditional_request(conditional_request));
+    REQUIRE(is_successful_http_status(conditional_request, 304));
+    REQUIRE(is_successful_http_status(conditional_request, 200));
+    REQUIRE(!is_successful_http_status(conditional_request, 404));
+}
+
+TEST_CASE("HTTP resource revalidation", "[io][http]")
+{
+    auto request = make_get_request("https://example.com/resource", {});
+
+    // The server's copy of the resource
+    string current_etag = "\"v1\"";
+    string current_body = "1";
+
+    Mock<http_connection_interface> mock_connection;
+    When(Method(mock_connection, perform_request))
+        .AlwaysDo([&](check_in_interface& check_in,
+                      progress_reporter_interface& reporter,
+                      http_request const& r) {
+            auto if_none_match = find_http_header(r.headers, "If-None-Match");
+            if (if_none_match && *if_none_match == current_etag)
+                return make_http_response(304, {}, blob());
+            return make_http_response(
+                200,
+                {{"ETag", current_etag}},
+                make_string_blob(current_body));
+        });
+
+    int parse_count = 0;
+    auto parse = [&](http_response const& response) {
+        ++parse_count;
+        return dynamic(string(
+            reinterpret_cast<char const*>(response.body.data),
+            response.body.size));
+    };
+
+    http_freshness_policy always_revalidate;
+    always_revalidate.max_age = std::chrono::seconds(0);
+
+    // Initially, there's nothing cached, so the resource is retrieved.
+    auto first = revalidate_http_resource(
+        mock_connection.get(), request, none, always_revalidate, parse);
+    REQUIRE(first.value == dynamic("1"));
+    REQUIRE(first.validators.etag == some(current_etag));
+    REQUIRE(parse_count == 1);
+
+    // While the cached copy is fresh, it's used without asking the server.
+    http_freshness_policy trusting;
+    trusting.max_age = std::chrono::seconds(3600);
+    REQUIRE(
+        revalidate_http_resource(
+            mock_connection.get(), request, first, trusting, parse)
+        == first);
+    Verify(Method(mock_connection, perform_request)).Exactly(1);
+
+    // Otherwise, it's revalidated, and since the resource hasn't changed,
+    // the server just confirms that.
+    auto second = revalidate_http_resource(
+        mock_connection.get(), request, first, always_revalidate, parse);
+    REQUIRE(second.value == first.value);
+    REQUIRE(second.validators == first.validators);
+    REQUIRE(second.checked_at >= first.checked_at);
+    REQUIRE(parse_count == 1);
+    Verify(Method(mock_connection, perform_request)).Exactly(2);
+
+    // Once the resource changes, the new version is retrieved.
+    current_etag = "\"v2\"";
+    current_body = "2";
+    auto third = revalidate_http_resource(
+        mock_connection.get(), request, second, always_revalidate, parse);
+    REQUIRE(third.value == dynamic("2"));
+    REQUIRE(third.validators.etag == some(current_etag));
+    REQUIRE(parse_count == 2);
+}
+
+TEST_CASE("HTTP resource freshness", "[io][http]")
+{
+    auto now = boost::posix_time::microsec_clock::universal_time();
+    http_cached_resource cached;
+    cached.checked_at = now - boost::posix_time::seconds(30);
+
+    http_freshness_policy policy;
+    policy.max_age = std::chrono::seconds(60);
+    REQUIRE(is_fresh(cached, policy, now));
+    policy.max_age = std::chrono::seconds(10);
+    REQUIRE(!is_fresh(cached, policy, now));
+}
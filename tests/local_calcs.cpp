@@ -5,6 +5,8 @@
 #include <cradle/utilities/testing.h>
 
 #include <cradle/encodings/base64.h>
+#include <cradle/thinknode/docker.h>
+#include <cradle/thinknode/supervisor.h>
 #include <cradle/utilities/environment.h>
 #include <cradle/websocket/messages.hpp>
 
@@ -13,10 +15,15 @@ using namespace cradle;
 #ifdef LOCAL_DOCKER_TESTING
 TEST_CASE("local calcs", "[local_calcs][ws]")
 {
-    disk_cache cache(disk_cache_config(none, 0x1'00'00'00'00));
+    tiered_cache cache(
+        immutable_cache_config(0x40'00'00'00, none),
+        disk_cache_config(none, 0x1'00'00'00'00));
 
     http_request_system http_system;
     http_connection connection(http_system);
+    docker_client docker(http_system);
+    docker_provider_launcher launcher(docker);
+    provider_pool providers(launcher);
 
     thinknode_session session;
     session.api_url = "https://mgh.thinknode.io/api/v1.0";
@@ -27,6 +34,7 @@ TEST_CASE("local calcs", "[local_calcs][ws]")
         return perform_local_calc(
             cache,
             connection,
+            providers,
             session,
             "5dadeb4a004073e81b5e096255e83652",
             request);
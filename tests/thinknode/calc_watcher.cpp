@@ -0,0 +1,247 @@
+#include <cradle/thinknode/calc_watcher.h>
+
+#include <condition_variable>
+#include <mutex>
+
+#include <cradle/encodings/json.h>
+#include <cradle/io/http_recording.hpp>
+#include <cradle/io/http_requests.hpp>
+#include <cradle/thinknode/calc.h>
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+
+static http_request_system the_http_request_system;
+
+namespace {
+
+string const status_path = "/calc/abc/status";
+
+std::vector<calculation_status> const test_statuses
+    = {make_calculation_status_with_calculating(
+           calculation_calculating_status{0.115}),
+       make_calculation_status_with_uploading(
+           calculation_uploading_status{0.995}),
+       make_calculation_status_with_completed(nil)};
+
+// Make the recorded exchanges that a Thinknode server would have with a
+// client watching calculation "abc" in context "123" (with the statuses
+// above).
+std::vector<http_exchange>
+make_calc_status_exchanges()
+{
+    std::vector<string> queries
+        = {"?context=123",
+           "?status=calculating&progress=0.12&timeout=120&context=123",
+           "?status=completed&timeout=120&context=123"};
+    std::vector<http_exchange> exchanges;
+    for (size_t i = 0; i != queries.size(); ++i)
+    {
+        exchanges.push_back(http_exchange{
+            make_get_request(
+                "https://mgh.thinknode.io/api/v1.0" + status_path
+                    + queries[i],
+                {}),
+            make_http_200_response(
+                value_to_json(to_dynamic(test_statuses[i])))});
+    }
+    return exchanges;
+}
+
+// status_log records the statuses delivered to a subscriber.
+struct status_log
+{
+    void
+    record(calculation_status const& status)
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        statuses.push_back(status);
+        changed.notify_all();
+    }
+
+    void
+    record_failure()
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        failed = true;
+        changed.notify_all();
+    }
+
+    // Wait for the log to contain at least :count statuses (or a failure).
+    std::vector<calculation_status>
+    wait_for(size_t count)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait_for(lock, std::chrono::seconds(10), [&] {
+            return statuses.size() >= count || failed;
+        });
+        return statuses;
+    }
+
+    // Wait for the calculation to finish (or fail).
+    std::vector<calculation_status>
+    wait_for_finish()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait_for(lock, std::chrono::seconds(10), [&] {
+            return failed
+                   || (!statuses.empty()
+                       && !get_next_calculation_status(statuses.back()));
+        });
+        return statuses;
+    }
+
+    calculation_status_callback
+    status_callback()
+    {
+        return [this](calculation_status const& status) {
+            this->record(status);
+        };
+    }
+
+    calculation_watch_failure_callback
+    failure_callback()
+    {
+        return [this](std::exception_ptr) { this->record_failure(); };
+    }
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<calculation_status> statuses;
+    bool failed = false;
+};
+
+thinknode_session
+make_session(http_replay_server const& server)
+{
+    thinknode_session session;
+    session.api_url = server.url() + "/api/v1.0";
+    session.access_token = "xyz";
+    return session;
+}
+
+} // namespace
+
+TEST_CASE("calc status watching", "[thinknode][tn_calc]")
+{
+    http_replayer replayer(make_calc_status_exchanges());
+    // Give each request some latency so that both subscribers are in place
+    // before the first status arrives.
+    http_replay_options options;
+    options.latency = std::chrono::milliseconds(50);
+    http_replay_server server(replayer, options);
+    auto session = make_session(server);
+
+    http_request_loop loop(the_http_request_system);
+    calculation_status_watcher watcher(loop);
+
+    // Two subscribers to the same calculation share a single poll.
+    status_log a, b;
+    watcher.watch(
+        session, "123", "abc", a.status_callback(), a.failure_callback());
+    watcher.watch(
+        session, "123", "abc", b.status_callback(), b.failure_callback());
+    REQUIRE(watcher.watched_calculation_count() == 1);
+
+    REQUIRE(a.wait_for(3) == test_statuses);
+    REQUIRE(b.wait_for(3) == test_statuses);
+    REQUIRE(!a.failed);
+    REQUIRE(!b.failed);
+
+    // Once the calculation is finished, it's no longer watched.
+    REQUIRE(watcher.watched_calculation_count() == 0);
+}
+
+TEST_CASE("calc status watching subscriber changes", "[thinknode][tn_calc]")
+{
+    http_replayer replayer(make_calc_status_exchanges());
+    http_replay_options options;
+    options.latency = std::chrono::milliseconds(200);
+    http_replay_server server(replayer, options);
+    auto session = make_session(server);
+
+    http_request_loop loop(the_http_request_system);
+    calculation_status_watcher watcher(loop);
+
+    status_log early;
+    auto early_watch = watcher.watch(
+        session,
+        "123",
+        "abc",
+        early.status_callback(),
+        early.failure_callback());
+    REQUIRE(early.wait_for(1).size() >= 1);
+
+    // A subscriber that joins late starts with the most recent status.
+    status_log late;
+    watcher.watch(
+        session,
+        "123",
+        "abc",
+        late.status_callback(),
+        late.failure_callback());
+    auto late_statuses = late.wait_for(1);
+    REQUIRE(!late_statuses.empty());
+    REQUIRE(late_statuses.front() == early.wait_for(1).back());
+
+    // Once a subscriber unwatches, it gets no further updates, but the
+    // others are unaffected.
+    watcher.unwatch(early_watch);
+    auto early_count = early.wait_for(0).size();
+    REQUIRE(late.wait_for_finish().back() == test_statuses.back());
+    REQUIRE(early.wait_for(0).size() == early_count);
+    REQUIRE(watcher.watched_calculation_count() == 0);
+}
+
+TEST_CASE("calc status watching failures", "[thinknode][tn_calc]")
+{
+    http_replayer replayer(make_calc_status_exchanges());
+    http_replay_server server(replayer);
+    auto session = make_session(server);
+
+    http_request_loop loop(the_http_request_system);
+    calculation_status_watcher watcher(loop);
+
+    // The server doesn't know about this calculation.
+    status_log log;
+    watcher.watch(
+        session, "123", "def", log.status_callback(), log.failure_callback());
+    log.wait_for(1);
+    REQUIRE(log.failed);
+    REQUIRE(log.statuses.empty());
+    REQUIRE(watcher.watched_calculation_count() == 0);
+}
+
+TEST_CASE("calc status watching abandonment", "[thinknode][tn_calc]")
+{
+    http_replayer replayer(make_calc_status_exchanges());
+    http_replay_options options;
+    options.latency = std::chrono::milliseconds(200);
+    http_replay_server server(replayer, options);
+    auto session = make_session(server);
+
+    http_request_loop loop(the_http_request_system);
+    status_log log;
+    {
+        calculation_status_watcher watcher(loop);
+        auto watch = watcher.watch(
+            session,
+            "123",
+            "abc",
+            log.status_callback(),
+            log.failure_callback());
+        // Unwatching the only subscriber abandons the calculation.
+        watcher.unwatch(watch);
+        REQUIRE(watcher.watched_calculation_count() == 0);
+
+        // Destroying the watcher abandons anything that's still watched.
+        watcher.watch(
+            session,
+            "123",
+            "abc",
+            log.status_callback(),
+            log.failure_callback());
+    }
+    REQUIRE(log.statuses.empty());
+    REQUIRE(!log.failed);
+}
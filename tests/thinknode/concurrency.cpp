@@ -0,0 +1,46 @@
+#include <cradle/thinknode/concurrency.h>
+
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+
+TEST_CASE("Thinknode concurrency policy", "[thinknode][http]")
+{
+    thinknode_concurrency_policy policy;
+    string const api_url = "https://mgh.thinknode.io/api/v1.0";
+
+    // Each service has its own limiter.
+    auto* iss_limiter
+        = policy.get_limiter(make_get_request(api_url + "/iss/abc", {}));
+    auto* calc_limiter
+        = policy.get_limiter(make_get_request(api_url + "/calc/abc", {}));
+    REQUIRE(
+        iss_limiter
+        == &policy.get_service_limiter(thinknode_service_id::ISS));
+    REQUIRE(
+        calc_limiter
+        == &policy.get_service_limiter(thinknode_service_id::CALC));
+
+    // Other requests aren't limited.
+    REQUIRE(!policy.get_limiter(make_get_request("https://example.com/", {})));
+
+    // Ordinary requests are timed.
+    REQUIRE(policy.is_latency_meaningful(
+        make_get_request(api_url + "/calc/abc?context=123", {})));
+    REQUIRE(policy.is_latency_meaningful(
+        make_get_request(api_url + "/iss/immutable/abc?context=123", {})));
+
+    // Long polls aren't.
+    REQUIRE(!policy.is_latency_meaningful(make_get_request(
+        api_url
+            + "/calc/abc/status?status=calculating&progress=0.5&timeout=120"
+              "&context=123",
+        {})));
+
+    // Neither are ISS uploads.
+    REQUIRE(!policy.is_latency_meaningful(make_http_request(
+        http_request_method::POST,
+        api_url + "/iss/immutable?context=123",
+        {},
+        blob())));
+}
@@ -0,0 +1,361 @@
+#include <cradle/io/asio.h>
+
+#include <cradle/thinknode/docker.h>
+
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+namespace asio = boost::asio;
+using asio::local::stream_protocol;
+
+static http_request_system the_http_request_system;
+
+namespace {
+
+// docker_stand_in serves a small subset of the Docker Engine API over a Unix
+// socket and keeps track of how it's used.
+struct docker_stand_in
+{
+    docker_stand_in(string kernel_version)
+        : kernel_version(std::move(kernel_version)),
+          socket_path(
+              (std::filesystem::temp_directory_path()
+               / "cradle_docker_test.sock")
+                  .string()),
+          acceptor(io_context)
+    {
+        std::filesystem::remove(socket_path);
+        acceptor.open();
+        acceptor.bind(stream_protocol::endpoint(socket_path));
+        acceptor.listen();
+        accept();
+        thread = std::thread([this] { io_context.run(); });
+    }
+
+    ~docker_stand_in()
+    {
+        io_context.stop();
+        thread.join();
+        std::filesystem::remove(socket_path);
+    }
+
+    // the number of requests that have been made for :target
+    int
+    request_count(string const& target)
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        return requests[target];
+    }
+
+    string kernel_version;
+    string socket_path;
+
+    std::atomic<int> connection_count = 0;
+
+    // how long pulls take to respond
+    std::chrono::milliseconds pull_delay{0};
+
+    std::mutex mutex;
+    // the number of requests for each request target (e.g., "GET /path")
+    std::map<string, int> requests;
+    // the images that are present
+    std::set<string> images;
+
+ private:
+    struct session
+    {
+        session(asio::io_context& io_context) : socket(io_context)
+        {
+        }
+        stream_protocol::socket socket;
+        asio::streambuf buffer;
+    };
+
+    void
+    accept()
+    {
+        auto s = std::make_shared<session>(io_context);
+        acceptor.async_accept(s->socket, [this, s](auto error) {
+            if (error)
+                return;
+            ++connection_count;
+            read_request(s);
+            accept();
+        });
+    }
+
+    void
+    read_request(std::shared_ptr<session> const& s)
+    {
+        asio::async_read_until(
+            s->socket, s->buffer, "\r\n\r\n", [this, s](auto error, auto) {
+                if (error)
+                    return;
+                std::istream stream(&s->buffer);
+                string method, target, line;
+                stream >> method >> target;
+                std::getline(stream, line);
+                size_t content_length = 0;
+                while (std::getline(stream, line) && line != "\r")
+                {
+                    auto colon = line.find(':');
+                    if (colon != string::npos
+                        && boost::iequals(
+                            line.substr(0, colon), "Content-Length"))
+                    {
+                        content_length = boost::lexical_cast<size_t>(
+                            boost::trim_copy(line.substr(colon + 1)));
+                    }
+                }
+                // Discard the body (which has possibly been partially read
+                // already).
+                auto buffered = (std::min)(content_length, s->buffer.size());
+                s->buffer.consume(buffered);
+                asio::async_read(
+                    s->socket,
+                    s->buffer,
+                    asio::transfer_exactly(content_length - buffered),
+                    [this, s, method, target](auto error, auto size) {
+                        if (error)
+                            return;
+                        s->buffer.consume(size);
+                        auto response = handle_request(method, target);
+                        if (method == "POST" && pull_delay.count() != 0)
+                        {
+                            auto timer
+                                = std::make_shared<asio::steady_timer>(
+                                    io_context, pull_delay);
+                            timer->async_wait(
+                                [this, s, timer, response](auto) {
+                                    respond(s, response);
+                                });
+                        }
+                        else
+                        {
+                            respond(s, response);
+                        }
+                    });
+            });
+    }
+
+    void
+    respond(
+        std::shared_ptr<session> const& s, std::pair<int, string> response)
+    {
+        auto message = std::make_shared<string>(
+            "HTTP/1.1 " + std::to_string(response.first)
+            + " X\r\nContent-Type: application/json\r\nContent-Length: "
+            + std::to_string(response.second.size()) + "\r\n\r\n"
+            + response.second);
+        asio::async_write(
+            s->socket,
+            asio::buffer(*message),
+            [this, s, message](auto error, auto) {
+                if (!error)
+                    read_request(s);
+            });
+    }
+
+    std::pair<int, string>
+    handle_request(string const& method, string const& target)
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        ++requests[method + " " + target];
+
+        if (method == "GET" && target == "/v1.38/info")
+            return {200, "{\"KernelVersion\":\"" + kernel_version + "\"}"};
+
+        string const inspect_prefix = "/v1.38/images/";
+        if (method == "GET" && boost::starts_with(target, inspect_prefix)
+            && boost::ends_with(target, "/json"))
+        {
+            auto image = target.substr(
+                inspect_prefix.size(),
+                target.size() - inspect_prefix.size() - 5);
+            return images.count(image) ? std::make_pair(200, string("{}"))
+                                       : std::make_pair(404, string("{}"));
+        }
+
+        string const pull_prefix = "/v1.38/images/create?fromImage=";
+        if (method == "POST" && boost::starts_with(target, pull_prefix))
+        {
+            auto query = target.substr(pull_prefix.size());
+            auto tag_start = query.find("&tag=");
+            auto repository = query.substr(0, tag_start);
+            // Like Docker, report failures partway through the pull in the
+            // progress stream.
+            if (boost::ends_with(repository, "/broken"))
+            {
+                return {
+                    200,
+                    "{\"status\":\"Pulling from " + repository
+                        + "\"}\r\n"
+                          "{\"errorDetail\":{\"message\":\"manifest "
+                          "unknown\"},\"error\":\"manifest unknown\"}\r\n"};
+            }
+            images.insert(repository + ":" + query.substr(tag_start + 5));
+            return {
+                200,
+                "{\"status\":\"Pulling from " + repository + "\"}\r\n"};
+        }
+
+        return {404, "{}"};
+    }
+
+    asio::io_context io_context;
+    stream_protocol::acceptor acceptor;
+    std::thread thread;
+};
+
+docker_client_config
+make_client_config(docker_stand_in const& stand_in)
+{
+    docker_client_config config;
+    config.socket_path = stand_in.socket_path;
+    return config;
+}
+
+} // namespace
+
+TEST_CASE("Docker service detection", "[thinknode][docker]")
+{
+    {
+        docker_stand_in stand_in("5.4.0-generic");
+        docker_client docker(
+            the_http_request_system, make_client_config(stand_in));
+        REQUIRE(docker.service_type() == docker_service_type::LINUX);
+        // The service type is only detected once.
+        REQUIRE(docker.service_type() == docker_service_type::LINUX);
+        REQUIRE(stand_in.request_count("GET /v1.38/info") == 1);
+    }
+    {
+        docker_stand_in stand_in("4.19.128-microsoft-standard");
+        docker_client docker(
+            the_http_request_system, make_client_config(stand_in));
+        REQUIRE(docker.service_type() == docker_service_type::WSL);
+    }
+}
+
+TEST_CASE("Docker image presence", "[thinknode][docker]")
+{
+    docker_stand_in stand_in("5.4.0-generic");
+    docker_client docker(
+        the_http_request_system, make_client_config(stand_in));
+
+    string const inspect = "GET /v1.38/images/registry/app:1.0/json";
+    string const pull
+        = "POST /v1.38/images/create?fromImage=registry/app&tag=1.0";
+
+    // The first time, the image is inspected, found missing, and pulled.
+    docker.ensure_image("registry/app", "1.0");
+    REQUIRE(stand_in.request_count(inspect) == 1);
+    REQUIRE(stand_in.request_count(pull) == 1);
+
+    // After that, it's known to be present.
+    docker.ensure_image("registry/app", "1.0");
+    REQUIRE(stand_in.request_count(inspect) == 1);
+    REQUIRE(stand_in.request_count(pull) == 1);
+
+    // Once that knowledge expires, it's inspected again (but not pulled).
+    auto config = make_client_config(stand_in);
+    config.image_ttl = std::chrono::seconds(0);
+    docker_client forgetful_docker(the_http_request_system, config);
+    forgetful_docker.ensure_image("registry/app", "1.0");
+    forgetful_docker.ensure_image("registry/app", "1.0");
+    REQUIRE(stand_in.request_count(inspect) == 3);
+    REQUIRE(stand_in.request_count(pull) == 1);
+}
+
+TEST_CASE("Docker image pull failures", "[thinknode][docker]")
+{
+    docker_stand_in stand_in("5.4.0-generic");
+    docker_client docker(
+        the_http_request_system, make_client_config(stand_in));
+
+    string const pull
+        = "POST /v1.38/images/create?fromImage=registry/broken&tag=1.0";
+
+    // The pull responds with 200, but the failure in its progress stream is
+    // still reported.
+    REQUIRE_THROWS_AS(
+        docker.ensure_image("registry/broken", "1.0"),
+        docker_image_pull_failure);
+    REQUIRE(stand_in.request_count(pull) == 1);
+
+    // The image isn't considered present, so it's tried again.
+    REQUIRE_THROWS_AS(
+        docker.ensure_image("registry/broken", "1.0"),
+        docker_image_pull_failure);
+    REQUIRE(stand_in.request_count(pull) == 2);
+}
+
+TEST_CASE("Docker concurrent image pulls", "[thinknode][docker]")
+{
+    docker_stand_in stand_in("5.4.0-generic");
+    stand_in.pull_delay = std::chrono::milliseconds(500);
+    docker_client docker(
+        the_http_request_system, make_client_config(stand_in));
+    docker.service_type();
+
+    string const inspect = "GET /v1.38/images/registry/app:1.0/json";
+    string const pull
+        = "POST /v1.38/images/create?fromImage=registry/app&tag=1.0";
+
+    std::atomic<int> finished_count = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i != 4; ++i)
+    {
+        threads.emplace_back([&] {
+            docker.ensure_image("registry/app", "1.0");
+            ++finished_count;
+        });
+    }
+
+    // Other requests aren't held up by the pull.
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    docker.perform_request(http_request_method::GET, "/v1.38/info");
+    REQUIRE(finished_count == 0);
+
+    for (auto& thread : threads)
+        thread.join();
+    REQUIRE(finished_count == 4);
+
+    // The callers all shared a single check and pull.
+    REQUIRE(stand_in.request_count(inspect) == 1);
+    REQUIRE(stand_in.request_count(pull) == 1);
+}
+
+TEST_CASE("Docker connection persistence", "[thinknode][docker]")
+{
+    docker_stand_in stand_in("5.4.0-generic");
+    docker_client docker(
+        the_http_request_system, make_client_config(stand_in));
+
+    docker.service_type();
+    for (int i = 0; i != 5; ++i)
+        docker.perform_request(http_request_method::GET, "/v1.38/info");
+    REQUIRE_THROWS_AS(
+        docker.perform_request(http_request_method::GET, "/v1.38/missing"),
+        bad_http_status_code);
+    docker.perform_request(http_request_method::GET, "/v1.38/info");
+
+    // All of those requests shared a single connection.
+    REQUIRE(stand_in.request_count("GET /v1.38/info") == 7);
+    REQUIRE(stand_in.connection_count == 1);
+}
+
+#endif
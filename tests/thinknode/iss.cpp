@@ -81,10 +81,11 @@ TEST_CASE("ISS immutable retrieval", "[thinknode][iss]")
 {
     Mock<http_connection_interface> mock_connection;
 
-    When(Method(mock_connection, perform_request))
+    When(Method(mock_connection, perform_streaming_request))
         .Do([&](check_in_interface& check_in,
                 progress_reporter_interface& reporter,
-                http_request const& request) {
+                http_request const& request,
+                http_response_sink& sink) {
             auto expected_request = make_get_request(
                 "https://mgh.thinknode.io/api/v1.0/iss/immutable/"
                 "abc?context=123",
@@ -92,8 +93,15 @@ TEST_CASE("ISS immutable retrieval", "[thinknode][iss]")
                  {"Accept", "application/octet-stream"}});
             REQUIRE(request == expected_request);
 
-            return make_http_200_response(
-                value_to_msgpack_string(dynamic("the-data")));
+            // Deliver the body in two pieces.
+            auto body = value_to_msgpack_string(dynamic("the-data"));
+            auto const* data = reinterpret_cast<uint8_t const*>(body.data());
+            sink.on_start(body.size());
+            sink.on_data(data, 4);
+            sink.on_data(data + 4, body.size() - 4);
+            sink.on_finish();
+
+            return make_http_200_response("");
         });
 
     thinknode_session session;
@@ -0,0 +1,331 @@
+#include <cradle/io/asio.h>
+
+#include <cradle/thinknode/provider_pool.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include <cradle/thinknode/ipc.h>
+#include <cradle/thinknode/messages.h>
+#include <cradle/utilities/testing.h>
+
+using namespace cradle;
+
+namespace asio = boost::asio;
+
+namespace {
+
+uint8_t const ipc_version = 1;
+
+// Run a fake provider that connects to the supervisor at :port.
+//
+// The provider implements the following functions:
+// "echo" returns its first argument.
+// "slow" returns its first argument after a delay.
+// "fail" reports a failure.
+// "crash" disconnects without responding.
+// "mute" returns its first argument but stops responding to pings.
+//
+void
+run_fake_provider(uint16_t port, string const& pid)
+{
+    asio::io_context io_context;
+    tcp::socket socket(io_context);
+    try
+    {
+        socket.connect(
+            tcp::endpoint(asio::ip::make_address("127.0.0.1"), port));
+        write_message(
+            socket,
+            ipc_version,
+            make_thinknode_provider_message_with_registration(
+                make_thinknode_provider_registration(0, pid)));
+        bool mute = false;
+        while (true)
+        {
+            auto message = read_message<thinknode_supervisor_message>(
+                socket, ipc_version);
+            switch (get_tag(message))
+            {
+                case thinknode_supervisor_message_tag::FUNCTION: {
+                    auto const& request = as_function(message);
+                    if (request.name == "crash")
+                        return;
+                    if (request.name == "fail")
+                    {
+                        write_message(
+                            socket,
+                            ipc_version,
+                            make_thinknode_provider_message_with_failure(
+                                make_thinknode_provider_failure(
+                                    "EFAIL", "failed as requested")));
+                        break;
+                    }
+                    if (request.name == "mute")
+                        mute = true;
+                    if (request.name == "slow")
+                    {
+                        std::this_thread::sleep_for(
+                            std::chrono::milliseconds(300));
+                    }
+                    write_message(
+                        socket,
+                        ipc_version,
+                        make_thinknode_provider_message_with_progress(
+                            make_thinknode_provider_progress_update(
+                                0.5, "halfway")));
+                    write_message(
+                        socket,
+                        ipc_version,
+                        make_thinknode_provider_message_with_result(
+                            request.args.at(0)));
+                    break;
+                }
+                case thinknode_supervisor_message_tag::PING:
+                    if (!mute)
+                    {
+                        write_message(
+                            socket,
+                            ipc_version,
+                            make_thinknode_provider_message_with_pong(
+                                as_ping(message)));
+                    }
+                    break;
+            }
+        }
+    }
+    catch (...)
+    {
+        // The supervisor disconnected.
+    }
+}
+
+// fake_launcher launches fake providers in background threads.
+struct fake_launcher : provider_launcher_interface
+{
+    ~fake_launcher()
+    {
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    string
+    launch(
+        provider_pool_key const& key,
+        uint16_t port,
+        string const& pid) override
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        ++launch_count;
+        auto registered_pid = misregister ? string(32, 'x') : pid;
+        threads.emplace_back(
+            [=] { run_fake_provider(port, registered_pid); });
+        return "provider-" + pid;
+    }
+
+    void
+    stop(string const& id) override
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        stopped.push_back(id);
+    }
+
+    std::atomic<int> launch_count = 0;
+    // If this is set, providers register with the wrong PID.
+    std::atomic<bool> misregister = false;
+
+    std::mutex mutex;
+    std::vector<std::thread> threads;
+    // the IDs of the providers that have been stopped
+    std::vector<string> stopped;
+};
+
+provider_pool_config
+make_test_config()
+{
+    provider_pool_config config;
+    config.registration_timeout = std::chrono::seconds(10);
+    return config;
+}
+
+provider_pool_key const test_key{"mgh", "dosimetry", "sha256:abc"};
+
+} // namespace
+
+TEST_CASE("provider pool reuse", "[thinknode][provider_pool]")
+{
+    fake_launcher launcher;
+    provider_pool pool(launcher, make_test_config());
+
+    // Consecutive calculations for the same app share a provider.
+    for (int i = 0; i != 3; ++i)
+    {
+        REQUIRE(
+            pool.perform_calculation(test_key, "echo", {dynamic("foo")})
+            == dynamic("foo"));
+    }
+    REQUIRE(launcher.launch_count == 1);
+    REQUIRE(pool.idle_provider_count() == 1);
+
+    // Other apps get their own providers.
+    auto other_key = test_key;
+    other_key.app = "planning";
+    REQUIRE(
+        pool.perform_calculation(other_key, "echo", {dynamic("bar")})
+        == dynamic("bar"));
+    REQUIRE(launcher.launch_count == 2);
+    REQUIRE(pool.idle_provider_count() == 2);
+}
+
+TEST_CASE("provider pool calculation failures", "[thinknode][provider_pool]")
+{
+    fake_launcher launcher;
+    provider_pool pool(launcher, make_test_config());
+
+    // A provider that reports a failure is still reusable.
+    REQUIRE_THROWS_AS(
+        pool.perform_calculation(test_key, "fail", {}),
+        local_calculation_failure);
+    REQUIRE(pool.idle_provider_count() == 1);
+    REQUIRE(
+        pool.perform_calculation(test_key, "echo", {dynamic("foo")})
+        == dynamic("foo"));
+    REQUIRE(launcher.launch_count == 1);
+
+    // A provider that disconnects is discarded and replaced.
+    REQUIRE_THROWS(pool.perform_calculation(test_key, "crash", {}));
+    REQUIRE(pool.idle_provider_count() == 0);
+    REQUIRE(
+        pool.perform_calculation(test_key, "echo", {dynamic("foo")})
+        == dynamic("foo"));
+    REQUIRE(launcher.launch_count == 2);
+}
+
+TEST_CASE("provider pool health checks", "[thinknode][provider_pool]")
+{
+    fake_launcher launcher;
+    auto config = make_test_config();
+    config.ping_interval = std::chrono::milliseconds(20);
+    config.ping_timeout = std::chrono::milliseconds(100);
+    provider_pool pool(launcher, config);
+
+    // Healthy providers stay in the pool.
+    pool.perform_calculation(test_key, "echo", {dynamic("foo")});
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    REQUIRE(pool.idle_provider_count() == 1);
+
+    // A provider that stops responding to pings is dropped.
+    pool.perform_calculation(test_key, "mute", {dynamic("foo")});
+    REQUIRE(launcher.launch_count == 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    REQUIRE(pool.idle_provider_count() == 0);
+    pool.perform_calculation(test_key, "echo", {dynamic("foo")});
+    REQUIRE(launcher.launch_count == 2);
+}
+
+TEST_CASE("provider pool health check waits", "[thinknode][provider_pool]")
+{
+    fake_launcher launcher;
+    auto config = make_test_config();
+    config.ping_interval = std::chrono::milliseconds(50);
+    config.ping_timeout = std::chrono::milliseconds(1000);
+    provider_pool pool(launcher, config);
+
+    // Get two providers into the pool and mute the most recently used one.
+    std::vector<std::thread> threads;
+    for (int i = 0; i != 2; ++i)
+    {
+        threads.emplace_back([&] {
+            pool.perform_calculation(test_key, "slow", {dynamic("foo")});
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    REQUIRE(launcher.launch_count == 2);
+    pool.perform_calculation(test_key, "mute", {dynamic("foo")});
+
+    // Once the health checks are underway, the muted provider holds up its
+    // own check, but the healthy one is available as soon as it passes.
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE(
+        pool.perform_calculation(test_key, "echo", {dynamic("foo")})
+        == dynamic("foo"));
+    REQUIRE(
+        std::chrono::steady_clock::now() - start
+        < std::chrono::milliseconds(500));
+    REQUIRE(launcher.launch_count == 2);
+}
+
+TEST_CASE("provider pool idle expiration", "[thinknode][provider_pool]")
+{
+    fake_launcher launcher;
+    auto config = make_test_config();
+    config.ping_interval = std::chrono::milliseconds(20);
+    config.max_idle_time = std::chrono::milliseconds(100);
+    provider_pool pool(launcher, config);
+
+    pool.perform_calculation(test_key, "echo", {dynamic("foo")});
+    REQUIRE(pool.idle_provider_count() == 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    REQUIRE(pool.idle_provider_count() == 0);
+}
+
+TEST_CASE("provider pool concurrency", "[thinknode][provider_pool]")
+{
+    fake_launcher launcher;
+    provider_pool pool(launcher, make_test_config());
+
+    // Concurrent calculations each get their own provider.
+    std::vector<std::thread> threads;
+    std::vector<dynamic> results(4);
+    for (size_t i = 0; i != results.size(); ++i)
+    {
+        threads.emplace_back([&, i] {
+            results[i] = pool.perform_calculation(
+                test_key, "slow", {dynamic(std::to_string(i))});
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    for (size_t i = 0; i != results.size(); ++i)
+        REQUIRE(results[i] == dynamic(std::to_string(i)));
+    REQUIRE(launcher.launch_count == 4);
+    REQUIRE(pool.idle_provider_count() == 4);
+
+    // Separate pools can coexist (since they listen on different ports).
+    fake_launcher other_launcher;
+    provider_pool other_pool(other_launcher, make_test_config());
+    REQUIRE(
+        other_pool.perform_calculation(test_key, "echo", {dynamic("foo")})
+        == dynamic("foo"));
+    REQUIRE(other_launcher.launch_count == 1);
+}
+
+TEST_CASE("provider pool registration", "[thinknode][provider_pool]")
+{
+    fake_launcher launcher;
+    auto config = make_test_config();
+    config.registration_timeout = std::chrono::milliseconds(200);
+    provider_pool pool(launcher, config);
+
+    // A provider that registers with a PID that the pool didn't assign isn't
+    // accepted.
+    launcher.misregister = true;
+    REQUIRE_THROWS_AS(
+        pool.perform_calculation(test_key, "echo", {dynamic("foo")}),
+        provider_registration_failure);
+    REQUIRE(pool.idle_provider_count() == 0);
+    // The provider that never registered is cleaned up.
+    {
+        std::scoped_lock<std::mutex> lock(launcher.mutex);
+        REQUIRE(launcher.stopped.size() == 1);
+        REQUIRE(launcher.stopped[0].find("provider-") == 0);
+    }
+
+    launcher.misregister = false;
+    REQUIRE(
+        pool.perform_calculation(test_key, "echo", {dynamic("foo")})
+        == dynamic("foo"));
+}
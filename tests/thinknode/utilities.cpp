@@ -120,3 +120,28 @@ TEST_CASE("Thinknode account name", "[thinknode][utilities]")
     session.access_token = "xyz";
     REQUIRE(get_account_name(session) == "mgh");
 }
+
+TEST_CASE("Thinknode service URLs", "[thinknode][utilities]")
+{
+    REQUIRE(
+        get_thinknode_service_for_url(
+            "https://mgh.thinknode.io/api/v1.0/iss/immutable/abc?context=x")
+        == some(thinknode_service_id::ISS));
+    REQUIRE(
+        get_thinknode_service_for_url(
+            "https://mgh.thinknode.io/api/v1.0/calc/abc/status?status=/iss")
+        == some(thinknode_service_id::CALC));
+    // Only the first segment that names a service counts.
+    REQUIRE(
+        get_thinknode_service_for_url(
+            "https://mgh.thinknode.io/api/v1.0/apm/apps/mgh/iss")
+        == some(thinknode_service_id::APM));
+    REQUIRE(
+        get_thinknode_service_for_url(
+            "https://mgh.thinknode.io/api/v1.0/iam/contexts/abc")
+        == some(thinknode_service_id::IAM));
+    REQUIRE(
+        get_thinknode_service_for_url("https://mgh.thinknode.io/api/v1.0")
+        == none);
+    REQUIRE(get_thinknode_service_for_url("https://example.com") == none);
+}